@@ -139,6 +139,10 @@ int CControlSocket::ResetOperation(int nErrorCode)
 
 		log(logmsg::debug_verbose, L"%s::Reset(%d) in state %d", oldOperation->name_, nErrorCode, oldOperation->opState);
 		nErrorCode = oldOperation->Reset(nErrorCode);
+
+		if (currentServer_) {
+			engine_.metrics_.record_operation(currentServer_, oldOperation->name_, fz::monotonic_clock::now() - oldOperation->started_);
+		}
 	}
 	if (!operations_.empty()) {
 		if (nErrorCode == FZ_REPLY_OK ||
@@ -207,6 +211,12 @@ int CControlSocket::ResetOperation(int nErrorCode)
 						UpdateCache(data, data.remotePath_, data.remoteFile_, (nErrorCode == FZ_REPLY_OK) ? data.localFileSize_ : -1);
 					}
 				}
+				if (nErrorCode == FZ_REPLY_OK && data.transferInitiated_ && currentServer_) {
+					auto const status = engine_.transfer_status_.Snapshot();
+					if (status && !status.started.empty()) {
+						engine_.metrics_.record_transfer(currentServer_, data.download(), status.currentOffset - status.startOffset, fz::datetime::now() - status.started);
+					}
+				}
 				LogTransferResultMessage(nErrorCode, &data);
 			}
 			break;
@@ -378,6 +388,18 @@ int CControlSocket::CheckOverwriteFile()
 		if (data.localFileSize_ == fz::aio_base::nosize && data.localFileTime_.empty()) {
 			return FZ_REPLY_OK;
 		}
+
+		// An interrupted segmented download leaves a file of the full size
+		// behind. Only the completed segments at its start count, so that it
+		// is neither taken as complete nor resumed past a hole.
+		auto const* file_writer = dynamic_cast<fz::file_writer_factory const*>(&*data.writer_factory_);
+		if (file_writer && data.localFileSize_ != fz::aio_base::nosize) {
+			int64_t const usable = download_segments::usable_size(file_writer->name());
+			if (usable >= 0 && static_cast<uint64_t>(usable) < data.localFileSize_) {
+				log(logmsg::debug_info, L"Local file is incomplete, %d bytes of it have been downloaded in segments", usable);
+				data.localFileSize_ = static_cast<uint64_t>(usable);
+			}
+		}
 	}
 
 	CDirentry entry;
@@ -463,6 +485,9 @@ CFileTransferOpData::CFileTransferOpData(wchar_t const* name, CFileTransferComma
 	, localName_(reader_factory_ ? reader_factory_.name() : writer_factory_.name())
 	, remoteFile_(cmd.GetRemoteFile())
 	, remotePath_(cmd.GetRemotePath())
+	, segments_(cmd.GetSegments())
+	, segmentPrimary_(cmd.SegmentPrimary())
+	, moreTransfersPending_(cmd.MoreTransfersPending())
 {
 	localFileSize_ = download() ? writer_factory_.size() : reader_factory_.size();
 	localFileTime_ = download() ? writer_factory_.mtime() : reader_factory_.mtime();
@@ -476,6 +501,18 @@ std::wstring CControlSocket::ConvToLocal(char const* buffer, size_t len)
 		return ret;
 	}
 
+	if (currentServer_.GetEncodingType() != ENCODING_CUSTOM) {
+		// Pure ASCII reads the same in all the charsets below, skip the converters.
+		size_t i = 0;
+		while (i < len && !(static_cast<unsigned char>(buffer[i]) & 0x80)) {
+			++i;
+		}
+		if (i == len) {
+			ret.assign(buffer, buffer + len);
+			return ret;
+		}
+	}
+
 	if (m_useUTF8) {
 		ret = fz::to_wstring_from_utf8(buffer, len);
 		if (!ret.empty()) {
@@ -654,12 +691,18 @@ int CControlSocket::ParseSubcommandResult(int prevResult, std::unique_ptr<COpDat
 
 OpLock CControlSocket::Lock(locking_reason reason, CServerPath const& path, bool inclusive)
 {
-	return opLockManager_.Lock(this, reason, path, inclusive);
+	OpLock lock = opLockManager_.Lock(this, reason, path, inclusive);
+	lockWaitStart_ = lock.waiting() ? fz::monotonic_clock::now() : fz::monotonic_clock();
+	return lock;
 }
 
 void CControlSocket::OnObtainLock()
 {
 	if (opLockManager_.ObtainWaiting(this)) {
+		if (lockWaitStart_ && currentServer_) {
+			engine_.metrics_.record_lock_wait(currentServer_, fz::monotonic_clock::now() - lockWaitStart_);
+		}
+		lockWaitStart_ = fz::monotonic_clock();
 		SendNextCommand();
 	}
 }
@@ -1154,6 +1197,20 @@ void CControlSocket::SendDirectoryListingNotification(CServerPath const& path, b
 	engine_.AddNotification(std::make_unique<CDirectoryListingNotification>(path, operations_.size() == 1 && operations_.back()->opId == Command::list, failed));
 }
 
+void CControlSocket::SendPartialListingNotification(CServerPath const& path, std::vector<fz::shared_value<CDirentry>> && entries, bool first)
+{
+	if (!currentServer_) {
+		return;
+	}
+
+	// Only listings explicitly requested get displayed progressively
+	if (operations_.size() != 1 || operations_.back()->opId != Command::list) {
+		return;
+	}
+
+	engine_.AddNotification(std::make_unique<CPartialListingNotification>(path, std::move(entries), first));
+}
+
 void CControlSocket::CallSetAsyncRequestReply(CAsyncRequestNotification *pNotification)
 {
 	if (operations_.empty() || !operations_.back()->waitForAsyncRequest) {
@@ -1213,6 +1270,25 @@ std::unique_ptr<fz::writer_base> CControlSocket::OpenWriter(fz::writer_factory_h
 	return factory->open(*buffer_pool_, resumeOffset, status_update, buffer_pool_->buffer_count());
 }
 
+std::unique_ptr<fz::writer_base> CControlSocket::OpenSegmentWriter(download_segments const& segments, download_segments::segment const& s)
+{
+	if (!buffer_pool_) {
+		return {};
+	}
+
+	fz::file f(fz::to_native(segments.file()), fz::file::writing, fz::file::existing);
+	if (!f.opened() || f.seek(s.offset_, fz::file::begin) != s.offset_) {
+		log(logmsg::error, _("Could not open \"%s\" for writing"), segments.file());
+		return {};
+	}
+
+	fz::writer_base::progress_cb_t status_update = [&st = engine_.transfer_status_](fz::writer_base const*, uint64_t written) {
+		st.SetMadeProgress();
+		st.Update(written);
+	};
+	return std::make_unique<fz::file_writer>(std::wstring(segments.file()), *buffer_pool_, std::move(f), engine_.GetThreadPool(), false, std::move(status_update), buffer_pool_->buffer_count());
+}
+
 int64_t CalculateNextChunkSize(int64_t remaining, int64_t lastChunkSize, fz::duration const& lastChunkDuration, int64_t minChunkSize, int64_t multiple, int64_t partCount, int64_t maxPartCount, int64_t maxChunkSize)
 {
 	if (remaining <= 0) {
@@ -3,6 +3,7 @@
 
 #include "../include/activity_logger.h"
 #include "../include/directorylisting.h"
+#include "../include/download_segments.h"
 #include "../include/server.h"
 #include "../include/serverpath.h"
 
@@ -50,6 +51,8 @@ public:
 
 	bool topLevelOperation_{}; // If set to true, if this command finishes, any other commands on the stack do not get a SubCommandResult
 	bool waitForAsyncRequest{};
+
+	fz::monotonic_clock const started_{fz::monotonic_clock::now()};
 };
 
 template<typename T>
@@ -150,6 +153,11 @@ public:
 
 	int64_t remoteFileSize_{-1};
 	fz::datetime remoteFileTime_;
+
+	std::shared_ptr<download_segments> segments_;
+	bool segmentPrimary_{};
+
+	bool moreTransfersPending_{};
 };
 
 class CMkdirOpData : public COpData
@@ -226,6 +234,9 @@ public:
 	std::wstring ConvToLocal(char const* buffer, size_t len);
 	std::string ConvToServer(std::wstring const&, bool force_utf8 = false);
 
+	// Used by CDirectoryListingParser in incremental mode
+	void SendPartialListingNotification(CServerPath const& path, std::vector<fz::shared_value<CDirentry>> && entries, bool first);
+
 	void RecordActivity(activity_logger::_direction direction, uint64_t amount);
 	template<typename T, std::enable_if_t<std::is_signed_v<T>, int> = 0>
 	inline void RecordActivity(activity_logger::_direction direction, int64_t amount) {
@@ -304,6 +315,9 @@ protected:
 
 	std::unique_ptr<fz::writer_base> OpenWriter(fz::writer_factory_holder & h, uint64_t resumeOffset, bool withProgress);
 
+	// Unlike OpenWriter, does not truncate the file at the segment offset
+	std::unique_ptr<fz::writer_base> OpenSegmentWriter(download_segments const& segments, download_segments::segment const& s);
+
 	std::optional<fz::aio_buffer_pool> buffer_pool_;
 	std::vector<std::unique_ptr<COpData>> operations_;
 	CFileZillaEnginePrivate & engine_;
@@ -320,6 +334,9 @@ protected:
 
 	OpLockManager & opLockManager_;
 
+	// Set while waiting for a lock
+	fz::monotonic_clock lockWaitStart_;
+
 	bool m_invalidateCurrentPath{};
 	ServerHandle handle_;
 
@@ -1,7 +1,50 @@
 #include "filezilla.h"
 #include "directorycache.h"
+#include "stringpool.h"
+
+#include <libfilezilla/buffer.hpp>
+#include <libfilezilla/file.hpp>
+#include <libfilezilla/local_filesys.hpp>
 
 #include <assert.h>
+#include <iterator>
+
+namespace {
+// Servers for which SameContent is true have the same hash
+size_t ServerHash(CServer const& server)
+{
+	size_t ret = std::hash<std::wstring>()(server.GetHost());
+	ret ^= (static_cast<size_t>(server.GetPort()) << 16) ^ static_cast<size_t>(server.GetProtocol());
+	ret ^= std::hash<std::wstring>()(server.GetUser()) * 31;
+	return ret;
+}
+
+// With only a shared lock held the search maps of the listing must not be
+// modified. Returns false if they would have to be.
+bool FindFile(CDirectoryListing const& listing, std::wstring const& filename, bool nocase, bool shared, size_t & index, bool & matchedCase)
+{
+	if (!listing.HasFindMap(false)) {
+		if (shared) {
+			return false;
+		}
+		listing.BuildFindMap(false);
+	}
+
+	index = listing.FindFile_CmpCase(filename);
+	matchedCase = index != std::string::npos;
+	if (!matchedCase && nocase) {
+		if (!listing.HasFindMap(true)) {
+			if (shared) {
+				return false;
+			}
+			listing.BuildFindMap(true);
+		}
+		index = listing.FindFile_CmpNoCase(filename);
+	}
+
+	return true;
+}
+}
 
 CDirectoryCache::CDirectoryCache()
 {
@@ -12,7 +55,7 @@ CDirectoryCache::~CDirectoryCache()
 	for (auto & serverEntry : m_serverList) {
 		for (auto & cacheEntry : serverEntry.cacheList) {
 #ifndef NDEBUG
-			m_totalFileCount -= cacheEntry.listing.size();
+			m_totalSize -= cacheEntry.bytes;
 #endif
 			tLruList::iterator* lruIt = (tLruList::iterator*)cacheEntry.lruIt;
 			if (lruIt) {
@@ -22,32 +65,32 @@ CDirectoryCache::~CDirectoryCache()
 		}
 	}
 #ifndef NDEBUG
-	assert(m_totalFileCount == 0);
+	assert(m_totalSize == 0);
 #endif
 }
 
 void CDirectoryCache::Store(CDirectoryListing const& listing, CServer const& server)
 {
-	fz::scoped_lock lock(mutex_);
+	std::unique_lock lock(mutex_);
 
 	tServerIter sit = CreateServerEntry(server);
 	assert(sit != m_serverList.end());
 
-	m_totalFileCount += listing.size();
-
 	tCacheIter cit;
 	bool unused;
 	if (Lookup(cit, sit, listing.path, true, unused)) {
 		auto & entry = const_cast<CCacheEntry&>(*cit);
 		entry.modificationTime = fz::monotonic_clock::now();
 
-		m_totalFileCount -= cit->listing.size();
 		entry.listing = listing;
+		UpdateMemoryUsage(entry);
 
+		Prune();
 		return;
 	}
 
-	cit = sit->cacheList.emplace_hint(cit, listing);
+	cit = sit->Insert(cit, listing);
+	UpdateMemoryUsage(*cit);
 
 	UpdateLru(sit, cit);
 
@@ -56,7 +99,7 @@ void CDirectoryCache::Store(CDirectoryListing const& listing, CServer const& ser
 
 bool CDirectoryCache::Lookup(CDirectoryListing &listing, CServer const& server, const CServerPath &path, bool allowUnsureEntries, bool& is_outdated)
 {
-	fz::scoped_lock lock(mutex_);
+	std::shared_lock lock(mutex_);
 
 	tServerIter sit = GetServerEntry(server);
 	if (sit == m_serverList.end()) {
@@ -64,41 +107,54 @@ bool CDirectoryCache::Lookup(CDirectoryListing &listing, CServer const& server,
 	}
 
 	tCacheIter iter;
-	if (Lookup(iter, sit, path, allowUnsureEntries, is_outdated)) {
+	if (Lookup(iter, sit, path, allowUnsureEntries, is_outdated, true)) {
+		// Only the copy gets expanded, the cached listing stays compact
 		listing = iter->listing;
+		listing.Expand();
 		return true;
 	}
 
 	return false;
 }
 
-bool CDirectoryCache::Lookup(tCacheIter &cacheIter, tServerIter &sit, CServerPath const& path, bool allowUnsureEntries, bool& is_outdated)
+bool CDirectoryCache::Lookup(tCacheIter &cacheIter, tServerIter &sit, CServerPath const& path, bool allowUnsureEntries, bool& is_outdated, bool shared)
 {
-	CCacheEntry dummy;
-	dummy.listing.path = path;
-	cacheIter = sit->cacheList.lower_bound(dummy);
+	cacheIter = Find(sit, path);
+	if (cacheIter == sit->cacheList.end()) {
+		return false;
+	}
 
-	if (cacheIter != sit->cacheList.end()) {
-		CCacheEntry const& entry = *cacheIter;
+	if (shared) {
+		cacheIter->touched = true;
+	}
+	else {
+		UpdateLru(sit, cacheIter);
+	}
 
-		if (entry.listing.path == path) {
-			UpdateLru(sit, cacheIter);
+	CCacheEntry const& entry = *cacheIter;
+	if (!allowUnsureEntries && entry.listing.get_unsure_flags()) {
+		return false;
+	}
 
-			if (!allowUnsureEntries && entry.listing.get_unsure_flags()) {
-				return false;
-			}
+	is_outdated = (fz::monotonic_clock::now() - entry.listing.m_firstListTime) > ttl_;
+	return true;
+}
 
-			is_outdated = (fz::monotonic_clock::now() - entry.listing.m_firstListTime) > ttl_;
-			return true;
+CDirectoryCache::tCacheIter CDirectoryCache::Find(tServerIter const& sit, CServerPath const& path) const
+{
+	auto const range = sit->pathIndex.equal_range(path.Hash());
+	for (auto it = range.first; it != range.second; ++it) {
+		if (it->second->listing.path == path) {
+			return it->second;
 		}
 	}
 
-	return false;
+	return sit->cacheList.end();
 }
 
 bool CDirectoryCache::DoesExist(CServer const& server, CServerPath const& path, int &hasUnsureEntries, bool &is_outdated)
 {
-	fz::scoped_lock lock(mutex_);
+	std::shared_lock lock(mutex_);
 
 	tServerIter sit = GetServerEntry(server);
 	if (sit == m_serverList.end()) {
@@ -106,7 +162,7 @@ bool CDirectoryCache::DoesExist(CServer const& server, CServerPath const& path,
 	}
 
 	tCacheIter iter;
-	if (Lookup(iter, sit, path, true, is_outdated)) {
+	if (Lookup(iter, sit, path, true, is_outdated, true)) {
 		hasUnsureEntries = iter->listing.get_unsure_flags();
 		return true;
 	}
@@ -119,44 +175,59 @@ std::tuple<LookupResults, CDirentry> CDirectoryCache::LookupFile(CServer const&
 	LookupResults results{};
 	CDirentry entry;
 
-	fz::scoped_lock lock(mutex_);
+	bool const nocase = server.GetCaseSensitivity() != CaseSensitivity::yes || (flags & LookupFlags::force_caseinsensitive);
 
-	tServerIter sit = GetServerEntry(server);
-	if (sit == m_serverList.end()) {
-		return {results, entry};
-	}
+	// Returns false if the lookup needs an exclusive lock
+	auto const lookup = [&](bool shared) {
+		tServerIter sit = GetServerEntry(server);
+		if (sit == m_serverList.end()) {
+			return true;
+		}
 
-	tCacheIter iter;
-	bool outdated{};
-	if (!Lookup(iter, sit, path, true, outdated)) {
-		return {results, entry};
-	}
+		tCacheIter iter;
+		bool outdated{};
+		if (!Lookup(iter, sit, path, true, outdated, shared)) {
+			return true;
+		}
 
-	if (outdated) {
-		results |= LookupResults::outdated;
-		if (!(flags & LookupFlags::allow_outdated)) {
-			return {results, entry};
+		if (outdated) {
+			results |= LookupResults::outdated;
+			if (!(flags & LookupFlags::allow_outdated)) {
+				return true;
+			}
 		}
-	}
 
-	results |= LookupResults::direxists;
+		CDirectoryListing const& listing = iter->listing;
 
-	CCacheEntry const& cacheEntry = *iter;
-	CDirectoryListing const& listing = cacheEntry.listing;
+		size_t i;
+		bool matchedCase;
+		if (!FindFile(listing, filename, nocase, shared, i, matchedCase)) {
+			return false;
+		}
 
-	size_t i = listing.FindFile_CmpCase(filename);
-	if (i != std::string::npos) {
-		entry = listing[i];
-		results |= LookupResults::found | LookupResults::matchedcase;
-	}
-	else if (server.GetCaseSensitivity() != CaseSensitivity::yes || (flags & LookupFlags::force_caseinsensitive)) {
-		i = listing.FindFile_CmpNoCase(filename);
+		results |= LookupResults::direxists;
 		if (i != std::string::npos) {
-			entry = listing[i];
+			entry = listing.GetEntry(i);
 			results |= LookupResults::found;
+			if (matchedCase) {
+				results |= LookupResults::matchedcase;
+			}
+		}
+		return true;
+	};
+
+	{
+		std::shared_lock lock(mutex_);
+		if (lookup(true)) {
+			return {results, entry};
 		}
 	}
 
+	results = LookupResults{};
+
+	std::unique_lock lock(mutex_);
+	lookup(false);
+
 	return {results, entry};
 }
 
@@ -164,96 +235,121 @@ std::vector<std::tuple<LookupResults, CDirentry>> CDirectoryCache::LookupFiles(C
 {
 	std::vector<std::tuple<LookupResults, CDirentry>> ret;
 
-	fz::scoped_lock lock(mutex_);
+	bool const nocase = server.GetCaseSensitivity() != CaseSensitivity::yes || (flags & LookupFlags::force_caseinsensitive);
 
-	tServerIter sit = GetServerEntry(server);
-	if (sit == m_serverList.end()) {
-		return ret;
-	}
+	// Returns false if the lookup needs an exclusive lock
+	auto const lookup = [&](bool shared) {
+		tServerIter sit = GetServerEntry(server);
+		if (sit == m_serverList.end()) {
+			return true;
+		}
 
-	tCacheIter iter;
-	bool outdated{};
-	if (!Lookup(iter, sit, path, true, outdated)) {
-		return ret;
-	}
+		tCacheIter iter;
+		bool outdated{};
+		if (!Lookup(iter, sit, path, true, outdated, shared)) {
+			return true;
+		}
 
-	LookupResults results{};
-	if (outdated) {
-		results |= LookupResults::outdated;
-		if (!(flags & LookupFlags::allow_outdated)) {
-			ret.insert(ret.begin(), filenames.size(), {results, CDirentry()});
-			return ret;
+		LookupResults results{};
+		if (outdated) {
+			results |= LookupResults::outdated;
+			if (!(flags & LookupFlags::allow_outdated)) {
+				ret.insert(ret.begin(), filenames.size(), {results, CDirentry()});
+				return true;
+			}
 		}
-	}
 
-	results |= LookupResults::direxists;
+		results |= LookupResults::direxists;
 
-	CCacheEntry const& cacheEntry = *iter;
-	CDirectoryListing const& listing = cacheEntry.listing;
+		CDirectoryListing const& listing = iter->listing;
 
-	ret.reserve(filenames.size());
+		ret.reserve(filenames.size());
 
-	for (auto const& filename : filenames) {
-		CDirentry entry;
-		LookupResults fileresults = results;
-		size_t i = listing.FindFile_CmpCase(filename);
-		if (i != std::string::npos) {
-			entry = listing[i];
-			fileresults |= LookupResults::found | LookupResults::matchedcase;
-		}
-		else if (server.GetCaseSensitivity() != CaseSensitivity::yes || (flags & LookupFlags::force_caseinsensitive)) {
-			i = listing.FindFile_CmpNoCase(filename);
+		for (auto const& filename : filenames) {
+			size_t i;
+			bool matchedCase;
+			if (!FindFile(listing, filename, nocase, shared, i, matchedCase)) {
+				ret.clear();
+				return false;
+			}
+
+			CDirentry entry;
+			LookupResults fileresults = results;
 			if (i != std::string::npos) {
-				entry = listing[i];
+				entry = listing.GetEntry(i);
 				fileresults |= LookupResults::found;
+				if (matchedCase) {
+					fileresults |= LookupResults::matchedcase;
+				}
 			}
+			ret.emplace_back(fileresults, entry);
+		}
+		return true;
+	};
+
+	{
+		std::shared_lock lock(mutex_);
+		if (lookup(true)) {
+			return ret;
 		}
-		ret.emplace_back(fileresults, entry);
 	}
 
+	std::unique_lock lock(mutex_);
+	lookup(false);
+
 	return ret;
 }
 
 bool CDirectoryCache::LookupFile(CDirentry &entry, CServer const& server, CServerPath const& path, std::wstring const& filename, bool &dirDidExist, bool &matchedCase)
 {
-	fz::scoped_lock lock(mutex_);
+	bool found{};
 
-	tServerIter sit = GetServerEntry(server);
-	if (sit == m_serverList.end()) {
-		dirDidExist = false;
-		return false;
-	}
+	// Returns false if the lookup needs an exclusive lock
+	auto const lookup = [&](bool shared) {
+		tServerIter sit = GetServerEntry(server);
+		if (sit == m_serverList.end()) {
+			dirDidExist = false;
+			return true;
+		}
 
-	tCacheIter iter;
-	bool unused;
-	if (!Lookup(iter, sit, path, true, unused)) {
-		dirDidExist = false;
-		return false;
-	}
-	dirDidExist = true;
+		tCacheIter iter;
+		bool unused;
+		if (!Lookup(iter, sit, path, true, unused, shared)) {
+			dirDidExist = false;
+			return true;
+		}
 
-	const CCacheEntry &cacheEntry = *iter;
-	const CDirectoryListing &listing = cacheEntry.listing;
+		CDirectoryListing const& listing = iter->listing;
 
-	size_t i = listing.FindFile_CmpCase(filename);
-	if (i != std::string::npos) {
-		entry = listing[i];
-		matchedCase = true;
-		return true;
-	}
-	i = listing.FindFile_CmpNoCase(filename);
-	if (i != std::string::npos) {
-		entry = listing[i];
-		matchedCase = false;
+		size_t i;
+		if (!FindFile(listing, filename, true, shared, i, matchedCase)) {
+			return false;
+		}
+
+		dirDidExist = true;
+		if (i != std::string::npos) {
+			entry = listing.GetEntry(i);
+			found = true;
+		}
 		return true;
+	};
+
+	{
+		std::shared_lock lock(mutex_);
+		if (lookup(true)) {
+			return found;
+		}
 	}
 
-	return false;
+	std::unique_lock lock(mutex_);
+	lookup(false);
+
+	return found;
 }
 
 bool CDirectoryCache::InvalidateFile(CServer const& server, CServerPath const& path, std::wstring const& filename)
 {
-	fz::scoped_lock lock(mutex_);
+	std::unique_lock lock(mutex_);
 
 	tServerIter sit = GetServerEntry(server);
 	if (sit == m_serverList.end()) {
@@ -264,7 +360,9 @@ bool CDirectoryCache::InvalidateFile(CServer const& server, CServerPath const& p
 	bool dir{};
 
 	auto const now = fz::monotonic_clock::now();
-	for (tCacheIter iter = sit->cacheList.begin(); iter != sit->cacheList.end(); ++iter) {
+	auto const range = sit->pathIndexNoCase.equal_range(path.HashNoCase());
+	for (auto indexIt = range.first; indexIt != range.second; ++indexIt) {
+		tCacheIter iter = indexIt->second;
 		auto & entry = const_cast<CCacheEntry&>(*iter);
 
 		if (cmpCase) {
@@ -279,6 +377,7 @@ bool CDirectoryCache::InvalidateFile(CServer const& server, CServerPath const& p
 		}
 
 		UpdateLru(sit, iter);
+		ExpandListing(entry);
 
 		for (unsigned int i = 0; i < entry.listing.size(); i++) {
 			bool same;
@@ -317,22 +416,30 @@ bool CDirectoryCache::InvalidateFile(CServer const& server, CServerPath const& p
 
 bool CDirectoryCache::UpdateFile(CServer const& server, CServerPath const& path, std::wstring const& filename, bool mayCreate, Filetype type, int64_t size, std::wstring const& ownerGroup)
 {
-	fz::scoped_lock lock(mutex_);
+	std::unique_lock lock(mutex_);
 
 	tServerIter sit = GetServerEntry(server);
 	if (sit == m_serverList.end()) {
 		return false;
 	}
 
+	return UpdateFile(sit, path, filename, mayCreate, type, size, ownerGroup);
+}
+
+bool CDirectoryCache::UpdateFile(tServerIter const& sit, CServerPath const& path, std::wstring const& filename, bool mayCreate, Filetype type, int64_t size, std::wstring const& ownerGroup)
+{
 	bool updated = false;
 
-	for (tCacheIter iter = sit->cacheList.begin(); iter != sit->cacheList.end(); ++iter) {
+	auto const range = sit->pathIndexNoCase.equal_range(path.HashNoCase());
+	for (auto indexIt = range.first; indexIt != range.second; ++indexIt) {
+		tCacheIter iter = indexIt->second;
 		auto & entry = const_cast<CCacheEntry&>(*iter);
 		if (path.CmpNoCase(entry.listing.path)) {
 			continue;
 		}
 
 		UpdateLru(sit, iter);
+		ExpandListing(entry);
 
 		bool matchCase = false;
 		size_t i;
@@ -369,7 +476,7 @@ bool CDirectoryCache::UpdateFile(CServer const& server, CServerPath const& path,
 			}
 			direntry.size = size;
 			if (!ownerGroup.empty()) {
-				direntry.ownerGroup.get() = ownerGroup;
+				direntry.ownerGroup = CStringPool::instance().get(ownerGroup);
 			}
 			switch (type) {
 			case dir:
@@ -382,9 +489,9 @@ bool CDirectoryCache::UpdateFile(CServer const& server, CServerPath const& path,
 				entry.listing.m_flags |= CDirectoryListing::unsure_invalid;
 				break;
 			}
+			// Count the slot as well, the listing grows by one
+			AdjustMemoryUsage(entry, 0, CDirectoryListing::MemoryUsage(direntry) + sizeof(fz::shared_value<CDirentry>));
 			entry.listing.Append(std::move(direntry));
-
-			++m_totalFileCount;
 		}
 		else {
 			entry.listing.m_flags |= CDirectoryListing::unsure_unknown;
@@ -399,20 +506,28 @@ bool CDirectoryCache::UpdateFile(CServer const& server, CServerPath const& path,
 
 bool CDirectoryCache::RemoveFile(CServer const& server, CServerPath const& path, std::wstring const& filename)
 {
-	fz::scoped_lock lock(mutex_);
+	std::unique_lock lock(mutex_);
 
 	tServerIter sit = GetServerEntry(server);
 	if (sit == m_serverList.end()) {
 		return false;
 	}
 
-	for (tCacheIter iter = sit->cacheList.begin(); iter != sit->cacheList.end(); ++iter) {
+	return RemoveFile(sit, path, filename);
+}
+
+bool CDirectoryCache::RemoveFile(tServerIter const& sit, CServerPath const& path, std::wstring const& filename)
+{
+	auto const range = sit->pathIndexNoCase.equal_range(path.HashNoCase());
+	for (auto indexIt = range.first; indexIt != range.second; ++indexIt) {
+		tCacheIter iter = indexIt->second;
 		auto & entry = const_cast<CCacheEntry&>(*iter);
 		if (path.CmpNoCase(entry.listing.path)) {
 			continue;
 		}
 
 		UpdateLru(sit, iter);
+		ExpandListing(entry);
 
 		bool matchCase = false;
 		for (size_t i = 0; i < entry.listing.size(); ++i) {
@@ -430,8 +545,9 @@ bool CDirectoryCache::RemoveFile(CServer const& server, CServerPath const& path,
 			}
 			assert(i != entry.listing.size());
 
+			// The slot of the entry stays allocated
+			AdjustMemoryUsage(entry, CDirectoryListing::MemoryUsage(entry.listing[i]), 0);
 			entry.listing.RemoveEntry(i); // This does set m_hasUnsureEntries
-			--m_totalFileCount;
 		}
 		else {
 			for (size_t i = 0; i < entry.listing.size(); ++i) {
@@ -449,31 +565,34 @@ bool CDirectoryCache::RemoveFile(CServer const& server, CServerPath const& path,
 
 void CDirectoryCache::InvalidateServer(CServer const& server)
 {
-	fz::scoped_lock lock(mutex_);
+	std::unique_lock lock(mutex_);
 
-	for (auto iter = m_serverList.begin(); iter != m_serverList.end(); ++iter) {
-		if (!iter->server.SameContent(server)) {
-			continue;
-		}
+	tServerIter sit = GetServerEntry(server);
+	if (sit == m_serverList.end()) {
+		return;
+	}
 
-		for (tCacheIter cit = iter->cacheList.begin(); cit != iter->cacheList.end(); ++cit) {
-			tLruList::iterator* lruIt = (tLruList::iterator*)cit->lruIt;
-			if (lruIt) {
-				m_leastRecentlyUsedList.erase(*lruIt);
-				delete lruIt;
-			}
+	InvalidateServer(sit);
+}
 
-			m_totalFileCount -= cit->listing.size();
+void CDirectoryCache::InvalidateServer(tServerIter const& sit)
+{
+	for (tCacheIter cit = sit->cacheList.begin(); cit != sit->cacheList.end(); ++cit) {
+		tLruList::iterator* lruIt = (tLruList::iterator*)cit->lruIt;
+		if (lruIt) {
+			m_leastRecentlyUsedList.erase(*lruIt);
+			delete lruIt;
 		}
 
-		m_serverList.erase(iter);
-		break;
+		m_totalSize -= cit->bytes;
 	}
+
+	RemoveServerEntry(sit);
 }
 
 bool CDirectoryCache::GetChangeTime(fz::monotonic_clock& time, CServer const& server, CServerPath const& path)
 {
-	fz::scoped_lock lock(mutex_);
+	std::shared_lock lock(mutex_);
 
 	tServerIter sit = GetServerEntry(server);
 	if (sit == m_serverList.end()) {
@@ -482,7 +601,7 @@ bool CDirectoryCache::GetChangeTime(fz::monotonic_clock& time, CServer const& se
 
 	tCacheIter iter;
 	bool unused;
-	if (Lookup(iter, sit, path, true, unused)) {
+	if (Lookup(iter, sit, path, true, unused, true)) {
 		time = iter->modificationTime;
 		return true;
 	}
@@ -492,7 +611,7 @@ bool CDirectoryCache::GetChangeTime(fz::monotonic_clock& time, CServer const& se
 
 void CDirectoryCache::RemoveDir(CServer const& server, CServerPath const& path, std::wstring const& filename, CServerPath const&)
 {
-	fz::scoped_lock lock(mutex_);
+	std::unique_lock lock(mutex_);
 
 	// TODO: This is not 100% foolproof and may not work properly
 	// Perhaps just throw away the complete cache?
@@ -502,6 +621,11 @@ void CDirectoryCache::RemoveDir(CServer const& server, CServerPath const& path,
 		return;
 	}
 
+	RemoveDir(sit, path, filename);
+}
+
+void CDirectoryCache::RemoveDir(tServerIter const& sit, CServerPath const& path, std::wstring const& filename)
+{
 	CServerPath absolutePath = path;
 	if (!absolutePath.AddSegment(filename)) {
 		absolutePath.clear();
@@ -511,25 +635,25 @@ void CDirectoryCache::RemoveDir(CServer const& server, CServerPath const& path,
 		auto & entry = const_cast<CCacheEntry&>(*iter);
 		// Delete exact matches and subdirs
 		if (!absolutePath.empty() && (entry.listing.path == absolutePath || absolutePath.IsParentOf(entry.listing.path, true))) {
-			m_totalFileCount -= entry.listing.size();
+			m_totalSize -= entry.bytes;
 			tLruList::iterator* lruIt = (tLruList::iterator*)iter->lruIt;
 			if (lruIt) {
 				m_leastRecentlyUsedList.erase(*lruIt);
 				delete lruIt;
 			}
-			sit->cacheList.erase(iter++);
+			sit->Erase(iter++);
 		}
 		else {
 			++iter;
 		}
 	}
 
-	RemoveFile(server, path, filename);
+	RemoveFile(sit, path, filename);
 }
 
 void CDirectoryCache::Rename(CServer const& server, CServerPath const& pathFrom, std::wstring const& fileFrom, CServerPath const& pathTo, std::wstring const& fileTo)
 {
-	fz::scoped_lock lock(mutex_);
+	std::unique_lock lock(mutex_);
 
 	tServerIter sit = GetServerEntry(server);
 	if (sit == m_serverList.end()) {
@@ -540,9 +664,9 @@ void CDirectoryCache::Rename(CServer const& server, CServerPath const& pathFrom,
 	bool is_outdated = false;
 	bool found = Lookup(iter, sit, pathFrom, true, is_outdated);
 	if (found) {
-		auto & listing = const_cast<CDirectoryListing&>(iter->listing);
+		auto & listing = ExpandListing(*iter);
 		if (pathFrom == pathTo) {
-			RemoveFile(server, pathFrom, fileTo);
+			RemoveFile(sit, pathFrom, fileTo);
 			size_t i;
 			for (i = 0; i < listing.size(); ++i) {
 				if (listing[i].name == fileFrom) {
@@ -551,15 +675,17 @@ void CDirectoryCache::Rename(CServer const& server, CServerPath const& pathFrom,
 			}
 			if (i != listing.size()) {
 				if (listing[i].is_dir()) {
-					RemoveDir(server, pathFrom, fileFrom, CServerPath());
-					RemoveDir(server, pathFrom, fileTo, CServerPath());
-					UpdateFile(server, pathFrom, fileTo, true, dir);
+					RemoveDir(sit, pathFrom, fileFrom);
+					RemoveDir(sit, pathFrom, fileTo);
+					UpdateFile(sit, pathFrom, fileTo, true, dir, -1, std::wstring());
 				}
 				else {
+					size_t const before = CDirectoryListing::MemoryUsage(listing[i]);
 					listing.get(i).name = fileTo;
 					listing.get(i).flags |= CDirentry::flag_unsure;
 					listing.m_flags |= CDirectoryListing::unsure_unknown;
 					listing.ClearFindMap();
+					AdjustMemoryUsage(*iter, before, CDirectoryListing::MemoryUsage(listing[i]));
 				}
 			}
 			return;
@@ -573,12 +699,12 @@ void CDirectoryCache::Rename(CServer const& server, CServerPath const& pathFrom,
 			}
 			if (i != listing.size()) {
 				if (listing[i].is_dir()) {
-					RemoveDir(server, pathFrom, fileFrom, CServerPath());
-					UpdateFile(server, pathTo, fileTo, true, dir);
+					RemoveDir(sit, pathFrom, fileFrom);
+					UpdateFile(sit, pathTo, fileTo, true, dir, -1, std::wstring());
 				}
 				else {
-					RemoveFile(server, pathFrom, fileFrom);
-					UpdateFile(server, pathTo, fileTo, true, file);
+					RemoveFile(sit, pathFrom, fileFrom);
+					UpdateFile(sit, pathTo, fileTo, true, file, -1, std::wstring());
 				}
 			}
 			return;
@@ -586,12 +712,12 @@ void CDirectoryCache::Rename(CServer const& server, CServerPath const& pathFrom,
 	}
 
 	// We know nothing, be on the safe side and invalidate everything.
-	InvalidateServer(server);
+	InvalidateServer(sit);
 }
 
 void CDirectoryCache::UpdateOwnerGroup(CServer const& server, CServerPath const& path, std::wstring const& filename, std::wstring& ownerGroup)
 {
-	fz::scoped_lock lock(mutex_);
+	std::unique_lock lock(mutex_);
 
 	tServerIter sit = GetServerEntry(server);
 	if (sit == m_serverList.end()) {
@@ -602,7 +728,7 @@ void CDirectoryCache::UpdateOwnerGroup(CServer const& server, CServerPath const&
 	bool is_outdated = false;
 	bool found = Lookup(iter, sit, path, true, is_outdated);
 	if (found) {
-		auto & listing = const_cast<CDirectoryListing&>(iter->listing);
+		auto & listing = ExpandListing(*iter);
 		size_t i;
 		for (i = 0; i < listing.size(); ++i) {
 			if (listing[i].name == filename) {
@@ -611,7 +737,8 @@ void CDirectoryCache::UpdateOwnerGroup(CServer const& server, CServerPath const&
 		}
 		if (i != listing.size()) {
 			if (!listing[i].is_dir()) {
-				listing.get(i).ownerGroup.get() = ownerGroup;
+				// Owner/group values are not counted, the size does not change
+				listing.get(i).ownerGroup = CStringPool::instance().get(ownerGroup);
 				listing.ClearFindMap();
 			}
 			return;
@@ -619,36 +746,77 @@ void CDirectoryCache::UpdateOwnerGroup(CServer const& server, CServerPath const&
 	}
 
 	// We know nothing, be on the safe side and invalidate everything.
-	InvalidateServer(server);
+	InvalidateServer(sit);
 }
 
 
 CDirectoryCache::tServerIter CDirectoryCache::CreateServerEntry(CServer const& server)
 {
-	for (tServerIter iter = m_serverList.begin(); iter != m_serverList.end(); ++iter) {
-		if (iter->server.SameContent(server)) {
-			return iter;
-		}
+	tServerIter iter = GetServerEntry(server);
+	if (iter != m_serverList.end()) {
+		return iter;
 	}
-	m_serverList.emplace_back(server);
 
-	return --m_serverList.end();
+	iter = m_serverList.emplace(m_serverList.end(), server);
+	m_serverIndex.emplace(ServerHash(server), iter);
+
+	return iter;
 }
 
 CDirectoryCache::tServerIter CDirectoryCache::GetServerEntry(CServer const& server)
 {
-	tServerIter iter;
-	for (iter = m_serverList.begin(); iter != m_serverList.end(); ++iter) {
-		if (iter->server.SameContent(server)) {
+	auto const range = m_serverIndex.equal_range(ServerHash(server));
+	for (auto it = range.first; it != range.second; ++it) {
+		if (it->second->server.SameContent(server)) {
+			return it->second;
+		}
+	}
+
+	return m_serverList.end();
+}
+
+void CDirectoryCache::RemoveServerEntry(tServerIter const& sit)
+{
+	auto const range = m_serverIndex.equal_range(ServerHash(sit->server));
+	for (auto it = range.first; it != range.second; ++it) {
+		if (it->second == sit) {
+			m_serverIndex.erase(it);
 			break;
 		}
 	}
 
-	return iter;
+	m_serverList.erase(sit);
+}
+
+CDirectoryCache::tCacheIter CDirectoryCache::CServerEntry::Insert(tCacheIter hint, CDirectoryListing const& listing)
+{
+	tCacheIter it = cacheList.emplace_hint(hint, listing);
+	pathIndex.emplace(it->pathHash, it);
+	pathIndexNoCase.emplace(it->pathHashNoCase, it);
+	return it;
+}
+
+void CDirectoryCache::CServerEntry::Erase(tCacheIter const& it)
+{
+	auto const unindex = [&it](std::unordered_multimap<size_t, tCacheIter> & index, size_t hash) {
+		auto const range = index.equal_range(hash);
+		for (auto indexIt = range.first; indexIt != range.second; ++indexIt) {
+			if (indexIt->second == it) {
+				index.erase(indexIt);
+				break;
+			}
+		}
+	};
+	unindex(pathIndex, it->pathHash);
+	unindex(pathIndexNoCase, it->pathHashNoCase);
+
+	cacheList.erase(it);
 }
 
 void CDirectoryCache::UpdateLru(tServerIter const& sit, tCacheIter const& cit)
 {
+	cit->touched = false;
+
 	tLruList::iterator* lruIt = (tLruList::iterator*)cit->lruIt;
 	if (lruIt) {
 		m_leastRecentlyUsedList.splice(m_leastRecentlyUsedList.end(), m_leastRecentlyUsedList, *lruIt);
@@ -658,23 +826,69 @@ void CDirectoryCache::UpdateLru(tServerIter const& sit, tCacheIter const& cit)
 		auto & entry = const_cast<CCacheEntry&>(*cit);
 		entry.lruIt = (void*)new tLruList::iterator(m_leastRecentlyUsedList.emplace(m_leastRecentlyUsedList.end(), sit, cit));
 	}
+
+	// Only the most recently used listings are kept expanded. At most one
+	// listing drops out of that set each time an entry gets moved to the end.
+	if (m_leastRecentlyUsedList.size() > expandedListings) {
+		auto it = std::prev(m_leastRecentlyUsedList.end(), expandedListings + 1);
+		auto & entry = const_cast<CCacheEntry&>(*it->second);
+		if (!entry.listing.compacted()) {
+			entry.listing.Compact();
+			UpdateMemoryUsage(entry);
+		}
+	}
+}
+
+void CDirectoryCache::UpdateMemoryUsage(CCacheEntry const& entry)
+{
+	auto & e = const_cast<CCacheEntry&>(entry);
+	m_totalSize -= e.bytes;
+	e.bytes = sizeof(CCacheEntry) + e.listing.MemoryUsage();
+	m_totalSize += e.bytes;
+}
+
+void CDirectoryCache::AdjustMemoryUsage(CCacheEntry const& entry, size_t before, size_t after)
+{
+	auto & e = const_cast<CCacheEntry&>(entry);
+	assert(e.bytes >= before);
+	e.bytes = e.bytes - before + after;
+	m_totalSize -= before;
+	m_totalSize += after;
+}
+
+CDirectoryListing& CDirectoryCache::ExpandListing(CCacheEntry const& entry)
+{
+	auto & listing = const_cast<CDirectoryListing&>(entry.listing);
+	if (listing.compacted()) {
+		listing.Expand();
+		UpdateMemoryUsage(entry);
+	}
+	return listing;
 }
 
 void CDirectoryCache::Prune()
 {
+	// Always keep the most recently used listing, even if it exceeds the
+	// limit on its own.
 	while ((m_leastRecentlyUsedList.size() > 50000) ||
-		(m_totalFileCount > 1000000 && m_leastRecentlyUsedList.size() > 1000) ||
-		(m_totalFileCount > 5000000 && m_leastRecentlyUsedList.size() > 100))
+		(m_totalSize > memoryLimit_ && m_leastRecentlyUsedList.size() > 1))
 	{
 		tFullEntryPosition pos = m_leastRecentlyUsedList.front();
+		if (pos.second->touched) {
+			// Used since it was last moved, give it another round
+			pos.second->touched = false;
+			m_leastRecentlyUsedList.splice(m_leastRecentlyUsedList.end(), m_leastRecentlyUsedList, m_leastRecentlyUsedList.begin());
+			continue;
+		}
+
 		tLruList::iterator* lruIt = (tLruList::iterator*)pos.second->lruIt;
 		delete lruIt;
 
-		m_totalFileCount -= pos.second->listing.size();
+		m_totalSize -= pos.second->bytes;
 
-		pos.first->cacheList.erase(pos.second);
+		pos.first->Erase(pos.second);
 		if (pos.first->cacheList.empty()) {
-			m_serverList.erase(pos.first);
+			RemoveServerEntry(pos.first);
 		}
 
 		m_leastRecentlyUsedList.pop_front();
@@ -683,7 +897,7 @@ void CDirectoryCache::Prune()
 
 void CDirectoryCache::SetTtl(fz::duration const& ttl)
 {
-	fz::scoped_lock lock(mutex_);
+	std::unique_lock lock(mutex_);
 
 	if (ttl < fz::duration::from_seconds(30)) {
 		ttl_ = fz::duration::from_seconds(30);
@@ -695,3 +909,470 @@ void CDirectoryCache::SetTtl(fz::duration const& ttl)
 		ttl_ = ttl;
 	}
 }
+
+void CDirectoryCache::SetMemoryLimit(int64_t bytes)
+{
+	std::unique_lock lock(mutex_);
+
+	memoryLimit_ = bytes;
+	Prune();
+}
+
+namespace {
+// Persistent cache file format, all integers are little endian:
+//   magic, version, server count, servers, listing count, listings
+// Listings are stored least recently used first, each with the wall clock
+// time it was listed at.
+char const cacheFileMagic[] = "FZDC";
+uint32_t const cacheFileVersion = 2;
+
+class cache_writer final
+{
+public:
+	explicit cache_writer(fz::native_string const& file)
+		: file_(file, fz::file::writing, fz::file::empty)
+	{
+		failed_ = !file_.opened();
+	}
+
+	void u8(uint8_t v)
+	{
+		buffer_.append(&v, 1);
+	}
+
+	void u32(uint32_t v)
+	{
+		uint8_t data[4];
+		for (size_t i = 0; i < 4; ++i) {
+			data[i] = static_cast<uint8_t>(v >> (i * 8));
+		}
+		buffer_.append(data, 4);
+	}
+
+	void i64(int64_t v)
+	{
+		u32(static_cast<uint32_t>(static_cast<uint64_t>(v)));
+		u32(static_cast<uint32_t>(static_cast<uint64_t>(v) >> 32));
+	}
+
+	void str(std::string_view v)
+	{
+		u32(static_cast<uint32_t>(v.size()));
+		buffer_.append(reinterpret_cast<unsigned char const*>(v.data()), v.size());
+		if (buffer_.size() >= 256 * 1024) {
+			flush();
+		}
+	}
+
+	void str(std::wstring_view v)
+	{
+		str(fz::to_utf8(v));
+	}
+
+	bool flush()
+	{
+		while (!failed_ && !buffer_.empty()) {
+			int64_t written = file_.write(buffer_.get(), static_cast<int64_t>(buffer_.size()));
+			if (written <= 0) {
+				failed_ = true;
+			}
+			else {
+				buffer_.consume(static_cast<size_t>(written));
+			}
+		}
+		return !failed_;
+	}
+
+	bool close()
+	{
+		flush();
+		file_.close();
+		return !failed_;
+	}
+
+private:
+	fz::file file_;
+	fz::buffer buffer_;
+	bool failed_{};
+};
+
+// Reading past the end or any other inconsistency sets the error flag,
+// all subsequent reads then return empty values.
+class cache_reader final
+{
+public:
+	explicit cache_reader(fz::buffer const& buffer)
+		: buffer_(buffer)
+	{}
+
+	uint8_t u8()
+	{
+		if (!check(1)) {
+			return 0;
+		}
+		return buffer_[pos_++];
+	}
+
+	uint32_t u32()
+	{
+		if (!check(4)) {
+			return 0;
+		}
+		uint32_t ret{};
+		for (size_t i = 0; i < 4; ++i) {
+			ret |= static_cast<uint32_t>(buffer_[pos_++]) << (i * 8);
+		}
+		return ret;
+	}
+
+	int64_t i64()
+	{
+		uint64_t ret = u32();
+		ret |= static_cast<uint64_t>(u32()) << 32;
+		return static_cast<int64_t>(ret);
+	}
+
+	std::string_view str()
+	{
+		uint32_t const len = u32();
+		if (!check(len)) {
+			return {};
+		}
+		std::string_view ret(reinterpret_cast<char const*>(buffer_.get()) + pos_, len);
+		pos_ += len;
+		return ret;
+	}
+
+	std::wstring wstr()
+	{
+		return fz::to_wstring_from_utf8(str());
+	}
+
+	// Guards against bogus counts, each item takes at least one byte
+	uint32_t count()
+	{
+		uint32_t const ret = u32();
+		if (ret > buffer_.size() - pos_) {
+			error_ = true;
+			return 0;
+		}
+		return ret;
+	}
+
+	void fail() { error_ = true; }
+	bool error() const { return error_; }
+
+private:
+	bool check(size_t len)
+	{
+		if (error_ || buffer_.size() - pos_ < len) {
+			error_ = true;
+			return false;
+		}
+		return true;
+	}
+
+	fz::buffer const& buffer_;
+	size_t pos_{};
+	bool error_{};
+};
+
+void WriteServer(cache_writer & w, CServer const& server)
+{
+	w.u32(static_cast<uint32_t>(server.GetProtocol()));
+	w.u32(static_cast<uint32_t>(server.GetType()));
+	w.str(server.GetHost());
+	w.u32(server.GetPort());
+	w.str(server.GetUser());
+	w.u32(static_cast<uint32_t>(server.GetTimezoneOffset()));
+	w.u32(static_cast<uint32_t>(server.GetEncodingType()));
+	w.str(server.GetCustomEncoding());
+
+	auto const& commands = server.GetPostLoginCommands();
+	w.u32(static_cast<uint32_t>(commands.size()));
+	for (auto const& command : commands) {
+		w.str(command);
+	}
+
+	// Only what distinguishes the content, never credentials
+	std::vector<std::pair<std::string, std::wstring>> parameters;
+	for (auto const& trait : ExtraServerParameterTraits(server.GetProtocol())) {
+		if ((trait.flags_ & ParameterTraits::content_transparent) || trait.section_ == ParameterSection::credentials) {
+			continue;
+		}
+		std::wstring value = server.GetExtraParameter(trait.name_);
+		if (!value.empty()) {
+			parameters.emplace_back(trait.name_, std::move(value));
+		}
+	}
+	w.u32(static_cast<uint32_t>(parameters.size()));
+	for (auto const& parameter : parameters) {
+		w.str(parameter.first);
+		w.str(parameter.second);
+	}
+}
+
+CServer ReadServer(cache_reader & r)
+{
+	CServer server;
+
+	uint32_t const protocol = r.u32();
+	uint32_t const type = r.u32();
+	if (protocol > ServerProtocol::MAX_VALUE || type >= SERVERTYPE_MAX) {
+		r.fail();
+		return server;
+	}
+	server.SetProtocol(static_cast<ServerProtocol>(protocol));
+	server.SetType(static_cast<ServerType>(type));
+
+	std::wstring const host = r.wstr();
+	unsigned int const port = r.u32();
+	if (!server.SetHost(host, port)) {
+		r.fail();
+	}
+	server.SetUser(r.wstr());
+	server.SetTimezoneOffset(static_cast<int>(r.u32()));
+
+	uint32_t const encoding = r.u32();
+	std::wstring const customEncoding = r.wstr();
+	if (encoding <= ENCODING_CUSTOM) {
+		server.SetEncodingType(static_cast<CharsetEncoding>(encoding), customEncoding);
+	}
+
+	std::vector<std::wstring> commands;
+	for (uint32_t i = r.count(); i; --i) {
+		commands.emplace_back(r.wstr());
+	}
+	if (!commands.empty()) {
+		server.SetPostLoginCommands(commands);
+	}
+
+	for (uint32_t i = r.count(); i; --i) {
+		std::string const name(r.str());
+		server.SetExtraParameter(name, r.wstr());
+	}
+
+	return server;
+}
+
+void WriteTime(cache_writer & w, fz::datetime const& time)
+{
+	if (time.empty()) {
+		w.u8(0);
+		return;
+	}
+
+	w.u8(static_cast<uint8_t>(time.get_accuracy()) + 1);
+	w.i64(time.get_time_t());
+	if (time.get_accuracy() == fz::datetime::milliseconds) {
+		w.u32(static_cast<uint32_t>((time - fz::datetime(time.get_time_t(), fz::datetime::milliseconds)).get_milliseconds()));
+	}
+}
+
+fz::datetime ReadTime(cache_reader & r)
+{
+	uint8_t const accuracy = r.u8();
+	if (!accuracy) {
+		return fz::datetime();
+	}
+	if (accuracy > fz::datetime::milliseconds + 1) {
+		r.fail();
+		return fz::datetime();
+	}
+
+	fz::datetime ret(static_cast<time_t>(r.i64()), static_cast<fz::datetime::accuracy>(accuracy - 1));
+	if (ret.get_accuracy() == fz::datetime::milliseconds) {
+		ret += fz::duration::from_milliseconds(r.u32());
+	}
+	return ret;
+}
+}
+
+bool CDirectoryCache::Save(std::wstring const& file)
+{
+	std::shared_lock lock(mutex_);
+
+	// Written next to the file and moved into place once complete, so that
+	// a crash or a full disk never leaves a truncated cache behind.
+	fz::native_string const target = fz::to_native(file);
+	fz::native_string const temp = target + fzT(".tmp");
+
+	cache_writer w(temp);
+	w.str(std::string_view(cacheFileMagic));
+	w.u32(cacheFileVersion);
+
+	std::unordered_map<CServerEntry const*, uint32_t> serverIndices;
+	w.u32(static_cast<uint32_t>(m_serverList.size()));
+	for (auto const& serverEntry : m_serverList) {
+		serverIndices.emplace(&serverEntry, static_cast<uint32_t>(serverIndices.size()));
+		WriteServer(w, serverEntry.server);
+	}
+
+	// The monotonic clock does not survive restarts
+	auto const now = fz::datetime::now();
+	auto const monotonicNow = fz::monotonic_clock::now();
+
+	std::vector<tFullEntryPosition> positions;
+	positions.reserve(m_leastRecentlyUsedList.size());
+	for (auto const& pos : m_leastRecentlyUsedList) {
+		CDirectoryListing const& listing = pos.second->listing;
+		if (!listing.failed() && !listing.incomplete()) {
+			positions.push_back(pos);
+		}
+	}
+
+	w.u32(static_cast<uint32_t>(positions.size()));
+	for (auto const& pos : positions) {
+		CDirectoryListing const& listing = pos.second->listing;
+		w.u32(serverIndices[&*pos.first]);
+		w.str(listing.path.GetSafePath());
+		w.u32(static_cast<uint32_t>(listing.m_flags));
+		if (listing.m_firstListTime) {
+			w.i64((now - (monotonicNow - listing.m_firstListTime)).get_time_t());
+		}
+		else {
+			w.i64(0);
+		}
+
+		size_t const count = listing.size();
+		w.u32(static_cast<uint32_t>(count));
+		for (size_t i = 0; i < count; ++i) {
+			CDirentry const entry = listing.GetEntry(i);
+			w.str(entry.name);
+			w.i64(entry.size);
+			w.str(*entry.permissions);
+			w.str(*entry.ownerGroup);
+			w.u32(static_cast<uint32_t>(entry.flags));
+			if (entry.is_link()) {
+				w.str(entry.target ? *entry.target : std::wstring());
+			}
+			WriteTime(w, entry.time);
+		}
+	}
+
+	if (!w.close() || !fz::rename_file(temp, target)) {
+		fz::remove_file(temp);
+		return false;
+	}
+	return true;
+}
+
+void CDirectoryCache::Clear()
+{
+	std::unique_lock lock(mutex_);
+
+	while (!m_serverList.empty()) {
+		InvalidateServer(m_serverList.begin());
+	}
+}
+
+bool CDirectoryCache::Load(std::wstring const& file)
+{
+	fz::buffer buffer;
+	{
+		fz::file f(fz::to_native(file), fz::file::reading, fz::file::existing);
+		if (!f.opened()) {
+			return false;
+		}
+
+		int64_t read;
+		do {
+			read = f.read(buffer.get(64 * 1024), 64 * 1024);
+			if (read > 0) {
+				buffer.add(static_cast<size_t>(read));
+			}
+		} while (read > 0);
+		if (read < 0) {
+			return false;
+		}
+	}
+
+	cache_reader r(buffer);
+	if (r.str() != cacheFileMagic || r.u32() != cacheFileVersion) {
+		return false;
+	}
+
+	std::vector<CServer> servers;
+	for (uint32_t i = r.count(); i && !r.error(); --i) {
+		servers.emplace_back(ReadServer(r));
+	}
+
+	struct loaded_listing final
+	{
+		uint32_t server{};
+		CDirectoryListing listing;
+		fz::datetime listTime;
+	};
+	std::vector<loaded_listing> listings;
+	for (uint32_t i = r.count(); i && !r.error(); --i) {
+		uint32_t const server = r.u32();
+		if (server >= servers.size()) {
+			r.fail();
+			break;
+		}
+
+		CDirectoryListing listing;
+		if (!listing.path.SetSafePath(r.wstr())) {
+			r.fail();
+			break;
+		}
+		int const flags = static_cast<int>(r.u32());
+		int64_t const listTime = r.i64();
+
+		std::vector<fz::shared_value<CDirentry>> entries;
+		for (uint32_t j = r.count(); j && !r.error(); --j) {
+			CDirentry entry;
+			entry.name = r.wstr();
+			entry.size = r.i64();
+			entry.permissions = CStringPool::instance().get(r.wstr());
+			entry.ownerGroup = CStringPool::instance().get(r.wstr());
+			entry.flags = static_cast<int>(r.u32());
+			if (entry.is_link()) {
+				entry.target = fz::sparse_optional<std::wstring>(r.wstr());
+			}
+			entry.time = ReadTime(r);
+			entries.emplace_back(std::move(entry));
+		}
+		listing.Assign(std::move(entries));
+		listing.m_flags = flags;
+
+		listings.push_back({server, std::move(listing), listTime > 0 ? fz::datetime(static_cast<time_t>(listTime), fz::datetime::seconds) : fz::datetime()});
+	}
+
+	if (r.error()) {
+		return false;
+	}
+
+	std::unique_lock lock(mutex_);
+
+	// Listings from a previous session are valid for what is left of the TTL
+	// since they got listed. Older ones, or all of them if the clock went
+	// backwards, are outdated. Lookups allowing outdated listings can still
+	// use them until the directory gets listed again.
+	auto const now = fz::datetime::now();
+	auto const monotonicNow = fz::monotonic_clock::now();
+	auto const outdated = monotonicNow - ttl_ - fz::duration::from_seconds(1);
+
+	for (auto & [server, listing, listTime] : listings) {
+		tServerIter sit = CreateServerEntry(servers[server]);
+		if (Find(sit, listing.path) != sit->cacheList.end()) {
+			// Already listed in this session
+			continue;
+		}
+
+		fz::duration const age = listTime.empty() ? fz::duration() : now - listTime;
+		if (listTime.empty() || age < fz::duration() || age > ttl_) {
+			listing.m_firstListTime = outdated;
+		}
+		else {
+			listing.m_firstListTime = monotonicNow - age;
+		}
+		tCacheIter cit = sit->Insert(sit->cacheList.end(), listing);
+		UpdateMemoryUsage(*cit);
+		UpdateLru(sit, cit);
+	}
+
+	Prune();
+
+	return true;
+}
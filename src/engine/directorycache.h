@@ -16,10 +16,11 @@ version.
 
 #include "../include/directorylisting.h"
 
-#include <libfilezilla/mutex.hpp>
-
+#include <atomic>
 #include <list>
 #include <set>
+#include <shared_mutex>
+#include <unordered_map>
 
 enum class LookupFlags
 {
@@ -67,7 +68,7 @@ inline LookupResults& operator|=(LookupResults & lhs, LookupResults rhs)
 	return lhs;
 }
 
-class CDirectoryCache final
+class FZC_PUBLIC_SYMBOL CDirectoryCache final
 {
 public:
 	enum Filetype
@@ -102,33 +103,52 @@ public:
 
 	void SetTtl(fz::duration const& ttl);
 
+	// Approximate upper bound for the memory used by cached listings
+	void SetMemoryLimit(int64_t bytes);
+
+	// Persist the cached listings across sessions. Loaded listings are
+	// always outdated, listings already in the cache take precedence.
+	bool Save(std::wstring const& file);
+	bool Load(std::wstring const& file);
+
+	// Removes all cached listings
+	void Clear();
+
 protected:
 
 	class CCacheEntry final
 	{
 	public:
-		CCacheEntry() = default;
-		CCacheEntry(CCacheEntry const& entry) = default;
-		CCacheEntry(CCacheEntry && entry) noexcept = default;
-
 		explicit CCacheEntry(CDirectoryListing const& l)
 			: listing(l)
 			, modificationTime(fz::monotonic_clock::now())
+			, pathHash(l.path.Hash())
+			, pathHashNoCase(l.path.HashNoCase())
 		{}
 
 		CDirectoryListing listing;
 		fz::monotonic_clock modificationTime;
 
-		CCacheEntry& operator=(CCacheEntry const& a) = default;
-		CCacheEntry& operator=(CCacheEntry && a) noexcept = default;
-
 		void* lruIt{}; // void* to break cyclic declaration dependency
 
+		// Set by lookups holding only a shared lock, these cannot move the
+		// entry in the LRU list. Prune gives such entries a second chance.
+		mutable std::atomic<bool> touched{};
+
+		// Approximate memory used by this entry
+		size_t bytes{};
+
+		size_t pathHash{};
+		size_t pathHashNoCase{};
+
 		bool operator<(CCacheEntry const& op) const noexcept {
 			return listing.path < op.listing.path;
 		}
 	};
 
+	typedef std::set<CCacheEntry>::iterator tCacheIter;
+	typedef std::set<CCacheEntry>::const_iterator tCacheConstIter;
+
 	class CServerEntry final
 	{
 	public:
@@ -139,31 +159,66 @@ protected:
 
 		CServer server;
 		std::set<CCacheEntry> cacheList;
+
+		// Entries of cacheList by their path hashes
+		std::unordered_multimap<size_t, tCacheIter> pathIndex;
+		std::unordered_multimap<size_t, tCacheIter> pathIndexNoCase;
+
+		tCacheIter Insert(tCacheIter hint, CDirectoryListing const& listing);
+		void Erase(tCacheIter const& it);
 	};
 
 	typedef std::list<CServerEntry>::iterator tServerIter;
 
 	tServerIter CreateServerEntry(const CServer& server);
 	tServerIter GetServerEntry(const CServer& server);
+	void RemoveServerEntry(tServerIter const& sit);
 
-	typedef std::set<CCacheEntry>::iterator tCacheIter;
-	typedef std::set<CCacheEntry>::const_iterator tCacheConstIter;
+	// With shared set, the caller holds only a shared lock and the LRU list
+	// is left alone
+	bool Lookup(tCacheIter &cacheIter, tServerIter &sit, CServerPath const& path, bool allowUnsureEntries, bool& is_outdated, bool shared = false);
+
+	tCacheIter Find(tServerIter const& sit, CServerPath const& path) const;
 
-	bool Lookup(tCacheIter &cacheIter, tServerIter &sit, CServerPath const& path, bool allowUnsureEntries, bool& is_outdated);
+	// Unlocked implementations, the public functions call each other through these
+	bool UpdateFile(tServerIter const& sit, CServerPath const& path, std::wstring const& filename, bool mayCreate, Filetype type, int64_t size, std::wstring const& ownerGroup);
+	bool RemoveFile(tServerIter const& sit, CServerPath const& path, std::wstring const& filename);
+	void RemoveDir(tServerIter const& sit, CServerPath const& path, std::wstring const& filename);
+	void InvalidateServer(tServerIter const& sit);
 
-	fz::mutex mutex_;
+	// Lookups only take a shared lock as long as they do not need to
+	// modify the cache. Everything else needs an exclusive lock.
+	std::shared_mutex mutex_;
 
 	std::list<CServerEntry> m_serverList;
 
+	// Entries of m_serverList by server hash
+	std::unordered_multimap<size_t, tServerIter> m_serverIndex;
+
 	void UpdateLru(tServerIter const& sit, tCacheIter const& cit);
 
+	// Recomputes the memory usage of the whole listing of an entry. Only
+	// needed if the listing got replaced, compacted or expanded, individual
+	// changes to its entries are accounted for through AdjustMemoryUsage.
+	void UpdateMemoryUsage(CCacheEntry const& entry);
+
+	// Replaces the given number of bytes used by the entry with the new value
+	void AdjustMemoryUsage(CCacheEntry const& entry, size_t before, size_t after);
+
+	// Needs to be called before the listing of an entry gets modified or
+	// read through CDirectoryListing::operator[]
+	CDirectoryListing& ExpandListing(CCacheEntry const& entry);
+
 	void Prune();
 
 	typedef std::pair<tServerIter, tCacheIter> tFullEntryPosition;
 	typedef std::list<tFullEntryPosition> tLruList;
 	tLruList m_leastRecentlyUsedList;
 
-	int64_t m_totalFileCount{};
+	int64_t m_totalSize{};
+	int64_t memoryLimit_{512 * 1024 * 1024};
+
+	static constexpr size_t expandedListings{10};
 
 	fz::duration ttl_{fz::duration::from_seconds(600)};
 };
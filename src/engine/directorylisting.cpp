@@ -3,6 +3,8 @@
 #include <libfilezilla/format.hpp>
 
 #include <algorithm>
+#include <iterator>
+#include <limits>
 
 void CDirentry::clear()
 {
@@ -55,8 +57,111 @@ bool CDirentry::operator==(const CDirentry &op) const
 	return true;
 }
 
+bool CCompactDirentries::Assign(std::vector<fz::shared_value<CDirentry>> const& entries)
+{
+	*this = CCompactDirentries();
+
+	size_t total{};
+	for (auto const& entry : entries) {
+		total += entry->name.size();
+	}
+	if (total > std::numeric_limits<uint32_t>::max() || entries.size() > std::numeric_limits<uint32_t>::max()) {
+		return false;
+	}
+
+	names_.reserve(total);
+	name_offsets_.reserve(entries.size() + 1);
+	sizes_.reserve(entries.size());
+	times_.reserve(entries.size());
+	flags_.reserve(entries.size());
+	permissions_.reserve(entries.size());
+	ownerGroups_.reserve(entries.size());
+
+	// Keys point into the strings held by strings_, those do not move.
+	std::unordered_map<std::wstring_view, uint32_t> indexes;
+	auto const intern = [&](fz::shared_value<std::wstring> const& v) {
+		auto it = indexes.find(*v);
+		if (it != indexes.end()) {
+			return it->second;
+		}
+		uint32_t const index = static_cast<uint32_t>(strings_.size());
+		strings_.push_back(v);
+		indexes.emplace(*strings_.back(), index);
+		return index;
+	};
+
+	name_offsets_.push_back(0);
+	for (auto const& entry : entries) {
+		names_ += entry->name;
+		name_offsets_.push_back(static_cast<uint32_t>(names_.size()));
+		sizes_.push_back(entry->size);
+		times_.push_back(entry->time);
+		flags_.push_back(static_cast<uint8_t>(entry->flags));
+		permissions_.push_back(intern(entry->permissions));
+		ownerGroups_.push_back(intern(entry->ownerGroup));
+		if (entry->target) {
+			targets_.emplace_back(static_cast<uint32_t>(sizes_.size() - 1), *entry->target);
+		}
+	}
+
+	return true;
+}
+
+CDirentry CCompactDirentries::entry(size_t index) const
+{
+	CDirentry ret;
+	ret.name = name(index);
+	ret.size = sizes_[index];
+	ret.permissions = strings_[permissions_[index]];
+	ret.ownerGroup = strings_[ownerGroups_[index]];
+	ret.time = times_[index];
+	ret.flags = flags_[index];
+
+	auto it = std::lower_bound(targets_.cbegin(), targets_.cend(), index, [](auto const& target, size_t i) { return target.first < i; });
+	if (it != targets_.cend() && it->first == index) {
+		ret.target = fz::sparse_optional<std::wstring>(it->second);
+	}
+
+	return ret;
+}
+
+std::vector<fz::shared_value<CDirentry>> CCompactDirentries::Expand() const
+{
+	std::vector<fz::shared_value<CDirentry>> ret;
+	ret.reserve(size());
+	for (size_t i = 0; i < size(); ++i) {
+		ret.emplace_back(entry(i));
+	}
+	return ret;
+}
+
+size_t CCompactDirentries::MemoryUsage() const
+{
+	size_t ret = sizeof(CCompactDirentries);
+	ret += names_.capacity() * sizeof(wchar_t);
+	ret += name_offsets_.capacity() * sizeof(uint32_t);
+	ret += sizes_.capacity() * sizeof(int64_t);
+	ret += times_.capacity() * sizeof(fz::datetime);
+	ret += flags_.capacity();
+	ret += (permissions_.capacity() + ownerGroups_.capacity()) * sizeof(uint32_t);
+	ret += strings_.capacity() * sizeof(fz::shared_value<std::wstring>);
+	ret += targets_.capacity() * sizeof(std::pair<uint32_t, std::wstring>);
+	for (auto const& target : targets_) {
+		ret += target.second.capacity() * sizeof(wchar_t);
+	}
+	return ret;
+}
+
 const CDirentry& CDirectoryListing::operator[](size_t index) const
 {
+	if (m_compact) {
+		auto & decoded = m_decoded.get();
+		auto it = decoded.find(index);
+		if (it == decoded.end()) {
+			it = decoded.emplace(index, m_compact->entry(index)).first;
+		}
+		return it->second;
+	}
 	return *(*m_entries)[index];
 }
 
@@ -64,17 +169,129 @@ CDirentry& CDirectoryListing::get(size_t index)
 {
 	// Commented out, too heavy speed penalty
 	// assert(index < m_entryCount);
+	Expand();
 	return m_entries.get()[index].get();
 }
 
+CDirentry CDirectoryListing::GetEntry(size_t index) const
+{
+	if (m_compact) {
+		return m_compact->entry(index);
+	}
+	return *(*m_entries)[index];
+}
+
+std::wstring_view CDirectoryListing::name(size_t index) const
+{
+	if (m_compact) {
+		return m_compact->name(index);
+	}
+	return (*m_entries)[index]->name;
+}
+
+void CDirectoryListing::Compact()
+{
+	if (m_compact || !m_entries || m_entries->empty()) {
+		return;
+	}
+
+	if (!m_compact.get().Assign(*m_entries)) {
+		m_compact.clear();
+		return;
+	}
+
+	m_entries.clear();
+	m_decoded.clear();
+
+	// The search maps hold a copy of each name, keeping them would undo
+	// most of the savings. They get rebuilt from the compact names if needed.
+	m_searchmap_case.clear();
+	m_searchmap_nocase.clear();
+}
+
+size_t CDirectoryListing::MemoryUsage() const
+{
+	if (m_compact) {
+		size_t ret = m_compact->MemoryUsage();
+		if (m_decoded) {
+			for (auto const& decoded : *m_decoded) {
+				ret += MemoryUsage(decoded.second);
+			}
+		}
+		return ret;
+	}
+	if (!m_entries) {
+		return 0;
+	}
+
+	size_t ret = m_entries->capacity() * sizeof(fz::shared_value<CDirentry>);
+	for (auto const& entry : *m_entries) {
+		ret += MemoryUsage(*entry);
+	}
+	return ret;
+}
+
+size_t CDirectoryListing::MemoryUsage(CDirentry const& entry)
+{
+	// Each entry has its own allocation, including the control block
+	size_t ret = sizeof(CDirentry) + 2 * sizeof(void*);
+	ret += entry.name.capacity() * sizeof(wchar_t);
+	if (entry.target) {
+		ret += sizeof(std::wstring) + entry.target->capacity() * sizeof(wchar_t);
+	}
+	return ret;
+}
+
+void CDirectoryListing::Expand()
+{
+	if (!m_compact) {
+		return;
+	}
+
+	m_entries.get() = m_compact->Expand();
+	m_compact.clear();
+	m_decoded.clear();
+}
+
 void CDirectoryListing::Assign(std::vector<fz::shared_value<CDirentry>> && entries)
 {
+	m_compact.clear();
+	m_decoded.clear();
+
 	std::vector<fz::shared_value<CDirentry>> & own_entries = m_entries.get();
 	own_entries = std::move(entries);
 
 	m_flags &= ~(listing_has_dirs | listing_has_perms | listing_has_usergroup);
+	UpdateFlags(0);
+
+	m_searchmap_case.clear();
+	m_searchmap_nocase.clear();
+}
+
+void CDirectoryListing::Append(std::vector<fz::shared_value<CDirentry>> && entries)
+{
+	Expand();
+
+	std::vector<fz::shared_value<CDirentry>> & own_entries = m_entries.get();
+	size_t const old_size = own_entries.size();
+	if (own_entries.empty()) {
+		own_entries = std::move(entries);
+	}
+	else {
+		own_entries.insert(own_entries.end(), std::make_move_iterator(entries.begin()), std::make_move_iterator(entries.end()));
+	}
+
+	UpdateFlags(old_size);
 
-	for (auto const& entry : own_entries) {
+	m_searchmap_case.clear();
+	m_searchmap_nocase.clear();
+}
+
+void CDirectoryListing::UpdateFlags(size_t first)
+{
+	auto const& entries = *m_entries;
+	for (size_t i = first; i < entries.size(); ++i) {
+		auto const& entry = entries[i];
 		if (entry->is_dir()) {
 			m_flags |= listing_has_dirs;
 		}
@@ -85,9 +302,6 @@ void CDirectoryListing::Assign(std::vector<fz::shared_value<CDirentry>> && entri
 			m_flags |= listing_has_usergroup;
 		}
 	}
-
-	m_searchmap_case.clear();
-	m_searchmap_nocase.clear();
 }
 
 bool CDirectoryListing::RemoveEntry(size_t index)
@@ -99,6 +313,7 @@ bool CDirectoryListing::RemoveEntry(size_t index)
 	m_searchmap_case.clear();
 	m_searchmap_nocase.clear();
 
+	Expand();
 	std::vector<fz::shared_value<CDirentry> >& entries = m_entries.get();
 	std::vector<fz::shared_value<CDirentry> >::iterator iter = entries.begin() + index;
 	if ((*iter)->is_dir()) {
@@ -116,13 +331,14 @@ void CDirectoryListing::GetFilenames(std::vector<std::wstring> &names) const
 {
 	names.reserve(size());
 	for (size_t i = 0; i < size(); ++i) {
-		names.push_back((*m_entries)[i]->name);
+		names.emplace_back(name(i));
 	}
 }
 
 size_t CDirectoryListing::FindFile_CmpCase(std::wstring const& name) const
 {
-	if (!m_entries || m_entries->empty()) {
+	size_t const count = size();
+	if (!count) {
 		return std::string::npos;
 	}
 
@@ -137,16 +353,15 @@ size_t CDirectoryListing::FindFile_CmpCase(std::wstring const& name) const
 	}
 
 	size_t i = m_searchmap_case->size();
-	if (i == m_entries->size()) {
+	if (i == count) {
 		return std::string::npos;
 	}
 
 	auto & searchmap_case = m_searchmap_case.get();
 
 	// Build map if not yet complete
-	std::vector<fz::shared_value<CDirentry> >::const_iterator entry_iter = m_entries->begin() + i;
-	for (; entry_iter != m_entries->end(); ++entry_iter, ++i) {
-		std::wstring const& entry_name = (*entry_iter)->name;
+	for (; i < count; ++i) {
+		std::wstring_view const entry_name = this->name(i);
 		searchmap_case.emplace(entry_name, i);
 
 		if (entry_name == name) {
@@ -160,7 +375,8 @@ size_t CDirectoryListing::FindFile_CmpCase(std::wstring const& name) const
 
 size_t CDirectoryListing::FindFile_CmpNoCase(std::wstring const& name) const
 {
-	if (!m_entries || m_entries->empty()) {
+	size_t const count = size();
+	if (!count) {
 		return std::string::npos;
 	}
 
@@ -177,16 +393,15 @@ size_t CDirectoryListing::FindFile_CmpNoCase(std::wstring const& name) const
 	}
 
 	size_t i = m_searchmap_nocase->size();
-	if (i == m_entries->size()) {
+	if (i == count) {
 		return std::string::npos;
 	}
 
 	auto& searchmap_nocase = m_searchmap_nocase.get();
 
 	// Build map if not yet complete
-	std::vector<fz::shared_value<CDirentry> >::const_iterator entry_iter = m_entries->begin() + i;
-	for (; entry_iter != m_entries->end(); ++entry_iter, ++i) {
-		std::wstring entry_lrw = fz::str_tolower((*entry_iter)->name);
+	for (; i < count; ++i) {
+		std::wstring entry_lrw = fz::str_tolower(this->name(i));
 		searchmap_nocase.emplace(entry_lrw, i);
 
 		if (entry_lrw == lwr) {
@@ -198,6 +413,38 @@ size_t CDirectoryListing::FindFile_CmpNoCase(std::wstring const& name) const
 	return std::string::npos;
 }
 
+bool CDirectoryListing::HasFindMap(bool nocase) const
+{
+	size_t const count = size();
+	if (!count) {
+		return true;
+	}
+
+	auto const& searchmap = nocase ? m_searchmap_nocase : m_searchmap_case;
+	return searchmap && searchmap->size() == count;
+}
+
+void CDirectoryListing::BuildFindMap(bool nocase) const
+{
+	if (HasFindMap(nocase)) {
+		return;
+	}
+
+	size_t const count = size();
+	if (nocase) {
+		auto & searchmap_nocase = m_searchmap_nocase.get();
+		for (size_t i = searchmap_nocase.size(); i < count; ++i) {
+			searchmap_nocase.emplace(fz::str_tolower(name(i)), i);
+		}
+	}
+	else {
+		auto & searchmap_case = m_searchmap_case.get();
+		for (size_t i = searchmap_case.size(); i < count; ++i) {
+			searchmap_case.emplace(name(i), i);
+		}
+	}
+}
+
 void CDirectoryListing::ClearFindMap()
 {
 	if (!m_searchmap_case) {
@@ -210,6 +457,7 @@ void CDirectoryListing::ClearFindMap()
 
 void CDirectoryListing::Append(CDirentry&& entry)
 {
+	Expand();
 	m_entries.get().emplace_back(entry);
 }
 
@@ -1,6 +1,7 @@
 #include "filezilla.h"
 #include "directorylistingparser.h"
 #include "controlsocket.h"
+#include "stringpool.h"
 
 #include <libfilezilla/format.hpp>
 
@@ -11,8 +12,6 @@
 #include <assert.h>
 #include <string.h>
 
-std::map<std::wstring, int> CDirectoryListingParser::m_MonthNamesMap;
-
 //#define LISTDEBUG_MVS
 //#define LISTDEBUG
 #ifdef LISTDEBUG
@@ -22,39 +21,10 @@ static char const data[][150]={
 
 #endif
 
-namespace {
-struct ObjectCache
-{
-	fz::shared_value<std::wstring> const& get(std::wstring const& v)
-	{
-		auto it = std::lower_bound(cache.begin(), cache.end(), v);
-
-		if (it == cache.end() || !(*it == v)) {
-			it = cache.emplace(it, v);
-		}
-		return *it;
-	}
-
-	fz::shared_value<std::wstring> const& get(std::wstring && v)
-	{
-		auto it = std::lower_bound(cache.begin(), cache.end(), v);
-
-		if (it == cache.end() || !(*it == v)) {
-			it = cache.emplace(it, std::move(v));
-		}
-		return *it;
-	}
-
-	// Vector coupled with binary search and sorted insertion is fastest
-	// alternative as we expect a relatively low amount of inserts.
-	// Note that we cannot use set, as it it cannot search based on a different type.
-	std::vector<fz::shared_value<std::wstring>> cache;
-};
-
-
-ObjectCache objcache;
-}
+class CLine;
 
+// A field of a listing line. Refers to the raw bytes of the line, which
+// only get converted to the local charset for the fields that are kept.
 class CToken final
 {
 protected:
@@ -83,15 +53,12 @@ public:
 		hex
 	};
 
-	CToken(std::wstring_view data)
+	CToken(std::string_view data, CLine const* line)
 		: data_(data)
+		, line_(line)
 	{}
 
-	CToken(wchar_t const* data, size_t len)
-		: data_(data, len)
-	{}
-
-	wchar_t const* data() const
+	char const* data() const
 	{
 		return data_.data();
 	}
@@ -102,21 +69,19 @@ public:
 
 	explicit operator bool() const { return !data_.empty(); }
 
-	wchar_t operator[](size_t i) const { return data_[i]; }
+	char operator[](size_t i) const { return data_[i]; }
 
-	std::wstring GetString() const
+	// Converted to the local charset
+	std::wstring GetString() const;
+
+	std::string_view get_view() const
 	{
-		if (data_.empty()) {
-			return std::wstring();
-		}
-		else {
-			return std::wstring(data_.data(), data_.size());
-		}
+		return data_;
 	}
 
-	std::wstring_view get_view() const
+	CToken substr(size_t start, size_t len = std::string_view::npos) const
 	{
-		return data_;
+		return CToken(data_.substr(start, len), line_);
 	}
 
 	bool IsNumeric(t_numberBase base = decimal)
@@ -182,7 +147,7 @@ public:
 		return flags_ & numeric_right;
 	}
 
-	int Find(wchar_t const* chr, size_t start = 0) const
+	int Find(char const* chr, size_t start = 0) const
 	{
 		if (!chr) {
 			return -1;
@@ -198,7 +163,7 @@ public:
 		return -1;
 	}
 
-	int Find(wchar_t chr, size_t start = 0) const
+	int Find(char chr, size_t start = 0) const
 	{
 		for (size_t i = start; i < data_.size(); ++i) {
 			if (data_[i] == chr) {
@@ -283,7 +248,7 @@ public:
 					if (number > max) {
 						return -1;
 					}
-					wchar_t const& c = data_[i];
+					char const c = data_[i];
 					if (c >= '0' && c <= '9') {
 						number *= 16;
 						number += c - '0';
@@ -308,28 +273,81 @@ public:
 protected:
 	int64_t m_number{std::numeric_limits<int64_t>::min()};
 
-	std::wstring_view data_;
+	std::string_view data_;
+	CLine const* line_{};
 	unsigned char flags_{};
 };
 
 class CLine final
 {
 public:
-	CLine(std::wstring && line, size_t trailing_whitespace = std::string::npos)
-		: trailing_whitespace_(trailing_whitespace)
+	// The line refers to the given data, see Detach(). Fields are converted to
+	// the local charset by the control socket, unless the line is known to
+	// be UTF-8.
+	CLine(std::string_view line, CControlSocket* pControlSocket, bool utf8 = false, size_t trailing_whitespace = std::string::npos)
+		: m_pControlSocket(pControlSocket)
+		, utf8_(utf8)
+		, trailing_whitespace_(trailing_whitespace)
 		, line_(line)
 	{
 		m_Tokens.reserve(10);
 		m_LineEndTokens.reserve(10);
-		while (m_parsePos < line_.size() && (line_[m_parsePos] == ' ' || line_[m_parsePos] == '\t')) {
-			++m_parsePos;
-		}
+		SkipLeadingWhitespace();
+	}
+
+	CLine(std::string && line, CControlSocket* pControlSocket, bool utf8 = false, size_t trailing_whitespace = std::string::npos)
+		: m_pControlSocket(pControlSocket)
+		, utf8_(utf8)
+		, trailing_whitespace_(trailing_whitespace)
+		, storage_(std::move(line))
+		, line_(storage_)
+	{
+		m_Tokens.reserve(10);
+		m_LineEndTokens.reserve(10);
+		SkipLeadingWhitespace();
 	}
 
+	CLine(CLine const&) = delete;
+	CLine& operator=(CLine const&) = delete;
+
 	~CLine()
 	{
 	}
 
+	// Copies the data the line refers to, needed if the line has to
+	// outlive the received data.
+	void Detach()
+	{
+		if (line_.data() == storage_.data()) {
+			return;
+		}
+		storage_ = line_;
+		line_ = storage_;
+
+		m_Tokens.clear();
+		m_LineEndTokens.clear();
+		SkipLeadingWhitespace();
+	}
+
+	std::wstring Convert(std::string_view data) const
+	{
+		if (data.empty()) {
+			return std::wstring();
+		}
+		if (m_pControlSocket && !utf8_) {
+			return m_pControlSocket->ConvToLocal(data.data(), data.size());
+		}
+
+		std::wstring ret = fz::to_wstring_from_utf8(data);
+		if (ret.empty()) {
+			ret = fz::to_wstring(data);
+			if (ret.empty()) {
+				ret.assign(reinterpret_cast<unsigned char const*>(data.data()), reinterpret_cast<unsigned char const*>(data.data() + data.size()));
+			}
+		}
+		return ret;
+	}
+
 	CToken GetToken(unsigned int n)
 	{
 		if (m_Tokens.size() > n) {
@@ -339,7 +357,7 @@ public:
 		size_t start = m_parsePos;
 		while (m_parsePos < line_.size()) {
 			if (line_[m_parsePos] == ' ' || line_[m_parsePos] == '\t') {
-				m_Tokens.emplace_back(line_.c_str() + start, m_parsePos - start);
+				m_Tokens.emplace_back(line_.substr(start, m_parsePos - start), this);
 
 				while (m_parsePos < line_.size() && (line_[m_parsePos] == ' ' || line_[m_parsePos] == '\t')) {
 					++m_parsePos;
@@ -354,7 +372,7 @@ public:
 			++m_parsePos;
 		}
 		if (m_parsePos != start) {
-			m_Tokens.emplace_back(line_.c_str() + start, m_parsePos - start);
+			m_Tokens.emplace_back(line_.substr(start, m_parsePos - start), this);
 		}
 
 		if (m_Tokens.size() > n) {
@@ -376,14 +394,12 @@ public:
 			if (!ref) {
 				return ref;
 			}
-			wchar_t const* p = ref.data() + ref.size() + 1;
-
-			if (static_cast<size_t>(p - line_.c_str()) >= line_.size()) {
+			size_t const offset = ref.data() + ref.size() + 1 - line_.data();
+			if (offset >= line_.size()) {
 				return CToken();
 			}
 
-			auto newLen = line_.size() - (p - line_.c_str());
-			return CToken(p, newLen);
+			return CToken(line_.substr(offset), this);
 		}
 
 		if (m_LineEndTokens.size() > n) {
@@ -406,13 +422,11 @@ public:
 		}
 
 		for (unsigned int i = static_cast<unsigned int>(m_LineEndTokens.size()); i <= n; ++i) {
-			CToken const& refToken = m_Tokens[i];
-			const wchar_t* p = refToken.data();
-			if ((p - line_.c_str()) + trailing_whitespace_ >= line_.size()) {
+			size_t const offset = m_Tokens[i].data() - line_.data();
+			if (offset + trailing_whitespace_ >= line_.size()) {
 				return CToken();
 			}
-			auto newLen = line_.size() - (p - line_.c_str()) - trailing_whitespace_;
-			m_LineEndTokens.emplace_back(p, newLen);
+			m_LineEndTokens.emplace_back(line_.substr(offset, line_.size() - offset - trailing_whitespace_), this);
 		}
 		return m_LineEndTokens[n];
 	}
@@ -430,246 +444,281 @@ public:
 
 	CLine *Concat(CLine const* pLine) const
 	{
-		std::wstring n;
+		std::string n;
 		n.reserve(line_.size() + pLine->line_.size() + 1);
 		n = line_;
 		n += ' ';
 		n += pLine->line_;
-		return new CLine(std::move(n), pLine->trailing_whitespace_);
+		return new CLine(std::move(n), m_pControlSocket, utf8_, pLine->trailing_whitespace_);
 	}
 
 protected:
+	void SkipLeadingWhitespace()
+	{
+		m_parsePos = 0;
+		while (m_parsePos < line_.size() && (line_[m_parsePos] == ' ' || line_[m_parsePos] == '\t')) {
+			++m_parsePos;
+		}
+	}
+
+	CControlSocket* m_pControlSocket;
+	bool const utf8_;
+
 	std::vector<CToken> m_Tokens;
 	std::vector<CToken> m_LineEndTokens;
 	size_t m_parsePos{};
 	size_t trailing_whitespace_;
-	std::wstring const line_;
+
+	// The data of the line if owned, see Detach()
+	std::string storage_;
+	std::string_view line_;
 };
 
+std::wstring CToken::GetString() const
+{
+	if (!line_) {
+		return std::wstring();
+	}
+	return line_->Convert(data_);
+}
+
+namespace {
+std::map<std::wstring, int> make_month_names()
+{
+	std::map<std::wstring, int> names;
+
+	//English month names
+	names[L"jan"] = 1;
+	names[L"feb"] = 2;
+	names[L"mar"] = 3;
+	names[L"apr"] = 4;
+	names[L"may"] = 5;
+	names[L"jun"] = 6;
+	names[L"june"] = 6;
+	names[L"jul"] = 7;
+	names[L"july"] = 7;
+	names[L"aug"] = 8;
+	names[L"sep"] = 9;
+	names[L"sept"] = 9;
+	names[L"oct"] = 10;
+	names[L"nov"] = 11;
+	names[L"dec"] = 12;
+
+	//Numerical values for the month
+	names[L"1"] = 1;
+	names[L"01"] = 1;
+	names[L"2"] = 2;
+	names[L"02"] = 2;
+	names[L"3"] = 3;
+	names[L"03"] = 3;
+	names[L"4"] = 4;
+	names[L"04"] = 4;
+	names[L"5"] = 5;
+	names[L"05"] = 5;
+	names[L"6"] = 6;
+	names[L"06"] = 6;
+	names[L"7"] = 7;
+	names[L"07"] = 7;
+	names[L"8"] = 8;
+	names[L"08"] = 8;
+	names[L"9"] = 9;
+	names[L"09"] = 9;
+	names[L"10"] = 10;
+	names[L"11"] = 11;
+	names[L"12"] = 12;
+
+	//German month names
+	names[L"mrz"] = 3;
+	names[L"m\xe4r"] = 3;
+	names[L"m\xe4rz"] = 3;
+	names[L"mai"] = 5;
+	names[L"juni"] = 6;
+	names[L"juli"] = 7;
+	names[L"okt"] = 10;
+	names[L"dez"] = 12;
+
+	//Austrian month names
+	names[L"j\xe4n"] = 1;
+
+	//French month names
+	names[L"janv"] = 1;
+	names[L"f\xe9" L"b"] = 1;
+	names[L"f\xe9v"] = 2;
+	names[L"fev"] = 2;
+	names[L"f\xe9vr"] = 2;
+	names[L"fevr"] = 2;
+	names[L"mars"] = 3;
+	names[L"mrs"] = 3;
+	names[L"avr"] = 4;
+	names[L"avril"] = 4;
+	names[L"juin"] = 6;
+	names[L"juil"] = 7;
+	names[L"jui"] = 7;
+	names[L"ao\xfb"] = 8;
+	names[L"ao\xfbt"] = 8;
+	names[L"aout"] = 8;
+	names[L"d\xe9" L"c"] = 12;
+	names[L"dec"] = 12;
+
+	//Italian month names
+	names[L"gen"] = 1;
+	names[L"mag"] = 5;
+	names[L"giu"] = 6;
+	names[L"lug"] = 7;
+	names[L"ago"] = 8;
+	names[L"set"] = 9;
+	names[L"ott"] = 10;
+	names[L"dic"] = 12;
+
+	//Spanish month names
+	names[L"ene"] = 1;
+	names[L"fbro"] = 2;
+	names[L"mzo"] = 3;
+	names[L"ab"] = 4;
+	names[L"abr"] = 4;
+	names[L"agto"] = 8;
+	names[L"sbre"] = 9;
+	names[L"obre"] = 9;
+	names[L"nbre"] = 9;
+	names[L"dbre"] = 9;
+
+	//Polish month names
+	names[L"sty"] = 1;
+	names[L"lut"] = 2;
+	names[L"kwi"] = 4;
+	names[L"maj"] = 5;
+	names[L"cze"] = 6;
+	names[L"lip"] = 7;
+	names[L"sie"] = 8;
+	names[L"wrz"] = 9;
+	names[L"pa\x9f"] = 10;
+	names[L"pa\xbc"] = 10; // ISO-8859-2
+	names[L"paz"] = 10; // ASCII
+	names[L"pa\xc5\xba"] = 10; // UTF-8
+	names[L"pa\x017a"] = 10; // some servers send this
+	names[L"lis"] = 11;
+	names[L"gru"] = 12;
+
+	//Russian month names
+	names[L"\xff\xed\xe2"] = 1;
+	names[L"\xf4\xe5\xe2"] = 2;
+	names[L"\xec\xe0\xf0"] = 3;
+	names[L"\xe0\xef\xf0"] = 4;
+	names[L"\xec\xe0\xe9"] = 5;
+	names[L"\xe8\xfe\xed"] = 6;
+	names[L"\xe8\xfe\xeb"] = 7;
+	names[L"\xe0\xe2\xe3"] = 8;
+	names[L"\xf1\xe5\xed"] = 9;
+	names[L"\xee\xea\xf2"] = 10;
+	names[L"\xed\xee\xff"] = 11;
+	names[L"\xe4\xe5\xea"] = 12;
+
+	//Dutch month names
+	names[L"mrt"] = 3;
+	names[L"mei"] = 5;
+
+	//Portuguese month names
+	names[L"out"] = 10;
+
+	//Finnish month names
+	names[L"tammi"] = 1;
+	names[L"helmi"] = 2;
+	names[L"maalis"] = 3;
+	names[L"huhti"] = 4;
+	names[L"touko"] = 5;
+	names[L"kes\xe4"] = 6;
+	names[L"hein\xe4"] = 7;
+	names[L"elo"] = 8;
+	names[L"syys"] = 9;
+	names[L"loka"] = 10;
+	names[L"marras"] = 11;
+	names[L"joulu"] = 12;
+
+	//Slovenian month names
+	names[L"avg"] = 8;
+
+	//Icelandic
+	names[L"ma\x00ed"] = 5;
+	names[L"j\x00fan"] = 6;
+	names[L"j\x00fal"] = 7;
+	names[L"\x00e1g"] = 8;
+	names[L"n\x00f3v"] = 11;
+	names[L"des"] = 12;
+
+	//Lithuanian
+	names[L"sau"] = 1;
+	names[L"vas"] = 2;
+	names[L"kov"] = 3;
+	names[L"bal"] = 4;
+	names[L"geg"] = 5;
+	names[L"bir"] = 6;
+	names[L"lie"] = 7;
+	names[L"rgp"] = 8;
+	names[L"rgs"] = 9;
+	names[L"spa"] = 10;
+	names[L"lap"] = 11;
+	names[L"grd"] = 12;
+
+	// Hungarian
+	names[L"szept"] = 9;
+
+	//There are more languages and thus month
+	//names, but as long as nobody reports a
+	//problem, I won't add them, there are way
+	//too many languages
+
+	// Some servers send a combination of month name and number,
+	// Add corresponding numbers to the month names.
+	std::map<std::wstring, int> combo;
+	for (auto iter = names.begin(); iter != names.end(); ++iter) {
+		// January could be 1 or 0, depends how the server counts
+		combo[fz::sprintf(L"%s%02d", iter->first, iter->second)] = iter->second;
+		combo[fz::sprintf(L"%s%02d", iter->first, iter->second - 1)] = iter->second;
+		if (iter->second < 10) {
+			combo[fz::sprintf(L"%s%d", iter->first, iter->second)] = iter->second;
+		}
+		else {
+			combo[fz::sprintf(L"%s%d", iter->first, iter->second % 10)] = iter->second;
+		}
+		if (iter->second <= 10) {
+			combo[fz::sprintf(L"%s%d", iter->first, iter->second - 1)] = iter->second;
+		}
+		else {
+			combo[fz::sprintf(L"%s%d", iter->first, (iter->second - 1) % 10)] = iter->second;
+		}
+	}
+	names.insert(combo.begin(), combo.end());
+
+	names[L"1"] = 1;
+	names[L"2"] = 2;
+	names[L"3"] = 3;
+	names[L"4"] = 4;
+	names[L"5"] = 5;
+	names[L"6"] = 6;
+	names[L"7"] = 7;
+	names[L"8"] = 8;
+	names[L"9"] = 9;
+	names[L"10"] = 10;
+	names[L"11"] = 11;
+	names[L"12"] = 12;
+
+	return names;
+}
+
+// Shared by all parsers. Built on first use, which is thread-safe even
+// with listings getting parsed on several event loops at once.
+std::map<std::wstring, int> const& month_names()
+{
+	static std::map<std::wstring, int> const names = make_month_names();
+	return names;
+}
+}
+
 CDirectoryListingParser::CDirectoryListingParser(CControlSocket* pControlSocket, const CServer& server, listingEncoding::type encoding)
 	: m_pControlSocket(pControlSocket)
 	, m_server(server)
 	, m_listingEncoding(encoding)
 {
-	if (m_MonthNamesMap.empty()) {
-		//Fill the month names map
-
-		//English month names
-		m_MonthNamesMap[L"jan"] = 1;
-		m_MonthNamesMap[L"feb"] = 2;
-		m_MonthNamesMap[L"mar"] = 3;
-		m_MonthNamesMap[L"apr"] = 4;
-		m_MonthNamesMap[L"may"] = 5;
-		m_MonthNamesMap[L"jun"] = 6;
-		m_MonthNamesMap[L"june"] = 6;
-		m_MonthNamesMap[L"jul"] = 7;
-		m_MonthNamesMap[L"july"] = 7;
-		m_MonthNamesMap[L"aug"] = 8;
-		m_MonthNamesMap[L"sep"] = 9;
-		m_MonthNamesMap[L"sept"] = 9;
-		m_MonthNamesMap[L"oct"] = 10;
-		m_MonthNamesMap[L"nov"] = 11;
-		m_MonthNamesMap[L"dec"] = 12;
-
-		//Numerical values for the month
-		m_MonthNamesMap[L"1"] = 1;
-		m_MonthNamesMap[L"01"] = 1;
-		m_MonthNamesMap[L"2"] = 2;
-		m_MonthNamesMap[L"02"] = 2;
-		m_MonthNamesMap[L"3"] = 3;
-		m_MonthNamesMap[L"03"] = 3;
-		m_MonthNamesMap[L"4"] = 4;
-		m_MonthNamesMap[L"04"] = 4;
-		m_MonthNamesMap[L"5"] = 5;
-		m_MonthNamesMap[L"05"] = 5;
-		m_MonthNamesMap[L"6"] = 6;
-		m_MonthNamesMap[L"06"] = 6;
-		m_MonthNamesMap[L"7"] = 7;
-		m_MonthNamesMap[L"07"] = 7;
-		m_MonthNamesMap[L"8"] = 8;
-		m_MonthNamesMap[L"08"] = 8;
-		m_MonthNamesMap[L"9"] = 9;
-		m_MonthNamesMap[L"09"] = 9;
-		m_MonthNamesMap[L"10"] = 10;
-		m_MonthNamesMap[L"11"] = 11;
-		m_MonthNamesMap[L"12"] = 12;
-
-		//German month names
-		m_MonthNamesMap[L"mrz"] = 3;
-		m_MonthNamesMap[L"m\xe4r"] = 3;
-		m_MonthNamesMap[L"m\xe4rz"] = 3;
-		m_MonthNamesMap[L"mai"] = 5;
-		m_MonthNamesMap[L"juni"] = 6;
-		m_MonthNamesMap[L"juli"] = 7;
-		m_MonthNamesMap[L"okt"] = 10;
-		m_MonthNamesMap[L"dez"] = 12;
-
-		//Austrian month names
-		m_MonthNamesMap[L"j\xe4n"] = 1;
-
-		//French month names
-		m_MonthNamesMap[L"janv"] = 1;
-		m_MonthNamesMap[L"f\xe9" L"b"] = 1;
-		m_MonthNamesMap[L"f\xe9v"] = 2;
-		m_MonthNamesMap[L"fev"] = 2;
-		m_MonthNamesMap[L"f\xe9vr"] = 2;
-		m_MonthNamesMap[L"fevr"] = 2;
-		m_MonthNamesMap[L"mars"] = 3;
-		m_MonthNamesMap[L"mrs"] = 3;
-		m_MonthNamesMap[L"avr"] = 4;
-		m_MonthNamesMap[L"avril"] = 4;
-		m_MonthNamesMap[L"juin"] = 6;
-		m_MonthNamesMap[L"juil"] = 7;
-		m_MonthNamesMap[L"jui"] = 7;
-		m_MonthNamesMap[L"ao\xfb"] = 8;
-		m_MonthNamesMap[L"ao\xfbt"] = 8;
-		m_MonthNamesMap[L"aout"] = 8;
-		m_MonthNamesMap[L"d\xe9" L"c"] = 12;
-		m_MonthNamesMap[L"dec"] = 12;
-
-		//Italian month names
-		m_MonthNamesMap[L"gen"] = 1;
-		m_MonthNamesMap[L"mag"] = 5;
-		m_MonthNamesMap[L"giu"] = 6;
-		m_MonthNamesMap[L"lug"] = 7;
-		m_MonthNamesMap[L"ago"] = 8;
-		m_MonthNamesMap[L"set"] = 9;
-		m_MonthNamesMap[L"ott"] = 10;
-		m_MonthNamesMap[L"dic"] = 12;
-
-		//Spanish month names
-		m_MonthNamesMap[L"ene"] = 1;
-		m_MonthNamesMap[L"fbro"] = 2;
-		m_MonthNamesMap[L"mzo"] = 3;
-		m_MonthNamesMap[L"ab"] = 4;
-		m_MonthNamesMap[L"abr"] = 4;
-		m_MonthNamesMap[L"agto"] = 8;
-		m_MonthNamesMap[L"sbre"] = 9;
-		m_MonthNamesMap[L"obre"] = 9;
-		m_MonthNamesMap[L"nbre"] = 9;
-		m_MonthNamesMap[L"dbre"] = 9;
-
-		//Polish month names
-		m_MonthNamesMap[L"sty"] = 1;
-		m_MonthNamesMap[L"lut"] = 2;
-		m_MonthNamesMap[L"kwi"] = 4;
-		m_MonthNamesMap[L"maj"] = 5;
-		m_MonthNamesMap[L"cze"] = 6;
-		m_MonthNamesMap[L"lip"] = 7;
-		m_MonthNamesMap[L"sie"] = 8;
-		m_MonthNamesMap[L"wrz"] = 9;
-		m_MonthNamesMap[L"pa\x9f"] = 10;
-		m_MonthNamesMap[L"pa\xbc"] = 10; // ISO-8859-2
-		m_MonthNamesMap[L"paz"] = 10; // ASCII
-		m_MonthNamesMap[L"pa\xc5\xba"] = 10; // UTF-8
-		m_MonthNamesMap[L"pa\x017a"] = 10; // some servers send this
-		m_MonthNamesMap[L"lis"] = 11;
-		m_MonthNamesMap[L"gru"] = 12;
-
-		//Russian month names
-		m_MonthNamesMap[L"\xff\xed\xe2"] = 1;
-		m_MonthNamesMap[L"\xf4\xe5\xe2"] = 2;
-		m_MonthNamesMap[L"\xec\xe0\xf0"] = 3;
-		m_MonthNamesMap[L"\xe0\xef\xf0"] = 4;
-		m_MonthNamesMap[L"\xec\xe0\xe9"] = 5;
-		m_MonthNamesMap[L"\xe8\xfe\xed"] = 6;
-		m_MonthNamesMap[L"\xe8\xfe\xeb"] = 7;
-		m_MonthNamesMap[L"\xe0\xe2\xe3"] = 8;
-		m_MonthNamesMap[L"\xf1\xe5\xed"] = 9;
-		m_MonthNamesMap[L"\xee\xea\xf2"] = 10;
-		m_MonthNamesMap[L"\xed\xee\xff"] = 11;
-		m_MonthNamesMap[L"\xe4\xe5\xea"] = 12;
-
-		//Dutch month names
-		m_MonthNamesMap[L"mrt"] = 3;
-		m_MonthNamesMap[L"mei"] = 5;
-
-		//Portuguese month names
-		m_MonthNamesMap[L"out"] = 10;
-
-		//Finnish month names
-		m_MonthNamesMap[L"tammi"] = 1;
-		m_MonthNamesMap[L"helmi"] = 2;
-		m_MonthNamesMap[L"maalis"] = 3;
-		m_MonthNamesMap[L"huhti"] = 4;
-		m_MonthNamesMap[L"touko"] = 5;
-		m_MonthNamesMap[L"kes\xe4"] = 6;
-		m_MonthNamesMap[L"hein\xe4"] = 7;
-		m_MonthNamesMap[L"elo"] = 8;
-		m_MonthNamesMap[L"syys"] = 9;
-		m_MonthNamesMap[L"loka"] = 10;
-		m_MonthNamesMap[L"marras"] = 11;
-		m_MonthNamesMap[L"joulu"] = 12;
-
-		//Slovenian month names
-		m_MonthNamesMap[L"avg"] = 8;
-
-		//Icelandic
-		m_MonthNamesMap[L"ma\x00ed"] = 5;
-		m_MonthNamesMap[L"j\x00fan"] = 6;
-		m_MonthNamesMap[L"j\x00fal"] = 7;
-		m_MonthNamesMap[L"\x00e1g"] = 8;
-		m_MonthNamesMap[L"n\x00f3v"] = 11;
-		m_MonthNamesMap[L"des"] = 12;
-
-		//Lithuanian
-		m_MonthNamesMap[L"sau"] = 1;
-		m_MonthNamesMap[L"vas"] = 2;
-		m_MonthNamesMap[L"kov"] = 3;
-		m_MonthNamesMap[L"bal"] = 4;
-		m_MonthNamesMap[L"geg"] = 5;
-		m_MonthNamesMap[L"bir"] = 6;
-		m_MonthNamesMap[L"lie"] = 7;
-		m_MonthNamesMap[L"rgp"] = 8;
-		m_MonthNamesMap[L"rgs"] = 9;
-		m_MonthNamesMap[L"spa"] = 10;
-		m_MonthNamesMap[L"lap"] = 11;
-		m_MonthNamesMap[L"grd"] = 12;
-
-		// Hungarian
-		m_MonthNamesMap[L"szept"] = 9;
-
-		//There are more languages and thus month
-		//names, but as long as nobody reports a
-		//problem, I won't add them, there are way
-		//too many languages
-
-		// Some servers send a combination of month name and number,
-		// Add corresponding numbers to the month names.
-		std::map<std::wstring, int> combo;
-		for (auto iter = m_MonthNamesMap.begin(); iter != m_MonthNamesMap.end(); ++iter) {
-			// January could be 1 or 0, depends how the server counts
-			combo[fz::sprintf(L"%s%02d", iter->first, iter->second)] = iter->second;
-			combo[fz::sprintf(L"%s%02d", iter->first, iter->second - 1)] = iter->second;
-			if (iter->second < 10) {
-				combo[fz::sprintf(L"%s%d", iter->first, iter->second)] = iter->second;
-			}
-			else {
-				combo[fz::sprintf(L"%s%d", iter->first, iter->second % 10)] = iter->second;
-			}
-			if (iter->second <= 10) {
-				combo[fz::sprintf(L"%s%d", iter->first, iter->second - 1)] = iter->second;
-			}
-			else {
-				combo[fz::sprintf(L"%s%d", iter->first, (iter->second - 1) % 10)] = iter->second;
-			}
-		}
-		m_MonthNamesMap.insert(combo.begin(), combo.end());
-
-		m_MonthNamesMap[L"1"] = 1;
-		m_MonthNamesMap[L"2"] = 2;
-		m_MonthNamesMap[L"3"] = 3;
-		m_MonthNamesMap[L"4"] = 4;
-		m_MonthNamesMap[L"5"] = 5;
-		m_MonthNamesMap[L"6"] = 6;
-		m_MonthNamesMap[L"7"] = 7;
-		m_MonthNamesMap[L"8"] = 8;
-		m_MonthNamesMap[L"9"] = 9;
-		m_MonthNamesMap[L"10"] = 10;
-		m_MonthNamesMap[L"11"] = 11;
-		m_MonthNamesMap[L"12"] = 12;
-	}
-
 #ifdef LISTDEBUG
 	for (unsigned int i = 0; data[i][0]; ++i) {
 		unsigned int len = (unsigned int)strlen(data[i]);
@@ -711,10 +760,12 @@ bool CDirectoryListingParser::ParseData(bool partial)
 				}
 				else {
 					m_prevLine = pLine;
+					m_prevLine->Detach();
 				}
 			}
 			else {
 				m_prevLine = pLine;
+				m_prevLine->Detach();
 			}
 		}
 		else {
@@ -754,9 +805,101 @@ CDirectoryListing CDirectoryListingParser::Parse(const CServerPath &path)
 
 	listing.Assign(std::move(entries_));
 
+	if (m_pControlSocket) {
+		internedStrings_.flush_stats();
+		auto const stats = CStringPool::instance().get_stats();
+		m_pControlSocket->log(logmsg::debug_debug, L"Interned strings: %u distinct values using %u bytes, %u bytes saved so far", stats.distinct, stats.bytes, stats.saved);
+	}
+
 	return listing;
 }
 
+namespace {
+// The heuristic formats, in the order they get tried if there is no
+// format hint or if the hint does not match.
+listingFormat::type const formatCascade[] = {
+	listingFormat::ls,
+	listingFormat::dos,
+	listingFormat::eplf,
+	listingFormat::vms,
+	listingFormat::other,
+	listingFormat::ibm,
+	listingFormat::wfftp,
+	listingFormat::mvs,
+	listingFormat::mvs_pds,
+	listingFormat::os9,
+	listingFormat::mvs_migrated,
+	listingFormat::mvs_pds2,
+	listingFormat::mvs_tape,
+	listingFormat::ls_nodate
+};
+}
+
+int CDirectoryListingParser::ParseAs(listingFormat::type format, CLine &line, CDirentry &entry, ServerType const serverType)
+{
+	switch (format) {
+	case listingFormat::ls:
+		return ParseAsUnix(line, entry, true) ? 1 : 0; // Common 'ls -l'
+	case listingFormat::dos:
+		return ParseAsDos(line, entry) ? 1 : 0;
+	case listingFormat::eplf:
+		return ParseAsEplf(line, entry) ? 1 : 0;
+	case listingFormat::vms:
+		return ParseAsVms(line, entry) ? 1 : 0;
+	case listingFormat::other:
+		return ParseOther(line, entry) ? 1 : 0;
+	case listingFormat::ibm:
+		return ParseAsIbm(line, entry) ? 1 : 0;
+	case listingFormat::wfftp:
+		return ParseAsWfFtp(line, entry) ? 1 : 0;
+	case listingFormat::mvs:
+		return ParseAsIBM_MVS(line, entry) ? 1 : 0;
+	case listingFormat::mvs_pds:
+		return ParseAsIBM_MVS_PDS(line, entry) ? 1 : 0;
+	case listingFormat::os9:
+		return ParseAsOS9(line, entry) ? 1 : 0;
+	case listingFormat::mvs_migrated:
+	case listingFormat::mvs_pds2:
+	case listingFormat::mvs_tape:
+#ifndef LISTDEBUG_MVS
+		if (serverType != MVS) {
+			return 0;
+		}
+#endif //LISTDEBUG_MVS
+		if (format == listingFormat::mvs_migrated) {
+			return ParseAsIBM_MVS_Migrated(line, entry) ? 1 : 0;
+		}
+		else if (format == listingFormat::mvs_pds2) {
+			return ParseAsIBM_MVS_PDS2(line, entry) ? 1 : 0;
+		}
+		return ParseAsIBM_MVS_Tape(line, entry) ? 1 : 0;
+	case listingFormat::ls_nodate:
+		return ParseAsUnix(line, entry, false) ? 1 : 0; // 'ls -l' but without the date/time
+	default:
+		return 0;
+	}
+}
+
+bool CDirectoryListingParser::IsHintableFormat(listingFormat::type format)
+{
+	// The remaining formats are far less picky, e.g. a regular 'ls -l' line
+	// also parses as ls_nodate, just with the date ending up in the name.
+	switch (format) {
+	case listingFormat::ls:
+	case listingFormat::dos:
+	case listingFormat::eplf:
+	case listingFormat::vms:
+		return true;
+	default:
+		return false;
+	}
+}
+
+void CDirectoryListingParser::SetFormatHint(listingFormat::type format)
+{
+	m_formatHint = IsHintableFormat(format) ? format : listingFormat::unknown;
+}
+
 bool CDirectoryListingParser::ParseLine(CLine &line, ServerType const serverType, bool concatenated, CDirentry const* override)
 {
 	fz::shared_value<CDirentry> refEntry;
@@ -785,67 +928,34 @@ bool CDirectoryListingParser::ParseLine(CLine &line, ServerType const serverType
 	else if (ires == 2) {
 		goto skip;
 	}
-	res = ParseAsUnix(line, entry, true); // Common 'ls -l'
-	if (res) {
-		goto done;
-	}
-	res = ParseAsDos(line, entry);
-	if (res) {
-		goto done;
-	}
-	res = ParseAsEplf(line, entry);
-	if (res) {
-		goto done;
-	}
-	res = ParseAsVms(line, entry);
-	if (res) {
-		goto done;
-	}
-	res = ParseOther(line, entry);
-	if (res) {
-		goto done;
-	}
-	res = ParseAsIbm(line, entry);
-	if (res) {
-		goto done;
-	}
-	res = ParseAsWfFtp(line, entry);
-	if (res) {
-		goto done;
-	}
-	res = ParseAsIBM_MVS(line, entry);
-	if (res) {
-		goto done;
-	}
-	res = ParseAsIBM_MVS_PDS(line, entry);
-	if (res) {
-		goto done;
-	}
-	res = ParseAsOS9(line, entry);
-	if (res) {
-		goto done;
-	}
-#ifndef LISTDEBUG_MVS
-	if (serverType == MVS)
-#endif //LISTDEBUG_MVS
-	{
-		res = ParseAsIBM_MVS_Migrated(line, entry);
-		if (res) {
+
+	// Servers almost always use a single format for all lines, so try the
+	// one which matched before first. Only fall back to the full cascade if
+	// it does not match.
+	if (m_formatHint != listingFormat::unknown) {
+		if (ParseAs(m_formatHint, line, entry, serverType)) {
+			if (m_detectedFormat == listingFormat::unknown) {
+				m_detectedFormat = m_formatHint;
+			}
 			goto done;
 		}
-		res = ParseAsIBM_MVS_PDS2(line, entry);
-		if (res) {
-			goto done;
+
+		// Start over with a clean entry, a failed attempt may have left partial data behind.
+		entry = CDirentry();
+	}
+
+	for (auto const format : formatCascade) {
+		if (format == m_formatHint) {
+			continue;
 		}
-		res = ParseAsIBM_MVS_Tape(line, entry);
-		if (res) {
+		if (ParseAs(format, line, entry, serverType)) {
+			if (m_detectedFormat == listingFormat::unknown) {
+				m_detectedFormat = format;
+				SetFormatHint(format);
+			}
 			goto done;
 		}
 	}
-	res = ParseAsUnix(line, entry, false); // 'ls -l' but without the date/time
-	if (res) {
-		goto done;
-	}
 
 	// Some servers just send a list of filenames. If a line could not be parsed,
 	// check if it's a filename. If that's the case, store it for later, else clear
@@ -927,7 +1037,7 @@ bool CDirectoryListingParser::ParseAsUnix(CLine &line, CDirentry &entry, bool ex
 		return false;
 	}
 
-	wchar_t chr = permissionToken[0];
+	char chr = permissionToken[0];
 	if (chr != 'b' &&
 		chr != 'c' &&
 		chr != 'd' &&
@@ -939,7 +1049,7 @@ bool CDirectoryListingParser::ParseAsUnix(CLine &line, CDirentry &entry, bool ex
 		return false;
 	}
 
-	std::wstring permissions = permissionToken.GetString();
+	std::string permissions(permissionToken.get_view());
 
 	entry.flags = 0;
 
@@ -958,7 +1068,8 @@ bool CDirectoryListingParser::ParseAsUnix(CLine &line, CDirentry &entry, bool ex
 		if (!cont_perm) {
 			return false;
 		}
-		permissions += L" " + cont_perm.GetString();
+		permissions += ' ';
+		permissions += cont_perm.get_view();
 		netware = true;
 	}
 
@@ -981,16 +1092,16 @@ bool CDirectoryListingParser::ParseAsUnix(CLine &line, CDirentry &entry, bool ex
 		// Reset index
 		index = startindex;
 
-		std::wstring ownerGroup;
+		std::string ownerGroup;
 		for (int i = 0; i < numOwnerGroup; ++i) {
 			CToken ownerGroupToken = line.GetToken(++index);
 			if (!ownerGroupToken) {
 				return false;
 			}
 			if (i) {
-				ownerGroup += L" ";
+				ownerGroup += ' ';
 			}
-			ownerGroup += ownerGroupToken.GetString();
+			ownerGroup += ownerGroupToken.get_view();
 		}
 
 
@@ -1008,10 +1119,10 @@ bool CDirectoryListingParser::ParseAsUnix(CLine &line, CDirentry &entry, bool ex
 
 			// Append missing group to ownerGroup
 			if (!ownerGroup.empty()) {
-				ownerGroup += L" ";
+				ownerGroup += ' ';
 			}
 
-			std::wstring const group = sizeToken.GetString();
+			std::string_view const group = sizeToken.get_view();
 			int i;
 			for (i = group.size() - 1;
 				 i >= 0 && group[i] >= '0' && group[i] <= '9';
@@ -1034,29 +1145,28 @@ bool CDirectoryListingParser::ParseAsUnix(CLine &line, CDirentry &entry, bool ex
 			continue;
 		}
 
-		entry.name = nameToken.GetString();
-
 		// Filter out special chars at the end of the filenames
 		chr = nameToken[nameToken.size() - 1];
 		if (chr == '/' ||
 			chr == '|' ||
 			chr == '*')
 		{
-			entry.name.pop_back();
+			nameToken = nameToken.substr(0, nameToken.size() - 1);
 		}
 
-		if (entry.is_link()) {
-			size_t pos;
-			if ((pos = entry.name.find(L" -> ")) != std::wstring::npos) {
-				entry.target = fz::sparse_optional<std::wstring>(entry.name.substr(pos + 4));
-				entry.name = entry.name.substr(0, pos);
-			}
+		size_t pos;
+		if (entry.is_link() && (pos = nameToken.get_view().find(" -> ")) != std::string_view::npos) {
+			entry.target = fz::sparse_optional<std::wstring>(nameToken.substr(pos + 4).GetString());
+			entry.name = nameToken.substr(0, pos).GetString();
+		}
+		else {
+			entry.name = nameToken.GetString();
 		}
 
 		entry.time += m_timezoneOffset;
 
-		entry.permissions = objcache.get(permissions);
-		entry.ownerGroup = objcache.get(ownerGroup);
+		entry.permissions = internedStrings_.get(line.Convert(permissions));
+		entry.ownerGroup = internedStrings_.get(line.Convert(ownerGroup));
 		return true;
 	}
 	while (numOwnerGroup--);
@@ -1086,9 +1196,9 @@ bool CDirectoryListingParser::ParseUnixDateTime(CLine & line, int &index, CDiren
 	// Some servers use the following date formats:
 	// 26-05 2002, 2002-10-14, 01-jun-99 or 2004.07.15
 	// slashes instead of dashes are also possible
-	int pos = token.Find(L"-/.");
+	int pos = token.Find("-/.");
 	if (pos != -1) {
-		int pos2 = token.Find(L"-/.", pos + 1);
+		int pos2 = token.Find("-/.", pos + 1);
 		if (pos2 == -1) {
 			if (token[pos] != '.') {
 				// something like 26-05 2002
@@ -1096,7 +1206,7 @@ bool CDirectoryListingParser::ParseUnixDateTime(CLine & line, int &index, CDiren
 				if (day < 1 || day > 31) {
 					return false;
 				}
-				dateMonth = CToken(token.data(), pos);
+				dateMonth = token.substr(0, pos);
 			}
 			else {
 				dateMonth = token;
@@ -1138,7 +1248,7 @@ bool CDirectoryListingParser::ParseUnixDateTime(CLine & line, int &index, CDiren
 		}
 	}
 	else {
-		if (token.IsLeftNumeric() && (unsigned int)token[token.size() - 1] > 127 &&
+		if (token.IsLeftNumeric() && static_cast<unsigned char>(token[token.size() - 1]) > 127 &&
 			token.GetNumber() > 1000)
 		{
 			if (token.GetNumber() > 10000) {
@@ -1171,7 +1281,7 @@ bool CDirectoryListingParser::ParseUnixDateTime(CLine & line, int &index, CDiren
 		// Check for non-numeric day
 		if (!dayToken.IsNumeric() && !dayToken.IsLeftNumeric()) {
 			int offset = 0;
-			if (dateMonth.GetString().back() == '.') {
+			if (dateMonth && dateMonth[dateMonth.size() - 1] == '.') {
 				++offset;
 			}
 			if (!dateMonth.IsNumeric(0, dateMonth.size() - offset)) {
@@ -1225,14 +1335,14 @@ bool CDirectoryListingParser::ParseUnixDateTime(CLine & line, int &index, CDiren
 		return false;
 	}
 
-	pos = timeOrYearToken.Find(L":.-");
+	pos = timeOrYearToken.Find(":.-");
 	if (pos != -1 && mayHaveTime) {
 		// token is a time
 		if (!pos || static_cast<size_t>(pos) == (timeOrYearToken.size() - 1)) {
 			return false;
 		}
 
-		std::wstring str = timeOrYearToken.GetString();
+		std::string_view const str = timeOrYearToken.get_view();
 		hour = fz::to_integral<int>(str.substr(0, pos), -1);
 		minute = fz::to_integral<int>(str.substr(pos + 1), -1);
 
@@ -1295,7 +1405,7 @@ bool CDirectoryListingParser::ParseUnixDateTime(CLine & line, int &index, CDiren
 					return false;
 				}
 
-				std::wstring str = timeToken.GetString();
+				std::string_view const str = timeToken.get_view();
 
 				hour = fz::to_integral<int>(str.substr(0, pos), -1);
 				minute = fz::to_integral<int>(str.substr(pos + 1), -1);
@@ -1341,7 +1451,7 @@ bool CDirectoryListingParser::ParseShortDate(CToken &token, CDirentry &entry, bo
 	int month = 0;
 	int day = 0;
 
-	int pos = token.Find(L"-./");
+	int pos = token.Find("-./");
 	if (pos < 1) {
 		return false;
 	}
@@ -1350,7 +1460,7 @@ bool CDirectoryListingParser::ParseShortDate(CToken &token, CDirentry &entry, bo
 		// Seems to be monthname-dd-yy
 
 		// Check month name
-		std::wstring const dateMonth = token.GetString().substr(0, pos);
+		std::wstring const dateMonth = token.substr(0, pos).GetString();
 		if (!GetMonthFromName(dateMonth, month)) {
 			return false;
 		}
@@ -1411,7 +1521,7 @@ bool CDirectoryListingParser::ParseShortDate(CToken &token, CDirentry &entry, bo
 		return false;
 	}
 
-	int pos2 = token.Find(L"-./", pos + 1);
+	int pos2 = token.Find("-./", pos + 1);
 	if (pos2 == -1 || (pos2 - pos) == 1) {
 		return false;
 	}
@@ -1438,7 +1548,7 @@ bool CDirectoryListingParser::ParseShortDate(CToken &token, CDirentry &entry, bo
 	if (gotYear || gotDay) {
 		// Month field in yyyy-mm-dd or dd-mm-yyyy
 		// Check month name
-		std::wstring dateMonth = token.GetString().substr(pos + 1, pos2 - pos - 1);
+		std::wstring dateMonth = token.substr(pos + 1, pos2 - pos - 1).GetString();
 		if (!GetMonthFromName(dateMonth, month)) {
 			return false;
 		}
@@ -1520,7 +1630,7 @@ bool CDirectoryListingParser::ParseAsDos(CLine &line, CDirentry &entry)
 	if (!line.GetToken(++index, token))
 		return false;
 
-	if (token.GetString() == L"<DIR>") {
+	if (token.get_view() == "<DIR>") {
 		entry.flags |= CDirentry::flag_dir;
 		entry.size = -1;
 	}
@@ -1553,7 +1663,7 @@ bool CDirectoryListingParser::ParseAsDos(CLine &line, CDirentry &entry)
 	entry.name = token.GetString();
 
 	entry.target.clear();
-	entry.ownerGroup = objcache.get(std::wstring());
+	entry.ownerGroup = internedStrings_.get(std::wstring());
 	entry.permissions = entry.ownerGroup;
 	entry.time += m_timezoneOffset;
 
@@ -1623,12 +1733,10 @@ bool CDirectoryListingParser::ParseAsEplf(CLine &line, CDirentry &entry)
 	if (pos == -1 || static_cast<size_t>(pos) == (token.size() - 1))
 		return false;
 
-	entry.name = token.GetString().substr(pos + 1);
-
 	entry.flags = 0;
 	entry.size = -1;
 
-	std::wstring permissions;
+	std::string_view permissions;
 
 	int fact = 1;
 	while (fact < pos) {
@@ -1662,23 +1770,24 @@ bool CDirectoryListingParser::ParseAsEplf(CLine &line, CDirentry &entry)
 			entry.time = fz::datetime(static_cast<time_t>(number), fz::datetime::seconds);
 		}
 		else if (type == 'u' && len > 2 && token[fact + 1] == 'p') {
-			permissions = token.GetString().substr(fact + 2, len - 2);
+			permissions = token.get_view().substr(fact + 2, len - 2);
 		}
 
 		fact += len + 1;
 	}
 
-	entry.permissions = objcache.get(permissions);
-	entry.ownerGroup = objcache.get(std::wstring());
+	entry.name = token.substr(pos + 1).GetString();
+	entry.permissions = internedStrings_.get(line.Convert(permissions));
+	entry.ownerGroup = internedStrings_.get(std::wstring());
 	return true;
 }
 
 namespace {
-std::wstring Unescape(const std::wstring& str, wchar_t escape)
+std::string Unescape(std::string_view const& str, char escape)
 {
-	std::wstring res;
-	for (unsigned int i = 0; i < str.size(); ++i) {
-		wchar_t c = str[i];
+	std::string res;
+	for (size_t i = 0; i < str.size(); ++i) {
+		char c = str[i];
 		if (c == escape) {
 			++i;
 			if (i == str.size() || !str[i]) {
@@ -1707,24 +1816,22 @@ bool CDirectoryListingParser::ParseAsVms(CLine &line, CDirentry &entry)
 
 	entry.flags = 0;
 
-	if (pos > 4 && token.GetString().substr(pos - 4, 4) == L".DIR") {
+	std::string name;
+	std::string_view const view = token.get_view();
+	if (pos > 4 && view.substr(pos - 4, 4) == ".DIR") {
 		entry.flags |= CDirentry::flag_dir;
-		if (token.GetString().substr(pos) == L";1")
-			entry.name = token.GetString().substr(0, pos - 4);
-		else
-			entry.name = token.GetString().substr(0, pos - 4) + token.GetString().substr(pos);
+		name = view.substr(0, pos - 4);
+		if (view.substr(pos) != ";1")
+			name += view.substr(pos);
 	}
 	else
-		entry.name = token.GetString();
-
-	// Some VMS servers escape special characters like additional dots with ^
-	entry.name = Unescape(entry.name, '^');
+		name = view;
 
 	if (!line.GetToken(++index, token))
 		return false;
 
-	std::wstring ownerGroup;
-	std::wstring permissions;
+	std::string ownerGroup;
+	std::string permissions;
 
 	// This field can either be the filesize, a username (at least that's what I think) enclosed in [] or a date.
 	if (!token.IsNumeric() && !token.IsLeftNumeric()) {
@@ -1732,7 +1839,7 @@ bool CDirectoryListingParser::ParseAsVms(CLine &line, CDirentry &entry)
 		const int len = token.size();
 		if (len < 3 || token[0] != '[' || token[len - 1] != ']')
 			return false;
-		ownerGroup = token.GetString().substr(1, len - 2);
+		ownerGroup = token.get_view().substr(1, len - 2);
 
 		if (!line.GetToken(++index, token))
 			return false;
@@ -1753,7 +1860,7 @@ bool CDirectoryListingParser::ParseAsVms(CLine &line, CDirentry &entry)
 		if (pos == -1)
 			sizeToken = token;
 		else
-			sizeToken = CToken(token.data(), pos);
+			sizeToken = token.substr(0, pos);
 		if (!ParseComplexFileSize(sizeToken, entry.size, 512))
 			return false;
 		gotSize = true;
@@ -1808,7 +1915,7 @@ bool CDirectoryListingParser::ParseAsVms(CLine &line, CDirentry &entry)
 		if (pos == -1)
 			sizeToken = token;
 		else
-			sizeToken = CToken(token.data(), pos);
+			sizeToken = token.substr(0, pos);
 		if (!ParseComplexFileSize(sizeToken, entry.size, 512))
 			return false;
 	}
@@ -1818,22 +1925,25 @@ bool CDirectoryListingParser::ParseAsVms(CLine &line, CDirentry &entry)
 		const int len = token.size();
 		if (len > 2 && token[0] == '(' && token[len - 1] == ')') {
 			if (!permissions.empty())
-				permissions += L" ";
-			permissions += token.GetString().substr(1, len - 2);
+				permissions += ' ';
+			permissions += token.get_view().substr(1, len - 2);
 		}
 		else if (len > 2 && token[0] == '[' && token[len - 1] == ']') {
 			if (!ownerGroup.empty())
-				ownerGroup += L" ";
-			ownerGroup += token.GetString().substr(1, len - 2);
+				ownerGroup += ' ';
+			ownerGroup += token.get_view().substr(1, len - 2);
 		}
 		else {
 			if (!ownerGroup.empty())
-				ownerGroup += L" ";
-			ownerGroup += token.GetString();
+				ownerGroup += ' ';
+			ownerGroup += token.get_view();
 		}
 	}
-	entry.permissions = objcache.get(permissions);
-	entry.ownerGroup = objcache.get(ownerGroup);
+
+	// Some VMS servers escape special characters like additional dots with ^
+	entry.name = line.Convert(Unescape(name, '^'));
+	entry.permissions = internedStrings_.get(line.Convert(permissions));
+	entry.ownerGroup = internedStrings_.get(line.Convert(ownerGroup));
 
 	entry.time += m_timezoneOffset;
 
@@ -1879,14 +1989,14 @@ bool CDirectoryListingParser::ParseAsIbm(CLine &line, CDirentry &entry)
 	if (!line.GetToken(index + 2, token, 1))
 		return false;
 
-	entry.name = token.GetString();
 	if (token[token.size() - 1] == '/') {
-		entry.name.pop_back();
+		token = token.substr(0, token.size() - 1);
 		entry.flags |= CDirentry::flag_dir;
 	}
+	entry.name = token.GetString();
 
-	entry.ownerGroup = objcache.get(ownerGroupToken.GetString());
-	entry.permissions = objcache.get(std::wstring());
+	entry.ownerGroup = internedStrings_.get(ownerGroupToken.GetString());
+	entry.permissions = internedStrings_.get(std::wstring());
 
 	entry.time += m_timezoneOffset;
 
@@ -1922,13 +2032,14 @@ bool CDirectoryListingParser::ParseOther(CLine &line, CDirentry &entry)
 			entry.flags |= CDirentry::flag_dir;
 		}
 
-		std::wstring ownerGroup = token.GetString();
+		std::string ownerGroup(token.get_view());
 
 		if (!line.GetToken(++index, token)) {
 			return false;
 		}
 
-		ownerGroup += L" " + token.GetString();
+		ownerGroup += ' ';
+		ownerGroup += token.get_view();
 
 		// Get size
 		if (!line.GetToken(++index, token)) {
@@ -1960,8 +2071,8 @@ bool CDirectoryListingParser::ParseOther(CLine &line, CDirentry &entry)
 		entry.name = token.GetString();
 		entry.target.clear();
 
-		entry.permissions = objcache.get(firstToken.GetString());
-		entry.ownerGroup = objcache.get(ownerGroup);
+		entry.permissions = internedStrings_.get(firstToken.GetString());
+		entry.ownerGroup = internedStrings_.get(line.Convert(ownerGroup));
 	}
 	else {
 		// Possible conflict with multiline VMS listings
@@ -1979,10 +2090,10 @@ bool CDirectoryListingParser::ParseOther(CLine &line, CDirentry &entry)
 			// OS/2 or nortel.VxWorks
 			int skippedCount = 0;
 			do {
-				if (token.GetString() == L"DIR") {
+				if (token.get_view() == "DIR") {
 					entry.flags |= CDirentry::flag_dir;
 				}
-				else if (token.Find(L"-/.") != -1) {
+				else if (token.Find("-/.") != -1) {
 					break;
 				}
 
@@ -2011,17 +2122,18 @@ bool CDirectoryListingParser::ParseOther(CLine &line, CDirentry &entry)
 				return false;
 			}
 
-			entry.name = token.GetString();
-			if (entry.name.size() >= 5) {
-				std::wstring type = fz::str_tolower_ascii(entry.name.substr(entry.name.size() - 5));
-				if (!skippedCount && type == L"<dir>") {
+			std::string_view name = token.get_view();
+			if (name.size() >= 5) {
+				std::string const type = fz::str_tolower_ascii(name.substr(name.size() - 5));
+				if (!skippedCount && type == "<dir>") {
 					entry.flags |= CDirentry::flag_dir;
-					entry.name = entry.name.substr(0, entry.name.size() - 5);
-					while (!entry.name.empty() && entry.name.back() == ' ') {
-						entry.name.pop_back();
+					name = name.substr(0, name.size() - 5);
+					while (!name.empty() && name.back() == ' ') {
+						name.remove_suffix(1);
 					}
 				}
 			}
+			entry.name = line.Convert(name);
 		}
 		else {
 			// Get day
@@ -2073,15 +2185,15 @@ bool CDirectoryListingParser::ParseOther(CLine &line, CDirentry &entry)
 				return false;
 			}
 
-			entry.name = token.GetString();
 			auto const chr = token[token.size() - 1];
 			if (chr == '/' || chr == '\\') {
 				entry.flags |= CDirentry::flag_dir;
-				entry.name.pop_back();
+				token = token.substr(0, token.size() - 1);
 			}
+			entry.name = token.GetString();
 		}
 		entry.target.clear();
-		entry.ownerGroup = objcache.get(std::wstring());
+		entry.ownerGroup = internedStrings_.get(std::wstring());
 		entry.permissions = entry.ownerGroup;
 		entry.time += m_timezoneOffset;
 	}
@@ -2100,7 +2212,12 @@ bool CDirectoryListingParser::AddData(char *pData, int len)
 		return true;
 	}
 
-	return ParseData(true);
+	if (!ParseData(true)) {
+		return false;
+	}
+
+	SendPartialListing();
+	return true;
 }
 
 bool CDirectoryListingParser::AddLine(std::wstring && line, std::wstring && name, fz::datetime const& time)
@@ -2112,12 +2229,57 @@ bool CDirectoryListingParser::AddLine(std::wstring && line, std::wstring && name
 	CDirentry override;
 	override.name = std::move(name);
 	override.time = time;
-	CLine l(std::move(line));
+	CLine l(fz::to_utf8(line), m_pControlSocket, true);
 	ParseLine(l, m_server.GetType(), true, &override);
 
+	SendPartialListing();
+
 	return true;
 }
 
+void CDirectoryListingParser::EnablePartialListings(CServerPath const& path)
+{
+	partialPath_ = path;
+	reportedEntries_ = 0;
+	lastPartial_ = fz::monotonic_clock::now();
+}
+
+void CDirectoryListingParser::SendPartialListing()
+{
+	if (!m_pControlSocket || partialPath_.empty() || entries_.size() <= reportedEntries_) {
+		return;
+	}
+
+	// Each batch has to be processed by the UI, don't flood it. This also
+	// keeps small listings from being displayed twice.
+	auto const now = fz::monotonic_clock::now();
+	if (now - lastPartial_ < fz::duration::from_milliseconds(500)) {
+		return;
+	}
+	lastPartial_ = now;
+
+	std::vector<fz::shared_value<CDirentry>> entries(entries_.begin() + reportedEntries_, entries_.end());
+	bool const first = !reportedEntries_;
+	reportedEntries_ = entries_.size();
+
+	m_pControlSocket->SendPartialListingNotification(partialPath_, std::move(entries), first);
+}
+
+namespace {
+// Returns the offset of the first line terminator at or after offset,
+// or len if the chunk does not contain one.
+int find_line_end(char const* p, int offset, int len)
+{
+	for (int i = offset; i < len; ++i) {
+		char const c = p[i];
+		if (c == '\n' || c == '\r' || !c) {
+			return i;
+		}
+	}
+	return len;
+}
+}
+
 CLine *CDirectoryListingParser::GetLine(bool breakAtEnd, bool &error)
 {
 	while (!m_DataList.empty()) {
@@ -2143,109 +2305,71 @@ CLine *CDirectoryListingParser::GetLine(bool breakAtEnd, bool &error)
 		m_DataList.erase(m_DataList.begin(), iter);
 		iter = m_DataList.begin();
 
-		// Remember start offset and find next linebreak
-		int startpos = m_currentOffset;
-		int reslen = 0;
+		// The raw line, including any terminating whitespace.
+		std::string_view raw;
 
-		int currentOffset = m_currentOffset;
-		while (iter->p[currentOffset] != '\n' && iter->p[currentOffset] != '\r' && iter->p[currentOffset]) {
-			++reslen;
-
-			++currentOffset;
-			if (currentOffset >= len) {
-				++iter;
-				if (iter == m_DataList.end()) {
-					if (reslen > 10000) {
-						if (m_pControlSocket) {
-							m_pControlSocket->log(logmsg::error, _("Received a line exceeding 10000 characters, aborting."));
-						}
-						error = true;
-						return nullptr;
-					}
-					if (breakAtEnd) {
-						return nullptr;
-					}
+		int lineEnd = find_line_end(iter->p, m_currentOffset, len);
+		if (lineEnd < len) {
+			// Common case: The line is contained in a single chunk, refer to
+			// it in place. The chunk stays alive as it still contains the
+			// line terminator.
+			raw = std::string_view(iter->p + m_currentOffset, lineEnd - m_currentOffset);
+			m_currentOffset = lineEnd;
+		}
+		else {
+			// Line spans multiple chunks, assemble it in the reusable buffer.
+			lineBuffer_.assign(iter->p + m_currentOffset, len - m_currentOffset);
+
+			auto next = iter;
+			for (++next; next != m_DataList.end(); ++next) {
+				lineEnd = find_line_end(next->p, 0, next->len);
+				lineBuffer_.append(next->p, lineEnd);
+				if (lineEnd < next->len || lineBuffer_.size() > 10000) {
 					break;
 				}
-				len = iter->len;
-				currentOffset = 0;
 			}
-		}
-
-		if (reslen > 10000) {
-			if (m_pControlSocket) {
-				m_pControlSocket->log(logmsg::error, _("Received a line exceeding 10000 characters, aborting."));
-			}
-			error = true;
-			return nullptr;
-		}
-		m_currentOffset = currentOffset;
-
-		// Reslen is now the length of the line, including any terminating whitespace
-		int const buflen = reslen;
-		char *res = new char[buflen + 1];
-		res[buflen] = 0;
-
-		int respos = 0;
-
-		// Copy line data
-		auto i = m_DataList.begin();
-		while (i != iter && reslen) {
-			int copylen = i->len - startpos;
-			if (copylen > reslen) {
-				copylen = reslen;
-			}
-			memcpy(&res[respos], &i->p[startpos], copylen);
-			reslen -= copylen;
-			respos += i->len - startpos;
-			startpos = 0;
-
-			delete [] i->p;
-			++i;
-		};
 
-		// Copy last chunk
-		if (iter != m_DataList.end() && reslen) {
-			int copylen = m_currentOffset-startpos;
-			if (copylen > reslen) {
-				copylen = reslen;
-			}
-			memcpy(&res[respos], &iter->p[startpos], copylen);
-			if (reslen >= iter->len) {
-				delete [] iter->p;
-				m_DataList.erase(m_DataList.begin(), ++iter);
+			if (next == m_DataList.end()) {
+				if (lineBuffer_.size() <= 10000 && breakAtEnd) {
+					return nullptr;
+				}
+				for (auto & item : m_DataList) {
+					delete [] item.p;
+				}
+				m_DataList.clear();
+				m_currentOffset = 0;
 			}
 			else {
-				m_DataList.erase(m_DataList.begin(), iter);
+				for (auto i = m_DataList.begin(); i != next; ++i) {
+					delete [] i->p;
+				}
+				m_DataList.erase(m_DataList.begin(), next);
+				m_currentOffset = lineEnd;
 			}
-		}
-		else {
-			m_DataList.erase(m_DataList.begin(), iter);
+			raw = lineBuffer_;
 		}
 
-		std::wstring buffer;
-		if (m_pControlSocket) {
-			buffer = m_pControlSocket->ConvToLocal(res, buflen);
-			m_pControlSocket->log_raw(logmsg::listing, buffer);
-		}
-		else {
-			buffer = fz::to_wstring_from_utf8(res);
-			if (buffer.empty()) {
-				buffer = fz::to_wstring(res);
-				if (buffer.empty()) {
-					buffer = std::wstring(res, res + strlen(res));
-				}
+		if (raw.size() > 10000) {
+			if (m_pControlSocket) {
+				m_pControlSocket->log(logmsg::error, _("Received a line exceeding 10000 characters, aborting."));
 			}
+			error = true;
+			return nullptr;
 		}
-		delete [] res;
 
 		// Strip BOM
-		if (buffer[0] == 0xfeff) {
-			buffer = buffer.substr(1);
+		if (raw.substr(0, 3) == "\xef\xbb\xbf") {
+			raw.remove_prefix(3);
 		}
 
-		if (!buffer.empty()) {
-			return new CLine(std::move(buffer));
+		if (!raw.empty()) {
+			// The line is only converted as a whole if it gets logged, otherwise
+			// just the fields that are kept get converted.
+			auto * line = new CLine(raw, m_pControlSocket);
+			if (m_pControlSocket && m_pControlSocket->logger().should_log(logmsg::listing)) {
+				m_pControlSocket->log_raw(logmsg::listing, line->Convert(raw));
+			}
+			return line;
 		}
 	}
 
@@ -2258,11 +2382,10 @@ bool CDirectoryListingParser::ParseAsWfFtp(CLine &line, CDirentry &entry)
 	CToken token;
 
 	// Get filename
-	if (!line.GetToken(index++, token))
+	CToken nameToken;
+	if (!line.GetToken(index++, nameToken))
 		return false;
 
-	entry.name = token.GetString();
-
 	// Get filesize
 	if (!line.GetToken(index++, token))
 		return false;
@@ -2285,7 +2408,7 @@ bool CDirectoryListingParser::ParseAsWfFtp(CLine &line, CDirentry &entry)
 	if (!line.GetToken(index++, token))
 		return false;
 
-	if (token.GetString().back() != '.')
+	if (token[token.size() - 1] != '.')
 		return false;
 
 	// Parse time
@@ -2295,7 +2418,8 @@ bool CDirectoryListingParser::ParseAsWfFtp(CLine &line, CDirentry &entry)
 	if (!ParseTime(token, entry))
 		return false;
 
-	entry.ownerGroup = objcache.get(std::wstring());
+	entry.name = nameToken.GetString();
+	entry.ownerGroup = internedStrings_.get(std::wstring());
 	entry.permissions = entry.ownerGroup;
 	entry.time += m_timezoneOffset;
 
@@ -2320,21 +2444,21 @@ bool CDirectoryListingParser::ParseAsIBM_MVS(CLine &line, CDirentry &entry)
 		return false;
 
 	entry.flags = 0;
-	if (token.GetString() != L"**NONE**" && !ParseShortDate(token, entry)) {
+	if (token.get_view() != "**NONE**" && !ParseShortDate(token, entry)) {
 		// Perhaps of the following type:
 		// TSO004 3390 VSAM FOO.BAR
-		if (token.GetString() != L"VSAM")
+		if (token.get_view() != "VSAM")
 			return false;
 
 		if (!line.GetToken(index++, token))
 			return false;
 
-		entry.name = token.GetString();
-		if (entry.name.find(' ') != std::wstring::npos)
+		if (token.Find(' ') != -1)
 			return false;
+		entry.name = token.GetString();
 
 		entry.size = -1;
-		entry.ownerGroup = objcache.get(std::wstring());
+		entry.ownerGroup = internedStrings_.get(std::wstring());
 		entry.permissions = entry.ownerGroup;
 
 		return true;
@@ -2351,7 +2475,7 @@ bool CDirectoryListingParser::ParseAsIBM_MVS(CLine &line, CDirentry &entry)
 	// used
 	if (!line.GetToken(index++, token))
 		return false;
-	if (token.IsNumeric() || token.GetString() == L"????" || token.GetString() == L"++++" ) {
+	if (token.IsNumeric() || token.get_view() == "????" || token.get_view() == "++++" ) {
 		// recfm
 		if (!line.GetToken(index++, token))
 			return false;
@@ -2379,7 +2503,7 @@ bool CDirectoryListingParser::ParseAsIBM_MVS(CLine &line, CDirentry &entry)
 	if (!line.GetToken(index++, token))
 		return false;
 
-	if (token.GetString() == L"PO" || token.GetString() == L"PO-E")
+	if (token.get_view() == "PO" || token.get_view() == "PO-E")
 	{
 		entry.flags |= CDirentry::flag_dir;
 		entry.size = -1;
@@ -2393,7 +2517,7 @@ bool CDirectoryListingParser::ParseAsIBM_MVS(CLine &line, CDirentry &entry)
 
 	entry.name = token.GetString();
 
-	entry.ownerGroup = objcache.get(std::wstring());
+	entry.ownerGroup = internedStrings_.get(std::wstring());
 	entry.permissions = entry.ownerGroup;
 
 	return true;
@@ -2405,9 +2529,9 @@ bool CDirectoryListingParser::ParseAsIBM_MVS_PDS(CLine &line, CDirentry &entry)
 	CToken token;
 
 	// pds member name
-	if (!line.GetToken(index++, token))
+	CToken nameToken;
+	if (!line.GetToken(index++, nameToken))
 		return false;
-	entry.name = token.GetString();
 
 	// vv.mm
 	if (!line.GetToken(index++, token))
@@ -2456,7 +2580,8 @@ bool CDirectoryListingParser::ParseAsIBM_MVS_PDS(CLine &line, CDirentry &entry)
 	if (!line.GetToken(index++, token, true))
 		return false;
 
-	entry.ownerGroup = objcache.get(std::wstring());
+	entry.name = nameToken.GetString();
+	entry.ownerGroup = internedStrings_.get(std::wstring());
 	entry.permissions = entry.ownerGroup;
 	entry.time += m_timezoneOffset;
 
@@ -2473,21 +2598,21 @@ bool CDirectoryListingParser::ParseAsIBM_MVS_Migrated(CLine &line, CDirentry &en
 	if (!line.GetToken(index, token))
 		return false;
 
-	std::wstring s = fz::str_tolower_ascii(token.GetString());
-	if (s != L"migrated")
+	if (fz::str_tolower_ascii(token.get_view()) != "migrated")
 		return false;
 
-	if (!line.GetToken(++index, token))
+	CToken nameToken;
+	if (!line.GetToken(++index, nameToken))
 		return false;
 
-	entry.name = token.GetString();
-
 	if (line.GetToken(++index, token))
 		return false;
 
+	entry.name = nameToken.GetString();
+
 	entry.flags = 0;
 	entry.size = -1;
-	entry.ownerGroup = objcache.get(std::wstring());
+	entry.ownerGroup = internedStrings_.get(std::wstring());
 	entry.permissions = entry.ownerGroup;
 
 	return true;
@@ -2497,18 +2622,18 @@ bool CDirectoryListingParser::ParseAsIBM_MVS_PDS2(CLine &line, CDirentry &entry)
 {
 	int index = 0;
 	CToken token;
-	if (!line.GetToken(index, token)) {
+	CToken nameToken;
+	if (!line.GetToken(index, nameToken)) {
 		return false;
 	}
 
-	entry.name = token.GetString();
-
 	entry.flags = 0;
-	entry.ownerGroup = objcache.get(std::wstring());
+	entry.ownerGroup = internedStrings_.get(std::wstring());
 	entry.permissions = entry.ownerGroup;
 	entry.size = -1;
 
 	if (!line.GetToken(++index, token)) {
+		entry.name = nameToken.GetString();
 		return true;
 	}
 
@@ -2545,14 +2670,14 @@ bool CDirectoryListingParser::ParseAsIBM_MVS_PDS2(CLine &line, CDirentry &entry)
 	if (!line.GetToken(index, token)) {
 		return false;
 	}
-	if (!token.IsNumeric() && (token.GetString() != L"ANY")) {
+	if (!token.IsNumeric() && (token.get_view() != "ANY")) {
 		return false;
 	}
 
 	if (!line.GetToken(index - 1, token)) {
 		return false;
 	}
-	if (!token.IsNumeric() && (token.GetString() != L"ANY")) {
+	if (!token.IsNumeric() && (token.get_view() != "ANY")) {
 		return false;
 	}
 
@@ -2568,6 +2693,7 @@ bool CDirectoryListingParser::ParseAsIBM_MVS_PDS2(CLine &line, CDirentry &entry)
 		}
 	}
 
+	entry.name = nameToken.GetString();
 	return true;
 }
 
@@ -2586,8 +2712,7 @@ bool CDirectoryListingParser::ParseAsIBM_MVS_Tape(CLine &line, CDirentry &entry)
 		return false;
 	}
 
-	std::wstring s = fz::str_tolower_ascii(token.GetString());
-	if (s != L"tape") {
+	if (fz::str_tolower_ascii(token.get_view()) != "tape") {
 		return false;
 	}
 
@@ -2596,16 +2721,16 @@ bool CDirectoryListingParser::ParseAsIBM_MVS_Tape(CLine &line, CDirentry &entry)
 		return false;
 	}
 
+	if (line.GetToken(index)) {
+		return false;
+	}
+
 	entry.name = token.GetString();
 	entry.flags = 0;
-	entry.ownerGroup = objcache.get(std::wstring());
-	entry.permissions = objcache.get(std::wstring());
+	entry.ownerGroup = internedStrings_.get(std::wstring());
+	entry.permissions = internedStrings_.get(std::wstring());
 	entry.size = -1;
 
-	if (line.GetToken(index++, token)) {
-		return false;
-	}
-
 	return true;
 }
 
@@ -2713,7 +2838,7 @@ int CDirectoryListingParser::ParseAsMlsd(CLine &line, CDirentry &entry)
 		return 0;
 	}
 
-	std::wstring_view const facts = token.get_view();
+	std::string_view const facts = token.get_view();
 	if (facts.empty()) {
 		return 0;
 	}
@@ -2723,14 +2848,14 @@ int CDirectoryListingParser::ParseAsMlsd(CLine &line, CDirentry &entry)
 	entry.time.clear();
 	entry.target.clear();
 
-	std::wstring_view owner, ownername, group, groupname, user, uid, gid;
-	std::wstring ownerGroup;
-	std::wstring permissions;
+	std::string_view owner, ownername, group, groupname, user, uid, gid;
+	std::string ownerGroup;
+	std::string permissions;
 
 	size_t start = 0;
 	while (start < facts.size()) {
 		auto delim = facts.find(';', start);
-		if (delim == std::wstring::npos) {
+		if (delim == std::string_view::npos) {
 			delim = facts.size();
 		}
 		else if (delim < start + 3) {
@@ -2738,38 +2863,37 @@ int CDirectoryListingParser::ParseAsMlsd(CLine &line, CDirentry &entry)
 		}
 
 		auto const pos = facts.find('=', start);
-		if (pos == std::wstring::npos || pos < start + 1 || pos > delim) {
+		if (pos == std::string_view::npos || pos < start + 1 || pos > delim) {
 			return 0;
 		}
 
-		std::wstring factname = fz::str_tolower_ascii(facts.substr(start, pos - start));
-		std::wstring_view value = facts.substr(pos + 1, delim - pos - 1);
-		if (factname == L"type") {
+		std::string factname = fz::str_tolower_ascii(facts.substr(start, pos - start));
+		std::string_view value = facts.substr(pos + 1, delim - pos - 1);
+		if (factname == "type") {
 			auto colonPos = value.find(':');
-			std::wstring valuePrefix;
-			if (colonPos == std::wstring::npos) {
+			std::string valuePrefix;
+			if (colonPos == std::string_view::npos) {
 				valuePrefix = fz::str_tolower_ascii(value);
 			}
 			else {
 				valuePrefix = fz::str_tolower_ascii(value.substr(0, colonPos));
 			}
 
-			if (valuePrefix == L"dir" && colonPos == std::wstring::npos) {
+			if (valuePrefix == "dir" && colonPos == std::string_view::npos) {
 				entry.flags |= CDirentry::flag_dir;
 			}
-			else if (valuePrefix == L"os.unix=slink" || valuePrefix == L"os.unix=symlink") {
+			else if (valuePrefix == "os.unix=slink" || valuePrefix == "os.unix=symlink") {
 				entry.flags |= CDirentry::flag_dir | CDirentry::flag_link;
-				if (colonPos != std::wstring::npos) {
-					std::wstring_view target = value.substr(colonPos);
-					entry.target = fz::sparse_optional<std::wstring>(std::wstring(target.begin(), target.end()));
+				if (colonPos != std::string_view::npos) {
+					entry.target = fz::sparse_optional<std::wstring>(line.Convert(value.substr(colonPos)));
 				}
 			}
-			else if ((valuePrefix == L"cdir" || valuePrefix == L"pdir") && colonPos == std::wstring::npos) {
+			else if ((valuePrefix == "cdir" || valuePrefix == "pdir") && colonPos == std::string_view::npos) {
 				// Current and parent directory, don't parse it
 				return 2;
 			}
 		}
-		else if (factname == L"size") {
+		else if (factname == "size") {
 			entry.size = 0;
 
 			for (unsigned int i = 0; i < value.size(); ++i) {
@@ -2780,22 +2904,22 @@ int CDirectoryListingParser::ParseAsMlsd(CLine &line, CDirentry &entry)
 				entry.size += value[i] - '0';
 			}
 		}
-		else if (factname == L"modify" ||
-			(!entry.has_date() && factname == L"create"))
+		else if (factname == "modify" ||
+			(!entry.has_date() && factname == "create"))
 		{
 			entry.time = fz::datetime(value, fz::datetime::utc);
 			if (entry.time.empty()) {
 				return 0;
 			}
 		}
-		else if (factname == L"perm") {
+		else if (factname == "perm") {
 			if (!value.empty()) {
 				if (!permissions.empty()) {
-					std::wstring tmp;
+					std::string tmp;
 					tmp = value;
-					tmp += L" (";
+					tmp += " (";
 					tmp += permissions;
-					tmp += L")";
+					tmp += ")";
 					permissions = std::move(tmp);
 				}
 				else {
@@ -2803,35 +2927,35 @@ int CDirectoryListingParser::ParseAsMlsd(CLine &line, CDirentry &entry)
 				}
 			}
 		}
-		else if (factname == L"unix.mode") {
+		else if (factname == "unix.mode") {
 			if (!permissions.empty()) {
-				permissions += L" (";
+				permissions += " (";
 				permissions += value;
-				permissions += L")";
+				permissions += ")";
 			}
 			else {
 				permissions = value;
 			}
 		}
-		else if (factname == L"unix.owner") {
+		else if (factname == "unix.owner") {
 			owner = value;
 		}
-		else if (factname == L"unix.ownername") {
+		else if (factname == "unix.ownername") {
 			ownername = value;
 		}
-		else if (factname == L"unix.group") {
+		else if (factname == "unix.group") {
 			group = value;
 		}
-		else if (factname == L"unix.groupname") {
+		else if (factname == "unix.groupname") {
 			groupname = value;
 		}
-		else if (factname == L"unix.user") {
+		else if (factname == "unix.user") {
 			user = value;
 		}
-		else if (factname == L"unix.uid") {
+		else if (factname == "unix.uid") {
 			uid = value;
 		}
-		else if (factname == L"unix.gid") {
+		else if (factname == "unix.gid") {
 			gid = value;
 		}
 
@@ -2872,8 +2996,8 @@ int CDirectoryListingParser::ParseAsMlsd(CLine &line, CDirentry &entry)
 	}
 
 	entry.name = nameToken.GetString();
-	entry.ownerGroup = objcache.get(std::move(ownerGroup));
-	entry.permissions = objcache.get(std::move(permissions));
+	entry.ownerGroup = internedStrings_.get(line.Convert(ownerGroup));
+	entry.permissions = internedStrings_.get(line.Convert(permissions));
 
 	return 1;
 }
@@ -2938,8 +3062,8 @@ bool CDirectoryListingParser::ParseAsOS9(CLine &line, CDirentry &entry)
 		return false;
 
 	entry.name = token.GetString();
-	entry.ownerGroup = objcache.get(ownerGroupToken.GetString());
-	entry.permissions = objcache.get(permToken.GetString());
+	entry.ownerGroup = internedStrings_.get(ownerGroupToken.GetString());
+	entry.permissions = internedStrings_.get(permToken.GetString());
 
 	return true;
 }
@@ -2954,9 +3078,16 @@ void CDirectoryListingParser::Reset()
 	delete m_prevLine;
 	m_prevLine = nullptr;
 
+	lineBuffer_.clear();
 	entries_.clear();
 	m_fileList.clear();
 	m_currentOffset = 0;
+	m_detectedFormat = listingFormat::unknown;
+
+	reportedEntries_ = 0;
+	if (lastPartial_) {
+		lastPartial_ = fz::monotonic_clock::now();
+	}
 	m_fileListOnly = true;
 	m_maybeMultilineVms = false;
 }
@@ -2970,18 +3101,18 @@ bool CDirectoryListingParser::ParseAsZVM(CLine &line, CDirentry &entry)
 	if (!line.GetToken(index, token))
 		return false;
 
-	entry.name = token.GetString();
+	std::string name(token.get_view());
 
 	// Get filename extension
 	if (!line.GetToken(++index, token))
 		return false;
-	entry.name += L"." + token.GetString();
+	name += '.';
+	name += token.get_view();
 
 	// File format. Unused
 	if (!line.GetToken(++index, token))
 		return false;
-	std::wstring format = token.GetString();
-	if (format != L"V" && format != L"F")
+	if (token.get_view() != "V" && token.get_view() != "F")
 		return false;
 
 	// Record length
@@ -3034,8 +3165,9 @@ bool CDirectoryListingParser::ParseAsZVM(CLine &line, CDirentry &entry)
 	if (line.GetToken(++index, token))
 		return false;
 
-	entry.ownerGroup = objcache.get(ownerGroupToken.GetString());
-	entry.permissions = objcache.get(std::wstring());
+	entry.name = line.Convert(name);
+	entry.ownerGroup = internedStrings_.get(ownerGroupToken.GetString());
+	entry.permissions = internedStrings_.get(std::wstring());
 	entry.target.clear();
 	entry.time += m_timezoneOffset;
 
@@ -3048,11 +3180,10 @@ bool CDirectoryListingParser::ParseAsHPNonstop(CLine &line, CDirentry &entry)
 	CToken token;
 
 	// Get name
-	if (!line.GetToken(index, token))
+	CToken nameToken;
+	if (!line.GetToken(index, nameToken))
 		return false;
 
-	entry.name = token.GetString();
-
 	// File code, numeric, unsuded
 	if (!line.GetToken(++index, token))
 		return false;
@@ -3084,13 +3215,14 @@ bool CDirectoryListingParser::ParseAsHPNonstop(CLine &line, CDirentry &entry)
 	// Owner
 	if (!line.GetToken(++index, token))
 		return false;
-	std::wstring ownerGroup = token.GetString();
+	std::string ownerGroup(token.get_view());
 
 	if (token[token.size() - 1] == ',') {
 		// Owner, part 2
 		if (!line.GetToken(++index, token))
 			return false;
-		ownerGroup += L" " + token.GetString();
+		ownerGroup += ' ';
+		ownerGroup += token.get_view();
 	}
 
 	// Permissions
@@ -3102,8 +3234,9 @@ bool CDirectoryListingParser::ParseAsHPNonstop(CLine &line, CDirentry &entry)
 	if (line.GetToken(++index, token))
 		return false;
 
-	entry.permissions = objcache.get(permToken.GetString());
-	entry.ownerGroup = objcache.get(ownerGroup);
+	entry.name = nameToken.GetString();
+	entry.permissions = internedStrings_.get(permToken.GetString());
+	entry.ownerGroup = internedStrings_.get(line.Convert(ownerGroup));
 
 	return true;
 }
@@ -3111,8 +3244,9 @@ bool CDirectoryListingParser::ParseAsHPNonstop(CLine &line, CDirentry &entry)
 bool CDirectoryListingParser::GetMonthFromName(const std::wstring& name, int &month)
 {
 	std::wstring lower = fz::str_tolower_ascii(name);
-	auto iter = m_MonthNamesMap.find(lower);
-	if (iter == m_MonthNamesMap.end())
+	auto const& names = month_names();
+	auto iter = names.find(lower);
+	if (iter == names.end())
 		return false;
 
 	month = iter->second;
@@ -34,6 +34,7 @@
 
 #include "../include/directorylisting.h"
 #include "../include/server.h"
+#include "stringpool.h"
 
 #include <deque>
 #include <vector>
@@ -52,6 +53,29 @@ namespace listingEncoding
 	};
 }
 
+namespace listingFormat
+{
+	// The different parsers of CDirectoryListingParser which can be used
+	// as format hint. MLSD is not included, it is always tried first.
+	enum type
+	{
+		unknown,
+		ls,
+		dos,
+		eplf,
+		vms,
+		other,
+		ibm,
+		wfftp,
+		mvs,
+		mvs_pds,
+		os9,
+		mvs_migrated,
+		mvs_pds2,
+		mvs_tape,
+		ls_nodate
+	};
+}
 
 class FZC_PUBLIC_SYMBOL CDirectoryListingParser final
 {
@@ -73,6 +97,23 @@ public:
 
 	void SetServer(const CServer& server) { m_server = server; };
 
+	// The format to try first on each line, e.g. the one detected in a
+	// previous listing of the same server. Ignored unless IsHintableFormat
+	// returns true for it.
+	void SetFormatHint(listingFormat::type format);
+
+	// Whether lines of any format earlier in the cascade can never be
+	// mistaken for the given format. Only such formats can be tried ahead
+	// of the cascade without changing the parse result.
+	static bool IsHintableFormat(listingFormat::type format);
+
+	// The format the first recognized line of this listing was parsed as
+	listingFormat::type GetDetectedFormat() const { return m_detectedFormat; }
+
+	// In incremental mode, the entries parsed so far are periodically sent
+	// to the control socket as partial listing of the given path.
+	void EnablePartialListings(CServerPath const& path);
+
 protected:
 	CLine *GetLine(bool breakAtEnd, bool& error);
 
@@ -80,6 +121,9 @@ protected:
 
 	bool ParseLine(CLine &line, ServerType const serverType, bool concatenated, CDirentry const* override = nullptr);
 
+	// Returns 1 if the line could be parsed in the given format, 0 otherwise
+	int ParseAs(listingFormat::type format, CLine &line, CDirentry &entry, ServerType const serverType);
+
 	bool ParseAsUnix(CLine &line, CDirentry &entry, bool expect_date);
 	bool ParseAsDos(CLine &line, CDirentry &entry);
 	bool ParseAsEplf(CLine &line, CDirentry &entry);
@@ -113,13 +157,13 @@ protected:
 
 	bool GetMonthFromName(std::wstring const& name, int &month);
 
+	void SendPartialListing();
+
 	void DeduceEncoding();
 	void ConvertEncoding(char *pData, int len);
 
 	CControlSocket* m_pControlSocket;
 
-	static std::map<std::wstring, int> m_MonthNamesMap;
-
 	struct t_list
 	{
 		t_list() = default;
@@ -134,9 +178,15 @@ protected:
 	int m_currentOffset{};
 
 	std::deque<t_list> m_DataList;
+
+	// Scratch space for lines spanning multiple chunks of m_DataList
+	std::string lineBuffer_;
 	std::vector<fz::shared_value<CDirentry>> entries_;
 	int64_t m_totalData{};
 
+	// Permissions and owner/group values
+	CStringPoolCache internedStrings_;
+
 	CLine *m_prevLine{};
 
 	CServer m_server;
@@ -149,6 +199,13 @@ protected:
 	fz::duration m_timezoneOffset;
 
 	listingEncoding::type m_listingEncoding;
+
+	CServerPath partialPath_;
+	size_t reportedEntries_{};
+	fz::monotonic_clock lastPartial_;
+
+	listingFormat::type m_formatHint{listingFormat::unknown};
+	listingFormat::type m_detectedFormat{listingFormat::unknown};
 };
 
 #endif
@@ -0,0 +1,320 @@
+#include "filezilla.h"
+
+#include "../include/download_segments.h"
+#include "../include/local_path.h"
+
+#include <libfilezilla/event_handler.hpp>
+#include <libfilezilla/file.hpp>
+#include <libfilezilla/format.hpp>
+#include <libfilezilla/local_filesys.hpp>
+
+#include <algorithm>
+
+namespace {
+std::string const recordMagic = "FZSEG1";
+
+std::wstring record_name(std::wstring const& file)
+{
+	return file + L".fzsegments";
+}
+
+struct record final
+{
+	bool exists{};
+	bool valid{};
+	int64_t size{};
+	int64_t segment_size{};
+
+	// One character per segment, '1' if completed
+	std::string segments;
+};
+
+record read_record(std::wstring const& file)
+{
+	record ret;
+
+	std::string data;
+	{
+		fz::file f(fz::to_native(record_name(file)), fz::file::reading, fz::file::existing);
+		if (!f.opened()) {
+			return ret;
+		}
+		ret.exists = true;
+
+		char buf[4096];
+		int64_t read;
+		while ((read = f.read(buf, sizeof(buf))) > 0) {
+			data.append(buf, static_cast<size_t>(read));
+		}
+	}
+
+	// Magic, total size and segment size, then one character per segment
+	auto const tokens = fz::strtok(data, " \n");
+	if (tokens.size() != 4 || tokens[0] != recordMagic) {
+		return ret;
+	}
+
+	ret.size = fz::to_integral<int64_t>(tokens[1], -1);
+	ret.segment_size = fz::to_integral<int64_t>(tokens[2]);
+	if (ret.size < 0 || ret.segment_size <= 0) {
+		return ret;
+	}
+	if (tokens[3].size() != static_cast<size_t>((ret.size + ret.segment_size - 1) / ret.segment_size)) {
+		return ret;
+	}
+
+	ret.segments = tokens[3];
+	ret.valid = true;
+	return ret;
+}
+}
+
+download_segments::download_segments(std::wstring const& file, int64_t size, int64_t segment_size)
+	: file_(file)
+	, size_(std::max(int64_t(0), size))
+	, segment_size_(std::max(int64_t(1), segment_size))
+{
+	states_.resize(segment_count());
+}
+
+size_t download_segments::segment_count() const
+{
+	return static_cast<size_t>((size_ + segment_size_ - 1) / segment_size_);
+}
+
+std::wstring download_segments::record_file() const
+{
+	return record_name(file_);
+}
+
+download_segments::segment download_segments::get(size_t index) const
+{
+	segment s;
+	s.index_ = index;
+	s.offset_ = static_cast<int64_t>(index) * segment_size_;
+	s.length_ = std::min(segment_size_, size_ - s.offset_);
+	return s;
+}
+
+void download_segments::load(int64_t existing_size)
+{
+	fz::scoped_lock l(mutex_);
+	if (started_) {
+		return;
+	}
+
+	states_.assign(segment_count(), state::none);
+
+	auto const r = read_record(file_);
+	if (r.exists) {
+		if (r.valid && r.size == size_) {
+			segment_size_ = r.segment_size;
+			states_.assign(segment_count(), state::none);
+			for (size_t i = 0; i < states_.size(); ++i) {
+				if (r.segments[i] == '1') {
+					states_[i] = state::done;
+				}
+			}
+		}
+		return;
+	}
+
+	if (existing_size >= size_) {
+		return;
+	}
+	for (size_t i = 0; i < states_.size(); ++i) {
+		auto const s = get(i);
+		if (s.offset_ + s.length_ > existing_size) {
+			break;
+		}
+		states_[i] = state::done;
+	}
+}
+
+void download_segments::clear()
+{
+	fz::scoped_lock l(mutex_);
+	if (!started_) {
+		states_.assign(segment_count(), state::none);
+	}
+}
+
+bool download_segments::prepare(fz::native_string * last_created)
+{
+	std::wstring tmp;
+	CLocalPath local_path(file_, &tmp);
+	if (local_path.HasParent()) {
+		fz::mkdir(fz::to_native(local_path.GetPath()), true, fz::mkdir_permissions::normal, last_created);
+	}
+
+	fz::file f(fz::to_native(file_), fz::file::writing, fz::file::existing);
+	if (!f.opened()) {
+		return false;
+	}
+
+	if (f.seek(size_, fz::file::begin) != size_) {
+		return false;
+	}
+	if (!f.truncate()) {
+		return false;
+	}
+
+	fz::scoped_lock l(mutex_);
+	return save();
+}
+
+void download_segments::start()
+{
+	fz::scoped_lock l(mutex_);
+	started_ = true;
+}
+
+bool download_segments::started() const
+{
+	fz::scoped_lock l(mutex_);
+	return started_;
+}
+
+void download_segments::abandon()
+{
+	{
+		fz::scoped_lock l(mutex_);
+		abandoned_ = true;
+		if (started_) {
+			return;
+		}
+	}
+
+	discard(file_);
+}
+
+int64_t download_segments::usable_size(std::wstring const& file)
+{
+	auto const r = read_record(file);
+	if (!r.exists) {
+		return -1;
+	}
+
+	int64_t usable{};
+	if (r.valid) {
+		for (size_t i = 0; i < r.segments.size() && r.segments[i] == '1'; ++i) {
+			usable = std::min(r.size, usable + r.segment_size);
+		}
+	}
+	return usable;
+}
+
+void download_segments::discard(std::wstring const& file)
+{
+	int64_t const usable = usable_size(file);
+	if (usable < 0) {
+		return;
+	}
+
+	{
+		fz::file f(fz::to_native(file), fz::file::writing, fz::file::existing);
+		if (f.opened() && f.size() > usable) {
+			if (f.seek(usable, fz::file::begin) == usable) {
+				f.truncate();
+			}
+		}
+	}
+
+	fz::remove_file(fz::to_native(record_name(file)));
+}
+
+bool download_segments::claimable() const
+{
+	fz::scoped_lock l(mutex_);
+	if (!started_ || abandoned_) {
+		return false;
+	}
+	return std::find(states_.cbegin(), states_.cend(), state::none) != states_.cend();
+}
+
+bool download_segments::claim(segment & s)
+{
+	fz::scoped_lock l(mutex_);
+	if (!started_ || abandoned_) {
+		return false;
+	}
+
+	auto it = std::find(states_.begin(), states_.end(), state::none);
+	if (it == states_.end()) {
+		return false;
+	}
+
+	*it = state::claimed;
+	s = get(static_cast<size_t>(it - states_.begin()));
+	return true;
+}
+
+void download_segments::complete(size_t index)
+{
+	fz::scoped_lock l(mutex_);
+	if (index < states_.size()) {
+		states_[index] = state::done;
+		save();
+	}
+	notify();
+}
+
+void download_segments::release(size_t index)
+{
+	fz::scoped_lock l(mutex_);
+	if (index < states_.size() && states_[index] == state::claimed) {
+		states_[index] = state::none;
+	}
+	notify();
+}
+
+bool download_segments::done() const
+{
+	fz::scoped_lock l(mutex_);
+	return std::all_of(states_.cbegin(), states_.cend(), [](state s) { return s == state::done; });
+}
+
+int64_t download_segments::completed_bytes() const
+{
+	fz::scoped_lock l(mutex_);
+	int64_t ret{};
+	for (size_t i = 0; i < states_.size(); ++i) {
+		if (states_[i] == state::done) {
+			ret += get(i).length_;
+		}
+	}
+	return ret;
+}
+
+void download_segments::set_waiter(fz::event_handler * waiter)
+{
+	fz::scoped_lock l(mutex_);
+	waiter_ = waiter;
+}
+
+void download_segments::notify()
+{
+	if (waiter_) {
+		waiter_->send_event<download_segment_event>();
+	}
+}
+
+void download_segments::finish()
+{
+	fz::remove_file(fz::to_native(record_file()));
+}
+
+bool download_segments::save() const
+{
+	std::string data = fz::sprintf("%s %d %d\n", recordMagic, size_, segment_size_);
+	for (auto s : states_) {
+		data += (s == state::done) ? '1' : '0';
+	}
+	data += '\n';
+
+	fz::file f(fz::to_native(record_file()), fz::file::writing, fz::file::empty);
+	if (!f.opened()) {
+		return false;
+	}
+	return f.write(data.c_str(), static_cast<int64_t>(data.size())) == static_cast<int64_t>(data.size());
+}
@@ -2,6 +2,7 @@
 
 #include "../include/activity_logger.h"
 #include "../include/engine_context.h"
+#include "../include/engine_metrics.h"
 #include "../include/engine_options.h"
 
 #include "directorycache.h"
@@ -10,10 +11,14 @@
 #include "pathcache.h"
 
 #include <libfilezilla/event_loop.hpp>
+#include <libfilezilla/local_filesys.hpp>
+#include <libfilezilla/mutex.hpp>
 #include <libfilezilla/rate_limiter.hpp>
 #include <libfilezilla/thread_pool.hpp>
 #include <libfilezilla/tls_system_trust_store.hpp>
 
+#include <thread>
+
 namespace {
 class option_change_handler final : public fz::event_handler
 {
@@ -93,13 +98,52 @@ public:
 		, tlsSystemTrustStore_(pool_)
 	{
 		directory_cache_.SetTtl(fz::duration::from_seconds(options.get_int(OPTION_CACHE_TTL)));
+		directory_cache_.SetMemoryLimit(static_cast<int64_t>(options.get_int(OPTION_CACHE_MEMORY_LIMIT)) * 1024 * 1024);
+		if (options.get_int(OPTION_CACHE_PERSISTENT)) {
+			std::wstring const file = options.get_string(OPTION_CACHE_FILE);
+			if (!file.empty()) {
+				load_cache_task_ = pool_.spawn([this, file]() {
+					directory_cache_.Load(file);
+				});
+			}
+		}
 		rate_limit_mgr_.add(&rate_limiter_);
+
+		size_t count = static_cast<size_t>(options.get_int(OPTION_ENGINE_EVENT_LOOPS));
+		if (!count) {
+			count = std::thread::hardware_concurrency();
+		}
+		if (count < 1) {
+			count = 1;
+		}
+
+		// The first slot is the context's own loop, it also hosts the rate limit manager
+		// and the option change handler.
+		engine_loops_.push_back({&loop_, 0});
+		for (size_t i = 1; i < count; ++i) {
+			extra_loops_.emplace_back(std::make_unique<fz::event_loop>(pool_));
+			engine_loops_.push_back({extra_loops_.back().get(), 0});
+		}
 	}
 
 	~Impl()
 	{
+		load_cache_task_.join();
+
+		std::wstring const file = options_.get_string(OPTION_CACHE_FILE);
+		if (!file.empty()) {
+			if (options_.get_int(OPTION_CACHE_PERSISTENT)) {
+				directory_cache_.Save(file);
+			}
+			else {
+				fz::remove_file(fz::to_native(file));
+			}
+		}
 	}
 
+	fz::event_loop& AcquireEventLoop();
+	void ReleaseEventLoop(fz::event_loop& loop);
+
 
 	COptionsBase& options_;
 	fz::thread_pool pool_;
@@ -112,8 +156,56 @@ public:
 	OpLockManager opLockManager_;
 	fz::tls_system_trust_store tlsSystemTrustStore_;
 	activity_logger activity_logger_;
+	engine_metrics metrics_;
+
+	fz::async_task load_cache_task_;
+
+	struct engine_loop final
+	{
+		fz::event_loop* loop_{};
+		size_t engines_{};
+	};
+	fz::mutex loops_mutex_{false};
+	std::vector<engine_loop> engine_loops_;
+	size_t next_loop_{};
+
+	// Declared last so that the additional loops get destroyed before
+	// anything they might still refer to.
+	std::vector<std::unique_ptr<fz::event_loop>> extra_loops_;
 };
 
+fz::event_loop& CFileZillaEngineContext::Impl::AcquireEventLoop()
+{
+	fz::scoped_lock lock(loops_mutex_);
+
+	// Least loaded loop wins, ties are broken round-robin so that
+	// engines created in a row do not all end up on the same loop.
+	size_t best = next_loop_ % engine_loops_.size();
+	for (size_t i = 1; i < engine_loops_.size(); ++i) {
+		size_t const candidate = (next_loop_ + i) % engine_loops_.size();
+		if (engine_loops_[candidate].engines_ < engine_loops_[best].engines_) {
+			best = candidate;
+		}
+	}
+	next_loop_ = best + 1;
+
+	++engine_loops_[best].engines_;
+	return *engine_loops_[best].loop_;
+}
+
+void CFileZillaEngineContext::Impl::ReleaseEventLoop(fz::event_loop& loop)
+{
+	fz::scoped_lock lock(loops_mutex_);
+	for (auto & l : engine_loops_) {
+		if (l.loop_ == &loop) {
+			if (l.engines_) {
+				--l.engines_;
+			}
+			break;
+		}
+	}
+}
+
 CFileZillaEngineContext::CFileZillaEngineContext(COptionsBase & options, CustomEncodingConverterBase const& customEncodingConverter)
 : options_(options)
 , customEncodingConverter_(customEncodingConverter)
@@ -135,6 +227,16 @@ fz::event_loop& CFileZillaEngineContext::GetEventLoop()
 	return impl_->loop_;
 }
 
+fz::event_loop& CFileZillaEngineContext::AcquireEventLoop()
+{
+	return impl_->AcquireEventLoop();
+}
+
+void CFileZillaEngineContext::ReleaseEventLoop(fz::event_loop& loop)
+{
+	impl_->ReleaseEventLoop(loop);
+}
+
 fz::rate_limiter& CFileZillaEngineContext::GetRateLimiter()
 {
 	return impl_->rate_limiter_;
@@ -145,6 +247,18 @@ CDirectoryCache& CFileZillaEngineContext::GetDirectoryCache()
 	return impl_->directory_cache_;
 }
 
+void CFileZillaEngineContext::ClearDirectoryCache()
+{
+	// Loading must not bring back any listings afterwards
+	impl_->load_cache_task_.join();
+	impl_->directory_cache_.Clear();
+
+	std::wstring const file = options_.get_string(OPTION_CACHE_FILE);
+	if (!file.empty()) {
+		fz::remove_file(fz::to_native(file));
+	}
+}
+
 CPathCache& CFileZillaEngineContext::GetPathCache()
 {
 	return impl_->path_cache_;
@@ -163,4 +277,9 @@ fz::tls_system_trust_store& CFileZillaEngineContext::GetTlsSystemTrustStore()
 activity_logger& CFileZillaEngineContext::GetActivityLogger()
 {
 	return impl_->activity_logger_;
-}
\ No newline at end of file
+}
+
+engine_metrics& CFileZillaEngineContext::GetMetrics()
+{
+	return impl_->metrics_;
+}
@@ -0,0 +1,184 @@
+#include "filezilla.h"
+
+#include "../include/engine_metrics.h"
+
+#include <libfilezilla/file.hpp>
+#include <libfilezilla/format.hpp>
+#include <libfilezilla/util.hpp>
+
+#include <algorithm>
+
+void latency_histogram::record(fz::duration const& d)
+{
+	int64_t const us = std::max(int64_t(0), d.get_microseconds());
+
+	size_t bucket = us ? fz::bitscan_reverse(static_cast<uint64_t>(us)) + 1 : 0;
+	if (bucket >= bucket_count) {
+		bucket = bucket_count - 1;
+	}
+	++buckets_[bucket];
+
+	if (!count_ || us < min_us_) {
+		min_us_ = us;
+	}
+	if (!count_ || us > max_us_) {
+		max_us_ = us;
+	}
+	++count_;
+	total_us_ += us;
+}
+
+void latency_histogram::merge(latency_histogram const& other)
+{
+	if (!other.count_) {
+		return;
+	}
+
+	for (size_t i = 0; i < bucket_count; ++i) {
+		buckets_[i] += other.buckets_[i];
+	}
+	if (!count_ || other.min_us_ < min_us_) {
+		min_us_ = other.min_us_;
+	}
+	if (!count_ || other.max_us_ > max_us_) {
+		max_us_ = other.max_us_;
+	}
+	count_ += other.count_;
+	total_us_ += other.total_us_;
+}
+
+fz::duration latency_histogram::min() const
+{
+	return fz::duration::from_microseconds(min_us_);
+}
+
+fz::duration latency_histogram::max() const
+{
+	return fz::duration::from_microseconds(max_us_);
+}
+
+fz::duration latency_histogram::mean() const
+{
+	if (!count_) {
+		return fz::duration();
+	}
+	return fz::duration::from_microseconds(total_us_ / static_cast<int64_t>(count_));
+}
+
+fz::duration latency_histogram::percentile(double p) const
+{
+	if (!count_) {
+		return fz::duration();
+	}
+
+	uint64_t const rank = std::max(uint64_t(1), static_cast<uint64_t>(p / 100 * count_ + 0.5));
+	uint64_t seen{};
+	for (size_t i = 0; i < bucket_count; ++i) {
+		seen += buckets_[i];
+		if (seen >= rank) {
+			int64_t const upper = i ? (int64_t(1) << i) : 1;
+			return fz::duration::from_microseconds(std::clamp(upper, min_us_, max_us_));
+		}
+	}
+	return max();
+}
+
+uint64_t server_metrics::rate(bool download) const
+{
+	int64_t const ms = transfer_time_[download ? 0 : 1].get_milliseconds();
+	if (ms <= 0) {
+		return 0;
+	}
+	return bytes_[download ? 0 : 1] * 1000 / static_cast<uint64_t>(ms);
+}
+
+namespace {
+std::wstring format_ms(fz::duration const& d)
+{
+	int64_t const us = d.get_microseconds();
+	return fz::sprintf(L"%d.%03d", us / 1000, us % 1000);
+}
+
+std::wstring format_histogram(std::wstring const& name, latency_histogram const& h)
+{
+	return fz::sprintf(L"  %-32s %8d %10s %10s %10s %10s %10s\n", name, h.count(),
+		format_ms(h.mean()), format_ms(h.percentile(50)), format_ms(h.percentile(90)), format_ms(h.percentile(99)), format_ms(h.max()));
+}
+}
+
+std::wstring metrics_snapshot::format() const
+{
+	std::wstring ret;
+	for (auto const& [server, metrics] : servers_) {
+		ret += fz::sprintf(L"%s\n", server);
+		ret += fz::sprintf(L"  %-32s %8s %10s %10s %10s %10s %10s\n", L"Operation", L"Count", L"Mean ms", L"p50 ms", L"p90 ms", L"p99 ms", L"Max ms");
+		for (auto const& [name, h] : metrics.operations_) {
+			ret += format_histogram(name, h);
+		}
+		if (metrics.lock_wait_.count()) {
+			ret += format_histogram(L"Lock wait", metrics.lock_wait_);
+		}
+		for (int i = 0; i < 2; ++i) {
+			if (metrics.transfers_[i]) {
+				ret += fz::sprintf(L"  %s: %d transfers, %d bytes, %d bytes/s\n", i ? L"Uploads" : L"Downloads", metrics.transfers_[i], metrics.bytes_[i], metrics.rate(!i));
+			}
+		}
+		ret += L"\n";
+	}
+	return ret;
+}
+
+server_metrics& engine_metrics::get(CServer const& server)
+{
+	return data_.servers_[server.Format(ServerFormat::with_user_and_optional_port)];
+}
+
+void engine_metrics::record_operation(CServer const& server, std::wstring const& name, fz::duration const& d)
+{
+	fz::scoped_lock l(mutex_);
+	get(server).operations_[name].record(d);
+}
+
+void engine_metrics::record_lock_wait(CServer const& server, fz::duration const& d)
+{
+	fz::scoped_lock l(mutex_);
+	get(server).lock_wait_.record(d);
+}
+
+void engine_metrics::record_transfer(CServer const& server, bool download, int64_t bytes, fz::duration const& d)
+{
+	if (bytes < 0) {
+		return;
+	}
+
+	fz::scoped_lock l(mutex_);
+	auto & metrics = get(server);
+	int const i = download ? 0 : 1;
+	++metrics.transfers_[i];
+	metrics.bytes_[i] += static_cast<uint64_t>(bytes);
+	metrics.transfer_time_[i] += d;
+}
+
+metrics_snapshot engine_metrics::snapshot() const
+{
+	fz::scoped_lock l(mutex_);
+	return data_;
+}
+
+void engine_metrics::reset()
+{
+	fz::scoped_lock l(mutex_);
+	data_.servers_.clear();
+}
+
+bool engine_metrics::dump(std::wstring const& file) const
+{
+	std::string const out = fz::to_utf8(snapshot().format());
+
+	fz::file f(fz::to_native(file), fz::file::writing, fz::file::empty);
+	if (!f.opened()) {
+		return false;
+	}
+
+	return f.write(out.c_str(), static_cast<int64_t>(out.size())) == static_cast<int64_t>(out.size());
+}
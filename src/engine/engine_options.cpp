@@ -78,7 +78,15 @@ unsigned int register_engine_options()
 		{ "Size decimal places", 1, option_flags::numeric_clamp, 0, 3 },
 		{ "TCP Keepalive Interval", 15, option_flags::numeric_clamp, 1, 10000 },
 		{ "Cache TTL", 600, option_flags::numeric_clamp, 30, 60*60*24 },
-		{ "Minimum TLS Version", 2, option_flags::numeric_clamp, 0, 3 }
+		{ "Cache memory limit", 512, option_flags::numeric_clamp, 16, 64*1024 },
+		{ "Persistent directory cache", false, option_flags::normal },
+		{ "Directory cache file", L"", option_flags::internal },
+		{ "Minimum TLS Version", 2, option_flags::numeric_clamp, 0, 3 },
+		{ "Engine event loops", 0, option_flags::numeric_clamp, 0, 64 },
+		{ "Notification interval", 15, option_flags::numeric_clamp, 0, 1000 },
+		{ "Mode Z support", false, option_flags::normal },
+		{ "Mode Z compression level", 8, option_flags::numeric_clamp, 1, 9 },
+		{ "FTP pipeline depth", 8, option_flags::numeric_clamp, 1, 64 }
 	});
 	return value;
 }
@@ -36,10 +36,11 @@ unsigned int get_next_engine_id()
 }
 
 CFileZillaEnginePrivate::CFileZillaEnginePrivate(CFileZillaEngineContext& context, CFileZillaEngine& parent, std::function<void(CFileZillaEngine*)> const& notification_cb)
-	: event_handler(context.GetEventLoop())
+	: event_handler(context.AcquireEventLoop())
 	, transfer_status_(*this)
 	, opLockManager_(context.GetOpLockManager())
 	, activity_logger_(context.GetActivityLogger())
+	, metrics_(context.GetMetrics())
 	, notification_cb_(notification_cb)
 	, m_engine_id(get_next_engine_id())
 	, options_(context.GetOptions())
@@ -64,9 +65,19 @@ CFileZillaEnginePrivate::CFileZillaEnginePrivate(CFileZillaEngineContext& contex
 		queue_logs_ = queue_logs;
 	}
 
+	UpdateNotificationInterval();
+
 	options_.watch(OPTION_LOGGING_SHOW_DETAILED_LOGS, this);
 	options_.watch(OPTION_LOGGING_DEBUGLEVEL, this);
 	options_.watch(OPTION_LOGGING_RAWLISTING, this);
+	options_.watch(OPTION_NOTIFICATION_INTERVAL, this);
+}
+
+void CFileZillaEnginePrivate::UpdateNotificationInterval()
+{
+	auto const interval = fz::duration::from_milliseconds(options_.get_int(OPTION_NOTIFICATION_INTERVAL));
+	fz::scoped_lock lock(notification_mutex_);
+	notification_interval_ = interval;
 }
 
 bool CFileZillaEnginePrivate::ShouldQueueLogsFromOptions() const
@@ -98,6 +109,7 @@ void erase_unordered(C & container, V const& v) noexcept
 CFileZillaEnginePrivate::~CFileZillaEnginePrivate()
 {
 	shutdown();
+	context_.ReleaseEventLoop(event_loop_);
 }
 
 void CFileZillaEnginePrivate::shutdown()
@@ -158,16 +170,47 @@ bool CFileZillaEnginePrivate::IsConnected() const
 	return controlSocket_ != nullptr;
 }
 
-void CFileZillaEnginePrivate::AddNotification(fz::scoped_lock&, std::unique_ptr<CNotification> && notification)
+void CFileZillaEnginePrivate::AddNotification(fz::scoped_lock& lock, std::unique_ptr<CNotification> && notification)
 {
+	// Log messages, transfer status and partial listings only update the
+	// display, they can wait for the next batch.
+	bool urgent = true;
 	if (notification) {
+		switch (notification->GetID()) {
+		case nId_transferstatus:
+			// Only the latest status matters
+			if (!m_NotificationList.empty() && m_NotificationList.back()->GetID() == nId_transferstatus) {
+				delete m_NotificationList.back();
+				m_NotificationList.pop_back();
+			}
+			urgent = false;
+			break;
+		case nId_logmsg:
+		case nId_listing_partial:
+			urgent = false;
+			break;
+		default:
+			break;
+		}
 		m_NotificationList.push_back(notification.release());
 	}
 
-	if (m_maySendNotificationEvent && notification_cb_) {
+	SignalNotification(lock, urgent);
+}
+
+void CFileZillaEnginePrivate::SignalNotification(fz::scoped_lock&, bool urgent)
+{
+	if (!m_maySendNotificationEvent || m_NotificationList.empty() || !notification_cb_) {
+		return;
+	}
+
+	if (urgent || !notification_interval_) {
 		m_maySendNotificationEvent = false;
 		notification_cb_(&parent_);
 	}
+	else if (!notification_timer_) {
+		notification_timer_ = add_timer(notification_interval_, true);
+	}
 }
 
 void CFileZillaEnginePrivate::AddNotification(std::unique_ptr<CNotification> && notification)
@@ -209,12 +252,7 @@ void CFileZillaEnginePrivate::SendQueuedLogs(bool reset_flag)
 		queue_logs_ = ShouldQueueLogsFromOptions();
 	}
 
-	if (!m_maySendNotificationEvent || m_NotificationList.empty() || !notification_cb_) {
-		return;
-	}
-	m_maySendNotificationEvent = false;
-
-	notification_cb_(&parent_);
+	SignalNotification(lock, false);
 }
 
 void CFileZillaEnginePrivate::ClearQueuedLogs(fz::scoped_lock&, bool reset_flag)
@@ -432,6 +470,22 @@ int CFileZillaEnginePrivate::Chmod(CChmodCommand const& command)
 	return FZ_REPLY_CONTINUE;
 }
 
+int CFileZillaEnginePrivate::Metrics(CMetricsCommand const& command)
+{
+	int res = FZ_REPLY_OK;
+	if (!command.file_.empty() && !metrics_.dump(command.file_)) {
+		logger_->log(logmsg::error, _("Could not write metrics to \"%s\""), command.file_);
+		res = FZ_REPLY_ERROR;
+	}
+
+	AddNotification(std::make_unique<CMetricsNotification>(metrics_.snapshot()));
+	if (command.reset_) {
+		metrics_.reset();
+	}
+
+	return res;
+}
+
 void CFileZillaEnginePrivate::RegisterFailedLoginAttempt(const CServer& server, bool critical)
 {
 	fz::scoped_lock lock(global_mutex_);
@@ -483,8 +537,17 @@ fz::duration CFileZillaEnginePrivate::GetRemainingReconnectDelay(CServer const&
 	return fz::duration();
 }
 
-void CFileZillaEnginePrivate::OnTimer(fz::timer_id)
+void CFileZillaEnginePrivate::OnTimer(fz::timer_id id)
 {
+	{
+		fz::scoped_lock lock(notification_mutex_);
+		if (id == notification_timer_) {
+			notification_timer_ = 0;
+			SignalNotification(lock, true);
+			return;
+		}
+	}
+
 	if (!m_retryTimer) {
 		return;
 	}
@@ -608,7 +671,7 @@ int CFileZillaEnginePrivate::CheckCommandPreconditions(CCommand const& command,
 	if (checkBusy && IsBusy()) {
 		return FZ_REPLY_BUSY;
 	}
-	else if (command.GetId() != Command::connect && command.GetId() != Command::disconnect && !IsConnected()) {
+	else if (command.GetId() != Command::connect && command.GetId() != Command::disconnect && command.GetId() != Command::metrics && !IsConnected()) {
 		return FZ_REPLY_NOTCONNECTED;
 	}
 	else if (command.GetId() == Command::connect && controlSocket_) {
@@ -659,6 +722,9 @@ void CFileZillaEnginePrivate::OnCommandEvent()
 			case Command::chmod:
 				res = Chmod(static_cast<CChmodCommand const&>(command));
 				break;
+			case Command::metrics:
+				res = Metrics(static_cast<CMetricsCommand const&>(command));
+				break;
 			case Command::httprequest:
 				{
 					auto * http_socket = dynamic_cast<CHttpControlSocket*>(controlSocket_.get());
@@ -836,6 +902,8 @@ int CFileZillaEnginePrivate::Cancel()
 
 void CFileZillaEnginePrivate::OnOptionsChanged(watched_options const&)
 {
+	UpdateNotificationInterval();
+
 	bool queue_logs = ShouldQueueLogsFromOptions();
 	if (queue_logs) {
 		fz::scoped_lock lock(notification_mutex_);
@@ -857,11 +925,18 @@ CTransferStatusManager::CTransferStatusManager(CFileZillaEnginePrivate& engine)
 {
 }
 
+namespace {
+fz::datetime const epoch(0, fz::datetime::milliseconds);
+}
+
 void CTransferStatusManager::Reset()
 {
 	{
 		fz::scoped_lock lock(mutex_);
-		status_.clear();
+		sequence_.fetch_add(1, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_release);
+		startOffset_.store(-1, std::memory_order_relaxed);
+		sequence_.fetch_add(1, std::memory_order_release);
 		send_state_ = 0;
 	}
 
@@ -875,19 +950,29 @@ void CTransferStatusManager::Init(int64_t totalSize, int64_t startOffset, bool l
 		startOffset = 0;
 	}
 
-	status_ = CTransferStatus(totalSize, startOffset, list);
-	currentOffset_ = 0;
-	made_progress_ = false;
+	sequence_.fetch_add(1, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+	started_.store(0, std::memory_order_relaxed);
+	totalSize_.store(totalSize, std::memory_order_relaxed);
+	startOffset_.store(startOffset, std::memory_order_relaxed);
+	list_.store(list, std::memory_order_relaxed);
+	transferred_.store(0, std::memory_order_relaxed);
+	made_progress_.store(false, std::memory_order_relaxed);
+	sequence_.fetch_add(1, std::memory_order_release);
 }
 
 void CTransferStatusManager::SetStartTime()
 {
 	fz::scoped_lock lock(mutex_);
-	if (!status_) {
+	if (startOffset_.load(std::memory_order_relaxed) < 0) {
 		return;
 	}
 
-	status_.started = fz::datetime::now();
+	int64_t const started = (fz::datetime::now() - epoch).get_milliseconds();
+	sequence_.fetch_add(1, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+	started_.store(started, std::memory_order_relaxed);
+	sequence_.fetch_add(1, std::memory_order_release);
 }
 
 void CTransferStatusManager::SetMadeProgress()
@@ -895,55 +980,61 @@ void CTransferStatusManager::SetMadeProgress()
 	made_progress_ = true;
 }
 
-void CTransferStatusManager::Update(int64_t transferredBytes)
+CTransferStatus CTransferStatusManager::Snapshot() const
 {
-	std::unique_ptr<CNotification> notification;
+	CTransferStatus status;
+	int64_t started;
+	unsigned int seq;
+	do {
+		seq = sequence_.load(std::memory_order_acquire);
+		started = started_.load(std::memory_order_relaxed);
+		status.totalSize = totalSize_.load(std::memory_order_relaxed);
+		status.startOffset = startOffset_.load(std::memory_order_relaxed);
+		status.currentOffset = status.startOffset + transferred_.load(std::memory_order_relaxed);
+		status.madeProgress = made_progress_.load(std::memory_order_relaxed);
+		status.list = list_.load(std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_acquire);
+	} while ((seq & 1) || seq != sequence_.load(std::memory_order_relaxed));
+
+	if (status.empty()) {
+		return CTransferStatus();
+	}
+	if (started) {
+		status.started = epoch + fz::duration::from_milliseconds(started);
+	}
+	return status;
+}
 
-	{
-		int64_t oldOffset = currentOffset_.fetch_add(transferredBytes);
-		if (!oldOffset) {
-			fz::scoped_lock lock(mutex_);
-			if (!status_) {
-				return;
-			}
+void CTransferStatusManager::Update(int64_t transferredBytes)
+{
+	transferred_.fetch_add(transferredBytes, std::memory_order_relaxed);
 
-			if (!send_state_) {
-				status_.currentOffset += currentOffset_.exchange(0);
-				status_.madeProgress = made_progress_;
-				notification = std::make_unique<CTransferStatusNotification>(status_);
-			}
-			send_state_ = 2;
-		}
+	// Nobody has looked at the previous change yet, nothing else to do.
+	if (send_state_.load(std::memory_order_relaxed) == 2) {
+		return;
 	}
 
-	if (notification) {
-		engine_.AddNotification(std::move(notification));
+	if (send_state_.exchange(2) == 0) {
+		auto status = Snapshot();
+		if (status) {
+			engine_.AddNotification(std::make_unique<CTransferStatusNotification>(status));
+		}
 	}
 }
 
 CTransferStatus CTransferStatusManager::Get(bool &changed)
 {
-	fz::scoped_lock lock(mutex_);
-	if (!status_) {
-		changed = false;
-		send_state_ = 0;
-	}
-	else {
-		status_.currentOffset += currentOffset_.exchange(0);
-		if (send_state_ == 2) {
-			changed = true;
-			send_state_ = 1;
-		}
-		else {
-			changed = false;
-			send_state_ = 0;
-		}
+	auto status = Snapshot();
+
+	int state = send_state_.load();
+	while (!send_state_.compare_exchange_weak(state, (status && state == 2) ? 1 : 0)) {
 	}
-	return status_;
+	changed = status && state == 2;
+
+	return status;
 }
 
 bool CTransferStatusManager::empty()
 {
-	fz::scoped_lock lock(mutex_);
-	return status_.empty();
+	return startOffset_.load(std::memory_order_acquire) < 0;
 }
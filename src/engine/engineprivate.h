@@ -44,13 +44,27 @@ public:
 
 	CTransferStatus Get(bool &changed);
 
+	// Reads a consistent copy of the status without blocking
+	CTransferStatus Snapshot() const;
+
 protected:
+
+	// Serializes Init, Reset and SetStartTime. Update and Get never take it,
+	// they only read the fields below, guarded by the sequence counter.
 	fz::mutex mutex_;
+	std::atomic<unsigned int> sequence_{};
+
+	std::atomic<int64_t> started_{};
+	std::atomic<int64_t> totalSize_{-1};
+	std::atomic<int64_t> startOffset_{-1};
+	std::atomic<bool> list_{};
 
-	CTransferStatus status_;
-	std::atomic<int64_t> currentOffset_{};
-	int send_state_{};
-	std::atomic_bool made_progress_;
+	// Bytes transferred since Init
+	std::atomic<int64_t> transferred_{};
+
+	// 0: idle, 1: polled since last change, 2: changed
+	std::atomic<int> send_state_{};
+	std::atomic_bool made_progress_{};
 
 	CFileZillaEnginePrivate& engine_;
 };
@@ -109,12 +123,18 @@ public:
 
 	fz::logger_interface& GetLogger();
 	activity_logger& activity_logger_;
+	engine_metrics& metrics_;
 
 	void shutdown();
 
 protected:
 	void OnOptionsChanged(watched_options const& options);
 
+	// Invokes the notification callback, or if the notifications are not
+	// urgent, arms a timer so that they get delivered in one batch.
+	void SignalNotification(fz::scoped_lock& lock, bool urgent);
+	void UpdateNotificationInterval();
+
 	void SendQueuedLogs(bool reset_flag = false);
 	void ClearQueuedLogs(bool reset_flag);
 	void ClearQueuedLogs(fz::scoped_lock& lock, bool reset_flag);
@@ -135,6 +155,7 @@ protected:
 	int Mkdir(CMkdirCommand const& command);
 	int Rename(CRenameCommand const& command);
 	int Chmod(CChmodCommand const& command);
+	int Metrics(CMetricsCommand const& command);
 
 	void DoCancel();
 
@@ -168,6 +189,8 @@ protected:
 	// Protect access to these with notification_mutex_
 	std::deque<CNotification*> m_NotificationList;
 	bool m_maySendNotificationEvent{true};
+	fz::timer_id notification_timer_{};
+	fz::duration notification_interval_;
 	bool queue_logs_{true};
 	std::vector<CLogmsgNotification*> queued_logs_;
 
@@ -0,0 +1,164 @@
+#include "../filezilla.h"
+
+#include "compression_layer.h"
+
+namespace {
+size_t const chunk_size = 64 * 1024;
+}
+
+compression_layer::compression_layer(fz::event_handler* handler, fz::socket_interface& next_layer, bool deflate, int level)
+	: fz::socket_layer(handler, next_layer, true)
+	, deflate_(deflate)
+{
+	next_layer.set_event_handler(handler);
+
+	if (deflate_) {
+		initialized_ = deflateInit(&stream_, level) == Z_OK;
+	}
+	else {
+		initialized_ = inflateInit(&stream_) == Z_OK;
+	}
+}
+
+compression_layer::~compression_layer()
+{
+	if (initialized_) {
+		if (deflate_) {
+			deflateEnd(&stream_);
+		}
+		else {
+			inflateEnd(&stream_);
+		}
+	}
+	next_layer_.set_event_handler(nullptr);
+}
+
+int compression_layer::read(void* buffer, unsigned int size, int& error)
+{
+	if (deflate_ || !initialized_) {
+		error = ENOTCONN;
+		return -1;
+	}
+
+	for (;;) {
+		if (!stream_end_) {
+			// Also called with an empty input buffer, the previous call may
+			// have left output behind if the caller's buffer was too small.
+			stream_.next_in = buffer_.get();
+			stream_.avail_in = static_cast<uInt>(buffer_.size());
+			stream_.next_out = static_cast<Bytef*>(buffer);
+			stream_.avail_out = size;
+
+			int const res = inflate(&stream_, Z_NO_FLUSH);
+			buffer_.consume(buffer_.size() - stream_.avail_in);
+			if (res == Z_STREAM_END) {
+				stream_end_ = true;
+				buffer_.clear();
+			}
+			else if (res != Z_OK && res != Z_BUF_ERROR) {
+				error = EPROTO;
+				return -1;
+			}
+
+			unsigned int const produced = size - stream_.avail_out;
+			if (produced) {
+				return static_cast<int>(produced);
+			}
+		}
+
+		int const read = next_layer_.read(buffer_.get(chunk_size), chunk_size, error);
+		if (read < 0) {
+			return read;
+		}
+		if (!read) {
+			if (!stream_end_) {
+				// Connection closed in the middle of the stream
+				error = ECONNABORTED;
+				return -1;
+			}
+			return 0;
+		}
+
+		if (!stream_end_) {
+			buffer_.add(static_cast<size_t>(read));
+		}
+		// Anything after the end of the stream gets discarded
+	}
+}
+
+int compression_layer::write(void const* buffer, unsigned int size, int& error)
+{
+	if (!deflate_ || !initialized_ || stream_end_) {
+		error = ENOTCONN;
+		return -1;
+	}
+
+	if (!flush(error)) {
+		return -1;
+	}
+
+	stream_.next_in = static_cast<Bytef*>(const_cast<void*>(buffer));
+	stream_.avail_in = size;
+	while (stream_.avail_in && buffer_.size() < chunk_size) {
+		stream_.next_out = buffer_.get(chunk_size);
+		stream_.avail_out = chunk_size;
+		int const res = deflate(&stream_, Z_NO_FLUSH);
+		buffer_.add(chunk_size - stream_.avail_out);
+		if (res != Z_OK && res != Z_BUF_ERROR) {
+			error = EPROTO;
+			return -1;
+		}
+	}
+	int const consumed = static_cast<int>(size - stream_.avail_in);
+
+	// Whatever does not fit gets sent on the next write, which is triggered
+	// by the write event of the next layer.
+	if (!flush(error) && error != EAGAIN) {
+		return -1;
+	}
+
+	return consumed;
+}
+
+int compression_layer::shutdown()
+{
+	if (deflate_ && initialized_) {
+		stream_.next_in = nullptr;
+		stream_.avail_in = 0;
+		while (!stream_end_) {
+			stream_.next_out = buffer_.get(chunk_size);
+			stream_.avail_out = chunk_size;
+			int const res = deflate(&stream_, Z_FINISH);
+			buffer_.add(chunk_size - stream_.avail_out);
+			if (res == Z_STREAM_END) {
+				stream_end_ = true;
+			}
+			else if (res != Z_OK && res != Z_BUF_ERROR) {
+				return EPROTO;
+			}
+		}
+
+		int error;
+		if (!flush(error)) {
+			return error;
+		}
+	}
+
+	return next_layer_.shutdown();
+}
+
+bool compression_layer::flush(int& error)
+{
+	while (!buffer_.empty()) {
+		int const written = next_layer_.write(buffer_.get(), static_cast<unsigned int>(buffer_.size()), error);
+		if (written <= 0) {
+			if (!written) {
+				error = EAGAIN;
+			}
+			return false;
+		}
+		buffer_.consume(static_cast<size_t>(written));
+	}
+
+	return true;
+}
@@ -0,0 +1,45 @@
+#ifndef FILEZILLA_ENGINE_FTP_COMPRESSION_LAYER_HEADER
+#define FILEZILLA_ENGINE_FTP_COMPRESSION_LAYER_HEADER
+
+#include <libfilezilla/buffer.hpp>
+#include <libfilezilla/socket.hpp>
+
+#include <zlib.h>
+
+// Implements MODE Z on FTP data connections: Each transfer is a single zlib
+// stream. Data written gets deflated, data read gets inflated.
+//
+// Events of the next layer are passed through unchanged. Like any other
+// layer, read and write fail with EAGAIN if they can make no progress,
+// the next event from the lower layer signals when to try again.
+class compression_layer final : public fz::socket_layer
+{
+public:
+	// level is only used if deflating
+	compression_layer(fz::event_handler* handler, fz::socket_interface& next_layer, bool deflate, int level);
+	virtual ~compression_layer();
+
+	// False if zlib could not be initialized
+	bool initialized() const { return initialized_; }
+
+	virtual int read(void* buffer, unsigned int size, int& error) override;
+	virtual int write(void const* buffer, unsigned int size, int& error) override;
+
+	// Finishes the compressed stream before shutting down the next layer
+	virtual int shutdown() override;
+
+private:
+	// Writes pending compressed data to the next layer.
+	bool flush(int& error);
+
+	bool const deflate_;
+	bool initialized_{};
+	bool stream_end_{};
+
+	z_stream stream_{};
+
+	// Received data not yet inflated, or deflated data not yet sent
+	fz::buffer buffer_;
+};
+
+#endif
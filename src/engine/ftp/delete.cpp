@@ -18,21 +18,34 @@ int CFtpDeleteOpData::Send()
 		return FZ_REPLY_CONTINUE;
 	}
 	else if (opState == del_del) {
-		std::wstring const& file = files_.back();
-		if (file.empty()) {
-			log(logmsg::debug_info, L"Empty filename");
-			return FZ_REPLY_INTERNALERROR;
+		// Deleting one file does not depend on the outcome of deleting
+		// another, so keep several DELE commands outstanding.
+		size_t const window = static_cast<size_t>(controlSocket_.PipelineWindow());
+		while (!files_.empty() && pending_.size() < window) {
+			std::wstring const& file = files_.back();
+			if (file.empty()) {
+				log(logmsg::debug_info, L"Empty filename");
+				return FZ_REPLY_INTERNALERROR;
+			}
+
+			std::wstring filename = path_.FormatFilename(file, omitPath_);
+			if (filename.empty()) {
+				log(logmsg::error, _("Filename cannot be constructed for directory %s and filename %s"), path_.GetPath(), file);
+				return FZ_REPLY_ERROR;
+			}
+
+			engine_.GetDirectoryCache().InvalidateFile(currentServer_, path_, file);
+
+			int res = controlSocket_.SendCommand(L"DELE " + filename);
+			if (res != FZ_REPLY_WOULDBLOCK) {
+				return res;
+			}
+
+			pending_.push_back({file, !pending_.empty()});
+			files_.pop_back();
 		}
 
-		std::wstring filename = path_.FormatFilename(file, omitPath_);
-		if (filename.empty()) {
-			log(logmsg::error, _("Filename cannot be constructed for directory %s and filename %s"), path_.GetPath(), file);
-			return FZ_REPLY_ERROR;
-		}
-
-		engine_.GetDirectoryCache().InvalidateFile(currentServer_, path_, file);
-
-		return controlSocket_.SendCommand(L"DELE " + filename);
+		return FZ_REPLY_WOULDBLOCK;
 	}
 
 	log(logmsg::debug_warning, L"Unkown op state %d", opState);
@@ -41,14 +54,26 @@ int CFtpDeleteOpData::Send()
 
 int CFtpDeleteOpData::ParseResponse()
 {
+	if (pending_.empty()) {
+		log(logmsg::debug_warning, L"Reply without pending DELE command");
+		return FZ_REPLY_INTERNALERROR;
+	}
+
+	pending const p = std::move(pending_.front());
+	pending_.pop_front();
+
 	int code = controlSocket_.GetReplyCode();
-	if (code != 2 && code != 3) {
+	if (code == 5 && p.pipelined_ && controlSocket_.m_Response.size() >= 3 && controlSocket_.m_Response[1] == '0') {
+		// 500 to 504 are syntax and sequence errors. Servers choking on
+		// pipelined commands reply with these, retry the file in lock-step.
+		controlSocket_.PipelineFailed();
+		files_.push_back(p.file_);
+	}
+	else if (code != 2 && code != 3) {
 		deleteFailed_ = true;
 	}
 	else {
-		std::wstring const& file = files_.back();
-
-		engine_.GetDirectoryCache().RemoveFile(currentServer_, path_, file);
+		engine_.GetDirectoryCache().RemoveFile(currentServer_, path_, p.file_);
 
 		auto now = fz::monotonic_clock::now();
 		if (time_ && (now - time_).get_seconds() >= 1) {
@@ -61,9 +86,7 @@ int CFtpDeleteOpData::ParseResponse()
 		}
 	}
 
-	files_.pop_back();
-
-	if (!files_.empty()) {
+	if (!files_.empty() || !pending_.empty()) {
 		return FZ_REPLY_CONTINUE;
 	}
 
@@ -89,6 +112,11 @@ int CFtpDeleteOpData::SubcommandResult(int prevResult, COpData const&)
 
 int CFtpDeleteOpData::Reset(int result)
 {
+	if ((result & FZ_REPLY_TIMEOUT) == FZ_REPLY_TIMEOUT && pending_.size() > 1) {
+		// Some servers silently drop commands received while still busy
+		controlSocket_.PipelineFailed();
+	}
+
 	if (needSendListing_ && !(result & FZ_REPLY_DISCONNECTED)) {
 		controlSocket_.SendDirectoryListingNotification(path_, false);
 	}
@@ -5,6 +5,8 @@
 
 #include "../../include/serverpath.h"
 
+#include <deque>
+
 class CFtpDeleteOpData final : public COpData, public CFtpOpData
 {
 public:
@@ -19,9 +21,20 @@ public:
 	virtual int Reset(int result) override;
 
 	CServerPath path_;
+
+	// Not yet sent, processed from the back
 	std::vector<std::wstring> files_;
 	bool omitPath_{};
 
+	// DELE commands are pipelined, these are awaiting their replies,
+	// oldest first.
+	struct pending final
+	{
+		std::wstring file_;
+		bool pipelined_{};
+	};
+	std::deque<pending> pending_;
+
 	// Set to fz::monotonic_clock::now initially and after
 	// sending an updated listing to the UI.
 	fz::monotonic_clock time_;
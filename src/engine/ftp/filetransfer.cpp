@@ -19,6 +19,18 @@ CFtpFileTransferOpData::CFtpFileTransferOpData(CFtpControlSocket& controlSocket,
 	binary = !(cmd.GetFlags() & ftp_transfer_flags::ascii);
 }
 
+CFtpFileTransferOpData::~CFtpFileTransferOpData()
+{
+	if (segments_) {
+		if (segmentPrimary_) {
+			segments_->set_waiter(nullptr);
+		}
+		if (segmentClaimed_) {
+			segments_->release(segment_.index_);
+		}
+	}
+}
+
 int CFtpFileTransferOpData::Send()
 {
 	std::wstring cmd;
@@ -41,6 +53,13 @@ int CFtpFileTransferOpData::Send()
 			remotePath_.SetType(currentServer_.GetType());
 		}
 
+		if (segments_ && !segmentPrimary_) {
+			// The primary has already looked at the file, helpers go straight for the data
+			tryAbsolutePath_ = true;
+			opState = filetransfer_segment;
+			return FZ_REPLY_CONTINUE;
+		}
+
 		controlSocket_.ChangeDir(remotePath_);
 		return FZ_REPLY_CONTINUE;
 	case filetransfer_size:
@@ -58,9 +77,22 @@ int CFtpFileTransferOpData::Send()
 			controlSocket_.m_pTransferSocket.reset();
 		}
 
+		if (segments_ && download()) {
+			int res = StartSegments();
+			if (res != FZ_REPLY_CONTINUE || segments_) {
+				return res;
+			}
+		}
+
 		{
 			resumeOffset = 0;
 			if (download()) {
+				// An earlier segmented download may have left holes in the file
+				auto const* file_writer = dynamic_cast<fz::file_writer_factory const*>(&*writer_factory_);
+				if (file_writer) {
+					download_segments::discard(file_writer->name());
+				}
+
 				// Potentially racy
 				localFileSize_ = writer_factory_.size(); 
 				fileDidExist_ = localFileSize_ != fz::aio_base::nosize;
@@ -161,6 +193,11 @@ int CFtpFileTransferOpData::Send()
 
 		break;
 	}
+	case filetransfer_segment:
+		return SendSegment();
+	case filetransfer_waitsegments:
+		opState = filetransfer_segment;
+		return FZ_REPLY_CONTINUE;
 	default:
 		log(logmsg::debug_warning, L"Unhandled opState: %d", opState);
 		return FZ_REPLY_ERROR;
@@ -173,6 +210,107 @@ int CFtpFileTransferOpData::Send()
 	return FZ_REPLY_WOULDBLOCK;
 }
 
+int CFtpFileTransferOpData::StartSegments()
+{
+	if (!binary || remoteFileSize_ <= 0 || remoteFileSize_ != segments_->size()) {
+		log(logmsg::debug_info, L"Not downloading in segments, remote file size is %d instead of %d", remoteFileSize_, segments_->size());
+		segments_->abandon();
+		segments_.reset();
+		return FZ_REPLY_CONTINUE;
+	}
+
+	if (resume_) {
+		uint64_t const existing = writer_factory_.size();
+		segments_->load(existing != fz::aio_base::nosize ? static_cast<int64_t>(existing) : 0);
+	}
+	else {
+		segments_->clear();
+	}
+
+	fz::native_string last_created;
+	bool const prepared = segments_->prepare(&last_created);
+	if (!last_created.empty()) {
+		// Send out notification
+		auto n = std::make_unique<CLocalDirCreatedNotification>();
+		if (n->dir.SetPath(fz::to_wstring(last_created))) {
+			engine_.AddNotification(std::move(n));
+		}
+	}
+	if (!prepared) {
+		log(logmsg::error, _("Could not open \"%s\" for writing"), segments_->file());
+		segments_->abandon();
+		return FZ_REPLY_CRITICALERROR;
+	}
+
+	log(logmsg::status, _("Downloading in %d segments"), segments_->segment_count());
+
+	segments_->set_waiter(&controlSocket_);
+	segments_->start();
+	engine_.AddNotification(std::make_unique<CSegmentsStartedNotification>());
+
+	opState = filetransfer_segment;
+	return FZ_REPLY_CONTINUE;
+}
+
+int CFtpFileTransferOpData::SendSegment()
+{
+	if (controlSocket_.m_pTransferSocket) {
+		controlSocket_.m_pTransferSocket.reset();
+	}
+
+	if (!segments_->claim(segment_)) {
+		if (!segmentPrimary_) {
+			// Nothing left, the primary takes care of segments other helpers give back
+			return FZ_REPLY_OK;
+		}
+		if (segments_->done()) {
+			return FinishSegments();
+		}
+
+		// Other engines are still busy with the remaining segments. There's
+		// nothing to time out on while waiting for them.
+		controlSocket_.SetWait(false);
+		opState = filetransfer_waitsegments;
+		return FZ_REPLY_WOULDBLOCK;
+	}
+	segmentClaimed_ = true;
+
+	log(logmsg::debug_info, L"Downloading segment %d, %d bytes at offset %d", segment_.index_, segment_.length_, segment_.offset_);
+
+	resumeOffset = segment_.offset_;
+	if (segmentPrimary_) {
+		engine_.transfer_status_.Init(segments_->size(), segments_->completed_bytes(), false);
+	}
+	else {
+		engine_.transfer_status_.Init(segment_.length_, 0, false);
+	}
+
+	controlSocket_.m_pTransferSocket = std::make_unique<CTransferSocket>(engine_, controlSocket_, TransferMode::download);
+	auto writer = controlSocket_.OpenSegmentWriter(*segments_, segment_);
+	if (!writer) {
+		return FZ_REPLY_CRITICALERROR;
+	}
+	controlSocket_.m_pTransferSocket->set_writer(std::move(writer), false);
+	controlSocket_.m_pTransferSocket->set_download_limit(segment_.length_);
+
+	opState = filetransfer_waitsegment;
+	controlSocket_.Transfer(L"RETR " + remotePath_.FormatFilename(remoteFile_, !tryAbsolutePath_), this);
+	return FZ_REPLY_CONTINUE;
+}
+
+int CFtpFileTransferOpData::FinishSegments()
+{
+	segments_->finish();
+
+	if (options_.get_int(OPTION_PRESERVE_TIMESTAMPS) && !remoteFileTime_.empty()) {
+		if (!writer_factory_->set_mtime(remoteFileTime_)) {
+			log(logmsg::debug_warning, L"Could not set modification time");
+		}
+	}
+
+	return FZ_REPLY_OK;
+}
+
 int CFtpFileTransferOpData::TestResumeCapability()
 {
 	log(logmsg::debug_verbose, L"CFtpFileTransferOpData::TestResumeCapability()");
@@ -434,6 +572,15 @@ int CFtpFileTransferOpData::SubcommandResult(int prevResult, COpData const&)
 		}
 		return prevResult;
 	}
+	else if (opState == filetransfer_waitsegment) {
+		segmentClaimed_ = false;
+		if (prevResult != FZ_REPLY_OK) {
+			segments_->release(segment_.index_);
+			return prevResult;
+		}
+		segments_->complete(segment_.index_);
+		opState = filetransfer_segment;
+	}
 	else if (opState == filetransfer_waitresumetest) {
 		if (prevResult != FZ_REPLY_OK) {
 			if (transferEndReason == TransferEndReason::failed_resumetest) {
@@ -14,13 +14,17 @@ enum filetransferStates
 	filetransfer_transfer,
 	filetransfer_waittransfer,
 	filetransfer_waitresumetest,
-	filetransfer_mfmt
+	filetransfer_mfmt,
+	filetransfer_segment,
+	filetransfer_waitsegment,
+	filetransfer_waitsegments
 };
 
 class CFtpFileTransferOpData final : public CFileTransferOpData, public CFtpTransferOpData, public CFtpOpData
 {
 public:
 	CFtpFileTransferOpData(CFtpControlSocket& controlSocket, CFileTransferCommand const& cmd);
+	virtual ~CFtpFileTransferOpData();
 
 	virtual int Send() override;
 	virtual int ParseResponse() override;
@@ -28,7 +32,15 @@ public:
 
 	int TestResumeCapability();
 
+	// Segmented downloads, see download_segments
+	int StartSegments();
+	int SendSegment();
+	int FinishSegments();
+
 	bool fileDidExist_{true};
+
+	download_segments::segment segment_;
+	bool segmentClaimed_{};
 };
 
 #endif
@@ -178,6 +178,8 @@ void CFtpControlSocket::ParseLine(std::wstring line)
 void CFtpControlSocket::OnConnect()
 {
 	m_lastTypeBinary = -1;
+	m_lastModeZ = 0;
+	m_lastModeZLevel = -1;
 	m_sentRestartOffset = false;
 
 	SetAlive();
@@ -248,6 +250,19 @@ void CFtpControlSocket::ParseResponse()
 		return;
 	}
 
+	if (!preopenCommand_.empty() && m_Response[0] != '1') {
+		OnPreopenReply();
+
+		SetWait(false);
+		if (operations_.empty()) {
+			StartKeepaliveTimer();
+		}
+		else if (!m_pendingReplies) {
+			SendNextCommand();
+		}
+		return;
+	}
+
 	if (operations_.empty()) {
 		log(logmsg::debug_info, L"Skipping reply without active operation.");
 		return;
@@ -331,8 +346,13 @@ int CFtpControlSocket::ResetOperation(int nErrorCode)
 
 	m_repliesToSkip = m_pendingReplies;
 
+	// Including the reply to a PASV sent ahead of time
+	preopenCommand_.clear();
+
+	bool preopen{};
 	if (!operations_.empty() && operations_.back()->opId == Command::transfer) {
 		auto & data = static_cast<CFtpFileTransferOpData &>(*operations_.back());
+		preopen = nErrorCode == FZ_REPLY_OK && data.moreTransfersPending_;
 		if (data.tranferCommandSent) {
 			if (data.transferEndReason == TransferEndReason::transfer_failure_critical) {
 				nErrorCode |= FZ_REPLY_CRITICALERROR | FZ_REPLY_WRITEFAILED;
@@ -374,7 +394,11 @@ int CFtpControlSocket::ResetOperation(int nErrorCode)
 		m_idleTimer = 0;
 	}
 
-	return CControlSocket::ResetOperation(nErrorCode);
+	int const res = CControlSocket::ResetOperation(nErrorCode);
+	if (preopen && operations_.empty()) {
+		PreopenDataConnection();
+	}
+	return res;
 }
 
 bool CFtpControlSocket::CanSendNextCommand()
@@ -384,9 +408,260 @@ bool CFtpControlSocket::CanSendNextCommand()
 		return false;
 	}
 
+	if (!preopenCommand_.empty()) {
+		log(logmsg::debug_verbose, L"Waiting for reply to %s before sending next command...", preopenCommand_);
+		return false;
+	}
+
+	return true;
+}
+
+int CFtpControlSocket::PipelineWindow() const
+{
+	if (m_repliesToSkip) {
+		return 1;
+	}
+
+	if (CServerCapabilities::GetCapability(currentServer_, command_pipelining) == no) {
+		return 1;
+	}
+
+	return static_cast<int>(engine_.GetOptions().get_int(OPTION_FTP_PIPELINE_DEPTH));
+}
+
+void CFtpControlSocket::PipelineFailed()
+{
+	if (CServerCapabilities::GetCapability(currentServer_, command_pipelining) != no) {
+		log(logmsg::debug_warning, L"Server does not handle pipelined commands, sending commands one by one from now on.");
+		CServerCapabilities::SetCapability(currentServer_, command_pipelining, no);
+	}
+}
+
+bool CFtpControlSocket::UsePassiveMode() const
+{
+	if (proxy_layer_) {
+		// Only passive supported
+		// Theoretically could use reverse proxy ability in SOCKS5, but
+		// it is too fragile to set up with all those broken routers and
+		// firewalls sabotaging connections. Regular active mode is hard
+		// enough already
+		return true;
+	}
+
+	switch (currentServer_.GetPasvMode())
+	{
+	case MODE_PASSIVE:
+		return true;
+	case MODE_ACTIVE:
+		return false;
+	default:
+		return engine_.GetOptions().get_int(OPTION_USEPASV) != 0;
+	}
+}
+
+std::wstring CFtpControlSocket::GetPassiveCommand() const
+{
+	std::wstring ret = L"PASV";
+
+	if (proxy_layer_) {
+		// We don't actually know the address family the other end of the proxy uses to reach the server. Hence prefer EPSV
+		// if the server supports it.
+		if (CServerCapabilities::GetCapability(currentServer_, epsv_command) == yes) {
+			ret = L"EPSV";
+		}
+	}
+	else if (socket_->address_family() == fz::address_type::ipv6) {
+		// EPSV is mandatory for IPv6, don't check capabilities
+		ret = L"EPSV";
+	}
+	return ret;
+}
+
+bool CFtpControlSocket::ParseEpsvResponse(std::wstring & host, int & port)
+{
+	size_t pos = m_Response.find(L"(|||");
+	if (pos == std::wstring::npos) {
+		return false;
+	}
+
+	size_t pos2 = m_Response.find(L"|)", pos + 4);
+	if (pos2 == std::wstring::npos || pos2 == pos + 4) {
+		return false;
+	}
+
+	std::wstring number = m_Response.substr(pos + 4, pos2 - pos - 4);
+	auto p = fz::to_integral<unsigned int>(number);
+
+	if (p == 0 || p > 65535) {
+		return false;
+	}
+
+	port = p;
+
+	if (proxy_layer_) {
+		host = currentServer_.GetHost();
+	}
+	else {
+		host = fz::to_wstring(socket_->peer_ip());
+	}
+	return true;
+}
+
+bool CFtpControlSocket::ParsePasvResponse(std::wstring & host, int & port, bool triedActive)
+{
+	// Validate ip address
+	if (!m_pasvReplyRegex) {
+		std::wstring digit = L"0*[0-9]{1,3}";
+		wchar_t const* const  dot = L",";
+		std::wstring exp = L"( |\\()(" + digit + dot + digit + dot + digit + dot + digit + dot + digit + dot + digit + L")( |\\)|$)";
+		m_pasvReplyRegex = std::make_unique<std::wregex>(exp);
+	}
+
+	std::wsmatch m;
+	if (!std::regex_search(m_Response, m, *m_pasvReplyRegex)) {
+		return false;
+	}
+
+	host = m[2].str();
+
+	size_t i = host.rfind(',');
+	if (i == std::wstring::npos) {
+		return false;
+	}
+	auto number = fz::to_integral<unsigned int>(host.substr(i + 1));
+	if (number > 255) {
+		return false;
+	}
+
+	port = number; //get ls byte of server socket
+	host = host.substr(0, i);
+	i = host.rfind(',');
+	if (i == std::string::npos) {
+		return false;
+	}
+	number = fz::to_integral<unsigned int>(host.substr(i + 1));
+	if (number > 255) {
+		return false;
+	}
+
+	port += 256 * number; //add ms byte of server socket
+	host = host.substr(0, i);
+	fz::replace_substrings(host, L",", L".");
+
+	if (proxy_layer_) {
+		// We do not have any information about the proxy's inner workings
+		return true;
+	}
+
+	auto & options = engine_.GetOptions();
+	std::wstring const peerIP = fz::to_wstring(socket_->peer_ip());
+	if (!fz::is_routable_address(host) && fz::is_routable_address(peerIP)) {
+		if (options.get_int(OPTION_PASVREPLYFALLBACKMODE) != 1 || triedActive) {
+			log(logmsg::status, _("Server sent passive reply with unroutable address. Using server address instead."));
+			log(logmsg::debug_info, L"  Reply: %s, peer: %s", host, peerIP);
+			host = peerIP;
+		}
+		else {
+			log(logmsg::status, _("Server sent passive reply with unroutable address. Passive mode failed."));
+			log(logmsg::debug_info, L"  Reply: %s, peer: %s", host, peerIP);
+			return false;
+		}
+	}
+	else if (options.get_int(OPTION_PASVREPLYFALLBACKMODE) == 2) {
+		// Always use server address
+		host = peerIP;
+	}
+
 	return true;
 }
 
+void CFtpControlSocket::PreopenDataConnection()
+{
+	if (!active_layer_ || !operations_.empty() || m_pendingReplies || m_repliesToSkip) {
+		return;
+	}
+
+	if (preopened_ || !preopenCommand_.empty() || !UsePassiveMode()) {
+		return;
+	}
+
+	log(logmsg::debug_verbose, L"Opening data connection for the next transfer ahead of time");
+	preopenCommand_ = GetPassiveCommand();
+	int res = SendCommand(preopenCommand_);
+	if (res != FZ_REPLY_WOULDBLOCK) {
+		preopenCommand_.clear();
+		DoClose(res);
+	}
+}
+
+void CFtpControlSocket::OnPreopenReply()
+{
+	std::wstring const cmd = std::move(preopenCommand_);
+	preopenCommand_.clear();
+
+	int const code = GetReplyCode();
+	if (code != 2 && code != 3) {
+		log(logmsg::debug_info, L"%s sent ahead of time failed, the next transfer sets up its own data connection.", cmd);
+		return;
+	}
+
+	std::wstring host;
+	int port{};
+	bool parsed;
+	if (cmd == L"EPSV") {
+		parsed = ParseEpsvResponse(host, port);
+	}
+	else {
+		parsed = ParsePasvResponse(host, port, false);
+	}
+	if (!parsed) {
+		return;
+	}
+
+	preopened_ = std::make_unique<CTransferSocket>(engine_, *this, TransferMode::preopened);
+	if (!preopened_->SetupPassiveTransfer(host, port)) {
+		log(logmsg::debug_info, L"Could not open data connection ahead of time");
+		preopened_.reset();
+		return;
+	}
+
+	// Servers do not keep idle data connections around for long either
+	stop_timer(preopenTimer_);
+	preopenTimer_ = add_timer(fz::duration::from_seconds(10), true);
+}
+
+bool CFtpControlSocket::TakePreopened(CTransferSocket & socket)
+{
+	if (!preopened_) {
+		return false;
+	}
+
+	stop_timer(preopenTimer_);
+	preopenTimer_ = 0;
+
+	bool const taken = socket.TakeConnection(*preopened_);
+	if (taken) {
+		log(logmsg::debug_info, L"Using data connection opened ahead of time");
+		preopened_.reset();
+	}
+	else {
+		ClosePreopened();
+	}
+	return taken;
+}
+
+void CFtpControlSocket::ClosePreopened()
+{
+	stop_timer(preopenTimer_);
+	preopenTimer_ = 0;
+
+	if (preopened_) {
+		log(logmsg::debug_verbose, L"Closing unused data connection");
+		preopened_->CloseUnused();
+		preopened_.reset();
+	}
+}
+
 void CFtpControlSocket::ChangeDir(CServerPath const& path, std::wstring const& subDir, bool link_discovery)
 {
 	auto pData = std::make_unique<CFtpChangeDirOpData>(*this);
@@ -463,6 +738,17 @@ void CFtpControlSocket::TransferEnd()
 	}
 }
 
+void CFtpControlSocket::OnSegmentEvent()
+{
+	// Another engine completed or gave back a segment of the download we
+	// are waiting on, see whether there is anything left to do.
+	if (operations_.empty() || operations_.back()->opId != Command::transfer || operations_.back()->opState != filetransfer_waitsegments) {
+		return;
+	}
+
+	SendNextCommand();
+}
+
 bool CFtpControlSocket::SetAsyncRequestReply(CAsyncRequestNotification *pNotification)
 {
 	log(logmsg::debug_verbose, L"CFtpControlSocket::SetAsyncRequestReply");
@@ -712,6 +998,12 @@ void CFtpControlSocket::Connect(CServer const& server, Credentials const& creden
 
 void CFtpControlSocket::OnTimer(fz::timer_id id)
 {
+	if (id == preopenTimer_) {
+		preopenTimer_ = 0;
+		ClosePreopened();
+		return;
+	}
+
 	if (id != m_idleTimer) {
 		CControlSocket::OnTimer(id);
 		return;
@@ -790,6 +1082,10 @@ void CFtpControlSocket::operator()(fz::event_base const& ev)
 		return;
 	}
 
+	if (fz::dispatch<download_segment_event>(ev, this, &CFtpControlSocket::OnSegmentEvent)) {
+		return;
+	}
+
 	if (fz::dispatch<fz::certificate_verification_event>(ev, this, &CFtpControlSocket::OnVerifyCert)) {
 		return;
 	}
@@ -807,6 +1103,8 @@ void CFtpControlSocket::ResetSocket()
 	m_MultilineResponseCode.clear();;
 	m_MultilineResponseLines.clear();
 	m_protectDataChannel = false;
+	ClosePreopened();
+	preopenCommand_.clear();
 
 	CRealControlSocket::ResetSocket();
 }
@@ -69,6 +69,7 @@ protected:
 	void Transfer(std::wstring const& cmd, CFtpTransferOpData* oldData);
 
 	void TransferEnd();
+	void OnSegmentEvent();
 
 	virtual void OnConnect() override;
 	virtual void OnReceive() override;
@@ -88,10 +89,33 @@ protected:
 
 	virtual bool CanSendNextCommand() override;
 
+	// Batches of independent commands may keep up to this many commands
+	// outstanding. Replies arrive in the order the commands were sent.
+	// Returns 1 if commands have to be sent in lock-step.
+	int PipelineWindow() const;
+
+	// The server mishandled pipelined commands, use lock-step from now on
+	void PipelineFailed();
+
 	int GetReplyCode() const;
 
 	int GetExternalIPAddress(std::string& address);
 
+	// Whether data connections get established in passive mode
+	bool UsePassiveMode() const;
+	std::wstring GetPassiveCommand() const;
+	bool ParsePasvResponse(std::wstring & host, int & port, bool triedActive);
+	bool ParseEpsvResponse(std::wstring & host, int & port);
+
+	// Called once a transfer is done if the queue has more files for this
+	// engine. Sends PASV and connects the data connection for the next
+	// transfer right away, saving the handshakes later on. Data connections
+	// not picked up by a transfer soon get closed again.
+	void PreopenDataConnection();
+	void OnPreopenReply();
+	bool TakePreopened(CTransferSocket & socket);
+	void ClosePreopened();
+
 	void StartKeepaliveTimer();
 
 	std::wstring m_Response;
@@ -100,6 +124,10 @@ protected:
 
 	std::unique_ptr<CTransferSocket> m_pTransferSocket;
 
+	std::unique_ptr<CTransferSocket> preopened_;
+	std::wstring preopenCommand_; // Set while waiting for its reply
+	fz::timer_id preopenTimer_{};
+
 	// Some servers keep track of the offset specified by REST between sessions
 	// So we always sent a REST 0 for a normal transfer following a restarted one
 	bool m_sentRestartOffset{};
@@ -116,6 +144,10 @@ protected:
 
 	int m_lastTypeBinary{-1};
 
+	// Data connection mode: 0 for stream, 1 for MODE Z, -1 if unknown
+	int m_lastModeZ{-1};
+	int m_lastModeZLevel{-1};
+
 	// Used by keepalive code so that we're not using keep alive
 	// till the end of time. Stop after a couple of minutes.
 	fz::monotonic_clock m_lastCommandCompletionTime;
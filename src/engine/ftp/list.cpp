@@ -95,8 +95,13 @@ int CFtpListOpData::Send()
 		}
 
 		listing_parser_ = std::make_unique<CDirectoryListingParser>(&controlSocket_, currentServer_, encoding);
+		int format{};
+		if (CServerCapabilities::GetCapability(currentServer_, listing_format, &format) == yes) {
+			listing_parser_->SetFormatHint(static_cast<listingFormat::type>(format));
+		}
 
 		listing_parser_->SetTimezoneOffset(controlSocket_.GetInferredTimezoneOffset());
+		listing_parser_->EnablePartialListings(currentPath_);
 		controlSocket_.m_pTransferSocket->m_pDirectoryListingParser = listing_parser_.get();
 
 		engine_.transfer_status_.Init(-1, 0, true);
@@ -226,6 +231,14 @@ int CFtpListOpData::SubcommandResult(int prevResult, COpData const&)
 		if (prevResult == FZ_REPLY_OK) {
 			CDirectoryListing listing = listing_parser_->Parse(currentPath_);
 
+			auto const format = listing_parser_->GetDetectedFormat();
+			if (CDirectoryListingParser::IsHintableFormat(format)) {
+				CServerCapabilities::SetCapability(currentServer_, listing_format, yes, static_cast<int>(format));
+			}
+			else if (format != listingFormat::unknown) {
+				CServerCapabilities::SetCapability(currentServer_, listing_format, no);
+			}
+
 			if (viewHiddenCheck_) {
 				if (!viewHidden_) {
 					// Repeat with LIST -a
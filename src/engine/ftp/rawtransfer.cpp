@@ -5,8 +5,6 @@
 #include "transfersocket.h"
 #include "../../include/engine_options.h"
 
-#include <libfilezilla/iputils.hpp>
-
 #include <assert.h>
 
 int CFtpRawTransferOpData::Send()
@@ -21,38 +19,24 @@ int CFtpRawTransferOpData::Send()
 	switch (opState)
 	{
 	case rawtransfer_init:
+		// Compressed transfers cannot be resumed, REST offsets are ambiguous in MODE Z
+		modeZ_ = options_.get_int(OPTION_MODEZ_SUPPORT) && pOldData->resumeOffset <= 0 &&
+			CServerCapabilities::GetCapability(currentServer_, mode_z_support) == yes;
+		modeZLevel_ = options_.get_int(OPTION_MODEZ_LEVEL);
+
 		if ((pOldData->binary && controlSocket_.m_lastTypeBinary == 1) ||
 			(!pOldData->binary && controlSocket_.m_lastTypeBinary == 0))
 		{
-			opState = rawtransfer_port_pasv;
+			opState = StateAfterType();
 		}
 		else {
 			opState = rawtransfer_type;
 		}
 
+		bPasv = controlSocket_.UsePassiveMode();
 		if (controlSocket_.proxy_layer_) {
-			// Only passive supported
-			// Theoretically could use reverse proxy ability in SOCKS5, but
-			// it is too fragile to set up with all those broken routers and
-			// firewalls sabotaging connections. Regular active mode is hard
-			// enough already
-			bPasv = true;
 			bTriedActive = true;
 		}
-		else {
-			switch (currentServer_.GetPasvMode())
-			{
-			case MODE_PASSIVE:
-				bPasv = true;
-				break;
-			case MODE_ACTIVE:
-				bPasv = false;
-				break;
-			default:
-				bPasv = options_.get_int(OPTION_USEPASV) != 0;
-				break;
-			}
-		}
 
 		return FZ_REPLY_CONTINUE;
 	case rawtransfer_type:
@@ -65,11 +49,27 @@ int CFtpRawTransferOpData::Send()
 		}
 		measureRTT = true;
 		break;
+	case rawtransfer_mode:
+		controlSocket_.m_lastModeZ = -1;
+		cmd = modeZ_ ? L"MODE Z" : L"MODE S";
+		break;
+	case rawtransfer_mode_level:
+		cmd = fz::sprintf(L"OPTS MODE Z LEVEL %d", modeZLevel_);
+		break;
 	case rawtransfer_port_pasv:
+		controlSocket_.m_pTransferSocket->set_compression(controlSocket_.m_lastModeZ == 1 ? modeZLevel_ : -1);
 		if (bPasv) {
+			if (controlSocket_.TakePreopened(*controlSocket_.m_pTransferSocket)) {
+				bTriedPasv = true;
+				preopened_ = true;
+				opState = StateAfterPasv();
+				return FZ_REPLY_CONTINUE;
+			}
 			cmd = GetPassiveCommand();
 		}
 		else {
+			controlSocket_.ClosePreopened();
+
 			std::string address;
 			int res = controlSocket_.GetExternalIPAddress(address);
 			if (res == FZ_REPLY_WOULDBLOCK) {
@@ -107,7 +107,7 @@ int CFtpRawTransferOpData::Send()
 		measureRTT = true;
 		break;
 	case rawtransfer_transfer:
-		if (bPasv) {
+		if (bPasv && !preopened_) {
 			if (!controlSocket_.m_pTransferSocket->SetupPassiveTransfer(host_, port_)) {
 				log(logmsg::error, _("Could not establish connection to server"));
 				return FZ_REPLY_ERROR;
@@ -152,10 +152,36 @@ int CFtpRawTransferOpData::ParseResponse()
 			error = true;
 		}
 		else {
-			opState = rawtransfer_port_pasv;
 			controlSocket_.m_lastTypeBinary = pOldData->binary ? 1 : 0;
+			opState = StateAfterType();
+		}
+		break;
+	case rawtransfer_mode:
+		if (code == 2 || code == 3) {
+			controlSocket_.m_lastModeZ = modeZ_ ? 1 : 0;
+			if (modeZ_ && controlSocket_.m_lastModeZLevel != modeZLevel_) {
+				opState = rawtransfer_mode_level;
+			}
+			else {
+				opState = rawtransfer_port_pasv;
+			}
+		}
+		else if (modeZ_) {
+			// Advertised but refused, fall back to stream mode for good
+			log(logmsg::debug_warning, L"Server refused MODE Z, transferring uncompressed.");
+			CServerCapabilities::SetCapability(currentServer_, mode_z_support, no);
+			modeZ_ = false;
+			opState = rawtransfer_mode;
+		}
+		else {
+			error = true;
 		}
 		break;
+	case rawtransfer_mode_level:
+		// Not all servers support setting the level, the default is fine then
+		controlSocket_.m_lastModeZLevel = modeZLevel_;
+		opState = rawtransfer_port_pasv;
+		break;
 	case rawtransfer_port_pasv:
 		if (code != 2 && code != 3) {
 			if (!options_.get_int(OPTION_ALLOW_TRANSFERMODEFALLBACK)) {
@@ -179,10 +205,10 @@ int CFtpRawTransferOpData::ParseResponse()
 		if (bPasv) {
 			bool parsed;
 			if (GetPassiveCommand() == L"EPSV") {
-				parsed = ParseEpsvResponse();
+				parsed = controlSocket_.ParseEpsvResponse(host_, port_);
 			}
 			else {
-				parsed = ParsePasvResponse();
+				parsed = controlSocket_.ParsePasvResponse(host_, port_, bTriedActive);
 			}
 			if (!parsed) {
 				if (!options_.get_int(OPTION_ALLOW_TRANSFERMODEFALLBACK)) {
@@ -199,12 +225,7 @@ int CFtpRawTransferOpData::ParseResponse()
 				break;
 			}
 		}
-		if (pOldData->resumeOffset > 0 || controlSocket_.m_sentRestartOffset) {
-			opState = rawtransfer_rest;
-		}
-		else {
-			opState = rawtransfer_transfer;
-		}
+		opState = StateAfterPasv();
 		break;
 	case rawtransfer_rest:
 		if (pOldData->resumeOffset <= 0) {
@@ -253,7 +274,7 @@ int CFtpRawTransferOpData::ParseResponse()
 		}
 		break;
 	case rawtransfer_waitfinish:
-		if (code != 2 && code != 3) {
+		if (code != 2 && code != 3 && !AbortedAtLimit()) {
 			if (pOldData->transferEndReason == TransferEndReason::successful) {
 				pOldData->transferEndReason = TransferEndReason::transfer_command_failure;
 			}
@@ -264,7 +285,7 @@ int CFtpRawTransferOpData::ParseResponse()
 		}
 		break;
 	case rawtransfer_waittransfer:
-		if (code != 2 && code != 3) {
+		if (code != 2 && code != 3 && !AbortedAtLimit()) {
 			if (pOldData->transferEndReason == TransferEndReason::successful) {
 				pOldData->transferEndReason = TransferEndReason::transfer_command_failure;
 			}
@@ -294,120 +315,37 @@ int CFtpRawTransferOpData::ParseResponse()
 	return FZ_REPLY_CONTINUE;
 }
 
-bool CFtpRawTransferOpData::ParseEpsvResponse()
+int CFtpRawTransferOpData::StateAfterType() const
 {
-	size_t pos = controlSocket_.m_Response.find(L"(|||");
-	if (pos == std::wstring::npos) {
-		return false;
+	if (controlSocket_.m_lastModeZ != (modeZ_ ? 1 : 0)) {
+		return rawtransfer_mode;
 	}
-
-	size_t pos2 = controlSocket_.m_Response.find(L"|)", pos + 4);
-	if (pos2 == std::wstring::npos || pos2 == pos + 4) {
-		return false;
-	}
-
-	std::wstring number = controlSocket_.m_Response.substr(pos + 4, pos2 - pos - 4);
-	auto port = fz::to_integral<unsigned int>(number);
-
-	if (port == 0 || port > 65535) {
-		return false;
-	}
-
-	port_ = port;
-
-	if (controlSocket_.proxy_layer_) {
-		host_ = currentServer_.GetHost();
-	}
-	else {
-		host_ = fz::to_wstring(controlSocket_.socket_->peer_ip());
-	}
-	return true;
+	return rawtransfer_port_pasv;
 }
 
-bool CFtpRawTransferOpData::ParsePasvResponse()
+int CFtpRawTransferOpData::StateAfterPasv() const
 {
-	// Validate ip address
-	if (!controlSocket_.m_pasvReplyRegex) {
-		std::wstring digit = L"0*[0-9]{1,3}";
-		wchar_t const* const  dot = L",";
-		std::wstring exp = L"( |\\()(" + digit + dot + digit + dot + digit + dot + digit + dot + digit + dot + digit + L")( |\\)|$)";
-		controlSocket_.m_pasvReplyRegex = std::make_unique<std::wregex>(exp);
-	}
-
-	std::wsmatch m;
-	if (!std::regex_search(controlSocket_.m_Response, m, *controlSocket_.m_pasvReplyRegex)) {
-		return false;
-	}
-
-	host_ = m[2].str();
-
-	size_t i = host_.rfind(',');
-	if (i == std::wstring::npos) {
-		return false;
-	}
-	auto number = fz::to_integral<unsigned int>(host_.substr(i + 1));
-	if (number > 255) {
-		return false;
-	}
-
-	port_ = number; //get ls byte of server socket
-	host_ = host_.substr(0, i);
-	i = host_.rfind(',');
-	if (i == std::string::npos) {
-		return false;
+	if (pOldData->resumeOffset > 0 || controlSocket_.m_sentRestartOffset) {
+		return rawtransfer_rest;
 	}
-	number = fz::to_integral<unsigned int>(host_.substr(i + 1));
-	if (number > 255) {
-		return false;
-	}
-
-	port_ += 256 * number; //add ms byte of server socket
-	host_ = host_.substr(0, i);
-	fz::replace_substrings(host_, L",", L".");
+	return rawtransfer_transfer;
+}
 
-	if (controlSocket_.proxy_layer_) {
-		// We do not have any information about the proxy's inner workings
+bool CFtpRawTransferOpData::AbortedAtLimit()
+{
+	// We closed the data connection ourselves after receiving all bytes of a
+	// segment, most servers then report the transfer as aborted.
+	if (controlSocket_.m_pTransferSocket && controlSocket_.m_pTransferSocket->download_limit_reached()) {
+		log(logmsg::debug_info, L"Ignoring error reply, the data connection was closed at the end of the segment.");
 		return true;
 	}
-
-	std::wstring const peerIP = fz::to_wstring(controlSocket_.socket_->peer_ip());
-	if (!fz::is_routable_address(host_) && fz::is_routable_address(peerIP)) {
-		if (options_.get_int(OPTION_PASVREPLYFALLBACKMODE) != 1 || bTriedActive) {
-			log(logmsg::status, _("Server sent passive reply with unroutable address. Using server address instead."));
-			log(logmsg::debug_info, L"  Reply: %s, peer: %s", host_, peerIP);
-			host_ = peerIP;
-		}
-		else {
-			log(logmsg::status, _("Server sent passive reply with unroutable address. Passive mode failed."));
-			log(logmsg::debug_info, L"  Reply: %s, peer: %s", host_, peerIP);
-			return false;
-		}
-	}
-	else if (options_.get_int(OPTION_PASVREPLYFALLBACKMODE) == 2) {
-		// Always use server address
-		host_ = peerIP;
-	}
-
-	return true;
+	return false;
 }
 
 std::wstring CFtpRawTransferOpData::GetPassiveCommand()
 {
-	std::wstring ret = L"PASV";
-
 	assert(bPasv);
 	bTriedPasv = true;
 
-	if (controlSocket_.proxy_layer_) {
-		// We don't actually know the address family the other end of the proxy uses to reach the server. Hence prefer EPSV
-		// if the server supports it.
-		if (CServerCapabilities::GetCapability(currentServer_, epsv_command) == yes) {
-			ret = L"EPSV";
-		}
-	}
-	else if (controlSocket_.socket_->address_family() == fz::address_type::ipv6) {
-		// EPSV is mandatory for IPv6, don't check capabilities
-		ret = L"EPSV";
-	}
-	return ret;
+	return controlSocket_.GetPassiveCommand();
 }
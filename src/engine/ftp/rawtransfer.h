@@ -7,6 +7,8 @@ enum rawtransferStates
 {
 	rawtransfer_init = 0,
 	rawtransfer_type,
+	rawtransfer_mode,
+	rawtransfer_mode_level,
 	rawtransfer_port_pasv,
 	rawtransfer_rest,
 	rawtransfer_transfer,
@@ -29,8 +31,11 @@ public:
 	virtual int ParseResponse() override;
 
 	std::wstring GetPassiveCommand();
-	bool ParsePasvResponse();
-	bool ParseEpsvResponse();
+	bool AbortedAtLimit();
+
+	// Sends MODE first if the data connection mode needs to change
+	int StateAfterType() const;
+	int StateAfterPasv() const;
 
 	std::wstring cmd_;
 
@@ -40,6 +45,12 @@ public:
 	bool bTriedPasv{};
 	bool bTriedActive{};
 
+	// Using a data connection opened ahead of time, no PASV sent
+	bool preopened_{};
+
+	bool modeZ_{};
+	int modeZLevel_{};
+
 	std::wstring host_;
 	int port_{};
 };
@@ -6,6 +6,7 @@
 #include "../servercapabilities.h"
 #include "../tls.h"
 
+#include "compression_layer.h"
 #include "ftpcontrolsocket.h"
 #include "transfersocket.h"
 
@@ -65,6 +66,7 @@ void CTransferSocket::ResetSocket()
 #if HAVE_ASCII_TRANSFORM
 	ascii_layer_.reset();
 #endif
+	compression_layer_.reset();
 	tls_layer_.reset();
 	proxy_layer_.reset();
 	ratelimit_layer_.reset();
@@ -238,6 +240,12 @@ void CTransferSocket::OnConnect()
 					return;
 				}
 				else if (cap == unknown) {
+					if (m_transferMode == TransferMode::preopened) {
+						// Nobody to ask yet, the transfer opens its own connection instead
+						TransferEnd(TransferEndReason::transfer_failure);
+						return;
+					}
+
 					// Ask whether to allow this insecure connection
 					++activity_block_;
 					controlSocket_.SendAsyncRequest(std::make_unique<FtpTlsNoResumptionNotification>(controlSocket_.currentServer_));
@@ -266,6 +274,19 @@ void CTransferSocket::OnReceive()
 {
 	controlSocket_.log(logmsg::debug_debug, L"CTransferSocket::OnReceive(), m_transferMode=%d", m_transferMode);
 
+	if (m_transferMode == TransferMode::preopened) {
+		// No transfer command has been sent yet, so this can only be the server
+		// closing the connection. Data sent this early is not usable either.
+		char tmp[1];
+		int error;
+		int numread = active_layer_->read(tmp, 1, error);
+		if (numread >= 0 || error != EAGAIN) {
+			controlSocket_.log(logmsg::debug_info, L"Data connection opened ahead of time got closed by the server");
+			TransferEnd(TransferEndReason::transfer_failure);
+		}
+		return;
+	}
+
 	if (activity_block_) {
 		controlSocket_.log(logmsg::debug_verbose, L"Postponing receive, m_bActive was false.");
 		m_postponedReceive = true;
@@ -323,10 +344,20 @@ void CTransferSocket::OnReceive()
 				}
 
 				size_t to_read = buffer_->capacity() - buffer_->size();
+				if (remaining_ >= 0 && static_cast<uint64_t>(remaining_) < to_read) {
+					to_read = static_cast<size_t>(remaining_);
+					if (!to_read) {
+						FinalizeWrite();
+						return;
+					}
+				}
 				numread = active_layer_->read(buffer_->get(to_read), static_cast<unsigned int>(to_read), error);
 				if (numread <= 0) {
 					break;
 				}
+				if (remaining_ > 0) {
+					remaining_ -= numread;
+				}
 
 				controlSocket_.SetAlive();
 				if (!m_madeProgress) {
@@ -344,7 +375,13 @@ void CTransferSocket::OnReceive()
 				}
 			}
 			else if (!numread) {
-				FinalizeWrite();
+				if (remaining_ > 0) {
+					controlSocket_.log(logmsg::error, L"Data connection closed %d bytes short of the end of the segment", remaining_);
+					TransferEnd(TransferEndReason::transfer_failure);
+				}
+				else {
+					FinalizeWrite();
+				}
 			}
 			else {
 				send_event<fz::socket_event>(active_layer_, fz::socket_event_flag::read, 0);
@@ -568,9 +605,25 @@ bool CTransferSocket::InitLayers(bool active)
 		}
 	}
 
+	return InitDataLayers();
+}
+
+bool CTransferSocket::InitDataLayers()
+{
+	// The layers get created with this as handler right away. When adopting a
+	// preopened connection, passing nullptr would drop pending events.
+	if (compression_level_ >= 0) {
+		compression_layer_ = std::make_unique<compression_layer>(this, *active_layer_, m_transferMode == TransferMode::upload, compression_level_);
+		if (!compression_layer_->initialized()) {
+			controlSocket_.log(logmsg::error, _("Could not initialize compression for the data connection"));
+			return false;
+		}
+		active_layer_ = compression_layer_.get();
+	}
+
 #if HAVE_ASCII_TRANSFORM
 	if (use_ascii_) {
-		ascii_layer_ = std::make_unique<fz::ascii_layer>(event_loop_, nullptr, *active_layer_);
+		ascii_layer_ = std::make_unique<fz::ascii_layer>(event_loop_, this, *active_layer_);
 		active_layer_ = ascii_layer_.get();
 	}
 #endif
@@ -608,7 +661,15 @@ void CTransferSocket::TransferEnd(TransferEndReason reason)
 	}
 	m_transferEndReason = reason;
 
-	if (reason != TransferEndReason::successful) {
+	if (m_transferMode == TransferMode::preopened) {
+		// Nothing waits for this connection yet, it just becomes unusable
+		ResetSocket();
+		return;
+	}
+
+	if (reason != TransferEndReason::successful || download_limit_reached()) {
+		// Closing the connection is what makes the server stop sending
+		// beyond the limit, it then replies with an error.
 		ResetSocket();
 	}
 	else {
@@ -650,7 +711,8 @@ std::unique_ptr<fz::listen_socket> CTransferSocket::CreateSocketServer()
 	// connection attempts. This may cause problems if transferring lots of
 	// files with a narrow port range.
 
-	static int start = 0;
+	// Engines may run on different event loops, hence atomic.
+	static std::atomic<int> start{0};
 
 	int low = engine_.GetOptions().get_int(OPTION_LIMITPORTS_LOW);
 	int high = engine_.GetOptions().get_int(OPTION_LIMITPORTS_HIGH);
@@ -659,7 +721,7 @@ std::unique_ptr<fz::listen_socket> CTransferSocket::CreateSocketServer()
 	}
 
 	if (start < low || start > high) {
-		start = static_cast<decltype(start)>(fz::random_number(low, high));
+		start = static_cast<int>(fz::random_number(low, high));
 	}
 
 	std::unique_ptr<fz::listen_socket> server;
@@ -819,6 +881,55 @@ void CTransferSocket::OnTimer(fz::timer_id)
 #endif
 }
 
+bool CTransferSocket::TakeConnection(CTransferSocket & other)
+{
+	if (other.m_transferMode != TransferMode::preopened || other.m_transferEndReason != TransferEndReason::none || !other.active_layer_) {
+		return false;
+	}
+
+	ResetSocket();
+
+	socket_ = std::move(other.socket_);
+	activity_logger_layer_ = std::move(other.activity_logger_layer_);
+	ratelimit_layer_ = std::move(other.ratelimit_layer_);
+	proxy_layer_ = std::move(other.proxy_layer_);
+	tls_layer_ = std::move(other.tls_layer_);
+	active_layer_ = other.active_layer_;
+	other.active_layer_ = nullptr;
+
+	// Also moves events still pending for the other socket over to this one
+	active_layer_->set_event_handler(this);
+
+	// The other socket has already handled the connection event
+	bool const connected = active_layer_->get_state() == fz::socket_state::connected;
+
+	if (!InitDataLayers()) {
+		ResetSocket();
+		return false;
+	}
+	active_layer_->set_event_handler(this);
+
+	if (connected) {
+		m_postponedReceive = true;
+		m_postponedSend = true;
+	}
+
+	return true;
+}
+
+void CTransferSocket::CloseUnused()
+{
+	if (m_transferMode != TransferMode::preopened) {
+		return;
+	}
+
+	if (active_layer_ && m_transferEndReason == TransferEndReason::none) {
+		active_layer_->shutdown();
+	}
+	m_transferEndReason = TransferEndReason::successful;
+	ResetSocket();
+}
+
 void CTransferSocket::ContinueWithoutSesssionResumption()
 {
 	if (activity_block_) {
@@ -6,13 +6,18 @@
 class CFileZillaEnginePrivate;
 class CFtpControlSocket;
 class CDirectoryListingParser;
+class compression_layer;
 
 enum class TransferMode
 {
 	list,
 	upload,
 	download,
-	resumetest
+	resumetest,
+
+	// Connected ahead of the next transfer, see
+	// CFtpControlSocket::PreopenDataConnection
+	preopened
 };
 
 namespace fz {
@@ -44,8 +49,25 @@ public:
 	void set_reader(std::unique_ptr<fz::reader_base> && reader, bool ascii);
 	void set_writer(std::unique_ptr<fz::writer_base> && writer, bool ascii);
 
+	// Downloads only: Closes the data connection once this many bytes
+	// have been received, the transfer counts as successful.
+	void set_download_limit(int64_t limit) { remaining_ = limit; }
+	bool download_limit_reached() const { return !remaining_; }
+
+	// MODE Z: Uploads get compressed with the given level, anything else
+	// gets decompressed. -1 disables compression.
+	void set_compression(int level) { compression_level_ = level; }
+
 	void ContinueWithoutSesssionResumption();
 
+	// Continues on the connection of a preopened transfer socket, skipping
+	// connection setup. Returns false if other cannot be used, e.g. since
+	// the server has closed it in the meantime.
+	bool TakeConnection(CTransferSocket & other);
+
+	// Preopened transfer sockets only: Shuts down the unused connection
+	void CloseUnused();
+
 protected:
 	bool CheckGetNextWriteBuffer();
 	bool CheckGetNextReadBuffer();
@@ -55,6 +77,9 @@ protected:
 
 	bool InitLayers(bool active);
 
+	// Adds the layers specific to the transferred data, e.g. MODE Z
+	bool InitDataLayers();
+
 	void ResetSocket();
 
 	void OnSocketEvent(fz::socket_event_source* source, fz::socket_event_flag t, int error);
@@ -94,6 +119,8 @@ protected:
 	std::unique_ptr<fz::rate_limited_layer> ratelimit_layer_;
 	std::unique_ptr<CProxySocket> proxy_layer_;
 	std::unique_ptr<fz::tls_layer> tls_layer_;
+	std::unique_ptr<compression_layer> compression_layer_;
+	int compression_level_{-1};
 #if HAVE_ASCII_TRANSFORM
 	std::unique_ptr<fz::ascii_layer> ascii_layer_;
 	bool use_ascii_{};
@@ -110,6 +137,9 @@ protected:
 	std::unique_ptr<fz::writer_base> writer_;
 	fz::buffer_lease buffer_;
 	size_t resumetest_{};
+
+	// Bytes left to receive, -1 if unlimited
+	int64_t remaining_{-1};
 };
 
 #endif
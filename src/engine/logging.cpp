@@ -6,6 +6,9 @@
 
 #include <libfilezilla/util.hpp>
 
+#include <algorithm>
+#include <thread>
+
 #include <errno.h>
 
 #ifndef FZ_WINDOWS
@@ -14,16 +17,391 @@
 #include <fcntl.h>
 #endif
 
-bool CLogging::m_logfile_initialized = false;
+namespace {
+struct log_record final
+{
+	logmsg::type type_{};
+	unsigned int engine_id_{};
+	fz::datetime time_;
+	std::wstring msg_;
+};
+
+// Number of messages that can be queued for the writer thread
+constexpr size_t log_queue_size = 4096;
+
+// Debug messages and raw listings may be dropped if the writer cannot keep up,
+// everything else waits for space in the queue.
+constexpr logmsg::type droppable_messages = static_cast<logmsg::type>(logmsg::debug_info | logmsg::debug_verbose | logmsg::debug_debug | logmsg::listing);
+
+std::atomic<uint64_t> dropped_messages{};
+std::atomic<uint64_t> blocked_messages{};
+}
+
+// Formats and writes log messages to the log file on a dedicated thread,
+// the size limit is checked once per batch of messages.
+class CLogFileWriter final
+{
+public:
+	CLogFileWriter(fz::native_string const& file, int64_t max_size, std::string const* prefixes);
+	~CLogFileWriter();
+
+	CLogFileWriter(CLogFileWriter const&) = delete;
+	CLogFileWriter& operator=(CLogFileWriter const&) = delete;
+
+	// Returns an error from the writer thread that has not been reported yet.
+	std::wstring push(log_record && record);
+
+private:
+	void entry();
+
+	std::wstring open();
+	std::wstring rotate();
+	std::wstring write(std::string const& out);
+	void close();
+
+	fz::mutex mutex_{false};
+	fz::condition cond_;
+	fz::condition space_;
+
+	std::vector<log_record> queue_;
+	size_t head_{};
+	size_t size_{};
+	uint64_t unreported_drops_{};
+	std::wstring error_;
+	bool failed_{};
+	bool quit_{};
+
+	fz::native_string const file_;
+	int64_t const max_size_;
+	std::string prefixes_[sizeof(logmsg::type) * 8];
+	unsigned int pid_{};
+
+#ifdef FZ_WINDOWS
+	HANDLE fd_{INVALID_HANDLE_VALUE};
+#else
+	int fd_{-1};
+#endif
+
+	std::thread thread_;
+};
+
+CLogFileWriter::CLogFileWriter(fz::native_string const& file, int64_t max_size, std::string const* prefixes)
+	: queue_(log_queue_size)
+	, file_(file)
+	, max_size_(max_size)
+{
+	std::copy(prefixes, prefixes + sizeof(logmsg::type) * 8, prefixes_);
+#if FZ_WINDOWS
+	pid_ = static_cast<unsigned int>(GetCurrentProcessId());
+#else
+	pid_ = static_cast<unsigned int>(getpid());
+#endif
+
+	thread_ = std::thread([this]() { entry(); });
+}
+
+CLogFileWriter::~CLogFileWriter()
+{
+	{
+		fz::scoped_lock l(mutex_);
+		quit_ = true;
+		cond_.signal(l);
+	}
+	thread_.join();
+}
+
+std::wstring CLogFileWriter::push(log_record && record)
+{
+	fz::scoped_lock l(mutex_);
+
+	std::wstring error = std::move(error_);
+	error_.clear();
+	if (failed_) {
+		return error;
+	}
+
+	if (size_ == queue_.size()) {
+		if (record.type_ & droppable_messages) {
+			++unreported_drops_;
+			++dropped_messages;
+			return error;
+		}
+
+		++blocked_messages;
+		while (size_ == queue_.size() && !failed_) {
+			space_.wait(l);
+		}
+		if (failed_) {
+			return error;
+		}
+	}
+
+	queue_[(head_ + size_) % queue_.size()] = std::move(record);
+	if (!size_++) {
+		cond_.signal(l);
+	}
+	if (size_ < queue_.size()) {
+		// Pass on the wakeup to other waiting threads
+		space_.signal(l);
+	}
+
+	return error;
+}
+
+void CLogFileWriter::entry()
+{
+	std::wstring error = open();
+
+	std::vector<log_record> batch;
+	std::string out;
+
+	fz::scoped_lock l(mutex_);
+	while (true) {
+		if (!error.empty()) {
+			// Give up on the log file, the error gets reported by the next push
+			error_ = std::move(error);
+			error.clear();
+			failed_ = true;
+		}
+		if (failed_) {
+			size_ = 0;
+			space_.signal(l);
+		}
+
+		if (!size_) {
+			if (quit_) {
+				break;
+			}
+			cond_.wait(l);
+			continue;
+		}
+
+		batch.clear();
+		for (; size_; --size_) {
+			batch.emplace_back(std::move(queue_[head_]));
+			head_ = (head_ + 1) % queue_.size();
+		}
+		uint64_t const drops = unreported_drops_;
+		unreported_drops_ = 0;
+		space_.signal(l);
+		l.unlock();
+
+		out.clear();
+		if (drops) {
+			out += fz::sprintf("%s %u %u %s %s"
+#ifdef FZ_WINDOWS
+				"\r\n",
+#else
+				"\n",
+#endif
+				fz::datetime::now().format("%Y-%m-%d %H:%M:%S", fz::datetime::local), pid_, 0, prefixes_[fz::bitscan_reverse(logmsg::debug_warning)],
+				fz::to_utf8(fz::sprintf(fztranslate("%u log message was dropped.", "%u log messages were dropped.", drops), drops)));
+		}
+		for (auto const& record : batch) {
+			out += fz::sprintf("%s %u %u %s %s"
+#ifdef FZ_WINDOWS
+				"\r\n",
+#else
+				"\n",
+#endif
+				record.time_.format("%Y-%m-%d %H:%M:%S", fz::datetime::local), pid_, record.engine_id_, prefixes_[fz::bitscan_reverse(record.type_)], fz::to_utf8(record.msg_));
+		}
+
+		error = rotate();
+		if (error.empty()) {
+			error = write(out);
+		}
+
+		l.lock();
+	}
+	l.unlock();
+
+	close();
+}
+
+void CLogFileWriter::close()
+{
+#ifdef FZ_WINDOWS
+	if (fd_ != INVALID_HANDLE_VALUE) {
+		CloseHandle(fd_);
+		fd_ = INVALID_HANDLE_VALUE;
+	}
+#else
+	if (fd_ != -1) {
+		::close(fd_);
+		fd_ = -1;
+	}
+#endif
+}
+
+std::wstring CLogFileWriter::open()
+{
+#ifdef FZ_WINDOWS
+	fd_ = CreateFile(file_.c_str(), FILE_APPEND_DATA, FILE_SHARE_DELETE | FILE_SHARE_WRITE | FILE_SHARE_READ, nullptr, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (fd_ == INVALID_HANDLE_VALUE) {
+		DWORD err = GetLastError();
+#else
+	fd_ = ::open(file_.c_str(), O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC, 0644);
+	if (fd_ == -1) {
+		int err = errno;
+#endif
+		return fz::sprintf(_("Could not open log file: %s"), GetSystemErrorDescription(err));
+	}
+	return std::wstring();
+}
+
+std::wstring CLogFileWriter::rotate()
+{
+	if (!max_size_) {
+		return std::wstring();
+	}
+
+#ifdef FZ_WINDOWS
+	LARGE_INTEGER size;
+	if (!GetFileSizeEx(fd_, &size) || size.QuadPart > max_size_) {
+		CloseHandle(fd_);
+		fd_ = INVALID_HANDLE_VALUE;
+
+		// fd_ might no longer be the original file.
+		// Recheck on a new handle. Proteced with a mutex against other processes
+		HANDLE hMutex = ::CreateMutexW(nullptr, true, L"FileZilla 3 Logrotate Mutex");
+		if (!hMutex) {
+			DWORD err = GetLastError();
+			return fz::sprintf(_("Could not create logging mutex: %s"), GetSystemErrorDescription(err));
+		}
+
+		HANDLE hFile = CreateFileW(file_.c_str(), FILE_APPEND_DATA, FILE_SHARE_DELETE | FILE_SHARE_WRITE | FILE_SHARE_READ, nullptr, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+		if (hFile == INVALID_HANDLE_VALUE) {
+			DWORD err = GetLastError();
+
+			// Oh dear..
+			ReleaseMutex(hMutex);
+			CloseHandle(hMutex);
+
+			return fz::sprintf(_("Could not open log file: %s"), GetSystemErrorDescription(err));
+		}
+
+		DWORD err{};
+		if (GetFileSizeEx(hFile, &size) && size.QuadPart > max_size_) {
+			CloseHandle(hFile);
+
+			// MoveFileEx can fail if trying to access a deleted file for which another process still has
+			// a handle. Move it far away first.
+			// Todo: Handle the case in which logdir and tmpdir are on different volumes.
+			// (Why is everthing so needlessly complex on MSW?)
+
+			wchar_t tempDir[MAX_PATH + 1];
+			DWORD res = GetTempPath(MAX_PATH, tempDir);
+			if (res && res <= MAX_PATH) {
+				tempDir[MAX_PATH] = 0;
+
+				wchar_t tempFile[MAX_PATH + 1];
+				res = GetTempFileNameW(tempDir, L"fz3", 0, tempFile);
+				if (res) {
+					tempFile[MAX_PATH] = 0;
+					MoveFileExW((file_ + L".1").c_str(), tempFile, MOVEFILE_REPLACE_EXISTING);
+					DeleteFileW(tempFile);
+				}
+			}
+			MoveFileExW(file_.c_str(), (file_ + L".1").c_str(), MOVEFILE_REPLACE_EXISTING);
+			fd_ = CreateFileW(file_.c_str(), FILE_APPEND_DATA, FILE_SHARE_DELETE | FILE_SHARE_WRITE | FILE_SHARE_READ, nullptr, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+			if (fd_ == INVALID_HANDLE_VALUE) {
+				// If this function would return bool, I'd return FILE_NOT_FOUND here.
+				err = GetLastError();
+			}
+		}
+		else {
+			fd_ = hFile;
+		}
+
+		if (hMutex) {
+			ReleaseMutex(hMutex);
+			CloseHandle(hMutex);
+		}
+
+		if (err) {
+			return fz::sprintf(_("Could not open log file: %s"), GetSystemErrorDescription(err));
+		}
+	}
+#else
+	struct stat buf;
+	int rc = fstat(fd_, &buf);
+	while (!rc && buf.st_size > max_size_) {
+		struct flock lock = {};
+		lock.l_type = F_WRLCK;
+		lock.l_whence = SEEK_SET;
+		lock.l_start = 0;
+		lock.l_len = 1;
+
+		// Retry through signals
+		while ((rc = fcntl(fd_, F_SETLKW, &lock)) == -1 && errno == EINTR);
+
+		// Ignore any other failures
+		int fd = ::open(file_.c_str(), O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC, 0644);
+		if (fd == -1) {
+			int err = errno;
+			close();
+			return fz::sprintf(_("Could not open log file: %s"), GetSystemErrorDescription(err));
+		}
+		struct stat buf2;
+		rc = fstat(fd, &buf2);
+
+		// Different files
+		if (!rc && buf.st_ino != buf2.st_ino) {
+			::close(fd_); // Releases the lock
+			fd_ = fd;
+			buf = buf2;
+			continue;
+		}
+
+		// The file is indeed the log file and we are holding a lock on it.
+
+		// Rename it
+		rc = rename(file_.c_str(), (file_ + ".1").c_str());
+		::close(fd_);
+		::close(fd);
+
+		// Get the new file
+		fd_ = ::open(file_.c_str(), O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC, 0644);
+		if (fd_ == -1) {
+			int err = errno;
+			return fz::sprintf(_("Could not open log file: %s"), GetSystemErrorDescription(err));
+		}
+
+		if (!rc) {
+			// Rename didn't fail
+			rc = fstat(fd_, &buf);
+		}
+	}
+#endif
+
+	return std::wstring();
+}
+
+std::wstring CLogFileWriter::write(std::string const& out)
+{
 #ifdef FZ_WINDOWS
-HANDLE CLogging::m_log_fd = INVALID_HANDLE_VALUE;
+	DWORD len = static_cast<DWORD>(out.size());
+	DWORD written;
+	BOOL res = WriteFile(fd_, out.c_str(), len, &written, nullptr);
+	if (!res || written != len) {
+		DWORD err = GetLastError();
+		close();
+		return fz::sprintf(_("Could not write to log file: %s"), GetSystemErrorDescription(err));
+	}
 #else
-int CLogging::m_log_fd = -1;
+	size_t written = ::write(fd_, out.c_str(), out.size());
+	if (written != out.size()) {
+		int err = errno;
+		close();
+		return fz::sprintf(_("Could not write to log file: %s"), GetSystemErrorDescription(err));
+	}
 #endif
-std::string CLogging::m_prefixes[sizeof(logmsg::type) * 8];
-unsigned int CLogging::m_pid;
-int CLogging::m_max_size;
-fz::native_string CLogging::m_file;
+	return std::wstring();
+}
+
+std::atomic<bool> CLogging::m_logfile_initialized{};
+std::unique_ptr<CLogFileWriter> CLogging::m_writer;
 
 int CLogging::m_refcount = 0;
 fz::mutex CLogging::mutex_(false);
@@ -75,257 +453,71 @@ CLogging::~CLogging()
 	--m_refcount;
 
 	if (!m_refcount) {
-#ifdef FZ_WINDOWS
-		if (m_log_fd != INVALID_HANDLE_VALUE) {
-			CloseHandle(m_log_fd);
-			m_log_fd = INVALID_HANDLE_VALUE;
-		}
-#else
-		if (m_log_fd != -1) {
-			close(m_log_fd);
-			m_log_fd = -1;
-		}
-#endif
+		// Flushes all pending messages
+		m_writer.reset();
 		m_logfile_initialized = false;
 	}
 }
 
-bool CLogging::InitLogFile(fz::scoped_lock& l)
+void CLogging::InitLogFile()
 {
-	if (m_logfile_initialized) {
-		return true;
+	fz::native_string const file = fz::to_native(engine_.GetOptions().get_string(OPTION_LOGGING_FILE));
+	if (file.empty()) {
+		return;
 	}
 
-	m_logfile_initialized = true;
-
-	m_file = fz::to_native(engine_.GetOptions().get_string(OPTION_LOGGING_FILE));
-	if (m_file.empty()) {
-		return false;
+	std::string prefixes[sizeof(logmsg::type) * 8];
+	prefixes[fz::bitscan_reverse(logmsg::status)] = fz::to_utf8(_("Status:"));
+	prefixes[fz::bitscan_reverse(logmsg::error)] = fz::to_utf8(_("Error:"));
+	prefixes[fz::bitscan_reverse(logmsg::command)] = fz::to_utf8(_("Command:"));
+	prefixes[fz::bitscan_reverse(logmsg::reply)] = fz::to_utf8(_("Response:"));
+	prefixes[fz::bitscan_reverse(logmsg::debug_warning)] = fz::to_utf8(_("Trace:"));
+	prefixes[fz::bitscan_reverse(logmsg::debug_info)] = prefixes[fz::bitscan_reverse(logmsg::debug_warning)];
+	prefixes[fz::bitscan_reverse(logmsg::debug_verbose)] = prefixes[fz::bitscan_reverse(logmsg::debug_warning)];
+	prefixes[fz::bitscan_reverse(logmsg::debug_debug)] = prefixes[fz::bitscan_reverse(logmsg::debug_warning)];
+	prefixes[fz::bitscan_reverse(logmsg::listing)] = fz::to_utf8(_("Listing:"));
+
+	int64_t max_size = engine_.GetOptions().get_int(OPTION_LOGGING_FILE_SIZELIMIT);
+	if (max_size < 0) {
+		max_size = 0;
 	}
-
-#ifdef FZ_WINDOWS
-	m_log_fd = CreateFile(m_file.c_str(), FILE_APPEND_DATA, FILE_SHARE_DELETE | FILE_SHARE_WRITE | FILE_SHARE_READ, nullptr, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
-	if (m_log_fd == INVALID_HANDLE_VALUE) {
-		DWORD err = GetLastError();
-#else
-	m_log_fd = open(m_file.c_str(), O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC, 0644);
-	if (m_log_fd == -1) {
-		int err = errno;
-#endif
-		l.unlock(); //Avoid recursion
-		log(logmsg::error, _("Could not open log file: %s"), GetSystemErrorDescription(err));
-		return false;
+	else if (max_size > 2000) {
+		max_size = 2000;
 	}
+	max_size *= 1024 * 1024;
 
-	m_prefixes[fz::bitscan_reverse(logmsg::status)] = fz::to_utf8(_("Status:"));
-	m_prefixes[fz::bitscan_reverse(logmsg::error)] = fz::to_utf8(_("Error:"));
-	m_prefixes[fz::bitscan_reverse(logmsg::command)] = fz::to_utf8(_("Command:"));
-	m_prefixes[fz::bitscan_reverse(logmsg::reply)] = fz::to_utf8(_("Response:"));
-	m_prefixes[fz::bitscan_reverse(logmsg::debug_warning)] = fz::to_utf8(_("Trace:"));
-	m_prefixes[fz::bitscan_reverse(logmsg::debug_info)] = m_prefixes[fz::bitscan_reverse(logmsg::debug_warning)];
-	m_prefixes[fz::bitscan_reverse(logmsg::debug_verbose)] = m_prefixes[fz::bitscan_reverse(logmsg::debug_warning)];
-	m_prefixes[fz::bitscan_reverse(logmsg::debug_debug)] = m_prefixes[fz::bitscan_reverse(logmsg::debug_warning)];
-	m_prefixes[fz::bitscan_reverse(logmsg::listing)] = fz::to_utf8(_("Listing:"));
-
-#if FZ_WINDOWS
-	m_pid = static_cast<unsigned int>(GetCurrentProcessId());
-#else
-	m_pid = static_cast<unsigned int>(getpid());
-#endif
-
-	m_max_size = engine_.GetOptions().get_int(OPTION_LOGGING_FILE_SIZELIMIT);
-	if (m_max_size < 0) {
-		m_max_size = 0;
-	}
-	else if (m_max_size > 2000) {
-		m_max_size = 2000;
-	}
-	m_max_size *= 1024 * 1024;
-
-	return true;
+	m_writer = std::make_unique<CLogFileWriter>(file, max_size, prefixes);
 }
 
 void CLogging::LogToFile(logmsg::type nMessageType, std::wstring const& msg, fz::datetime const& now)
 {
-	fz::scoped_lock l(mutex_);
-
-	if (!m_logfile_initialized) {
-		if (!InitLogFile(l)) {
-			return;
+	if (!m_logfile_initialized.load(std::memory_order_acquire)) {
+		fz::scoped_lock l(mutex_);
+		if (!m_logfile_initialized) {
+			InitLogFile();
+			m_logfile_initialized.store(true, std::memory_order_release);
 		}
 	}
-#ifdef FZ_WINDOWS
-	if (m_log_fd == INVALID_HANDLE_VALUE) {
-		return;
-	}
-#else
-	if (m_log_fd == -1) {
+
+	// Stays alive as long as this instance exists
+	if (!m_writer) {
 		return;
 	}
-#endif
-
-	std::string const out = fz::sprintf("%s %u %u %s %s"
-#ifdef FZ_WINDOWS
-		"\r\n",
-#else
-		"\n",
-#endif
-		now.format("%Y-%m-%d %H:%M:%S", fz::datetime::local), m_pid, engine_.GetEngineId(), m_prefixes[fz::bitscan_reverse(nMessageType)], fz::to_utf8(msg));
 
-#ifdef FZ_WINDOWS
-	if (m_max_size) {
-		LARGE_INTEGER size;
-		if (!GetFileSizeEx(m_log_fd, &size) || size.QuadPart > m_max_size) {
-			CloseHandle(m_log_fd);
-			m_log_fd = INVALID_HANDLE_VALUE;
-
-			// m_log_fd might no longer be the original file.
-			// Recheck on a new handle. Proteced with a mutex against other processes
-			HANDLE hMutex = ::CreateMutexW(nullptr, true, L"FileZilla 3 Logrotate Mutex");
-			if (!hMutex) {
-				DWORD err = GetLastError();
-				l.unlock();
-				log(logmsg::error, _("Could not create logging mutex: %s"), GetSystemErrorDescription(err));
-				return;
-			}
-
-			HANDLE hFile = CreateFileW(m_file.c_str(), FILE_APPEND_DATA, FILE_SHARE_DELETE | FILE_SHARE_WRITE | FILE_SHARE_READ, nullptr, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
-			if (hFile == INVALID_HANDLE_VALUE) {
-				DWORD err = GetLastError();
-
-				// Oh dear..
-				ReleaseMutex(hMutex);
-				CloseHandle(hMutex);
-
-				l.unlock(); // Avoid recursion
-				log(logmsg::error, _("Could not open log file: %s"), GetSystemErrorDescription(err));
-				return;
-			}
-
-			DWORD err{};
-			if (GetFileSizeEx(hFile, &size) && size.QuadPart > m_max_size) {
-				CloseHandle(hFile);
-
-				// MoveFileEx can fail if trying to access a deleted file for which another process still has
-				// a handle. Move it far away first.
-				// Todo: Handle the case in which logdir and tmpdir are on different volumes.
-				// (Why is everthing so needlessly complex on MSW?)
-
-				wchar_t tempDir[MAX_PATH + 1];
-				DWORD res = GetTempPath(MAX_PATH, tempDir);
-				if (res && res <= MAX_PATH) {
-					tempDir[MAX_PATH] = 0;
-
-					wchar_t tempFile[MAX_PATH + 1];
-					res = GetTempFileNameW(tempDir, L"fz3", 0, tempFile);
-					if (res) {
-						tempFile[MAX_PATH] = 0;
-						MoveFileExW((m_file + L".1").c_str(), tempFile, MOVEFILE_REPLACE_EXISTING);
-						DeleteFileW(tempFile);
-					}
-				}
-				MoveFileExW(m_file.c_str(), (m_file + L".1").c_str(), MOVEFILE_REPLACE_EXISTING);
-				m_log_fd = CreateFileW(m_file.c_str(), FILE_APPEND_DATA, FILE_SHARE_DELETE | FILE_SHARE_WRITE | FILE_SHARE_READ, nullptr, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
-				if (m_log_fd == INVALID_HANDLE_VALUE) {
-					// If this function would return bool, I'd return FILE_NOT_FOUND here.
-					err = GetLastError();
-				}
-			}
-			else {
-				m_log_fd = hFile;
-			}
-
-			if (hMutex) {
-				ReleaseMutex(hMutex);
-				CloseHandle(hMutex);
-			}
-
-			if (err) {
-				l.unlock(); // Avoid recursion
-				log(logmsg::error, _("Could not open log file: %s"), GetSystemErrorDescription(err));
-				return;
-			}
-		}
+	std::wstring error = m_writer->push(log_record{nMessageType, engine_.GetEngineId(), now, msg});
+	if (!error.empty()) {
+		log_raw(logmsg::error, error);
 	}
-	DWORD len = static_cast<DWORD>(out.size());
-	DWORD written;
-	BOOL res = WriteFile(m_log_fd, out.c_str(), len, &written, nullptr);
-	if (!res || written != len) {
-		DWORD err = GetLastError();
-		CloseHandle(m_log_fd);
-		m_log_fd = INVALID_HANDLE_VALUE;
-		l.unlock(); // Avoid recursion
-		log(logmsg::error, _("Could not write to log file: %s"), GetSystemErrorDescription(err));
-	}
-#else
-	if (m_max_size) {
-		struct stat buf;
-		int rc = fstat(m_log_fd, &buf);
-		while (!rc && buf.st_size > m_max_size) {
-			struct flock lock = {};
-			lock.l_type = F_WRLCK;
-			lock.l_whence = SEEK_SET;
-			lock.l_start = 0;
-			lock.l_len = 1;
-
-			// Retry through signals
-			while ((rc = fcntl(m_log_fd, F_SETLKW, &lock)) == -1 && errno == EINTR);
-
-			// Ignore any other failures
-			int fd = open(m_file.c_str(), O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC, 0644);
-			if (fd == -1) {
-				int err = errno;
-
-				close(m_log_fd);
-				m_log_fd = -1;
-
-				l.unlock(); // Avoid recursion
-				log(logmsg::error, _("Could not open log file: %s"), GetSystemErrorDescription(err));
-				return;
-			}
-			struct stat buf2;
-			rc = fstat(fd, &buf2);
-
-			// Different files
-			if (!rc && buf.st_ino != buf2.st_ino) {
-				close(m_log_fd); // Releases the lock
-				m_log_fd = fd;
-				buf = buf2;
-				continue;
-			}
-
-			// The file is indeed the log file and we are holding a lock on it.
-
-			// Rename it
-			rc = rename(m_file.c_str(), (m_file + ".1").c_str());
-			close(m_log_fd);
-			close(fd);
-
-			// Get the new file
-			m_log_fd = open(m_file.c_str(), O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC, 0644);
-			if (m_log_fd == -1) {
-				int err = errno;
-				l.unlock(); // Avoid recursion
-				log(logmsg::error, _("Could not open log file: %s"), GetSystemErrorDescription(err));
-				return;
-			}
+}
 
-			if (!rc) {
-				// Rename didn't fail
-				rc = fstat(m_log_fd, &buf);
-			}
-		}
-	}
-	size_t written = write(m_log_fd, out.c_str(), out.size());
-	if (written != out.size()) {
-		int err = errno;
-		close(m_log_fd);
-		m_log_fd = -1;
+uint64_t CLogging::GetDroppedMessages()
+{
+	return dropped_messages;
+}
 
-		l.unlock(); // Avoid recursion
-		log(logmsg::error, _("Could not write to log file: %s"), GetSystemErrorDescription(err));
-	}
-#endif
+uint64_t CLogging::GetBlockedMessages()
+{
+	return blocked_messages;
 }
 
 void CLogging::UpdateLogLevel(COptionsBase & options)
@@ -4,8 +4,12 @@
 #include "engineprivate.h"
 #include <libfilezilla/format.hpp>
 #include <libfilezilla/mutex.hpp>
+
+#include <atomic>
+#include <memory>
 #include <utility>
 
+class CLogFileWriter;
 class CLoggingOptionsChanged;
 
 class CLogging : public fz::logger_interface
@@ -25,22 +29,19 @@ public:
 	
 	void UpdateLogLevel(COptionsBase & options);
 
+	// Messages dropped because the log file writer could not keep up, and
+	// messages that had to wait for it. Cumulative over the process lifetime.
+	static uint64_t GetDroppedMessages();
+	static uint64_t GetBlockedMessages();
+
 private:
 	CFileZillaEnginePrivate & engine_;
 
-	bool InitLogFile(fz::scoped_lock& l);
+	void InitLogFile();
 	void LogToFile(logmsg::type nMessageType, std::wstring const& msg, fz::datetime const& now);
 
-	static bool m_logfile_initialized;
-#ifdef FZ_WINDOWS
-	static HANDLE m_log_fd;
-#else
-	static int m_log_fd;
-#endif
-	static std::string m_prefixes[sizeof(logmsg::type) * 8];
-	static unsigned int m_pid;
-	static int m_max_size;
-	static fz::native_string m_file;
+	static std::atomic<bool> m_logfile_initialized;
+	static std::unique_ptr<CLogFileWriter> m_writer;
 
 	static int m_refcount;
 
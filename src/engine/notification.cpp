@@ -5,6 +5,13 @@ CDirectoryListingNotification::CDirectoryListingNotification(CServerPath const&
 {
 }
 
+CPartialListingNotification::CPartialListingNotification(CServerPath const& path, std::vector<fz::shared_value<CDirentry>> && entries, bool first)
+	: path_(path)
+	, entries_(std::move(entries))
+	, first_(first)
+{
+}
+
 RequestId CFileExistsNotification::GetRequestID() const
 {
 	return reqId_fileexists;
@@ -3,11 +3,11 @@
 #include "controlsocket.h"
 #include "oplock_manager.h"
 
+#include <algorithm>
 #include <assert.h>
 
-OpLock::OpLock(OpLockManager * mgr, size_t socket, size_t lock)
+OpLock::OpLock(OpLockManager * mgr, size_t lock)
 	: mgr_(mgr)
-	, socket_(socket)
 	, lock_(lock)
 {
 }
@@ -26,7 +26,6 @@ OpLock::OpLock(OpLock && op) noexcept
 		mgr_->Unlock(*this);
 	}
 	mgr_ = op.mgr_;
-	socket_ = op.socket_;
 	lock_ = op.lock_;
 
 	op.mgr_ = nullptr;
@@ -39,7 +38,6 @@ OpLock& OpLock::operator=(OpLock && op) noexcept
 			mgr_->Unlock(*this);
 		}
 		mgr_ = op.mgr_;
-		socket_ = op.socket_;
 		lock_ = op.lock_;
 
 		op.mgr_ = nullptr;
@@ -58,178 +56,233 @@ bool OpLock::waiting() const
 }
 
 OpLock OpLockManager::Lock(CControlSocket * socket, locking_reason reason, CServerPath const& path, bool inclusive)
+{
+	return Lock(socket, socket->GetCurrentServer(), reason, path, inclusive);
+}
+
+OpLock OpLockManager::Lock(fz::event_handler * owner, CServer const& server, locking_reason reason, CServerPath const& path, bool inclusive)
 {
 	fz::scoped_lock l(mtx_);
 
-	size_t socket_index = get_or_create(socket);
-	auto & sli = socket_locks_[socket_index];
+	size_t const id = ++next_id_;
 
-	lock_info info;
-	info.reason = reason;
-	info.inclusive = inclusive;
-	info.path = path;
+	auto & lock = locks_[id];
+	lock.owner_ = owner;
+	lock.table_ = tables_.try_emplace(std::make_pair(server, reason)).first;
+	lock.path = path;
+	lock.inclusive = inclusive;
 
-	for (auto const& other_sli : socket_locks_) {
-		if (other_sli.control_socket_ == socket || other_sli.server_ != sli.server_) {
-			continue;
-		}
+	auto & si = sockets_[owner];
+	++si.locks_;
 
-		for (auto const& lock : other_sli.locks_) {
-			if (reason != lock.reason || lock.waiting || lock.released) {
-				continue;
-			}
-			if (lock.path == path || (lock.inclusive && lock.path.IsParentOf(path, false))) {
-				info.waiting = true;
-				break;
+	auto & table = lock.table_->second;
+	if (Conflicts(table, owner, path, inclusive)) {
+		lock.waiting = true;
+		++si.waiting_;
+		table[path].waiting_.push_back(id);
+	}
+	else {
+		Obtain(table, id, lock);
+	}
+
+	return OpLock(this, id);
+}
+
+bool OpLockManager::Conflicts(lock_table const& table, fz::event_handler * owner, CServerPath const& path, bool inclusive) const
+{
+	auto const held_by_other = [&](path_node const& node, bool inclusive_only) {
+		for (size_t id : node.held_) {
+			auto const& other = locks_.at(id);
+			if (other.owner_ != owner && (!inclusive_only || other.inclusive)) {
+				return true;
 			}
-			if (inclusive && path.IsParentOf(lock.path, false)) {
-				info.waiting = true;
-				break;
+		}
+		return false;
+	};
+
+	auto it = table.find(path);
+	if (it != table.end()) {
+		if (held_by_other(it->second, false)) {
+			return true;
+		}
+
+		if (inclusive && it->second.held_below_) {
+			// Rare, inclusive locks are seldom used. Find out whether the
+			// locks below are all our own.
+			for (auto const& [node_path, node] : table) {
+				if (!node.held_.empty() && path.IsParentOf(node_path, false) && held_by_other(node, false)) {
+					return true;
+				}
 			}
 		}
-		if (info.waiting) {
-			break;
+	}
+
+	// Inclusive locks on parents
+	for (CServerPath parent = path; parent.HasParent(); ) {
+		parent.MakeParent();
+		it = table.find(parent);
+		if (it != table.end() && held_by_other(it->second, true)) {
+			return true;
 		}
 	}
 
-	sli.locks_.push_back(info);
+	return false;
+}
 
-	return OpLock(this, socket_index, sli.locks_.size() - 1);
+void OpLockManager::Obtain(lock_table & table, size_t id, lock_info & lock)
+{
+	lock.waiting = false;
+	table[lock.path].held_.push_back(id);
+
+	for (CServerPath parent = lock.path; parent.HasParent(); ) {
+		parent.MakeParent();
+		++table[parent].held_below_;
+	}
 }
 
 void OpLockManager::Unlock(OpLock & lock)
 {
 	fz::scoped_lock l(mtx_);
-	assert(lock.socket_ < socket_locks_.size());
-	assert(lock.lock_ < socket_locks_[lock.socket_].locks_.size());
 
-	bool was_waiting = false;
+	auto it = locks_.find(lock.lock_);
+	assert(it != locks_.end());
 
-	auto & sli = socket_locks_[lock.socket_];
+	lock_info const info = std::move(it->second);
+	locks_.erase(it);
 
-	was_waiting = sli.locks_[lock.lock_].waiting;
+	auto & table = info.table_->second;
+	auto & node = table[info.path];
 
-	if (lock.lock_ + 1 == sli.locks_.size()) {
-		sli.locks_.pop_back();
-		while (!sli.locks_.empty() && sli.locks_.back().released) {
-			sli.locks_.pop_back();
-		}
-		if (sli.locks_.empty()) {
-			if (lock.socket_ + 1 == socket_locks_.size()) {
-				socket_locks_.pop_back();
-				while (!socket_locks_.empty() && !socket_locks_.back().control_socket_) {
-					socket_locks_.pop_back();
-				}
-			}
-			else {
-				socket_locks_[lock.socket_].control_socket_ = nullptr;
-			}
-		}
+	auto sit = sockets_.find(info.owner_);
+	assert(sit != sockets_.end());
+
+	if (info.waiting) {
+		node.waiting_.erase(std::find(node.waiting_.begin(), node.waiting_.end(), lock.lock_));
+		--sit->second.waiting_;
+
+		// Waiting locks do not block anyone, but the ones queued behind it
+		// may be able to proceed now.
+		ObtainWaiting(table, info.path);
 	}
 	else {
-		sli.locks_[lock.lock_].waiting = false;
-		sli.locks_[lock.lock_].released = true;
+		node.held_.erase(std::find(node.held_.begin(), node.held_.end(), lock.lock_));
+		for (CServerPath parent = info.path; parent.HasParent(); ) {
+			parent.MakeParent();
+			--table[parent].held_below_;
+		}
+
+		Wakeup(table, info.path, info.inclusive);
 	}
 
-	lock.mgr_ = nullptr;
+	if (!--sit->second.locks_) {
+		sockets_.erase(sit);
+	}
 
-	if (!was_waiting) {
-		Wakeup();
+	RemoveEmpty(table, info.path);
+	if (table.empty()) {
+		tables_.erase(info.table_);
 	}
+
+	lock.mgr_ = nullptr;
 }
 
-void OpLockManager::Wakeup()
+void OpLockManager::Wakeup(lock_table & table, CServerPath const& path, bool inclusive)
 {
-	for (auto & sli : socket_locks_) {
-		for (auto & lock : sli.locks_) {
-			if (lock.waiting) {
-				sli.control_socket_->send_event<CObtainLockEvent>();
-				break;
+	ObtainWaiting(table, path);
+
+	// Inclusive locks on parents may have been waiting for it
+	for (CServerPath parent = path; parent.HasParent(); ) {
+		parent.MakeParent();
+		ObtainWaiting(table, parent);
+	}
+
+	if (inclusive) {
+		std::vector<CServerPath> below;
+		for (auto const& [node_path, node] : table) {
+			if (!node.waiting_.empty() && path.IsParentOf(node_path, false)) {
+				below.push_back(node_path);
 			}
 		}
+		for (auto const& p : below) {
+			ObtainWaiting(table, p);
+		}
 	}
 }
 
-bool OpLockManager::ObtainWaiting(CControlSocket * socket)
+void OpLockManager::ObtainWaiting(lock_table & table, CServerPath const& path)
 {
-	bool obtained = false;
+	auto it = table.find(path);
+	if (it == table.end()) {
+		return;
+	}
 
-	fz::scoped_lock l(mtx_);
-	for (auto & sli : socket_locks_) {
-		if (sli.control_socket_ == socket) {
-			for (auto & lock : sli.locks_) {
-				if (lock.waiting) {
-					obtained |= ObtainWaiting(sli, lock);
-				}
-			}
+	// Obtaining locks adds nodes for the parents, references stay valid though.
+	auto & waiting = it->second.waiting_;
+	while (!waiting.empty()) {
+		size_t const id = waiting.front();
+		auto & lock = locks_.at(id);
+		if (Conflicts(table, lock.owner_, lock.path, lock.inclusive)) {
+			break;
 		}
-	}
 
-	return obtained;
+		waiting.pop_front();
+		Obtain(table, id, lock);
+
+		auto & si = sockets_.at(lock.owner_);
+		--si.waiting_;
+		if (!si.obtained_) {
+			si.obtained_ = true;
+			lock.owner_->send_event<CObtainLockEvent>();
+		}
+	}
 }
 
-bool OpLockManager::ObtainWaiting(socket_lock_info const& sli, lock_info& lock)
+void OpLockManager::RemoveEmpty(lock_table & table, CServerPath path)
 {
-	for (auto const& other_sli : socket_locks_) {
-		if (&other_sli == &sli) {
-			continue;
+	// Parents may be empty even if a path below them is not, e.g. if the
+	// latter only has waiting locks.
+	while (true) {
+		auto it = table.find(path);
+		if (it != table.end() && it->second.empty()) {
+			table.erase(it);
 		}
 
-		for (auto const& other_lock : other_sli.locks_) {
-			if (lock.reason != other_lock.reason || other_lock.waiting || other_lock.released) {
-				continue;
-			}
-			if (other_lock.path == lock.path || (other_lock.inclusive && other_lock.path.IsParentOf(lock.path, false))) {
-				return false;
-			}
-			if (lock.inclusive && lock.path.IsParentOf(other_lock.path, false)) {
-				return false;
-			}
+		if (!path.HasParent()) {
+			break;
 		}
+		path.MakeParent();
 	}
-
-	lock.waiting = false;
-	return true;
 }
 
-size_t OpLockManager::get_or_create(CControlSocket * socket)
+bool OpLockManager::ObtainWaiting(fz::event_handler * owner)
 {
-	for (size_t i = 0; i < socket_locks_.size(); ++i) {
-		if (socket_locks_[i].control_socket_ == socket) {
-			return i;
-		}
+	fz::scoped_lock l(mtx_);
+
+	auto it = sockets_.find(owner);
+	if (it == sockets_.end()) {
+		return false;
 	}
 
-	socket_lock_info info;
-	info.control_socket_ = socket;
-	info.server_ = socket->GetCurrentServer();
-	socket_locks_.push_back(info);
+	bool const obtained = it->second.obtained_;
+	it->second.obtained_ = false;
 
-	return socket_locks_.size() - 1;
+	return obtained;
 }
 
 bool OpLockManager::Waiting(OpLock const& lock) const
 {
 	fz::scoped_lock l(mtx_);
-	assert(lock.socket_ < socket_locks_.size());
-	assert(lock.lock_ < socket_locks_[lock.socket_].locks_.size());
 
-	auto & sli = socket_locks_[lock.socket_];
-	return sli.locks_[lock.lock_].waiting;
+	auto it = locks_.find(lock.lock_);
+	assert(it != locks_.end());
+
+	return it->second.waiting;
 }
 
-bool OpLockManager::Waiting(CControlSocket * socket) const
+bool OpLockManager::Waiting(fz::event_handler * owner) const
 {
 	fz::scoped_lock l(mtx_);
-	for (auto const& sli : socket_locks_) {
-		if (sli.control_socket_ == socket) {
-			for (auto const& lock : sli.locks_) {
-				if (lock.waiting) {
-					return true;
-				}
-			}
-		}
-	}
 
-	return false;
+	auto it = sockets_.find(owner);
+	return it != sockets_.end() && it->second.waiting_;
 }
@@ -3,10 +3,13 @@
 
 #include "../include/serverpath.h"
 
-#include <libfilezilla/event.hpp>
+#include <libfilezilla/event_handler.hpp>
 #include <libfilezilla/mutex.hpp>
 
+#include <deque>
+#include <map>
 #include <memory>
+#include <unordered_map>
 #include <vector>
 
 struct obtain_lock_event_type;
@@ -45,53 +48,95 @@ public:
 private:
 	friend class OpLockManager;
 
-	OpLock(OpLockManager * mgr, size_t socket, size_t lock);
+	OpLock(OpLockManager * mgr, size_t lock);
 
 	OpLockManager * mgr_{};
-	size_t socket_{};
 	size_t lock_{};
 };
 
+/*
+Locks are kept in one table per server and locking reason, indexed by path.
+Each path has a FIFO queue of the locks waiting for it. Releasing a lock
+hands it over to the waiting locks it was blocking, and only the sockets
+owning those get woken up.
 
+Owners are identified by their event handler, which receives a
+CObtainLockEvent once one of its waiting locks got obtained.
+*/
 class OpLockManager final
 {
 public:
 	OpLock Lock(CControlSocket * socket, locking_reason reason, CServerPath const& path, bool inclusive = false);
+	OpLock Lock(fz::event_handler * owner, CServer const& server, locking_reason reason, CServerPath const& path, bool inclusive = false);
 
-	bool Waiting(CControlSocket * socket) const;
+	bool Waiting(fz::event_handler * owner) const;
 
-	bool ObtainWaiting(CControlSocket * socket);
+	bool ObtainWaiting(fz::event_handler * owner);
 
 private:
 	friend class OpLock;
 
+	struct path_hash final
+	{
+		size_t operator()(CServerPath const& path) const {
+			return path.Hash();
+		}
+	};
+
+	struct path_node
+	{
+		// Obtained locks on this path
+		std::vector<size_t> held_;
+
+		// Number of obtained locks on paths below this one
+		size_t held_below_{};
+
+		std::deque<size_t> waiting_;
+
+		bool empty() const {
+			return held_.empty() && !held_below_ && waiting_.empty();
+		}
+	};
+
+	typedef std::unordered_map<CServerPath, path_node, path_hash> lock_table;
+	typedef std::map<std::pair<CServer, locking_reason>, lock_table> lock_tables;
+
 	struct lock_info
 	{
+		fz::event_handler * owner_{};
+		lock_tables::iterator table_;
 		CServerPath path;
-		locking_reason reason{};
 		bool inclusive{};
 		bool waiting{};
-		bool released{};
 	};
 
-	struct socket_lock_info
+	struct socket_info
 	{
-		CServer server_;
-		CControlSocket * control_socket_;
+		size_t locks_{};
+		size_t waiting_{};
 
-		std::vector<lock_info> locks_;
+		// Set if a waiting lock got obtained since the last call to ObtainWaiting
+		bool obtained_{};
 	};
 
 	void Unlock(OpLock & lock);
 
-	void Wakeup();
-	bool ObtainWaiting(socket_lock_info const& sli, lock_info& lock);
+	bool Conflicts(lock_table const& table, fz::event_handler * owner, CServerPath const& path, bool inclusive) const;
 
-	bool Waiting(OpLock const& lock) const;
+	void Obtain(lock_table & table, size_t id, lock_info & lock);
 
-	size_t get_or_create(CControlSocket * socket);
+	// Hands the released lock over to the waiting locks it was blocking
+	void Wakeup(lock_table & table, CServerPath const& path, bool inclusive);
+	void ObtainWaiting(lock_table & table, CServerPath const& path);
+
+	void RemoveEmpty(lock_table & table, CServerPath path);
+
+	bool Waiting(OpLock const& lock) const;
 
-	std::vector<socket_lock_info> socket_locks_;
+	std::unordered_map<size_t, lock_info> locks_;
+	std::unordered_map<fz::event_handler*, socket_info> sockets_;
+	lock_tables tables_;
+	size_t next_id_{};
 
 	mutable fz::mutex mtx_{false};
 };
@@ -13,7 +13,7 @@ CPathCache::~CPathCache()
 
 void CPathCache::Store(CServer const& server, CServerPath const& target, CServerPath const& source, std::wstring const& subdir)
 {
-	fz::scoped_lock lock(mutex_);
+	std::unique_lock lock(mutex_);
 
 	assert(!target.empty() && !source.empty());
 
@@ -33,7 +33,7 @@ void CPathCache::Store(CServer const& server, CServerPath const& target, CServer
 
 CServerPath CPathCache::Lookup(CServer const& server, CServerPath const& source, std::wstring const& subdir)
 {
-	fz::scoped_lock lock(mutex_);
+	std::shared_lock lock(mutex_);
 
 	const tCacheConstIterator iter = m_cache.find(server);
 	if (iter == m_cache.end()) {
@@ -70,7 +70,7 @@ CServerPath CPathCache::Lookup(tServerCache const& serverCache, CServerPath cons
 
 void CPathCache::InvalidateServer(CServer const& server)
 {
-	fz::scoped_lock lock(mutex_);
+	std::unique_lock lock(mutex_);
 
 	tCacheIterator iter = m_cache.find(server);
 	if (iter == m_cache.end()) {
@@ -82,7 +82,7 @@ void CPathCache::InvalidateServer(CServer const& server)
 
 void CPathCache::InvalidatePath(CServer const& server, CServerPath const& path, std::wstring const& subdir)
 {
-	fz::scoped_lock lock(mutex_);
+	std::unique_lock lock(mutex_);
 
 	tCacheIterator iter = m_cache.find(server);
 	if (iter != m_cache.end()) {
@@ -129,6 +129,6 @@ void CPathCache::InvalidatePath(tServerCache & serverCache, CServerPath const& p
 
 void CPathCache::Clear()
 {
-	fz::scoped_lock lock(mutex_);
+	std::unique_lock lock(mutex_);
 	m_cache.clear();
 }
@@ -4,7 +4,8 @@
 #include "../include/server.h"
 #include "../include/serverpath.h"
 
-#include <libfilezilla/mutex.hpp>
+#include <atomic>
+#include <shared_mutex>
 
 class CPathCache final
 {
@@ -41,7 +42,8 @@ protected:
 		}
 	};
 
-	fz::mutex mutex_;
+	// Lookups take a shared lock
+	std::shared_mutex mutex_;
 
 	typedef std::map<CSourcePath, CServerPath> tServerCache;
 	typedef tServerCache::iterator tServerCacheIterator;
@@ -55,8 +57,8 @@ protected:
 	void InvalidatePath(tServerCache & serverCache, CServerPath const& path, std::wstring const& subdir = std::wstring());
 
 #ifndef NDEBUG
-	int m_hits{};
-	int m_misses{};
+	std::atomic<int> m_hits{};
+	std::atomic<int> m_misses{};
 #endif
 };
 
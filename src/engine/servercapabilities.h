@@ -34,6 +34,7 @@ enum capabilityNames
 	list_hidden_support, // LIST -a command
 	rest_stream, // supports REST+STOR in addition to APPE
 	epsv_command,
+	command_pipelining, // set to 'no' if the server cannot cope with several outstanding commands
 
 	// Server timezone offset. If using FTP, LIST details are unspecified and
 	// can return different times than the UTC based times using the MLST or
@@ -46,7 +47,11 @@ enum capabilityNames
 	auth_tls_command,
 	auth_ssl_command,
 
-	tls_resumption
+	tls_resumption,
+
+	// The listingFormat::type the directory listing parser detected in
+	// the last listing, as number.
+	listing_format
 };
 
 class CCapabilities final
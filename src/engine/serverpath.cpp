@@ -990,6 +990,61 @@ int CServerPath::CmpNoCase(CServerPath const& op) const
 	return 0;
 }
 
+namespace {
+void hash_combine(size_t & seed, size_t v)
+{
+	seed ^= v + 0x9e3779b9 + (seed << 6) + (seed >> 2);
+}
+
+// Segments equal according to fz::stricmp have the same hash. The case
+// mapping of characters outside of ASCII depends on the locale, they all
+// hash the same.
+size_t hash_nocase(std::wstring const& segment)
+{
+	std::wstring folded = fz::str_tolower_ascii(segment);
+	for (auto & c : folded) {
+		if (static_cast<unsigned int>(c) > 127) {
+			c = 0;
+		}
+	}
+	return std::hash<std::wstring>()(folded);
+}
+}
+
+size_t CServerPath::Hash() const
+{
+	if (empty()) {
+		return 0;
+	}
+
+	size_t ret = static_cast<size_t>(m_type);
+	if (m_data->m_prefix) {
+		hash_combine(ret, std::hash<std::wstring>()(*m_data->m_prefix));
+	}
+	for (auto const& segment : m_data->m_segments) {
+		hash_combine(ret, std::hash<std::wstring>()(segment));
+	}
+
+	return ret;
+}
+
+size_t CServerPath::HashNoCase() const
+{
+	if (empty()) {
+		return 0;
+	}
+
+	size_t ret = static_cast<size_t>(m_type);
+	if (m_data->m_prefix) {
+		hash_combine(ret, std::hash<std::wstring>()(*m_data->m_prefix));
+	}
+	for (auto const& segment : m_data->m_segments) {
+		hash_combine(ret, hash_nocase(segment));
+	}
+
+	return ret;
+}
+
 bool CServerPath::AddSegment(std::wstring const& segment)
 {
 	if (empty()) {
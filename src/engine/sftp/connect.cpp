@@ -24,6 +24,7 @@
 enum connectStates
 {
 	connect_init,
+	connect_binary,
 	connect_proxy,
 	connect_keys,
 	connect_open
@@ -86,9 +87,19 @@ int CSftpConnectOpData::Send()
 				return FZ_REPLY_ERROR | FZ_REPLY_DISCONNECTED;
 			}
 
-			controlSocket_.input_parser_ = std::make_unique<SftpInputParser>(controlSocket_, *controlSocket_.process_);
+			controlSocket_.input_parser_ = std::make_unique<SftpInputParser>(controlSocket_, controlSocket_.logger(), *controlSocket_.process_,
+				[&socket = controlSocket_](char const* buffer, size_t len) { return socket.ConvToLocal(buffer, len); });
 		}
 		return FZ_REPLY_WOULDBLOCK;
+	case connect_binary:
+		{
+			// The command itself is the last line sent as text, fzsftp
+			// frames its reply already.
+			int const res = controlSocket_.SendCommand(L"binary");
+			controlSocket_.binary_ipc_ = true;
+			controlSocket_.input_parser_->SetBinary();
+			return res;
+		}
 	case connect_proxy:
 		{
 			int type;
@@ -153,6 +164,9 @@ int CSftpConnectOpData::ParseResponse()
 			log(logmsg::error, _("fzsftp belongs to a different version of FileZilla"));
 			return FZ_REPLY_INTERNALERROR | FZ_REPLY_DISCONNECTED;
 		}
+		opState = connect_binary;
+		break;
+	case connect_binary:
 		if (options_.get_int(OPTION_PROXY_TYPE) && !currentServer_.GetBypassProxy()) {
 			opState = connect_proxy;
 		}
@@ -4,8 +4,9 @@
 #include <libfilezilla/event.hpp>
 
 #include <string>
+#include <vector>
 
-#define FZSFTP_PROTOCOL_VERSION 11
+#define FZSFTP_PROTOCOL_VERSION 14
 
 enum class sftpEvent {
 	Unknown = -1,
@@ -39,6 +40,7 @@ enum class sftpEvent {
 	io_open,
 	io_nextbuf,
 	io_finalize,
+	transfer_window,
 
 	count
 };
@@ -47,6 +49,9 @@ struct sftp_message
 {
 	sftpEvent type;
 	std::wstring text[2];
+
+	// Payload of the messages carrying integers, such as Transfer or io_open
+	int64_t value[3]{};
 };
 
 struct sftp_event_type;
@@ -56,10 +61,12 @@ struct sftp_list_message
 {
 	mutable std::wstring text;
 	mutable std::wstring name;
-	uint64_t mtime;
+	uint64_t mtime{};
 };
 
 struct sftp_list_event_type;
-typedef fz::simple_event<sftp_list_event_type, sftp_list_message> CSftpListEvent;
+
+// fzsftp sends listing entries in batches
+typedef fz::simple_event<sftp_list_event_type, std::vector<sftp_list_message>> CSftpListEvent;
 
 #endif
@@ -2,13 +2,16 @@
 
 #include "event.h"
 #include "input_parser.h"
-#include "sftpcontrolsocket.h"
 
+#include <libfilezilla/event_handler.hpp>
+#include <libfilezilla/logger.hpp>
 #include <libfilezilla/process.hpp>
 
-SftpInputParser::SftpInputParser(CSftpControlSocket& owner, fz::process& proc)
-	: process_(proc)
-	, owner_(owner)
+SftpInputParser::SftpInputParser(fz::event_handler & handler, fz::logger_interface & logger, fz::process& proc, converter && conv)
+	: handler_(handler)
+	, logger_(logger)
+	, process_(proc)
+	, conv_(std::move(conv))
 {
 }
 
@@ -50,6 +53,7 @@ size_t SftpInputParser::lines(sftpEvent eventType) const
 	case sftpEvent::io_open:
 	case sftpEvent::io_finalize:
 	case sftpEvent::io_nextbuf:
+	case sftpEvent::transfer_window:
 		return 1;
 	case sftpEvent::AskHostkey:
 	case sftpEvent::AskHostkeyChanged:
@@ -61,8 +65,36 @@ size_t SftpInputParser::lines(sftpEvent eventType) const
 	return 0;
 }
 
+void SftpInputParser::ParseValues(sftp_message & message) const
+{
+	switch (message.type)
+	{
+	case sftpEvent::Done:
+	case sftpEvent::Recv:
+	case sftpEvent::Send:
+	case sftpEvent::Transfer:
+	case sftpEvent::io_open:
+	case sftpEvent::io_nextbuf:
+	case sftpEvent::io_finalize:
+	case sftpEvent::transfer_window:
+		{
+			auto const tokens = fz::strtok_view(message.text[0], ' ');
+			for (size_t i = 0; i < tokens.size() && i < std::size(message.value); ++i) {
+				message.value[i] = fz::to_integral<int64_t>(tokens[i]);
+			}
+		}
+		break;
+	default:
+		break;
+	}
+}
+
 int SftpInputParser::OnData()
 {
+	if (binary_) {
+		return OnBinaryData();
+	}
+
 	bool need_read = true;
 	while (true) {
 		if (need_read || recv_buffer_.empty())  {
@@ -70,10 +102,10 @@ int SftpInputParser::OnData()
 			if (res) {
 				if (!res.value_) {
 					if (listEvent_ || event_) {
-						owner_.log(logmsg::error, _("Got unexpected EOF from child process."));
+						logger_.log(logmsg::error, _("Got unexpected EOF from child process."));
 					}
 					else {
-						owner_.log(logmsg::debug_info, "Got eof from child process");
+						logger_.log(logmsg::debug_info, "Got eof from child process");
 					}
 					return FZ_REPLY_DISCONNECTED;
 				}
@@ -84,7 +116,7 @@ int SftpInputParser::OnData()
 				return FZ_REPLY_WOULDBLOCK;
 			}
 			else {
-				owner_.log(logmsg::debug_warning, "Could not read from child process with error %d, raw error %d", res.error_, res.raw_);
+				logger_.log(logmsg::debug_warning, "Could not read from child process with error %d, raw error %d", res.error_, res.raw_);
 				return FZ_REPLY_DISCONNECTED;
 			}
 		}
@@ -96,7 +128,7 @@ int SftpInputParser::OnData()
 				size_t pos = v.find('\n', search_offset_);
 				if (pos == std::string_view::npos) {
 					if (recv_buffer_.size() > 4096) {
-						owner_.log(logmsg::error, _("Got overlong input line, aborting."));
+						logger_.log(logmsg::error, _("Got overlong input line, aborting."));
 						return FZ_REPLY_WOULDBLOCK;
 					}
 					search_offset_ = recv_buffer_.size();
@@ -110,9 +142,9 @@ int SftpInputParser::OnData()
 
 				size_t i = lines(type) - pending_lines_--;
 				if (event_) {
-					std::wstring converted = owner_.ConvToLocal(line.data(), line.size());
+					std::wstring converted = conv_(line.data(), line.size());
 					if (line.size() && converted.empty()) {
-						owner_.log(logmsg::error, _("Failed to convert reply to local character set."));
+						logger_.log(logmsg::error, _("Failed to convert reply to local character set."));
 						return FZ_REPLY_DISCONNECTED;
 					}
 
@@ -120,19 +152,19 @@ int SftpInputParser::OnData()
 				}
 				else {
 					if (i == 1) {
-						std::get<0>(listEvent_->v_).mtime = fz::to_integral<uint64_t>(line);
+						std::get<0>(listEvent_->v_).back().mtime = fz::to_integral<uint64_t>(line);
 					}
 					else {
-						std::wstring converted = owner_.ConvToLocal(line.data(), line.size());
+						std::wstring converted = conv_(line.data(), line.size());
 						if (line.size() && converted.empty()) {
-							owner_.log(logmsg::error, _("Failed to convert reply to local character set."));
+							logger_.log(logmsg::error, _("Failed to convert reply to local character set."));
 							return FZ_REPLY_DISCONNECTED;
 						}
 						if (i) {
-							std::get<0>(listEvent_->v_).name = std::move(converted);
+							std::get<0>(listEvent_->v_).back().name = std::move(converted);
 						}
 						else {
-							std::get<0>(listEvent_->v_).text = std::move(converted);
+							std::get<0>(listEvent_->v_).back().text = std::move(converted);
 						}
 					}
 				}
@@ -141,10 +173,11 @@ int SftpInputParser::OnData()
 			}
 			if (!pending_lines_) {
 				if (event_) {
-					owner_.send_event(event_.release());
+					ParseValues(std::get<0>(event_->v_));
+					handler_.send_event(event_.release());
 				}
 				else {
-					owner_.send_event(listEvent_.release());
+					handler_.send_event(listEvent_.release());
 				}
 			}
 		}
@@ -153,12 +186,13 @@ int SftpInputParser::OnData()
 			recv_buffer_.consume(1);
 
 			if (eventType <= sftpEvent::Unknown || eventType >= sftpEvent::count) {
-				owner_.log(logmsg::error, _("Unknown eventType %d"), eventType);
+				logger_.log(logmsg::error, _("Unknown eventType %d"), eventType);
 				break;
 			}
 
 			if (eventType == sftpEvent::Listentry) {
 				listEvent_ = std::make_unique<CSftpListEvent>();
+				std::get<0>(listEvent_->v_).emplace_back();
 			}
 			else {
 				event_ = std::make_unique<CSftpEvent>();
@@ -166,9 +200,174 @@ int SftpInputParser::OnData()
 			}
 			pending_lines_ = lines(eventType);
 			if (!pending_lines_) {
-				owner_.send_event(event_.release());
+				handler_.send_event(event_.release());
 			}
 		}
 	}
 	return FZ_REPLY_WOULDBLOCK;
 }
+
+namespace {
+uint32_t get_uint32(unsigned char const* p)
+{
+	return (uint32_t(p[0]) << 24) | (uint32_t(p[1]) << 16) | (uint32_t(p[2]) << 8) | uint32_t(p[3]);
+}
+
+size_t const max_frame_size = 1024 * 1024;
+
+// Field readers for frames, each returns false on malformed input
+bool read_string(unsigned char const*& p, size_t& len, std::string_view& out)
+{
+	if (len < 5 || *p != 's') {
+		return false;
+	}
+	uint32_t const slen = get_uint32(p + 1);
+	if (len - 5 < slen) {
+		return false;
+	}
+	out = std::string_view(reinterpret_cast<char const*>(p + 5), slen);
+	p += 5 + slen;
+	len -= 5 + slen;
+	return true;
+}
+
+bool read_int(unsigned char const*& p, size_t& len, int64_t& out)
+{
+	if (len < 9 || *p != 'i') {
+		return false;
+	}
+	out = static_cast<int64_t>((uint64_t(get_uint32(p + 1)) << 32) | get_uint32(p + 5));
+	p += 9;
+	len -= 9;
+	return true;
+}
+}
+
+int SftpInputParser::ParseFrames()
+{
+	while (recv_buffer_.size() >= 4) {
+		uint32_t const len = get_uint32(recv_buffer_.get());
+		if (!len || len > max_frame_size) {
+			logger_.log(logmsg::error, _("Got malformed message from child process."));
+			return FZ_REPLY_DISCONNECTED;
+		}
+		if (recv_buffer_.size() - 4 < len) {
+			break;
+		}
+		if (!ParseFrame(recv_buffer_.get() + 4, len)) {
+			return FZ_REPLY_DISCONNECTED;
+		}
+		recv_buffer_.consume(4 + len);
+	}
+	return FZ_REPLY_WOULDBLOCK;
+}
+
+int SftpInputParser::OnBinaryData()
+{
+	while (true) {
+		int const parsed = ParseFrames();
+		if (parsed != FZ_REPLY_WOULDBLOCK) {
+			return parsed;
+		}
+
+		fz::rwresult res = process_.read(recv_buffer_.get(16 * 1024), 16 * 1024);
+		if (res) {
+			if (!res.value_) {
+				if (!recv_buffer_.empty()) {
+					logger_.log(logmsg::error, _("Got unexpected EOF from child process."));
+				}
+				else {
+					logger_.log(logmsg::debug_info, "Got eof from child process");
+				}
+				return FZ_REPLY_DISCONNECTED;
+			}
+			recv_buffer_.add(res.value_);
+		}
+		else if (res.error_ == fz::rwresult::wouldblock) {
+			return FZ_REPLY_WOULDBLOCK;
+		}
+		else {
+			logger_.log(logmsg::debug_warning, "Could not read from child process with error %d, raw error %d", res.error_, res.raw_);
+			return FZ_REPLY_DISCONNECTED;
+		}
+	}
+}
+
+bool SftpInputParser::Convert(std::string_view in, std::wstring& out)
+{
+	out = conv_(in.data(), in.size());
+	if (!in.empty() && out.empty()) {
+		logger_.log(logmsg::error, _("Failed to convert reply to local character set."));
+		return false;
+	}
+	return true;
+}
+
+bool SftpInputParser::ParseFrame(unsigned char const* p, size_t len)
+{
+	auto const type = static_cast<sftpEvent>(*p);
+	if (type <= sftpEvent::Unknown || type >= sftpEvent::count) {
+		logger_.log(logmsg::error, _("Unknown eventType %d"), type);
+		return false;
+	}
+	++p;
+	--len;
+
+	if (type == sftpEvent::Listentry) {
+		// A batch of entries, each consisting of text, mtime and name
+		auto ev = std::make_unique<CSftpListEvent>();
+		auto & entries = std::get<0>(ev->v_);
+		while (len) {
+			std::string_view text, name;
+			int64_t mtime{};
+			if (!read_string(p, len, text) || !read_int(p, len, mtime) || !read_string(p, len, name)) {
+				logger_.log(logmsg::error, _("Got malformed message from child process."));
+				return false;
+			}
+			auto & entry = entries.emplace_back();
+			if (!Convert(text, entry.text) || !Convert(name, entry.name)) {
+				return false;
+			}
+			entry.mtime = static_cast<uint64_t>(mtime);
+		}
+		if (!entries.empty()) {
+			handler_.send_event(ev.release());
+		}
+		return true;
+	}
+
+	// Strings and integers each get assigned in order of appearance,
+	// fields beyond what the message type uses are ignored.
+	auto ev = std::make_unique<CSftpEvent>();
+	auto & message = std::get<0>(ev->v_);
+	message.type = type;
+	size_t string_count{};
+	size_t value_count{};
+	while (len) {
+		if (*p == 's') {
+			std::string_view str;
+			if (!read_string(p, len, str)) {
+				break;
+			}
+			if (string_count < std::size(message.text) && !Convert(str, message.text[string_count++])) {
+				return false;
+			}
+		}
+		else {
+			int64_t value{};
+			if (!read_int(p, len, value)) {
+				break;
+			}
+			if (value_count < std::size(message.value)) {
+				message.value[value_count++] = value;
+			}
+		}
+	}
+	if (len) {
+		logger_.log(logmsg::error, _("Got malformed message from child process."));
+		return false;
+	}
+
+	handler_.send_event(ev.release());
+	return true;
+}
@@ -1,36 +1,63 @@
 #ifndef FILEZILLA_ENGINE_SFTP_INPUTPARSER_HEADER
 #define FILEZILLA_ENGINE_SFTP_INPUTPARSER_HEADER
 
-class CSftpControlSocket;
-
 #include "event.h"
 
 #include <libfilezilla/buffer.hpp>
 
+#include <functional>
+
 namespace fz {
+class event_handler;
+class logger_interface;
 class process;
 }
 
 class SftpInputParser final
 {
 public:
-	SftpInputParser(CSftpControlSocket & owner, fz::process& proc);
+	// Converts what fzsftp sends to the local character set, returns an empty
+	// string on failure. See CControlSocket::ConvToLocal
+	typedef std::function<std::wstring(char const*, size_t)> converter;
+
+	// The parsed messages get sent to the handler as CSftpEvent and
+	// CSftpListEvent.
+	SftpInputParser(fz::event_handler & handler, fz::logger_interface & logger, fz::process& proc, converter && conv);
 	~SftpInputParser();
 
 	int OnData();
 
+	// All further messages are framed, see fzprintf.c in fzsftp.
+	void SetBinary() { binary_ = true; }
+
 protected:
 
 	size_t lines(sftpEvent eventType) const;
 
+	int OnBinaryData();
+
+	// Handles all complete frames in the receive buffer
+	int ParseFrames();
+	bool ParseFrame(unsigned char const* p, size_t len);
+	bool Convert(std::string_view in, std::wstring& out);
+
+	// In text mode, the integers are yet to be parsed out of the text
+	void ParseValues(sftp_message & message) const;
+
+	fz::event_handler& handler_;
+	fz::logger_interface& logger_;
 	fz::process& process_;
-	CSftpControlSocket& owner_;
+	converter conv_;
 
 	fz::buffer recv_buffer_;
 	size_t pending_lines_{};
 	size_t search_offset_{};
 	std::unique_ptr<CSftpEvent> event_{};
 	std::unique_ptr<CSftpListEvent> listEvent_{};
+
+	bool binary_{};
+
+	friend class CSftpInputParserTest;
 };
 
 #endif
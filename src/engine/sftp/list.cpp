@@ -1,6 +1,7 @@
 #include "../filezilla.h"
 
 #include "../directorycache.h"
+#include "../servercapabilities.h"
 #include "list.h"
 
 #include <assert.h>
@@ -61,6 +62,11 @@ int CSftpListOpData::Send()
 	}
 	else if (opState == list_list) {
 		listing_parser_ = std::make_unique<CDirectoryListingParser>(&controlSocket_, currentServer_, listingEncoding::unknown);
+		int format{};
+		if (CServerCapabilities::GetCapability(currentServer_, listing_format, &format) == yes) {
+			listing_parser_->SetFormatHint(static_cast<listingFormat::type>(format));
+		}
+		listing_parser_->EnablePartialListings(currentPath_);
 		return controlSocket_.SendCommand(L"ls");
 	}
 
@@ -81,6 +87,14 @@ int CSftpListOpData::ParseResponse()
 		}
 
 		directoryListing_ = listing_parser_->Parse(currentPath_);
+
+		auto const format = listing_parser_->GetDetectedFormat();
+		if (CDirectoryListingParser::IsHintableFormat(format)) {
+			CServerCapabilities::SetCapability(currentServer_, listing_format, yes, static_cast<int>(format));
+		}
+		else if (format != listingFormat::unknown) {
+			CServerCapabilities::SetCapability(currentServer_, listing_format, no);
+		}
 		engine_.GetDirectoryCache().Store(directoryListing_, currentServer_);
 		controlSocket_.SendDirectoryListingNotification(currentPath_, false);
 
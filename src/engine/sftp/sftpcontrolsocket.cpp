@@ -81,10 +81,10 @@ void CSftpControlSocket::OnSftpEvent(sftp_message const& message)
 	case sftpEvent::Done:
 		{
 			int result;
-			if (message.text[0] == L"1") {
+			if (message.value[0] == 1) {
 				result = FZ_REPLY_OK;
 			}
-			else if (message.text[0] == L"2") {
+			else if (message.value[0] == 2) {
 				result = FZ_REPLY_CRITICALERROR;
 			}
 			else {
@@ -106,14 +106,14 @@ void CSftpControlSocket::OnSftpEvent(sftp_message const& message)
 		log_raw(logmsg::status, message.text[0]);
 		break;
 	case sftpEvent::Recv:
-		RecordActivity(activity_logger::recv, fz::to_integral<uint64_t>(message.text[0]));
+		RecordActivity(activity_logger::recv, static_cast<uint64_t>(message.value[0]));
 		break;
 	case sftpEvent::Send:
-		RecordActivity(activity_logger::send, fz::to_integral<uint64_t>(message.text[0]));
+		RecordActivity(activity_logger::send, static_cast<uint64_t>(message.value[0]));
 		break;
 	case sftpEvent::Transfer:
 		{
-			auto value = fz::to_integral<int64_t>(message.text[0]);
+			int64_t const value = message.value[0];
 
 			bool tmp;
 			CTransferStatus status = engine_.transfer_status_.Get(tmp);
@@ -260,13 +260,13 @@ void CSftpControlSocket::OnSftpEvent(sftp_message const& message)
 	case sftpEvent::io_nextbuf:
 		if (!operations_.empty() && operations_.back()->opId == Command::transfer) {
 			auto & data = static_cast<CSftpFileTransferOpData&>(*operations_.back());
-			data.OnNextBufferRequested(fz::to_integral<uint64_t>(message.text[0]));
+			data.OnNextBufferRequested(static_cast<uint64_t>(message.value[0]));
 		}
 		break;
 	case sftpEvent::io_open:
 		if (!operations_.empty() && operations_.back()->opId == Command::transfer) {
 			auto & data = static_cast<CSftpFileTransferOpData&>(*operations_.back());
-			data.OnOpenRequested(fz::to_integral<uint64_t>(message.text[0]));
+			data.OnOpenRequested(static_cast<uint64_t>(message.value[0]));
 		}
 		break;
 	case sftpEvent::io_size:
@@ -278,16 +278,20 @@ void CSftpControlSocket::OnSftpEvent(sftp_message const& message)
 	case sftpEvent::io_finalize:
 		if (!operations_.empty() && operations_.back()->opId == Command::transfer) {
 			auto & data = static_cast<CSftpFileTransferOpData&>(*operations_.back());
-			data.OnFinalizeRequested(fz::to_integral<uint64_t>(message.text[0]));
+			data.OnFinalizeRequested(static_cast<uint64_t>(message.value[0]));
 		}
 		break;
+	case sftpEvent::transfer_window:
+		log(logmsg::debug_info, L"Keeping up to %d bytes in flight in requests of %d bytes, round trip time %d ms",
+			message.value[0], message.value[1], message.value[2]);
+		break;
 	default:
 		log(logmsg::debug_warning, L"Message type %d not handled", message.type);
 		break;
 	}
 }
 
-void CSftpControlSocket::OnSftpListEvent(sftp_list_message const& message)
+void CSftpControlSocket::OnSftpListEvent(std::vector<sftp_list_message> const& messages)
 {
 	if (!currentServer_) {
 		return;
@@ -302,9 +306,13 @@ void CSftpControlSocket::OnSftpListEvent(sftp_list_message const& message)
 		return;
 	}
 	else {
-		int res = static_cast<CSftpListOpData&>(*operations_.back()).ParseEntry(std::move(message.text), message.mtime, std::move(message.name));
-		if (res != FZ_REPLY_WOULDBLOCK) {
-			ResetOperation(res);
+		auto & data = static_cast<CSftpListOpData&>(*operations_.back());
+		for (auto const& message : messages) {
+			int res = data.ParseEntry(std::move(message.text), message.mtime, std::move(message.name));
+			if (res != FZ_REPLY_WOULDBLOCK) {
+				ResetOperation(res);
+				break;
+			}
 		}
 	}
 }
@@ -347,7 +355,23 @@ int CSftpControlSocket::AddToSendBuffer(std::string const& cmd)
 
 	bool const can_send = send_buffer_.empty();
 
-	send_buffer_.append(cmd);
+	if (binary_ipc_) {
+		std::string_view line = cmd;
+		while (!line.empty() && (line.back() == '\n' || line.back() == '\r')) {
+			line.remove_suffix(1);
+		}
+		uint32_t const len = static_cast<uint32_t>(line.size());
+		unsigned char* p = send_buffer_.get(4);
+		p[0] = static_cast<unsigned char>(len >> 24);
+		p[1] = static_cast<unsigned char>(len >> 16);
+		p[2] = static_cast<unsigned char>(len >> 8);
+		p[3] = static_cast<unsigned char>(len);
+		send_buffer_.add(4);
+		send_buffer_.append(line);
+	}
+	else {
+		send_buffer_.append(cmd);
+	}
 
 	if (can_send) {
 		return SendToProcess();
@@ -54,7 +54,7 @@ protected:
 	virtual void operator()(fz::event_base const& ev) override;
 	void OnSftpEvent(sftp_message const& message);
 	void OnProcessEvent(fz::process* p, fz::process_event_flag const& f);
-	void OnSftpListEvent(sftp_list_message const& message);
+	void OnSftpListEvent(std::vector<sftp_list_message> const& messages);
 
 	std::wstring m_requestPreamble;
 	std::wstring m_requestInstruction;
@@ -66,6 +66,10 @@ protected:
 
 	fz::buffer send_buffer_;
 
+	// Once negotiated, each line sent to fzsftp is prefixed with its length
+	// instead of being terminated by a linebreak.
+	bool binary_ipc_{};
+
 	friend class CProtocolOpData<CSftpControlSocket>;
 	friend class CSftpChangeDirOpData;
 	friend class CSftpChmodOpData;
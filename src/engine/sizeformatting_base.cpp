@@ -54,6 +54,16 @@ std::wstring ToString(int64_t n, wchar_t const* const sepBegin = nullptr, wchar_
 	}
 	return ret;
 }
+
+wchar_t byte_unit()
+{
+	// Sizes get formatted from several event loops at once
+	static wchar_t const unit = [] {
+		std::wstring t = _("B <Unit symbol for bytes. Only translate first letter>"); // @translator: Only translate first letter.
+		return t[0];
+	}();
+	return unit;
+}
 }
 
 std::wstring CSizeFormatBase::Format(COptionsBase* pOptions, int64_t size, bool add_bytes_suffix, CSizeFormatBase::_format format, bool thousands_separator, int num_decimal_places)
@@ -162,14 +172,9 @@ std::wstring CSizeFormatBase::Format(COptionsBase* pOptions, int64_t size, bool
 	}
 	result += ' ';
 
-	static wchar_t byte_unit = 0;
-	if (!byte_unit) {
-		std::wstring t = _("B <Unit symbol for bytes. Only translate first letter>"); // @translator: Only translate first letter.
-		byte_unit = t[0];
-	}
 
 	if (!p) {
-		return result + byte_unit;
+		return result + byte_unit();
 	}
 
 	result += prefix[p];
@@ -177,7 +182,7 @@ std::wstring CSizeFormatBase::Format(COptionsBase* pOptions, int64_t size, bool
 		result += 'i';
 	}
 
-	result += byte_unit;
+	result += byte_unit();
 
 	return result;
 }
@@ -229,13 +234,8 @@ std::wstring CSizeFormatBase::GetUnit(COptionsBase* pOptions, _unit unit, CSizeF
 		ret += 'i';
 	}
 
-	static wchar_t byte_unit = 0;
-	if (!byte_unit) {
-		std::wstring t = _("B <Unit symbol for bytes. Only translate first letter>"); // @translator: Only translate first letter.
-		byte_unit = t[0];
-	}
 
-	ret += byte_unit;
+	ret += byte_unit();
 
 	return ret;
 }
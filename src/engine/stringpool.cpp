@@ -0,0 +1,87 @@
+#include "filezilla.h"
+#include "stringpool.h"
+
+#include <algorithm>
+
+namespace {
+// Once this many distinct values have accumulated, the pool starts over.
+// Values handed out earlier remain valid, they merely no longer get shared
+// with values interned afterwards.
+size_t const max_distinct = 100000;
+
+size_t cost(std::wstring_view v)
+{
+	return sizeof(std::wstring) + (v.size() + 1) * sizeof(wchar_t);
+}
+}
+
+CStringPool& CStringPool::instance()
+{
+	static CStringPool pool;
+	return pool;
+}
+
+fz::shared_value<std::wstring> CStringPool::get(std::wstring_view v)
+{
+	fz::scoped_lock lock(mutex_);
+
+	auto it = strings_.find(v);
+	if (it != strings_.end()) {
+		stats_.saved += cost(v);
+		return it->second;
+	}
+
+	if (strings_.size() >= max_distinct) {
+		strings_.clear();
+		stats_.bytes = 0;
+	}
+
+	fz::shared_value<std::wstring> value(std::wstring{v});
+	strings_.emplace(*value, value);
+	stats_.bytes += cost(v);
+
+	return value;
+}
+
+void CStringPool::add_saved(uint64_t bytes)
+{
+	fz::scoped_lock lock(mutex_);
+	stats_.saved += bytes;
+}
+
+CStringPool::stats CStringPool::get_stats() const
+{
+	fz::scoped_lock lock(mutex_);
+
+	stats ret = stats_;
+	ret.distinct = strings_.size();
+	return ret;
+}
+
+fz::shared_value<std::wstring> const& CStringPoolCache::get(std::wstring_view v)
+{
+	auto it = std::lower_bound(cache_.begin(), cache_.end(), v, [](fz::shared_value<std::wstring> const& a, std::wstring_view b) {
+		return std::wstring_view(*a) < b;
+	});
+
+	if (it == cache_.end() || std::wstring_view(**it) != v) {
+		it = cache_.emplace(it, CStringPool::instance().get(v));
+	}
+	else {
+		saved_ += cost(v);
+	}
+	return *it;
+}
+
+CStringPoolCache::~CStringPoolCache()
+{
+	flush_stats();
+}
+
+void CStringPoolCache::flush_stats()
+{
+	if (saved_) {
+		CStringPool::instance().add_saved(saved_);
+		saved_ = 0;
+	}
+}
@@ -0,0 +1,80 @@
+#ifndef FILEZILLA_ENGINE_STRINGPOOL_HEADER
+#define FILEZILLA_ENGINE_STRINGPOOL_HEADER
+
+#include <libfilezilla/mutex.hpp>
+#include <libfilezilla/shared.hpp>
+
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+/*
+Interning table for the short and highly repetitive strings found in
+directory listings, such as permissions and owner/group. Identical values
+share a single allocation across all parsers and cached listings.
+*/
+class CStringPool final
+{
+public:
+	static CStringPool& instance();
+
+	CStringPool(CStringPool const&) = delete;
+	CStringPool& operator=(CStringPool const&) = delete;
+
+	fz::shared_value<std::wstring> get(std::wstring_view v);
+
+	struct stats
+	{
+		size_t distinct{};
+
+		// Approximate bytes held by the distinct values
+		size_t bytes{};
+
+		// Approximate bytes not allocated thanks to values being shared,
+		// including values found in a CStringPoolCache once it has been
+		// flushed.
+		uint64_t saved{};
+	};
+	stats get_stats() const;
+
+private:
+	friend class CStringPoolCache;
+
+	CStringPool() = default;
+
+	void add_saved(uint64_t bytes);
+
+	mutable fz::mutex mutex_;
+
+	// Keys point into the values, which are never modified
+	std::unordered_map<std::wstring_view, fz::shared_value<std::wstring>> strings_;
+
+	stats stats_;
+};
+
+// Unsynchronized front to the pool for use by a single thread, such as a
+// listing parser. Avoids locking the pool for every value.
+class CStringPoolCache final
+{
+public:
+	CStringPoolCache() = default;
+	~CStringPoolCache();
+
+	CStringPoolCache(CStringPoolCache const&) = delete;
+	CStringPoolCache& operator=(CStringPoolCache const&) = delete;
+
+	fz::shared_value<std::wstring> const& get(std::wstring_view v);
+
+	// Adds the values found in this cache so far to the saved bytes of the
+	// pool.
+	void flush_stats();
+
+private:
+	// Vector coupled with binary search and sorted insertion is fastest
+	// alternative as we expect a relatively low amount of inserts.
+	std::vector<fz::shared_value<std::wstring>> cache_;
+
+	uint64_t saved_{};
+};
+
+#endif
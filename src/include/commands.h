@@ -9,6 +9,10 @@
 
 #include <libfilezilla/uri.hpp>
 
+#include <memory>
+
+class download_segments;
+
 // See below for actual commands and their parameters
 
 // Command IDs
@@ -27,6 +31,7 @@ enum class Command
 	chmod,
 	raw,
 	httprequest, // Only used by HTTP protocol
+	metrics, // Does not need a connection
 
 	// Only used internally
 	sleep,
@@ -238,6 +243,22 @@ public:
 	fz::reader_factory_holder const& GetReader() const { return reader_; }
 	fz::writer_factory_holder const& GetWriter() const { return writer_; }
 
+	// Downloads only: Fetch the file in segments, see download_segments.
+	// primary is set for the engine transferring the queue item and unset
+	// for helpers joining in.
+	void SetSegments(std::shared_ptr<download_segments> const& segments, bool primary)
+	{
+		segments_ = segments;
+		segmentPrimary_ = primary;
+	}
+	std::shared_ptr<download_segments> const& GetSegments() const { return segments_; }
+	bool SegmentPrimary() const { return segmentPrimary_; }
+
+	// Set if the queue has further files waiting for this engine. The engine
+	// may then prepare the next transfer ahead of time.
+	void SetMoreTransfersPending(bool pending) { moreTransfersPending_ = pending; }
+	bool MoreTransfersPending() const { return moreTransfersPending_; }
+
 protected:
 	fz::reader_factory_holder const reader_;
 	fz::writer_factory_holder const writer_;
@@ -245,6 +266,10 @@ protected:
 	std::wstring const m_remoteFile;
 	transfer_flags const flags_;
 	std::wstring const extraFlags_;
+
+	std::shared_ptr<download_segments> segments_;
+	bool segmentPrimary_{};
+	bool moreTransfersPending_{};
 };
 
 class FZC_PUBLIC_SYMBOL CHttpRequestCommand final : public CCommandHelper<CHttpRequestCommand, Command::httprequest>
@@ -267,6 +292,23 @@ public:
 	bool confidential_qs_{};
 };
 
+// Sends a CMetricsNotification with the metrics collected by all engines
+// of the context. If a file is given, they are also written to it.
+class FZC_PUBLIC_SYMBOL CMetricsCommand final : public CCommandHelper<CMetricsCommand, Command::metrics>
+{
+public:
+	CMetricsCommand() = default;
+	explicit CMetricsCommand(std::wstring const& file, bool reset = false)
+		: file_(file)
+		, reset_(reset)
+	{}
+
+	std::wstring const file_;
+
+	// Clears the collected metrics afterwards
+	bool const reset_{};
+};
+
 class FZC_PUBLIC_SYMBOL CRawCommand final : public CCommandHelper<CRawCommand, Command::raw>
 {
 public:
@@ -7,6 +7,7 @@
 #include <libfilezilla/shared.hpp>
 #include <libfilezilla/time.hpp>
 
+#include <string_view>
 #include <unordered_map>
 
 class FZC_PUBLIC_SYMBOL CDirentry
@@ -70,6 +71,53 @@ public:
 	bool operator==(const CDirentry &op) const;
 };
 
+// Columnar storage for directory listings that are not being worked with,
+// e.g. listings sitting in the directory cache.
+// Sizes, times and flags are kept in separate arrays, all names are packed
+// into a single arena and each distinct permission and owner/group value
+// is stored only once.
+class FZC_PUBLIC_SYMBOL CCompactDirentries final
+{
+public:
+	CCompactDirentries() = default;
+
+	// Returns false if the entries cannot be compacted, e.g. due to the
+	// name arena growing beyond what the offsets can address.
+	bool Assign(std::vector<fz::shared_value<CDirentry>> const& entries);
+
+	size_t size() const { return sizes_.size(); }
+
+	std::wstring_view name(size_t index) const {
+		return std::wstring_view(names_.data() + name_offsets_[index], name_offsets_[index + 1] - name_offsets_[index]);
+	}
+
+	int64_t file_size(size_t index) const { return sizes_[index]; }
+	int flags(size_t index) const { return flags_[index]; }
+	fz::datetime const& time(size_t index) const { return times_[index]; }
+
+	// Materializes a single entry
+	CDirentry entry(size_t index) const;
+
+	std::vector<fz::shared_value<CDirentry>> Expand() const;
+
+	size_t MemoryUsage() const;
+
+private:
+	std::wstring names_;
+	std::vector<uint32_t> name_offsets_;
+	std::vector<int64_t> sizes_;
+	std::vector<fz::datetime> times_;
+	std::vector<uint8_t> flags_;
+	std::vector<uint32_t> permissions_;
+	std::vector<uint32_t> ownerGroups_;
+
+	// Distinct permission and owner/group values, indexed by the above
+	std::vector<fz::shared_value<std::wstring>> strings_;
+
+	// Link targets, sorted by entry index
+	std::vector<std::pair<uint32_t, std::wstring>> targets_;
+};
+
 class FZC_PUBLIC_SYMBOL CDirectoryListing final
 {
 public:
@@ -82,13 +130,24 @@ public:
 	CDirectoryListing& operator=(CDirectoryListing const&) = default;
 	CDirectoryListing& operator=(CDirectoryListing &&) noexcept = default;
 
+	// On compacted listings, the entry gets decoded and kept until the
+	// listing is expanded or compacted again. Use GetEntry to read single
+	// entries of a listing that might be compacted without keeping them.
 	CDirentry const& operator[](size_t index) const;
 
 	// Word of caution: You MUST NOT change the name of the returned
 	// entry if you do not call ClearFindMap afterwards
 	CDirentry& get(size_t index);
 
-	size_t size() const { return m_entries ? m_entries->size() : 0; }
+	size_t size() const {
+		if (m_compact) {
+			return m_compact->size();
+		}
+		return m_entries ? m_entries->size() : 0;
+	}
+
+	// Returns a copy of the entry, works on compacted listings as well.
+	CDirentry GetEntry(size_t index) const;
 
 	void Append(CDirentry&& entry);
 
@@ -97,6 +156,12 @@ public:
 
 	void ClearFindMap();
 
+	// Completes the search map used by FindFile_CmpNoCase if nocase is set,
+	// otherwise the one used by FindFile_CmpCase. Once complete, the
+	// corresponding FindFile_* function no longer modifies the listing.
+	bool HasFindMap(bool nocase) const;
+	void BuildFindMap(bool nocase) const;
+
 	explicit operator bool() const { return !path.empty(); }
 
 	CServerPath path;
@@ -127,7 +192,11 @@ public:
 		listing_failed = 0x100,
 		listing_has_dirs = 0x200,
 		listing_has_perms = 0x400,
-		listing_has_usergroup = 0x800
+		listing_has_usergroup = 0x800,
+
+		// Set on listings assembled from partial listing notifications
+		// while the directory is still being listed.
+		listing_incomplete = 0x1000
 	};
 
 	int get_unsure_flags() const { return m_flags & unsure_mask; }
@@ -135,16 +204,42 @@ public:
 	bool has_dirs() const { return (m_flags & listing_has_dirs) != 0; }
 	bool has_perms() const { return (m_flags & listing_has_perms) != 0; }
 	bool has_usergroup() const { return (m_flags & listing_has_usergroup) != 0; }
+	bool incomplete() const { return (m_flags & listing_incomplete) != 0; }
 
 	void Assign(std::vector<fz::shared_value<CDirentry>> && entries);
 
+	// Adds the entries to the end of the listing
+	void Append(std::vector<fz::shared_value<CDirentry>> && entries);
+
 	bool RemoveEntry(size_t index);
 
 	void GetFilenames(std::vector<std::wstring> &names) const;
 
+	// Switches to the columnar layout. get and the modifying member
+	// functions transparently expand the listing again.
+	void Compact();
+	void Expand();
+	bool compacted() const { return static_cast<bool>(m_compact); }
+
+	// Approximate number of bytes used by the entries. Permissions and
+	// owner/group values are not included, they are shared between listings.
+	size_t MemoryUsage() const;
+
+	// Approximate number of bytes used by a single entry of an expanded
+	// listing, not counting its slot in the listing.
+	static size_t MemoryUsage(CDirentry const& entry);
+
 protected:
+	void UpdateFlags(size_t first);
+	std::wstring_view name(size_t index) const;
 
+	// At most one of these is set
 	fz::shared_optional<std::vector<fz::shared_value<CDirentry>>> m_entries;
+	fz::shared_optional<CCompactDirentries> m_compact;
+
+	// Entries of the compacted listing read through operator[]. Node based,
+	// references to them stay valid as more entries get decoded.
+	mutable fz::shared_optional<std::unordered_map<size_t, CDirentry>> m_decoded;
 
 	mutable fz::shared_optional<std::unordered_multimap<std::wstring, size_t>> m_searchmap_case;
 	mutable fz::shared_optional<std::unordered_multimap<std::wstring, size_t>> m_searchmap_nocase;
@@ -0,0 +1,130 @@
+#ifndef FILEZILLA_ENGINE_DOWNLOAD_SEGMENTS_HEADER
+#define FILEZILLA_ENGINE_DOWNLOAD_SEGMENTS_HEADER
+
+#include <libfilezilla/event.hpp>
+#include <libfilezilla/mutex.hpp>
+#include <libfilezilla/string.hpp>
+
+#include "visibility.h"
+
+#include <string>
+#include <vector>
+
+namespace fz {
+class event_handler;
+}
+
+struct download_segment_event_type{};
+
+// Sent to the waiter of a download_segments object whenever a segment
+// has been completed or given back.
+typedef fz::simple_event<download_segment_event_type> download_segment_event;
+
+// Splits the download of a single file into byte ranges which several
+// engines can fetch concurrently.
+//
+// The engine transferring the queue item is the primary. It checks that the
+// plan matches the remote file, prepares the local file and then starts the
+// plan. From then on, it and any number of helper engines claim segments until
+// none are left. The primary only finishes once all segments are done and
+// picks up any segment a failing helper gives back.
+//
+// Completed segments are recorded in a file next to the target, so that an
+// interrupted download can be resumed.
+class FZC_PUBLIC_SYMBOL download_segments final
+{
+public:
+	download_segments(std::wstring const& file, int64_t size, int64_t segment_size);
+
+	download_segments(download_segments const&) = delete;
+	download_segments& operator=(download_segments const&) = delete;
+
+	struct segment final
+	{
+		size_t index_{};
+		int64_t offset_{};
+		int64_t length_{};
+	};
+
+	std::wstring const& file() const { return file_; }
+	int64_t size() const { return size_; }
+
+	size_t segment_count() const;
+
+	// Only before starting: Restores the completed segments from the record
+	// file. If there is none, all segments below existing_size are assumed to
+	// be complete, as left behind by an ordinary interrupted download. A file
+	// of the full size is not trusted, prepare() leaves exactly such a file
+	// behind. Nothing is complete if the record file is not valid.
+	void load(int64_t existing_size);
+
+	// Only before starting: Forgets about completed segments
+	void clear();
+
+	// Creates the local file and its directory if needed and sets its size,
+	// without touching data already in it. If directories had to be created,
+	// last_created is set to the deepest one.
+	bool prepare(fz::native_string * last_created = nullptr);
+
+	void start();
+	bool started() const;
+
+	// The plan cannot be used, e.g. since the file size does not match. No
+	// further segments can be claimed. If not yet started, the record file
+	// is discarded, see below.
+	void abandon();
+
+	// Started, not abandoned and with unclaimed segments left
+	bool claimable() const;
+
+	// Returns false if there is no unclaimed segment
+	bool claim(segment & s);
+	void complete(size_t index);
+	void release(size_t index);
+
+	bool done() const;
+	int64_t completed_bytes() const;
+
+	// Gets sent a download_segment_event on each completed or released segment
+	void set_waiter(fz::event_handler * waiter);
+
+	// Removes the record file once all segments are done
+	void finish();
+
+	std::wstring record_file() const;
+
+	// Size of the completed segments at the start of the file, which is all
+	// an ordinary download could resume from. -1 if there is no record file,
+	// 0 if it is not valid.
+	static int64_t usable_size(std::wstring const& file);
+
+	// For downloads of the file not using this plan: If there is a record
+	// file, the local file gets truncated to the completed segments at its
+	// start, so that an ordinary download can resume from its size. Then the
+	// record file is removed.
+	static void discard(std::wstring const& file);
+
+private:
+	enum class state : unsigned char
+	{
+		none,
+		claimed,
+		done
+	};
+
+	segment get(size_t index) const;
+	bool save() const;
+	void notify();
+
+	std::wstring const file_;
+	int64_t const size_;
+	int64_t segment_size_;
+
+	mutable fz::mutex mutex_{false};
+	std::vector<state> states_;
+	bool started_{};
+	bool abandoned_{};
+	fz::event_handler * waiter_{};
+};
+
+#endif
@@ -9,6 +9,7 @@ class activity_logger;
 class CDirectoryCache;
 class COptionsBase;
 class CPathCache;
+class engine_metrics;
 class OpLockManager;
 
 namespace fz {
@@ -38,13 +39,24 @@ public:
 	COptionsBase& GetOptions() { return options_; }
 	fz::thread_pool& GetThreadPool();
 	fz::event_loop& GetEventLoop();
+
+	// Engines are spread across a pool of event loops. AcquireEventLoop
+	// returns the least loaded one, ReleaseEventLoop must be called once
+	// the engine no longer uses it.
+	fz::event_loop& AcquireEventLoop();
+	void ReleaseEventLoop(fz::event_loop& loop);
+
 	fz::rate_limiter& GetRateLimiter();
 	CDirectoryCache& GetDirectoryCache();
 	CPathCache& GetPathCache();
+
+	// Drops all cached directory listings, including the persisted ones
+	void ClearDirectoryCache();
 	CustomEncodingConverterBase const& GetCustomEncodingConverter() { return customEncodingConverter_; }
 	OpLockManager& GetOpLockManager();
 	fz::tls_system_trust_store& GetTlsSystemTrustStore();
 	activity_logger& GetActivityLogger();
+	engine_metrics& GetMetrics();
 
 protected:
 	COptionsBase& options_;
@@ -0,0 +1,94 @@
+#ifndef FILEZILLA_ENGINE_METRICS_HEADER
+#define FILEZILLA_ENGINE_METRICS_HEADER
+
+#include <libfilezilla/mutex.hpp>
+#include <libfilezilla/time.hpp>
+
+#include "visibility.h"
+
+#include <map>
+#include <string>
+
+class CServer;
+
+// Histogram of durations with logarithmic buckets. Bucket 0 counts samples
+// below 1 microsecond, bucket i > 0 those in [2^(i-1), 2^i) microseconds.
+// The last bucket also takes everything larger.
+class FZC_PUBLIC_SYMBOL latency_histogram final
+{
+public:
+	static constexpr size_t bucket_count = 40;
+
+	void record(fz::duration const& d);
+	void merge(latency_histogram const& other);
+
+	uint64_t count() const { return count_; }
+	fz::duration min() const;
+	fz::duration max() const;
+	fz::duration mean() const;
+
+	// Upper bound of the bucket containing the given percentile, p in [0, 100].
+	fz::duration percentile(double p) const;
+
+	uint64_t buckets_[bucket_count]{};
+
+private:
+	uint64_t count_{};
+	int64_t total_us_{};
+	int64_t min_us_{};
+	int64_t max_us_{};
+};
+
+class FZC_PUBLIC_SYMBOL server_metrics final
+{
+public:
+	// Time from starting an operation until it finished, keyed by the
+	// name of the operation, e.g. CFtpChangeDirOpData.
+	std::map<std::wstring, latency_histogram> operations_;
+
+	// Time operations spent queued waiting for a lock held by another engine.
+	// Time spent in the queue of the interface before reaching the engine is
+	// not included.
+	latency_histogram lock_wait_;
+
+	// Completed transfers, index 0 are downloads, 1 uploads
+	uint64_t transfers_[2]{};
+	uint64_t bytes_[2]{};
+	fz::duration transfer_time_[2];
+
+	// In bytes per second, 0 if nothing was transferred.
+	uint64_t rate(bool download) const;
+};
+
+class FZC_PUBLIC_SYMBOL metrics_snapshot final
+{
+public:
+	// Keyed by the server formatted with user and optional port
+	std::map<std::wstring, server_metrics> servers_;
+
+	// Human-readable tables, one per server
+	std::wstring format() const;
+};
+
+// Collects the metrics of all engines in a context.
+class FZC_PUBLIC_SYMBOL engine_metrics final
+{
+public:
+	void record_operation(CServer const& server, std::wstring const& name, fz::duration const& d);
+	void record_lock_wait(CServer const& server, fz::duration const& d);
+	void record_transfer(CServer const& server, bool download, int64_t bytes, fz::duration const& d);
+
+	metrics_snapshot snapshot() const;
+	void reset();
+
+	// Writes the formatted snapshot to the given file, replacing it.
+	bool dump(std::wstring const& file) const;
+
+private:
+	server_metrics& get(CServer const& server);
+
+	mutable fz::mutex mutex_{false};
+	metrics_snapshot data_;
+};
+
+#endif
@@ -78,9 +78,25 @@ enum engineOptions : unsigned int
 	OPTION_TCP_KEEPALIVE_INTERVAL,
 
 	OPTION_CACHE_TTL,
+	OPTION_CACHE_MEMORY_LIMIT,	// In MiB
+	OPTION_CACHE_PERSISTENT,	// Keep cached listings across restarts
+	OPTION_CACHE_FILE,		// Where to keep them, set by the interface
 
 	OPTION_MIN_TLS_VER,
 
+	OPTION_ENGINE_EVENT_LOOPS,	// Number of event loops engines are spread across,
+	                                // 0 for one per hardware thread
+
+	OPTION_NOTIFICATION_INTERVAL,	// In milliseconds, notifications that only update
+	                                // the display are delivered in batches at most
+	                                // this often. 0 delivers each right away.
+
+	OPTION_MODEZ_SUPPORT,		// Compress FTP data connections if the server supports MODE Z
+	OPTION_MODEZ_LEVEL,
+
+	OPTION_FTP_PIPELINE_DEPTH,	// Maximum number of outstanding commands in batches
+	                                // of independent FTP commands, 1 to disable pipelining
+
 	OPTIONS_ENGINE_NUM
 };
 
@@ -19,6 +19,8 @@
 // CFileZillaEngine::SetAsyncRequestReply to continue the current operation.
 
 #include "commands.h"
+#include "directorylisting.h"
+#include "engine_metrics.h"
 #include "local_path.h"
 #include "logging.h"
 #include "server.h"
@@ -36,7 +38,10 @@ enum NotificationId : unsigned int
 	nId_sftp_encryption,	// information about key exchange, encryption algorithms and so on for SFTP
 	nId_local_dir_created,	// local directory has been created
 	nId_serverchange,		// With some protocols, actual server identity isn't known until after logon
-	nId_ftp_tls_resumption
+	nId_ftp_tls_resumption,
+	nId_listing_partial,	// entries of a directory listing still being received
+	nId_metrics,			// reply to CMetricsCommand
+	nId_segments_started	// a segmented download has been started, other engines can join in
 };
 
 // Async request IDs
@@ -134,6 +139,21 @@ protected:
 	CServerPath m_path;
 };
 
+// Sent while a directory listing requested through a CListCommand is still
+// being received, carrying the entries parsed since the previous one. If
+// first_ is set, entries from earlier partial notifications for this path
+// are to be discarded. The regular CDirectoryListingNotification follows
+// once the complete listing is in the cache.
+class FZC_PUBLIC_SYMBOL CPartialListingNotification final : public CNotificationHelper<nId_listing_partial>
+{
+public:
+	CPartialListingNotification(CServerPath const& path, std::vector<fz::shared_value<CDirentry>> && entries, bool first);
+
+	CServerPath const path_;
+	std::vector<fz::shared_value<CDirentry>> entries_;
+	bool const first_{};
+};
+
 class FZC_PUBLIC_SYMBOL CAsyncRequestNotification : public CNotificationHelper<nId_asyncrequest>
 {
 public:
@@ -379,4 +399,20 @@ public:
 	bool allow_{};
 };
 
+class FZC_PUBLIC_SYMBOL CMetricsNotification final : public CNotificationHelper<nId_metrics>
+{
+public:
+	explicit CMetricsNotification(metrics_snapshot && metrics)
+		: metrics_(std::move(metrics))
+	{}
+
+	metrics_snapshot const metrics_;
+};
+
+// Sent once by the primary engine of a segmented download after it has
+// started the plan, see download_segments.
+class FZC_PUBLIC_SYMBOL CSegmentsStartedNotification final : public CNotificationHelper<nId_segments_started>
+{
+};
+
 #endif
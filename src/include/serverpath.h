@@ -65,6 +65,12 @@ public:
 
 	int CmpNoCase(CServerPath const& op) const;
 
+	// Paths comparing equal have the same hash
+	size_t Hash() const;
+
+	// Paths for which CmpNoCase returns 0 have the same hash
+	size_t HashNoCase() const;
+
 	// omitPath is just a hint. For example dataset member names on MVS servers
 	// always use absolute filenames including the full path
 	std::wstring FormatFilename(std::wstring const& filename, bool omitPath = false) const;
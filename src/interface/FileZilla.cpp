@@ -254,6 +254,12 @@ USE AT OWN RISK"), _T("Important Information"));
     }
 #endif
 
+	// Used by the engine if the directory cache is to be kept across restarts
+	std::wstring const settingsDir = options_->get_string(OPTION_DEFAULT_SETTINGSDIR);
+	if (!settingsDir.empty()) {
+		options_->set(OPTION_CACHE_FILE, settingsDir + L"dircache.dat");
+	}
+
 	CMainFrame *frame = new CMainFrame(*options_);
 	frame->Show(true);
 	SetTopWindow(frame);
@@ -1037,6 +1037,11 @@ void CMainFrame::OnEngineEvent(CFileZillaEngine* engine)
 				}
 			}
 			break;
+		case nId_listing_partial:
+			if (pState->m_pCommandQueue) {
+				pState->m_pCommandQueue->ProcessPartialDirectoryListing(static_cast<CPartialListingNotification&>(*pNotification.get()));
+			}
+			break;
 		case nId_asyncrequest:
 			{
 				auto pAsyncRequest = unique_static_cast<CAsyncRequestNotification>(std::move(pNotification));
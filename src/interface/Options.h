@@ -86,6 +86,8 @@ enum interfaceOptions : unsigned int
 	OPTION_DISABLE_UPDATE_FOOTER,
 	OPTION_TAB_DATA,
 	OPTION_SHOWN_OVERLAY,
+	OPTION_SEGMENTED_DOWNLOAD_CONNECTIONS,
+	OPTION_SEGMENTED_DOWNLOAD_MINSIZE,
 
 	// Has to be last element
 	OPTIONS_NUM
@@ -26,6 +26,7 @@
 #include "../commonui/ipcmutex.h"
 #include "../commonui/auto_ascii_files.h"
 #include "../commonui/misc.h"
+#include "../include/download_segments.h"
 
 #include <libfilezilla/glue/wxinvoker.hpp>
 
@@ -499,6 +500,12 @@ void CQueueView::ProcessNotification(t_EngineData *pEngineData, std::unique_ptr<
 			}
 		}
 		break;
+	case nId_segments_started:
+		// Other connections can join in now
+		if (pEngineData->active && pEngineData->pItem && pEngineData->pItem->segments_) {
+			AdvanceQueue(false);
+		}
+		break;
 	case nId_local_dir_created:
 		{
 			auto const& localDirCreatedNotification = static_cast<CLocalDirCreatedNotification const&>(*pNotification);
@@ -772,6 +779,11 @@ void CQueueView::ProcessReply(t_EngineData* pEngineData, COperationNotification
 	// Cancel pending requests
 	m_pAsyncRequestQueue->ClearPending(pEngineData->pEngine);
 
+	if (pEngineData->segments) {
+		ProcessSegmentReply(*pEngineData, notification);
+		return;
+	}
+
 	// Process reply from the engine
 	int replyCode = notification.replyCode_;
 
@@ -968,6 +980,11 @@ void CQueueView::ResetEngine(t_EngineData& data, const ResetReason reason)
 	m_waitStatusLineUpdate = true;
 
 	if (data.pItem) {
+		if (data.pItem->segments_) {
+			DetachSegmentHelpers(data.pItem);
+			data.pItem->segments_.reset();
+		}
+
 		CServerItem* pServerItem = static_cast<CServerItem*>(data.pItem->GetTopLevelItem());
 		if (pServerItem) {
 			wxASSERT(pServerItem->m_activeCount > 0);
@@ -1254,15 +1271,40 @@ void CQueueView::SendNextCommand(t_EngineData& engineData)
 				extraFlags = extraData->extraFlags_;
 			}
 
+			// Allows the engine to prepare the data connection for the next file
+			bool const morePending = static_cast<CServerItem*>(fileItem->GetTopLevelItem())->GetIdleChild(m_activeMode == 1, TransferDirection::both) != nullptr;
+
 			int res;
 			if (!fileItem->Download()) {
 				auto cmd = CFileTransferCommand(fz::file_reader_factory(fileItem->GetLocalPath().GetPath() + fileItem->GetLocalFile(), m_pMainFrame->GetEngineContext().GetThreadPool()),
 					fileItem->GetRemotePath(), fileItem->GetRemoteFile(), fileItem->flags(), extraFlags);
+				cmd.SetMoreTransfersPending(morePending);
 				res = engineData.pEngine->Execute(cmd);
 			}
 			else {
-				auto cmd = CFileTransferCommand(fz::file_writer_factory(fileItem->GetLocalPath().GetPath() + fileItem->GetLocalFile(), m_pMainFrame->GetEngineContext().GetThreadPool()),
+				std::wstring const localFile = fileItem->GetLocalPath().GetPath() + fileItem->GetLocalFile();
+				auto cmd = CFileTransferCommand(fz::file_writer_factory(localFile, m_pMainFrame->GetEngineContext().GetThreadPool()),
 					fileItem->GetRemotePath(), fileItem->GetRemoteFile(), fileItem->flags(), extraFlags);
+				cmd.SetMoreTransfersPending(morePending);
+
+				// Large binary FTP downloads may be split across several connections.
+				// The engine abandons the plan if the remote size turns out to differ.
+				if (fileItem->segments_) {
+					DetachSegmentHelpers(fileItem);
+					fileItem->segments_.reset();
+				}
+				int const connections = options_.get_int(OPTION_SEGMENTED_DOWNLOAD_CONNECTIONS);
+				int64_t const size = fileItem->GetSize();
+				ServerProtocol const protocol = engineData.lastSite.server.GetProtocol();
+				bool const ftp = protocol == FTP || protocol == FTPS || protocol == FTPES || protocol == INSECURE_FTP;
+				if (ftp && connections > 1 && !(fileItem->flags() & ftp_transfer_flags::ascii) &&
+					size >= options_.get_int(OPTION_SEGMENTED_DOWNLOAD_MINSIZE) * int64_t(1024 * 1024))
+				{
+					int64_t const segmentSize = std::max(int64_t(8 * 1024 * 1024), size / (connections * 4));
+					fileItem->segments_ = std::make_shared<download_segments>(localFile, size, segmentSize);
+					cmd.SetSegments(fileItem->segments_, true);
+				}
+
 				res = engineData.pEngine->Execute(cmd);
 			}
 
@@ -2371,6 +2413,256 @@ void CQueueView::TryRefreshListings()
 	}
 }
 
+bool CQueueView::TryStartSegmentHelper()
+{
+	if (m_quit || !m_activeMode) {
+		return false;
+	}
+
+	int const connections = options_.get_int(OPTION_SEGMENTED_DOWNLOAD_CONNECTIONS);
+	if (connections < 2) {
+		return false;
+	}
+
+	// Helpers count against the same limits as ordinary downloads
+	if (m_activeCount >= options_.get_int(OPTION_NUMTRANSFERS)) {
+		return false;
+	}
+	int const maxDownloads = options_.get_int(OPTION_CONCURRENTDOWNLOADLIMIT);
+	if (maxDownloads && m_activeCountDown >= maxDownloads) {
+		return false;
+	}
+
+	for (auto const* pPrimary : m_engineData) {
+		if (!pPrimary->active || pPrimary->state != t_EngineData::transfer || !pPrimary->pItem) {
+			continue;
+		}
+
+		CFileItem* const pItem = pPrimary->pItem;
+		if (!pItem->segments_ || !pItem->segments_->claimable()) {
+			continue;
+		}
+
+		if (CountSegmentHelpers(pItem) >= connections - 1) {
+			continue;
+		}
+
+		CServerItem* const pServerItem = static_cast<CServerItem*>(pItem->GetTopLevelItem());
+		if (!pServerItem) {
+			continue;
+		}
+
+		Site site = pServerItem->GetSite();
+		int const max_count = site.server.MaximumMultipleConnections();
+		if (max_count && pServerItem->m_activeCount >= max_count) {
+			continue;
+		}
+
+		// Never prompt for a password just to speed up a download
+		if (!CLoginManager::Get().GetPassword(site, true)) {
+			continue;
+		}
+
+		t_EngineData* const pEngineData = GetIdleEngine(site);
+		if (!pEngineData) {
+			return false;
+		}
+
+		pEngineData->active = true;
+		delete pEngineData->m_idleDisconnectTimer;
+		pEngineData->m_idleDisconnectTimer = 0;
+		pEngineData->segments = pItem->segments_;
+		pEngineData->segmentItem = pItem;
+		pServerItem->m_activeCount++;
+		m_activeCount++;
+		m_activeCountDown++;
+
+		Site const oldSite = pEngineData->lastSite;
+		pEngineData->lastSite = site;
+
+		if (!pEngineData->pEngine->IsConnected()) {
+			pEngineData->state = t_EngineData::connect;
+		}
+		else if (oldSite != site) {
+			pEngineData->state = t_EngineData::disconnect;
+		}
+		else {
+			pEngineData->state = t_EngineData::segment;
+		}
+
+		SendNextSegmentCommand(*pEngineData);
+
+		// Don't keep trying if the helper failed right away
+		return pEngineData->active;
+	}
+
+	return false;
+}
+
+int CQueueView::CountSegmentHelpers(CFileItem const* item) const
+{
+	int count = 0;
+	for (auto const* pEngineData : m_engineData) {
+		if (pEngineData->active && pEngineData->segmentItem == item) {
+			++count;
+		}
+	}
+
+	return count;
+}
+
+void CQueueView::SendNextSegmentCommand(t_EngineData& engineData)
+{
+	for (;;) {
+		if (!engineData.segmentItem) {
+			ResetSegmentHelper(engineData);
+			return;
+		}
+
+		if (engineData.state == t_EngineData::disconnect) {
+			if (engineData.pEngine->Execute(CDisconnectCommand()) == FZ_REPLY_WOULDBLOCK) {
+				return;
+			}
+			engineData.state = t_EngineData::connect;
+		}
+
+		if (engineData.state == t_EngineData::connect) {
+			int res = engineData.pEngine->Execute(CConnectCommand(engineData.lastSite.server, engineData.lastSite.Handle(), engineData.lastSite.credentials, false));
+
+			wxASSERT((res & FZ_REPLY_BUSY) != FZ_REPLY_BUSY);
+			if (res == FZ_REPLY_WOULDBLOCK) {
+				return;
+			}
+
+			if (res == FZ_REPLY_ALREADYCONNECTED) {
+				engineData.state = t_EngineData::disconnect;
+				continue;
+			}
+
+			if (res != FZ_REPLY_OK) {
+				ResetSegmentHelper(engineData);
+				return;
+			}
+
+			engineData.state = t_EngineData::segment;
+		}
+
+		if (engineData.state == t_EngineData::segment) {
+			CFileItem const* fileItem = engineData.segmentItem;
+
+			std::wstring extraFlags;
+			auto extraData = fileItem->GetExtraData();
+			if (extraData) {
+				extraFlags = extraData->extraFlags_;
+			}
+
+			// The writer is never opened, helpers write through the segment plan
+			auto cmd = CFileTransferCommand(fz::file_writer_factory(engineData.segments->file(), m_pMainFrame->GetEngineContext().GetThreadPool()),
+				fileItem->GetRemotePath(), fileItem->GetRemoteFile(), fileItem->flags(), extraFlags);
+			cmd.SetSegments(engineData.segments, false);
+
+			int res = engineData.pEngine->Execute(cmd);
+			wxASSERT((res & FZ_REPLY_BUSY) != FZ_REPLY_BUSY);
+			if (res == FZ_REPLY_WOULDBLOCK) {
+				return;
+			}
+
+			ResetSegmentHelper(engineData);
+			return;
+		}
+
+		wxFAIL;
+		ResetSegmentHelper(engineData);
+		return;
+	}
+}
+
+void CQueueView::ProcessSegmentReply(t_EngineData& engineData, COperationNotification const& notification)
+{
+	int const replyCode = notification.replyCode_;
+
+	switch (engineData.state)
+	{
+	case t_EngineData::disconnect:
+		engineData.state = t_EngineData::connect;
+		break;
+	case t_EngineData::connect:
+		if (replyCode != FZ_REPLY_OK) {
+			if (replyCode & FZ_REPLY_PASSWORDFAILED) {
+				CLoginManager::Get().CachedPasswordFailed(engineData.lastSite.server);
+			}
+			ResetSegmentHelper(engineData);
+			return;
+		}
+		engineData.state = t_EngineData::segment;
+		break;
+	case t_EngineData::segment:
+		// Either no segments are left, or something went wrong. Either way
+		// the primary picks up whatever remains.
+		ResetSegmentHelper(engineData);
+		return;
+	default:
+		return;
+	}
+
+	if (!m_activeMode) {
+		ResetSegmentHelper(engineData);
+		return;
+	}
+
+	SendNextSegmentCommand(engineData);
+}
+
+void CQueueView::ResetSegmentHelper(t_EngineData& engineData)
+{
+	if (!engineData.active) {
+		return;
+	}
+
+	if (engineData.segmentItem) {
+		CServerItem* pServerItem = static_cast<CServerItem*>(engineData.segmentItem->GetTopLevelItem());
+		if (pServerItem) {
+			wxASSERT(pServerItem->m_activeCount > 0);
+			if (pServerItem->m_activeCount > 0) {
+				pServerItem->m_activeCount--;
+			}
+		}
+		engineData.segmentItem = 0;
+	}
+	engineData.segments.reset();
+
+	wxASSERT(m_activeCountDown > 0);
+	if (m_activeCountDown > 0) {
+		m_activeCountDown--;
+	}
+	wxASSERT(m_activeCount > 0);
+	if (m_activeCount > 0) {
+		--m_activeCount;
+	}
+	engineData.active = false;
+	engineData.state = t_EngineData::none;
+
+	AdvanceQueue();
+}
+
+void CQueueView::DetachSegmentHelpers(CFileItem* item)
+{
+	// The item may be about to move to another queue or get deleted. The
+	// helpers get cancelled and reset once their engines reply.
+	for (auto* pEngineData : m_engineData) {
+		if (!pEngineData->active || pEngineData->segmentItem != item) {
+			continue;
+		}
+
+		CServerItem* pServerItem = static_cast<CServerItem*>(item->GetTopLevelItem());
+		if (pServerItem && pServerItem->m_activeCount > 0) {
+			pServerItem->m_activeCount--;
+		}
+		pEngineData->segmentItem = 0;
+		pEngineData->pEngine->Cancel();
+	}
+}
+
 void CQueueView::OnAskPassword()
 {
 	while (!m_waitingForPassword.empty()) {
@@ -2441,6 +2733,8 @@ void CQueueView::AdvanceQueue(bool refresh)
 	insideAdvanceQueue = true;
 	while (TryStartNextTransfer()) {
 	}
+	while (TryStartSegmentHelper()) {
+	}
 
 	// Set timer for connected, idle engines
 	for (unsigned int i = 0; i < m_engineData.size(); ++i) {
@@ -73,10 +73,17 @@ struct t_EngineData final
 		list,
 		mkdir,
 		askpassword,
-		waitprimary
+		waitprimary,
+		segment
 	} state;
 
 	CFileItem* pItem;
+
+	// Helper engines fetch segments of a download another engine is
+	// transferring. They have no pItem of their own.
+	std::shared_ptr<download_segments> segments;
+	CFileItem* segmentItem{};
+
 	Site lastSite;
 	CStatusLineCtrl* pStatusLineCtrl;
 	wxTimer* m_idleDisconnectTimer;
@@ -176,6 +183,13 @@ protected:
 	void ProcessReply(t_EngineData* pEngineData, COperationNotification const& notification);
 	void SendNextCommand(t_EngineData& engineData);
 
+	bool TryStartSegmentHelper();
+	int CountSegmentHelpers(CFileItem const* item) const;
+	void SendNextSegmentCommand(t_EngineData& engineData);
+	void ProcessSegmentReply(t_EngineData& engineData, COperationNotification const& notification);
+	void ResetSegmentHelper(t_EngineData& engineData);
+	void DetachSegmentHelpers(CFileItem* item);
+
 	enum class ResetReason
 	{
 		success,
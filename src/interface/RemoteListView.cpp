@@ -323,6 +323,7 @@ CRemoteListView::CRemoteListView(CView* pParent, CState& state, CQueueView* pQue
 	, m_parentView(pParent)
 {
 	state.RegisterHandler(this, STATECHANGE_REMOTE_DIR);
+	state.RegisterHandler(this, STATECHANGE_REMOTE_DIR_PARTIAL);
 	state.RegisterHandler(this, STATECHANGE_APPLYFILTER);
 	state.RegisterHandler(this, STATECHANGE_REMOTE_LINKNOTDIR);
 	state.RegisterHandler(this, STATECHANGE_SERVER);
@@ -418,7 +419,8 @@ bool CRemoteListView::IsItemValid(unsigned int item) const
 
 void CRemoteListView::UpdateDirectoryListing_Added(std::shared_ptr<CDirectoryListing> const& pDirectoryListing)
 {
-	size_t const to_add = pDirectoryListing->size() - m_pDirectoryListing->size();
+	// One file data per known entry, plus the one for the parent directory
+	size_t const to_add = pDirectoryListing->size() - (m_fileData.size() - 1);
 	m_pDirectoryListing = pDirectoryListing;
 	UpdateSortComparisonObject();
 
@@ -696,6 +698,22 @@ void CRemoteListView::SetDirectoryListing(std::shared_ptr<CDirectoryListing> con
 	else if (m_pDirectoryListing->path != pDirectoryListing->path) {
 		reset = true;
 	}
+	else if (m_pDirectoryListing->incomplete() && m_pDirectoryListing->m_firstListTime == pDirectoryListing->m_firstListTime
+		&& !IsComparing() && !m_fileData.empty() && pDirectoryListing->size() >= m_fileData.size() - 1)
+	{
+		// Further entries of a listing still being received got appended.
+		// The listing may have grown in place, so count the known entries
+		// by their file data instead of asking the old listing.
+		// Sorted insertion only pays off if the batch is small compared
+		// to what is already displayed, otherwise rebuild below.
+		size_t const known = m_fileData.size() - 1;
+		size_t const added = pDirectoryListing->size() - known;
+		if (added * 8 <= known) {
+			UpdateDirectoryListing_Added(pDirectoryListing);
+			RefreshListOnly();
+			return;
+		}
+	}
 	else if (m_pDirectoryListing->m_firstListTime == pDirectoryListing->m_firstListTime && !IsComparing()
 		&& m_pDirectoryListing->size() > 200)
 	{
@@ -2102,6 +2120,10 @@ void CRemoteListView::OnStateChange(t_statechange_notifications notification, st
 	if (notification == STATECHANGE_REMOTE_DIR) {
 		SetDirectoryListing(m_state.GetRemoteDir());
 	}
+	else if (notification == STATECHANGE_REMOTE_DIR_PARTIAL) {
+		wxASSERT(data2);
+		SetDirectoryListing(*static_cast<std::shared_ptr<CDirectoryListing> const*>(data2));
+	}
 	else if (notification == STATECHANGE_REMOTE_LINKNOTDIR) {
 		wxASSERT(data2);
 		LinkIsNotDir(*(CServerPath*)data2, data);
@@ -46,6 +46,8 @@ void CClearPrivateDataDialog::Run()
 	inner->Add(clearSitemanager);
 	auto clearQueue = new wxCheckBox(box, nullID, _("&Transfer queue"));
 	inner->Add(clearQueue);
+	auto clearDirectoryCache = new wxCheckBox(box, nullID, _("Cached &directory listings"));
+	inner->Add(clearDirectoryCache);
 
 	auto buttons = lay.createButtonSizer(this, main, false);
 
@@ -136,6 +138,10 @@ void CClearPrivateDataDialog::Run()
 		m_pMainFrame->GetQueue()->SetActive(false);
 		m_pMainFrame->GetQueue()->RemoveAll();
 	}
+
+	if (clearDirectoryCache->GetValue()) {
+		m_pMainFrame->GetEngineContext().ClearDirectoryCache();
+	}
 }
 
 void CClearPrivateDataDialog::OnTimer(wxTimerEvent&)
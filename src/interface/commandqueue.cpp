@@ -175,6 +175,9 @@ void CCommandQueue::ProcessReply(int nReplyCode, Command commandId)
 	++m_inside_commandqueue;
 
 	if (commandInfo.command->GetId() == Command::list && nReplyCode != FZ_REPLY_OK) {
+		// No complete listing is going to replace what got received so far
+		m_state.ClearPartialRemoteDir();
+
 		if ((nReplyCode & FZ_REPLY_LINKNOTDIR) == FZ_REPLY_LINKNOTDIR) {
 			// Symbolic link does not point to a directory. Either points to file
 			// or is completely invalid
@@ -316,3 +319,14 @@ void CCommandQueue::ProcessDirectoryListing(CDirectoryListingNotification const&
 		CContextManager::Get()->ProcessDirectoryListing(m_state.GetSite().server, pListing, listingIsRecursive ? 0 : &m_state);
 	}
 }
+
+void CCommandQueue::ProcessPartialDirectoryListing(CPartialListingNotification & listingNotification)
+{
+	auto const firstListing = std::find_if(m_CommandList.begin(), m_CommandList.end(), [](CommandInfo const& v) { return v.command->GetId() == Command::list; });
+	if (firstListing == m_CommandList.end() || firstListing->origin == recursiveOperation) {
+		// Recursive operations only care about complete listings
+		return;
+	}
+
+	m_state.SetPartialRemoteDir(listingNotification.path_, std::move(listingNotification.entries_), listingNotification.first_);
+}
@@ -7,6 +7,10 @@
 
 #include <libfilezilla/optional.hpp>
 
+#include <memory>
+
+class download_segments;
+
 enum class QueuePriority : unsigned char {
 	lowest,
 	low,
@@ -254,6 +258,9 @@ public:
 	unsigned char m_errorCount{};
 	t_EngineData* m_pEngineData{};
 
+	// Set while the download is split across several connections
+	std::shared_ptr<download_segments> segments_;
+
 	inline bool made_progress() const { return flags_ & queue_flags::made_progess; }
 	inline void set_made_progress(bool made_progress)
 	{
@@ -349,6 +349,13 @@ bool CState::SetLocalDir(CLocalPath const& dir, std::wstring *error, bool rememb
 
 bool CState::SetRemoteDir(std::shared_ptr<CDirectoryListing> const& pDirectoryListing, bool primary)
 {
+	// Whatever partial listing is being displayed gets superseded. If the
+	// new listing is not taken over, handlers still need to be told to
+	// go back to the previous one.
+	bool const hadPartial = m_pPartialDirectoryListing &&
+		(primary || (pDirectoryListing && pDirectoryListing->path == m_pPartialDirectoryListing->path)) &&
+		DropPartialRemoteDir();
+
 	if (!pDirectoryListing) {
 		m_changeDirFlags.compare = false;
 		SetSyncBrowse(false);
@@ -356,7 +363,7 @@ bool CState::SetRemoteDir(std::shared_ptr<CDirectoryListing> const& pDirectoryLi
 			return false;
 		}
 
-		if (m_pDirectoryListing) {
+		if (m_pDirectoryListing || hadPartial) {
 			m_pDirectoryListing = 0;
 			NotifyHandlers(STATECHANGE_REMOTE_DIR, std::wstring(), &primary);
 		}
@@ -378,6 +385,9 @@ bool CState::SetRemoteDir(std::shared_ptr<CDirectoryListing> const& pDirectoryLi
 	if (!primary) {
 		if (!m_pDirectoryListing || m_pDirectoryListing->path != pDirectoryListing->path) {
 			// We aren't interested in these listings
+			if (hadPartial) {
+				NotifyHandlers(STATECHANGE_REMOTE_DIR, std::wstring(), &primary);
+			}
 			return true;
 		}
 	}
@@ -389,6 +399,9 @@ bool CState::SetRemoteDir(std::shared_ptr<CDirectoryListing> const& pDirectoryLi
 		pDirectoryListing->failed())
 	{
 		// We still got an old listing, no need to display the new one
+		if (hadPartial) {
+			NotifyHandlers(STATECHANGE_REMOTE_DIR, std::wstring(), &primary);
+		}
 		return true;
 	}
 
@@ -448,6 +461,62 @@ std::shared_ptr<CDirectoryListing> CState::GetRemoteDir() const
 	return m_pDirectoryListing;
 }
 
+void CState::SetPartialRemoteDir(CServerPath const& path, std::vector<fz::shared_value<CDirentry>> && entries, bool first)
+{
+	if (m_pDirectoryListing && m_pDirectoryListing != m_pPartialDirectoryListing && m_pDirectoryListing->path == path) {
+		// Refreshing, keep displaying the old listing until the new one is complete
+		return;
+	}
+
+	if (first || !m_pPartialDirectoryListing || m_pPartialDirectoryListing->path != path) {
+		DropPartialRemoteDir();
+
+		m_pPartialDirectoryListing = std::make_shared<CDirectoryListing>();
+		m_pPartialDirectoryListing->path = path;
+		m_pPartialDirectoryListing->m_flags |= CDirectoryListing::listing_incomplete;
+		m_pPartialDirectoryListing->m_firstListTime = fz::monotonic_clock::now();
+		m_pPartialDirectoryListing->Append(std::move(entries));
+
+		// From here on the new directory is the current one, so that
+		// everything asking for the remote path gets the one on display.
+		m_pListingBeforePartial = m_pDirectoryListing;
+		m_pDirectoryListing = m_pPartialDirectoryListing;
+
+		bool primary = true;
+		NotifyHandlers(STATECHANGE_REMOTE_DIR, std::wstring(), &primary);
+		return;
+	}
+
+	// Appended in place. The views only look at entries past the ones they
+	// already know about, so each batch costs only its own size.
+	m_pPartialDirectoryListing->Append(std::move(entries));
+
+	NotifyHandlers(STATECHANGE_REMOTE_DIR_PARTIAL, std::wstring(), &m_pPartialDirectoryListing);
+}
+
+void CState::ClearPartialRemoteDir()
+{
+	// Listing failed, go back to whatever got displayed before
+	if (DropPartialRemoteDir()) {
+		bool primary = false;
+		NotifyHandlers(STATECHANGE_REMOTE_DIR, std::wstring(), &primary);
+	}
+}
+
+bool CState::DropPartialRemoteDir()
+{
+	if (!m_pPartialDirectoryListing) {
+		return false;
+	}
+
+	if (m_pDirectoryListing == m_pPartialDirectoryListing) {
+		m_pDirectoryListing = m_pListingBeforePartial;
+	}
+	m_pPartialDirectoryListing.reset();
+	m_pListingBeforePartial.reset();
+	return true;
+}
+
 const CServerPath CState::GetRemotePath() const
 {
 	if (!m_pDirectoryListing) {
@@ -5,6 +5,7 @@
 #include "sitemanager.h"
 #include "sitemanager_dialog.h"
 
+#include "../include/directorylisting.h"
 #include "../include/local_path.h"
 
 #include <memory>
@@ -15,6 +16,10 @@ enum t_statechange_notifications
 
 	STATECHANGE_REMOTE_DIR,
 	STATECHANGE_REMOTE_DIR_OTHER,
+
+	// data2 points to a std::shared_ptr<CDirectoryListing> with the entries
+	// received so far of the directory currently being listed
+	STATECHANGE_REMOTE_DIR_PARTIAL,
 	STATECHANGE_REMOTE_RECV,
 	STATECHANGE_REMOTE_SEND,
 	STATECHANGE_REMOTE_LINKNOTDIR,
@@ -147,6 +152,13 @@ public:
 	bool ChangeRemoteDir(CServerPath const& path, std::wstring const& subdir = std::wstring(), int flags = 0, bool ignore_busy = false, bool compare = false);
 	bool SetRemoteDir(std::shared_ptr<CDirectoryListing> const& pDirectoryListing, bool primary);
 	std::shared_ptr<CDirectoryListing> GetRemoteDir() const;
+
+	// Progressive display of a listing still being received. With the first
+	// batch, the partial listing becomes the current remote directory. It is
+	// superseded by the next SetRemoteDir call for the same path or a primary
+	// listing, or replaced by the previous one again if listing fails.
+	void SetPartialRemoteDir(CServerPath const& path, std::vector<fz::shared_value<CDirentry>> && entries, bool first);
+	void ClearPartialRemoteDir();
 	const CServerPath GetRemotePath() const;
 
 	Site const& GetSite() const;
@@ -227,6 +239,13 @@ protected:
 	CLocalPath m_localDir;
 	std::shared_ptr<CDirectoryListing> m_pDirectoryListing;
 
+	std::shared_ptr<CDirectoryListing> m_pPartialDirectoryListing;
+	std::shared_ptr<CDirectoryListing> m_pListingBeforePartial;
+
+	// Puts back the listing the partial one took the place of. Returns
+	// whether there was a partial listing.
+	bool DropPartialRemoteDir();
+
 	Site m_site;
 
 	wxString m_title;
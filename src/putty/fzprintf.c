@@ -1,13 +1,101 @@
 #include "putty.h"
 #include "misc.h"
 
+#ifdef _WINDOWS
+#include <fcntl.h>
+#include <io.h>
+#endif
+
 bool pending_reply = false;
+bool binary_ipc = false;
+
+void enable_binary_ipc(void)
+{
+#ifdef _WINDOWS
+    _setmode(_fileno(stdout), _O_BINARY);
+#endif
+    binary_ipc = true;
+}
+
+/*
+ * In binary mode, each message is a frame: a 32-bit length of the
+ * remainder, the message type as single byte, then a sequence of typed
+ * fields. String fields are 's' followed by a 32-bit length and the
+ * data, integer fields are 'i' followed by a 64-bit two's complement
+ * value. All integers are big-endian.
+ *
+ * Listing entries are collected into a single frame with one string,
+ * integer, string triple per entry. The batch goes out once it is large
+ * enough or before any other message.
+ */
+#define LIST_BATCH_SIZE (64 * 1024)
+
+static strbuf* list_batch = NULL;
+
+static void frame_send(strbuf* sb);
+
+static void list_batch_flush(void)
+{
+    if (list_batch) {
+        strbuf* sb = list_batch;
+        list_batch = NULL;
+        frame_send(sb);
+    }
+}
+
+static strbuf* frame_start(sftpEventTypes type)
+{
+    strbuf* sb;
+    list_batch_flush();
+
+    sb = strbuf_new();
+    put_uint32(sb, 0); /* filled in by frame_send */
+    put_byte(sb, (unsigned char)type);
+    return sb;
+}
+
+static void frame_put_string(strbuf* sb, const char* data, size_t len)
+{
+    put_byte(sb, 's');
+    put_uint32(sb, len);
+    put_data(sb, data, len);
+}
+
+static void frame_put_int(strbuf* sb, int64_t value)
+{
+    put_byte(sb, 'i');
+    put_uint64(sb, (uint64_t)value);
+}
+
+static void frame_send(strbuf* sb)
+{
+    PUT_32BIT_MSB_FIRST(sb->u, sb->len - 4);
+    fwrite(sb->u, 1, sb->len, stdout);
+    fflush(stdout);
+    strbuf_free(sb);
+}
+
+static void fzsend_line(sftpEventTypes type, const char* line)
+{
+    if (binary_ipc) {
+        strbuf* sb = frame_start(type);
+        frame_put_string(sb, line, strlen(line));
+        frame_send(sb);
+    }
+    else {
+        fprintf(stdout, "%c%s\n", (int)type + '0', line);
+    }
+}
 
 int fznotify(sftpEventTypes type)
 {
     if (type == sftpDone || type == sftpReply) {
         pending_reply = false;
     }
+    if (binary_ipc) {
+        frame_send(frame_start(type));
+        return 0;
+    }
     fprintf(stdout, "%c", (int)type + '0');
     fflush(stdout);
     return 0;
@@ -27,7 +115,7 @@ int fzprintf(sftpEventTypes type, const char* fmt, ...)
         sfree(str);
         va_end(ap);
 
-        fprintf(stdout, "%c\n", (int)type + '0');
+        fzsend_line(type, "");
         fflush(stdout);
 
         return 0;
@@ -38,7 +126,7 @@ int fzprintf(sftpEventTypes type, const char* fmt, ...)
         if (*p == '\r' || *p == '\n') {
             if (p != s) {
                 *p = 0;
-                fprintf(stdout, "%c%s\n", (int)type + '0', s);
+                fzsend_line(type, s);
                 s = p + 1;
             }
             else {
@@ -48,7 +136,7 @@ int fzprintf(sftpEventTypes type, const char* fmt, ...)
         else if (!*p) {
             if (p != s) {
                 *p = 0;
-                fprintf(stdout, "%c%s\n", (int)type + '0', s);
+                fzsend_line(type, s);
                 s = p + 1;
             }
             break;
@@ -92,12 +180,19 @@ int fzprintf_raw_untrusted(sftpEventTypes type, const char* fmt, ...)
     }
     *s = 0;
 
-    if (type != sftpUnknown) {
-        fputc((int)type + '0', stdout);
+    if (binary_ipc) {
+        strbuf* sb = frame_start(type);
+        frame_put_string(sb, str, strlen(str));
+        frame_send(sb);
+    }
+    else {
+        if (type != sftpUnknown) {
+            fputc((int)type + '0', stdout);
+        }
+        fputs(str, stdout);
+        fputc('\n', stdout);
+        fflush(stdout);
     }
-    fputs(str, stdout);
-    fputc('\n', stdout);
-    fflush(stdout);
 
     sfree(str);
 
@@ -117,9 +212,25 @@ int fzprintf_raw(sftpEventTypes type, const char* fmt, ...)
     va_start(ap, fmt);
     str = dupvprintf(fmt, ap);
 
-    fputc((char)type + '0', stdout);
-    fputs(str, stdout);
-    fflush(stdout);
+    if (binary_ipc) {
+        /* Each line becomes a field of its own */
+        strbuf* sb = frame_start(type);
+        char* s = str;
+        char* p;
+        while ((p = strchr(s, '\n'))) {
+            frame_put_string(sb, s, p - s);
+            s = p + 1;
+        }
+        if (*s) {
+            frame_put_string(sb, s, strlen(s));
+        }
+        frame_send(sb);
+    }
+    else {
+        fputc((char)type + '0', stdout);
+        fputs(str, stdout);
+        fflush(stdout);
+    }
 
     sfree(str);
 
@@ -128,14 +239,62 @@ int fzprintf_raw(sftpEventTypes type, const char* fmt, ...)
     return 0;
 }
 
-int fznotify1(sftpEventTypes type, int data)
+int fznotify1(sftpEventTypes type, int64_t data)
+{
+    return fznotifyn(type, 1, &data);
+}
+
+int fznotifyn(sftpEventTypes type, int count, const int64_t* data)
 {
+    int i;
+
     if (type == sftpDone || type == sftpReply) {
         pending_reply = false;
     }
 
-    fprintf(stdout, "%c%d\n", (int)type + '0', data);
+    if (binary_ipc) {
+        strbuf* sb = frame_start(type);
+        for (i = 0; i < count; ++i) {
+            frame_put_int(sb, data[i]);
+        }
+        frame_send(sb);
+        return 0;
+    }
+
+    fputc((int)type + '0', stdout);
+    for (i = 0; i < count; ++i) {
+        fprintf(stdout, i ? " %"PRId64 : "%"PRId64, data[i]);
+    }
+    fputc('\n', stdout);
     fflush(stdout);
     return 0;
 }
 
+void fzlistentry_flush(void)
+{
+    list_batch_flush();
+}
+
+int fzlistentry(const char* text, uint64_t mtime, const char* name)
+{
+    if (binary_ipc) {
+        size_t const textlen = strlen(text);
+        size_t const namelen = strlen(name);
+        if (list_batch && list_batch->len + textlen + namelen + 32 > LIST_BATCH_SIZE) {
+            list_batch_flush();
+        }
+        if (!list_batch) {
+            list_batch = frame_start(sftpListentry);
+        }
+        frame_put_string(list_batch, text, textlen);
+        frame_put_int(list_batch, (int64_t)mtime);
+        frame_put_string(list_batch, name, namelen);
+        return 0;
+    }
+
+    fzprintf_raw_untrusted(sftpListentry, "%s", text);
+    fzprintf_raw_untrusted(sftpUnknown, "%"PRIu64, mtime);
+    fzprintf_raw_untrusted(sftpUnknown, "%s", name);
+    return 0;
+}
+
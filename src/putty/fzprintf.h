@@ -1,4 +1,4 @@
-#define FZSFTP_PROTOCOL_VERSION 11
+#define FZSFTP_PROTOCOL_VERSION 14
 
 typedef enum
 {
@@ -33,10 +33,15 @@ typedef enum
     sftp_io_open,
     sftp_io_nextbuf,
     sftp_io_finalize,
+    sftp_transfer_window, /* payload: window and request size in bytes, smoothed round trip time in ms */
 } sftpEventTypes;
 
 extern bool pending_reply;
 
+// Set once the engine asked for framed messages, see fzprintf.c
+extern bool binary_ipc;
+void enable_binary_ipc(void);
+
 int fznotify(sftpEventTypes type);
 
 // Format the string. Each line of the string is prepended by type
@@ -47,4 +52,11 @@ int fzprintf_raw(sftpEventTypes type, const char* p, ...);
 
 // Format the string, then print the type (if not sftpUnknown) and the string with linebreaks replaced by spaces.
 int fzprintf_raw_untrusted(sftpEventTypes type, const char* p, ...);
-int fznotify1(sftpEventTypes type, int data);
+int fznotify1(sftpEventTypes type, int64_t data);
+
+// Sends a message carrying count integers
+int fznotifyn(sftpEventTypes type, int count, const int64_t* data);
+
+// In binary mode, entries are batched until the next message or fzlistentry_flush
+int fzlistentry(const char* text, uint64_t mtime, const char* name);
+void fzlistentry_flush(void);
@@ -18,6 +18,47 @@ char *input_buf = 0;
 int input_buflen = 0, input_bufsize = 0;
 #endif
 
+/* Upper bound for the length of framed input lines */
+#define MAX_INPUT_FRAME (64 * 1024)
+
+#ifdef _WINDOWS
+static bool read_exact(HANDLE h, char* buf, DWORD len)
+{
+    while (len) {
+        DWORD read;
+        if (!ReadFile(h, buf, len, &read, 0) || !read) {
+            return false;
+        }
+        buf += read;
+        len -= read;
+    }
+    return true;
+}
+
+char* read_input_frame()
+{
+    HANDLE hin = GetStdHandle(STD_INPUT_HANDLE);
+    unsigned char header[4];
+    uint32_t len;
+    char* line;
+
+    if (!read_exact(hin, (char*)header, 4)) {
+        return NULL;
+    }
+    len = GET_32BIT_MSB_FIRST(header);
+    if (len > MAX_INPUT_FRAME) {
+        return NULL;
+    }
+    line = snewn(len + 1, char);
+    if (!read_exact(hin, line, len)) {
+        sfree(line);
+        return NULL;
+    }
+    line[len] = 0;
+    return line;
+}
+#endif
+
 char* priority_read()
 {
 #ifdef _WINDOWS
@@ -25,6 +66,29 @@ char* priority_read()
     HANDLE hin;
     DWORD savemode, newmode;
 
+    if (binary_ipc) {
+        while (!ret) {
+            char* line = read_input_frame();
+            if (!line) {
+                fzprintf(sftpError, "read_input_frame failed in priority_read");
+                cleanup_exit(1);
+            }
+
+            if (line[0] != '-') {
+                if (input_pushback != 0) {
+                    sfree(line);
+                    fzprintf(sftpError, "input_pushback not null!");
+                    cleanup_exit(1);
+                }
+                input_pushback = line;
+            }
+            else {
+                ret = line;
+            }
+        }
+        return ret;
+    }
+
     hin = GetStdHandle(STD_INPUT_HANDLE);
 
     GetConsoleMode(hin, &savemode);
@@ -227,9 +291,69 @@ static void clear_input_buffers(int free)
     input_buflen = 0;
 }
 
+/*
+ * In binary mode, each line is preceded by its 32-bit big-endian length
+ * instead of being terminated by a linebreak. Only ever reads up to the
+ * end of the current frame. Unless forced, reads at most once.
+ */
+static char* read_input_frame(int force, int* error)
+{
+    int ret;
+    bool did_read = false;
+    while (1) {
+        int need;
+        if (input_buflen < 4) {
+            need = 4 - input_buflen;
+        }
+        else {
+            uint32_t len = GET_32BIT_MSB_FIRST(input_buf);
+            if (len > MAX_INPUT_FRAME) {
+                *error = 1;
+                clear_input_buffers(1);
+                return NULL;
+            }
+            need = 4 + (int)len - input_buflen;
+            if (!need) {
+                /* we have a full frame */
+                char* buf = snewn(len + 1, char);
+                memcpy(buf, input_buf + 4, len);
+                buf[len] = 0;
+                input_buflen = 0;
+                return buf;
+            }
+        }
+
+        if (did_read && !force) {
+            return NULL;
+        }
+
+        if (input_buflen + need > input_bufsize) {
+            input_bufsize = input_buflen + need;
+            input_buf = sresize(input_buf, input_bufsize, char);
+        }
+        ret = read(0, input_buf + input_buflen, need);
+        if (ret < 0) {
+            perror("read");
+            *error = 1;
+            clear_input_buffers(1);
+            return NULL;
+        }
+        if (ret == 0) {
+            *error = 1;
+            clear_input_buffers(1);
+            return NULL;
+        }
+        input_buflen += ret;
+        did_read = true;
+    }
+}
+
 char* read_input_line(int force, int* error)
 {
     int ret;
+    if (binary_ipc) {
+        return read_input_frame(force, error);
+    }
     do {
         if (input_buflen >= input_bufsize) {
             input_bufsize = input_buflen + 512;
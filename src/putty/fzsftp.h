@@ -10,6 +10,8 @@ char* get_input_pushback(void);
 int has_input_pushback(void);
 #ifndef _WINDOWS
 char* read_input_line(int force, int* error);
+#else
+char* read_input_frame();
 #endif
 
 int CurrentSpeedLimit(int direction);
@@ -376,7 +376,7 @@ int sftp_get_file(char *fname, char *outfname, bool restart)
         }
 
         if (fz_timer_check(&timer)) {
-            fzprintf(sftpTransfer, "%d", winterval);
+            fznotify1(sftpTransfer, winterval);
             winterval = 0;
         }
 
@@ -415,6 +415,7 @@ int sftp_put_file(char *fname, char *outfname, int restart)
     bool err = false, eof;
     struct fxp_attrs attrs;
     long permissions;
+    char *buffer;
 
     attrs.flags = 0;
 //FIXME    PUT_PERMISSIONS(attrs, permissions);
@@ -470,13 +471,13 @@ int sftp_put_file(char *fname, char *outfname, int restart)
      * thus put up a progress bar.
      */
     xfer = xfer_upload_init(fh, offset);
+    buffer = snewn(xfer_max_request_size(xfer), char);
     eof = false;
     while ((!err && !eof) || !xfer_done(xfer)) {
-        char buffer[4096*4];
         int len, ret;
 
         while (xfer_upload_ready(xfer) && !err && !eof) {
-            len = read_from_file(file, buffer, sizeof(buffer));
+            len = read_from_file(file, buffer, xfer_request_size(xfer));
             if (len == -1) {
                 fzprintf(sftpError, "error while reading local file");
                 err = true;
@@ -514,6 +515,7 @@ int sftp_put_file(char *fname, char *outfname, int restart)
     }
 
     xfer_cleanup(xfer);
+    sfree(buffer);
 
   cleanup:
     req = fxp_close_send(fh);
@@ -555,6 +557,16 @@ int sftp_cmd_quit(struct sftp_command *cmd)
     return -1;
 }
 
+/*
+ * Switches to framed messages in both directions, see fzprintf.c.
+ * Sent by the engine right after the startup banner.
+ */
+int sftp_cmd_binary(struct sftp_command *cmd)
+{
+    enable_binary_ipc();
+    return 1;
+}
+
 int sftp_cmd_keyfile(struct sftp_command *cmd)
 {
     if (cmd->nwords != 2) {
@@ -641,6 +653,13 @@ int sftp_cmd_close(struct sftp_command *cmd)
     return 0;
 }
 
+/*
+ * Number of READDIR requests kept in flight while listing. Servers
+ * typically return about 100 entries per reply, so a single request
+ * at a time would make large directories bound by the round trip time.
+ */
+#define LS_REQUESTS 16
+
 /*
  * List a directory. If no arguments are given, list pwd; otherwise
  * list the directory given in words[1].
@@ -653,7 +672,7 @@ int sftp_cmd_ls(struct sftp_command *cmd)
     char *cdir;
     struct sftp_packet *pktin;
     struct sftp_request *req;
-    struct sftp_request *reqs[4];
+    struct sftp_request *reqs[LS_REQUESTS];
     int i;
 
     if (!backend) {
@@ -684,10 +703,9 @@ int sftp_cmd_ls(struct sftp_command *cmd)
         return 0;
     }
 
-    reqs[0] = fxp_readdir_send(dirh);
-    reqs[1] = fxp_readdir_send(dirh);
-    reqs[2] = fxp_readdir_send(dirh);
-    reqs[3] = fxp_readdir_send(dirh);
+    for (i = 0; i < LS_REQUESTS; ++i) {
+        reqs[i] = fxp_readdir_send(dirh);
+    }
     int ri = 0;
     while (1) {
 
@@ -707,27 +725,26 @@ int sftp_cmd_ls(struct sftp_command *cmd)
         }
 
         for (i = 0; i < names->nnames; i++) {
-            unsigned long mtime = 0;
+            uint64_t mtime = 0;
             if (names->names[i].attrs.flags & SSH_FILEXFER_ATTR_ACMODTIME) {
                 mtime = names->names[i].attrs.mtime;
             }
-            fzprintf_raw_untrusted(sftpListentry, "%s", names->names[i].longname);
-            fzprintf_raw_untrusted(sftpUnknown, "%lu", mtime);
-            fzprintf_raw_untrusted(sftpUnknown, "%s", names->names[i].filename);
+            fzlistentry(names->names[i].longname, mtime, names->names[i].filename);
         }
 
         fxp_free_names(names);
         reqs[ri++] = fxp_readdir_send(dirh);
-        ri %= 4;
+        ri %= LS_REQUESTS;
     }
-    for (i = 0; i < 4; ++i) {
+    fzlistentry_flush();
+    for (i = 0; i < LS_REQUESTS; ++i) {
         if (reqs[ri]) {
             pktin = sftp_wait_for_reply(reqs[ri]);
             sfree(reqs[ri]);
             sfree(pktin);
         }
         ++ri;
-        ri %= 4;
+        ri %= LS_REQUESTS;
     }
     req = fxp_close_send(dirh);
     pktin = sftp_wait_for_reply(req);
@@ -1437,6 +1454,9 @@ static struct sftp_cmd_lookup {
      * List of sftp commands. This is binary-searched so it MUST be
      * in ASCII order.
      */
+    {
+        "binary", sftp_cmd_binary
+    },
     {
         "bye", sftp_cmd_quit
     },
@@ -1663,6 +1683,14 @@ static int do_sftp_init(void)
         return 1;                      /* failure */
     }
 
+    if (fxp_limits_supported()) {
+        req = fxp_limits_send();
+        pktin = sftp_wait_for_reply(req);
+        if (!fxp_limits_recv(pktin, req))
+            fzprintf(sftpVerbose, "Could not query server limits: %s",
+                     fxp_error());
+    }
+
     /*
      * Find out where our home directory is.
      */
@@ -8,16 +8,20 @@
 #include <assert.h>
 #include <limits.h>
 
+#include "putty.h"
 #include "misc.h"
 #include "tree234.h"
 #include "sftp.h"
 
-#include "fzprintf.h"
-#include "fzsftp.h"
-
 static const char *fxp_error_message;
 static int fxp_errtype;
 
+/*
+ * Server limits from the limits@openssh.com extension, zero if unknown.
+ */
+static bool fxp_limits_advertised;
+static uint64_t fxp_max_read_length, fxp_max_write_length;
+
 static void fxp_internal_error(const char *msg);
 
 /* ----------------------------------------------------------------------
@@ -309,16 +313,73 @@ bool fxp_init(void)
         return false;
     }
     /*
-     * In principle, this packet might also contain extension-
-     * string pairs. We should work through them and look for any
-     * we recognise. In practice we don't currently do so because
-     * we know we don't recognise _any_.
+     * The packet might also contain extension-string pairs. The only
+     * one we recognise tells us whether the server can report its
+     * limits, see fxp_limits_send.
      */
+    fxp_limits_advertised = false;
+    while (get_avail(pktin) > 0) {
+        ptrlen name = get_string(pktin);
+        ptrlen data = get_string(pktin);
+        if (get_err(pktin))
+            break;
+        if (ptrlen_eq_string(name, "limits@openssh.com") &&
+            ptrlen_eq_string(data, "1"))
+            fxp_limits_advertised = true;
+    }
     sftp_pkt_free(pktin);
 
     return true;
 }
 
+bool fxp_limits_supported(void)
+{
+    return fxp_limits_advertised;
+}
+
+/*
+ * Ask the server for the largest read and write requests it accepts.
+ */
+struct sftp_request *fxp_limits_send(void)
+{
+    struct sftp_request *req = sftp_alloc_request();
+    struct sftp_packet *pktout;
+
+    pktout = sftp_pkt_init(SSH_FXP_EXTENDED);
+    put_uint32(pktout, req->id);
+    put_stringz(pktout, "limits@openssh.com");
+    sftp_send(pktout);
+
+    return req;
+}
+
+bool fxp_limits_recv(struct sftp_packet *pktin, struct sftp_request *req)
+{
+    sfree(req);
+
+    if (pktin->type == SSH_FXP_EXTENDED_REPLY) {
+        uint64_t max_read, max_write;
+
+        get_uint64(pktin);             /* max-packet-length */
+        max_read = get_uint64(pktin);
+        max_write = get_uint64(pktin);
+        get_uint64(pktin);             /* max-open-handles */
+        if (get_err(pktin)) {
+            fxp_internal_error("malformed limits@openssh.com reply");
+            sftp_pkt_free(pktin);
+            return false;
+        }
+        fxp_max_read_length = max_read;
+        fxp_max_write_length = max_write;
+        sftp_pkt_free(pktin);
+        return true;
+    } else {
+        fxp_got_status(pktin);
+        sftp_pkt_free(pktin);
+        return false;
+    }
+}
+
 /*
  * Canonify a pathname.
  */
@@ -903,20 +964,58 @@ struct req {
     char *buffer;
     int len, retlen, complete;
     uint64_t offset;
+    unsigned long sent;
     struct req *next, *prev;
 };
 
+/*
+ * FileZilla: The number of bytes kept outstanding (req_maxsize) and
+ * the size of the individual requests adapt to the link, see
+ * xfer_adapt.
+ */
+#define XFER_MIN_WINDOW (256 * 1024)
+#define XFER_INITIAL_WINDOW (4 * 1024 * 1024)
+#define XFER_MAX_WINDOW (32 * 1024 * 1024)
+
+/* Without limits@openssh.com, stick to sizes every server accepts */
+#define XFER_DEFAULT_READ 32768
+#define XFER_DEFAULT_WRITE 16384
+#define XFER_MAX_REQUEST (256 * 1024)
+
+/* Shortest period over which throughput gets measured, in ms */
+#define XFER_MIN_EPOCH 200
+
 struct fxp_xfer {
     uint64_t offset, furthestdata, filesize;
     int req_totalsize, req_maxsize;
+    int req_size, req_minsize, req_maxreqsize;
     bool eof, err;
     struct fxp_handle *fh;
     struct req *head, *tail;
     _fztimer send_timer;
     int sent_interval;
+
+    /* Round trip times in ms, 0 until the first request completes */
+    unsigned long rtt_min, rtt_smoothed;
+
+    /* Completed bytes since the start of the epoch, and whether
+     * requests were held back by the window during it */
+    unsigned long epoch_start;
+    uint64_t epoch_bytes;
+    bool window_limited;
 };
 
-static struct fxp_xfer *xfer_init(struct fxp_handle *fh, uint64_t offset)
+static int xfer_request_size_limit(uint64_t server_limit, int fallback)
+{
+    if (!server_limit)
+        return fallback;
+    if (server_limit > XFER_MAX_REQUEST)
+        return XFER_MAX_REQUEST;
+    return (int)server_limit;
+}
+
+static struct fxp_xfer *xfer_init(struct fxp_handle *fh, uint64_t offset,
+                                  bool upload)
 {
     struct fxp_xfer *xfer = snew(struct fxp_xfer);
 
@@ -924,16 +1023,110 @@ static struct fxp_xfer *xfer_init(struct fxp_handle *fh, uint64_t offset)
     xfer->offset = offset;
     xfer->head = xfer->tail = NULL;
     xfer->req_totalsize = 0;
-    xfer->req_maxsize = 1048576*4;
+    xfer->req_maxsize = XFER_INITIAL_WINDOW;
+    xfer->req_minsize = upload ? XFER_DEFAULT_WRITE : XFER_DEFAULT_READ;
+    xfer->req_maxreqsize = upload ?
+        xfer_request_size_limit(fxp_max_write_length, XFER_DEFAULT_WRITE) :
+        xfer_request_size_limit(fxp_max_read_length, XFER_DEFAULT_READ);
+    if (xfer->req_minsize > xfer->req_maxreqsize)
+        xfer->req_minsize = xfer->req_maxreqsize;
+    xfer->req_size = xfer->req_minsize;
     xfer->err = false;
     xfer->filesize = UINT64_MAX;
     xfer->furthestdata = 0;
     fz_timer_init(&xfer->send_timer);
     xfer->sent_interval = 0;
+    xfer->rtt_min = 0;
+    xfer->rtt_smoothed = 0;
+    xfer->epoch_start = GETTICKCOUNT();
+    xfer->epoch_bytes = 0;
+    xfer->window_limited = false;
 
     return xfer;
 }
 
+/*
+ * Called for each completed request. Once per epoch, which lasts at
+ * least two round trips, the window gets adjusted:
+ *
+ *  - If the round trip time has grown well beyond the smallest one
+ *    seen, requests are queueing up somewhere, be it in the network,
+ *    the SSH channel window or the server. The window shrinks to
+ *    twice the bandwidth-delay product measured over the epoch.
+ *  - Otherwise, if the window was what held back further requests,
+ *    it doubles.
+ *
+ * The request size follows the window, so that there are always
+ * enough requests in flight, up to what the server accepts.
+ */
+static void xfer_adapt(struct fxp_xfer *xfer, struct req *rr, int len)
+{
+    unsigned long now = GETTICKCOUNT();
+    unsigned long rtt = now - rr->sent;
+    unsigned long elapsed, epoch;
+    int oldwindow = xfer->req_maxsize, oldsize = xfer->req_size;
+
+    if (!rtt)
+        rtt = 1;
+    if (!xfer->rtt_min || rtt < xfer->rtt_min)
+        xfer->rtt_min = rtt;
+    if (!xfer->rtt_smoothed)
+        xfer->rtt_smoothed = rtt;
+    else
+        xfer->rtt_smoothed = (7 * xfer->rtt_smoothed + rtt) / 8;
+
+    if (len > 0)
+        xfer->epoch_bytes += len;
+
+    elapsed = now - xfer->epoch_start;
+    epoch = 2 * xfer->rtt_smoothed;
+    if (epoch < XFER_MIN_EPOCH)
+        epoch = XFER_MIN_EPOCH;
+    if (elapsed < epoch)
+        return;
+
+    if (xfer->rtt_smoothed > xfer->rtt_min * 3 / 2 + 10) {
+        uint64_t rate = xfer->epoch_bytes * 1000 / elapsed;
+        uint64_t target = 2 * rate * xfer->rtt_min / 1000;
+        if (target < (uint64_t)xfer->req_maxsize) {
+            xfer->req_maxsize = target < XFER_MIN_WINDOW ?
+                XFER_MIN_WINDOW : (int)target;
+        }
+    } else if (xfer->window_limited) {
+        xfer->req_maxsize = xfer->req_maxsize > XFER_MAX_WINDOW / 2 ?
+            XFER_MAX_WINDOW : xfer->req_maxsize * 2;
+    }
+
+    xfer->req_size = xfer->req_minsize;
+    while (xfer->req_size < xfer->req_maxreqsize &&
+           xfer->req_size * 2 <= xfer->req_maxsize / 32)
+        xfer->req_size *= 2;
+    if (xfer->req_size > xfer->req_maxreqsize)
+        xfer->req_size = xfer->req_maxreqsize;
+
+    if (xfer->req_maxsize != oldwindow || xfer->req_size != oldsize) {
+        int64_t values[3];
+        values[0] = xfer->req_maxsize;
+        values[1] = xfer->req_size;
+        values[2] = xfer->rtt_smoothed;
+        fznotifyn(sftp_transfer_window, 3, values);
+    }
+
+    xfer->epoch_start = now;
+    xfer->epoch_bytes = 0;
+    xfer->window_limited = false;
+}
+
+int xfer_request_size(struct fxp_xfer *xfer)
+{
+    return xfer->req_size;
+}
+
+int xfer_max_request_size(struct fxp_xfer *xfer)
+{
+    return xfer->req_maxreqsize;
+}
+
 bool xfer_done(struct fxp_xfer *xfer)
 {
     /*
@@ -966,7 +1159,8 @@ void xfer_download_queue(struct fxp_xfer *xfer)
         xfer->tail = rr;
         rr->next = NULL;
 
-        rr->len = 32768;
+        rr->len = xfer->req_size;
+        rr->sent = GETTICKCOUNT();
         rr->buffer = snewn(rr->len, char);
         sftp_register(req = fxp_read_send(xfer->fh, rr->offset, rr->len));
         fxp_set_userdata(req, rr);
@@ -978,11 +1172,14 @@ void xfer_download_queue(struct fxp_xfer *xfer)
         printf("queueing read request %p at %"PRIu64"\n", rr, rr->offset);
 #endif
     }
+
+    if (xfer->req_totalsize >= xfer->req_maxsize)
+        xfer->window_limited = true;
 }
 
 struct fxp_xfer *xfer_download_init(struct fxp_handle *fh, uint64_t offset)
 {
-    struct fxp_xfer *xfer = xfer_init(fh, offset);
+    struct fxp_xfer *xfer = xfer_init(fh, offset, false);
 
     xfer->eof = false;
     xfer_download_queue(xfer);
@@ -1027,6 +1224,7 @@ int xfer_download_gotpkt(struct fxp_xfer *xfer, struct sftp_packet *pktin)
     }
 
     rr->complete = 1;
+    xfer_adapt(xfer, rr, rr->retlen);
 
     /*
      * Special case: if we have received fewer bytes than we
@@ -1119,7 +1317,7 @@ bool xfer_download_data(struct fxp_xfer *xfer, void **buf, int *len)
 
 struct fxp_xfer *xfer_upload_init(struct fxp_handle *fh, uint64_t offset)
 {
-    struct fxp_xfer *xfer = xfer_init(fh, offset);
+    struct fxp_xfer *xfer = xfer_init(fh, offset, true);
 
     /*
      * We set `eof' to 1 because this will cause xfer_done() to
@@ -1136,7 +1334,13 @@ struct fxp_xfer *xfer_upload_init(struct fxp_handle *fh, uint64_t offset)
 
 bool xfer_upload_ready(struct fxp_xfer *xfer)
 {
-    return sftp_sendbuffer() == 0;
+    if (sftp_sendbuffer() != 0)
+        return false;
+    if (xfer->req_totalsize >= xfer->req_maxsize) {
+        xfer->window_limited = true;
+        return false;
+    }
+    return true;
 }
 
 void xfer_upload_data(struct fxp_xfer *xfer, char *buffer, int len)
@@ -1158,6 +1362,7 @@ void xfer_upload_data(struct fxp_xfer *xfer, char *buffer, int len)
     rr->next = NULL;
 
     rr->len = len;
+    rr->sent = GETTICKCOUNT();
     rr->buffer = NULL;
     sftp_register(req = fxp_write_send(xfer->fh, buffer, rr->offset, len));
     fxp_set_userdata(req, rr);
@@ -1193,6 +1398,8 @@ int xfer_upload_gotpkt(struct fxp_xfer *xfer, struct sftp_packet *pktin)
 #ifdef DEBUG_UPLOAD
     printf("write request %p has returned [%d]\n", rr, ret ? 1 : 0);
 #endif
+    if (ret)
+        xfer_adapt(xfer, rr, rr->len);
 
     /*
      * Remove this one from the queue.
@@ -1211,7 +1418,7 @@ int xfer_upload_gotpkt(struct fxp_xfer *xfer, struct sftp_packet *pktin)
     xfer->sent_interval += rr->len;
     if (fz_timer_check(&xfer->send_timer)) {
         /* The data we sent is the data we earlier read from file */
-        fzprintf(sftpTransfer, "%d", xfer->sent_interval);
+        fznotify1(sftpTransfer, xfer->sent_interval);
         xfer->sent_interval = 0;
     }
     sfree(rr);
@@ -1225,7 +1432,7 @@ int xfer_upload_gotpkt(struct fxp_xfer *xfer, struct sftp_packet *pktin)
 void xfer_cleanup(struct fxp_xfer *xfer)
 {
     if (xfer->sent_interval > 0) {
-        fzprintf(sftpTransfer, "%d", xfer->sent_interval);
+        fznotify1(sftpTransfer, xfer->sent_interval);
     }
 
     struct req *rr;
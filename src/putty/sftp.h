@@ -168,6 +168,15 @@ int fxp_error_type(void);
  */
 bool fxp_init(void);
 
+/*
+ * FileZilla: Query the limits@openssh.com extension if the server
+ * advertised it. Afterwards, transfers use larger requests where
+ * allowed.
+ */
+bool fxp_limits_supported(void);
+struct sftp_request *fxp_limits_send(void);
+bool fxp_limits_recv(struct sftp_packet *pktin, struct sftp_request *req);
+
 /*
  * Canonify a pathname. Concatenate the two given path elements
  * with a separating slash, unless the second is NULL.
@@ -308,6 +317,13 @@ bool xfer_upload_ready(struct fxp_xfer *xfer);
 void xfer_upload_data(struct fxp_xfer *xfer, char *buffer, int len);
 int xfer_upload_gotpkt(struct fxp_xfer *xfer, struct sftp_packet *pktin);
 
+/*
+ * Size of the next request, and the largest size it can grow to. Uploads
+ * should pass chunks of the former to xfer_upload_data.
+ */
+int xfer_request_size(struct fxp_xfer *xfer);
+int xfer_max_request_size(struct fxp_xfer *xfer);
+
 bool xfer_done(struct fxp_xfer *xfer);
 void xfer_set_error(struct fxp_xfer *xfer);
 void xfer_cleanup(struct fxp_xfer *xfer);
@@ -97,6 +97,34 @@ static int block_and_read(int fd, void *buf, size_t len)
     return ret;
 }
 
+/*
+ * Reads the answer to a yes/no prompt. In binary mode it arrives in a
+ * frame of its own like any other input from the engine.
+ */
+static void read_answer(char *line, size_t len)
+{
+    line[0] = '\0';
+    if (binary_ipc) {
+        int error = 0;
+        char *answer = read_input_line(1, &error);
+        if (answer) {
+            strncpy(line, answer, len - 1);
+            line[len - 1] = '\0';
+            sfree(answer);
+        }
+        return;
+    }
+
+    struct termios oldmode, newmode;
+    tcgetattr(0, &oldmode);
+    newmode = oldmode;
+    newmode.c_lflag |= ISIG | ICANON;
+    tcsetattr(0, TCSANOW, &newmode);
+    if (block_and_read(0, line, len - 1) <= 0)
+        /* handled by the caller */;
+    tcsetattr(0, TCSANOW, &oldmode);
+}
+
 int console_verify_ssh_host_key(
     Seat *seat, const char *host, int port, const char *keytype,
     char *keystr, const char *keydisp, char **fingerprints,
@@ -119,15 +147,7 @@ int console_verify_ssh_host_key(
     fzprintf_raw((ret == 1) ? sftpAskHostkey : sftpAskHostkeyChanged, "%s\n%d\n", host, port);
 
     while (true) {
-        struct termios oldmode, newmode;
-        tcgetattr(0, &oldmode);
-        newmode = oldmode;
-        newmode.c_lflag |= ISIG | ICANON;
-        tcsetattr(0, TCSANOW, &newmode);
-        line[0] = '\0';
-        if (block_and_read(0, line, sizeof(line) - 1) <= 0)
-            /* handled below */;
-        tcsetattr(0, TCSANOW, &oldmode);
+        read_answer(line, sizeof(line));
 
         /*if (line[0] == 'i' || line[0] == 'I') {
             fprintf(stderr, "Full public key:\n%s\n", keydisp);
@@ -173,17 +193,7 @@ int console_confirm_weak_cached_hostkey(
 
     fzprintf_raw(sftpAskHostkeyBetteralg, "%d%s\n%s\n", algname, betteralgs);
 
-    {
-        struct termios oldmode, newmode;
-        tcgetattr(0, &oldmode);
-        newmode = oldmode;
-        newmode.c_lflag |= ISIG | ICANON;
-        tcsetattr(0, TCSANOW, &newmode);
-        line[0] = '\0';
-        if (block_and_read(0, line, sizeof(line) - 1) <= 0)
-            /* handled below */;
-        tcsetattr(0, TCSANOW, &oldmode);
-    }
+    read_answer(line, sizeof(line));
 
     if (line[0] == 'y' || line[0] == 'Y') {
 //FZ        postmsg(&cf);
@@ -393,6 +403,22 @@ int console_get_userpass_input(prompts_t *p)
         struct termios oldmode, newmode;
         prompt_t *pr = p->prompts[curr_prompt];
 
+        if (binary_ipc) {
+            int error = 0;
+            char *answer;
+
+            fzprintf_raw_untrusted(sftpAskPassword, "%s", pr->prompt);
+            answer = read_input_line(1, &error);
+            if (!answer) {
+                console_close(outfp, infd);
+                return 0;              /* failure due to read error */
+            }
+            prompt_set_result(pr, answer);
+            smemclr(answer, strlen(answer));
+            sfree(answer);
+            continue;
+        }
+
         tcgetattr(infd, &oldmode);
         newmode = oldmode;
         newmode.c_lflag |= ISIG | ICANON;
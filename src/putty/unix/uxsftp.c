@@ -137,7 +137,7 @@ RFile *open_existing_file(const char *name, uint64_t offset,
                           long *perms)
 {
 #if 1
-    fzprintf(sftp_io_open, "%"PRIu64, offset);
+    fznotify1(sftp_io_open, offset);
     char * s = priority_read();
 
     if (s[1] == '-') {
@@ -328,7 +328,7 @@ WFile *open_new_file(const char *name, long perms)
 WFile *open_existing_wfile(const char *name, uint64_t *size)
 {
 #if 1
-    fzprintf(sftp_io_open, "%"PRIu64, (uint64_t)-1);
+    fznotify1(sftp_io_open, -1);
     char * s = priority_read();
     if (s[1] == '-') {
         return NULL;
@@ -31,14 +31,40 @@ void console_print_error_msg(const char *prefix, const char *msg)
     fflush(stderr);
 }
 
+/*
+ * Reads the answer to a yes/no prompt. In binary mode it arrives in a
+ * frame of its own like any other input from the engine.
+ */
+static void read_answer(char *line, size_t len)
+{
+    HANDLE hin;
+    DWORD savemode, i;
+
+    line[0] = '\0';    /* fail safe if ReadFile returns no data */
+    if (binary_ipc) {
+        char *answer = read_input_frame();
+        if (answer) {
+            strncpy(line, answer, len - 1);
+            line[len - 1] = '\0';
+            sfree(answer);
+        }
+        return;
+    }
+
+    hin = GetStdHandle(STD_INPUT_HANDLE);
+    GetConsoleMode(hin, &savemode);
+    SetConsoleMode(hin, (savemode |
+                         ENABLE_PROCESSED_INPUT | ENABLE_LINE_INPUT));
+    ReadFile(hin, line, (DWORD)(len - 1), &i, NULL);
+    SetConsoleMode(hin, savemode);
+}
+
 int console_verify_ssh_host_key(
     Seat *seat, const char *host, int port, const char *keytype,
     char *keystr, const char *keydisp, char **fingerprints,
     void (*callback)(void *ctx, int result), void *ctx)
 {
     int ret;
-    HANDLE hin;
-    DWORD savemode, i;
 
     char line[32];
 
@@ -62,14 +88,7 @@ int console_verify_ssh_host_key(
     //}
 
     while (true) {
-        line[0] = '\0';    /* fail safe if ReadFile returns no data */
-
-        hin = GetStdHandle(STD_INPUT_HANDLE);
-        GetConsoleMode(hin, &savemode);
-        SetConsoleMode(hin, (savemode | 
-                             ENABLE_PROCESSED_INPUT | ENABLE_LINE_INPUT));
-        ReadFile(hin, line, sizeof(line) - 1, &i, NULL);
-        SetConsoleMode(hin, savemode);
+        read_answer(line, sizeof(line));
 
         /*FZ
         if (line[0] == 'i' || line[0] == 'I') {
@@ -110,19 +129,11 @@ int console_confirm_weak_cached_hostkey(
     Seat *seat, const char *algname, const char *betteralgs,
     void (*callback)(void *ctx, int result), void *ctx)
 {
-    HANDLE hin;
-    DWORD savemode, i;
-
     char line[32];
 
     fzprintf_raw(sftpAskHostkeyBetteralg, "%s\n%s\n", algname, betteralgs);
 
-    hin = GetStdHandle(STD_INPUT_HANDLE);
-    GetConsoleMode(hin, &savemode);
-    SetConsoleMode(hin, (savemode | 
-                         ENABLE_PROCESSED_INPUT | ENABLE_LINE_INPUT));
-    ReadFile(hin, line, sizeof(line) - 1, &i, NULL);
-    SetConsoleMode(hin, savemode);
+    read_answer(line, sizeof(line));
 
     if (line[0] == 'y' || line[0] == 'Y') {
         return 1;
@@ -346,6 +357,20 @@ int console_get_userpass_input(prompts_t *p)
         DWORD savemode, newmode;
         prompt_t *pr = p->prompts[curr_prompt];
 
+        if (binary_ipc) {
+            char *answer;
+
+            fzprintf_raw_untrusted(sftpAskPassword, "%s", pr->prompt);
+            answer = read_input_frame();
+            if (!answer) {
+                return 0;              /* failure due to read error */
+            }
+            prompt_set_result(pr, answer);
+            smemclr(answer, strlen(answer));
+            sfree(answer);
+            continue;
+        }
+
         GetConsoleMode(hin, &savemode);
         newmode = savemode | ENABLE_PROCESSED_INPUT | ENABLE_LINE_INPUT;
         //if (!pr->echo)
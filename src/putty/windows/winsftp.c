@@ -124,7 +124,7 @@ RFile *open_existing_file(const char *name, uint64_t offset,
                           long *perms)
 {
 #if 1
-    fzprintf(sftp_io_open, "%"PRIu64, offset);
+    fznotify1(sftp_io_open, offset);
     char * s = priority_read();
 
     if (s[1] == '-') {
@@ -318,7 +318,7 @@ WFile *open_new_file(const char *name, long perms)
 WFile *open_existing_wfile(const char *name, uint64_t *size)
 {
 #if 1
-    fzprintf(sftp_io_open, "%"PRIu64, (uint64_t)-1);
+    fznotify1(sftp_io_open, -1);
     char * s = priority_read();
 
     if (s[1] == '-') {
@@ -872,7 +872,7 @@ static DWORD WINAPI command_read_thread(void *param)
 {
     struct command_read_ctx *ctx = (struct command_read_ctx *) param;
 
-    ctx->line = fgetline(stdin);
+    ctx->line = binary_ipc ? read_input_frame() : fgetline(stdin);
 
     SetEvent(ctx->event);
 
@@ -893,7 +893,7 @@ char *ssh_sftp_get_cmdline(const char *prompt, bool no_fds_ok)
 
     if ((winselcli_unique_socket() == INVALID_SOCKET && no_fds_ok) ||
         p_WSAEventSelect == NULL) {
-        return fgetline(stdin);        /* very simple */
+        return binary_ipc ? read_input_frame() : fgetline(stdin);        /* very simple */
     }
 
     /*
@@ -0,0 +1,291 @@
+#include "../src/include/libfilezilla_engine.h"
+#include "../src/engine/ftp/compression_layer.h"
+
+#include <libfilezilla/format.hpp>
+#include <libfilezilla/thread_pool.hpp>
+
+#include <cppunit/extensions/HelperMacros.h>
+
+#include <algorithm>
+
+#include <string.h>
+
+/*
+ * This testsuite asserts the correctness of the compression_layer used for
+ * MODE Z: Data has to survive deflating and inflating, even if the next
+ * layer only takes or returns a few bytes at a time or is not ready.
+ */
+
+namespace {
+// Takes the place of the socket below the compression layer. It never
+// touches the layer below itself.
+class mock_layer final : public fz::socket_layer
+{
+public:
+	explicit mock_layer(fz::socket_interface & next)
+		: fz::socket_layer(nullptr, next, false)
+	{}
+
+	virtual int read(void* buffer, unsigned int size, int& error) override
+	{
+		if (alternate_ && (calls_++ % 2)) {
+			error = EAGAIN;
+			return -1;
+		}
+
+		size_t n = std::min(static_cast<size_t>(size), in_.size() - read_pos_);
+		if (max_) {
+			n = std::min(n, max_);
+		}
+		if (!n) {
+			if (eof_) {
+				return 0;
+			}
+			error = EAGAIN;
+			return -1;
+		}
+
+		memcpy(buffer, in_.c_str() + read_pos_, n);
+		read_pos_ += n;
+		return static_cast<int>(n);
+	}
+
+	virtual int write(void const* buffer, unsigned int size, int& error) override
+	{
+		if (alternate_ && (calls_++ % 2)) {
+			error = EAGAIN;
+			return -1;
+		}
+
+		size_t n = size;
+		if (max_) {
+			n = std::min(n, max_);
+		}
+		out_.append(static_cast<char const*>(buffer), n);
+		return static_cast<int>(n);
+	}
+
+	virtual int shutdown() override
+	{
+		++shutdowns_;
+		return 0;
+	}
+
+	// Every other call fails with EAGAIN
+	bool alternate_{};
+
+	// Most bytes to read or write at once, 0 for no limit
+	size_t max_{};
+
+	// What read returns and whether the connection gets closed after it
+	std::string in_;
+	size_t read_pos_{};
+	bool eof_{true};
+
+	std::string out_;
+	int shutdowns_{};
+
+private:
+	size_t calls_{};
+};
+}
+
+class CCompressionLayerTest final : public CppUnit::TestFixture
+{
+	CPPUNIT_TEST_SUITE(CCompressionLayerTest);
+	CPPUNIT_TEST(testRoundTrip);
+	CPPUNIT_TEST(testPartial);
+	CPPUNIT_TEST(testTruncated);
+	CPPUNIT_TEST(testInvalid);
+	CPPUNIT_TEST_SUITE_END();
+
+public:
+	void setUp();
+	void tearDown() {}
+
+	void testRoundTrip();
+	void testPartial();
+	void testTruncated();
+	void testInvalid();
+
+protected:
+	// Writes all of data, then shuts down. Returns the number of times the
+	// next layer was not ready while writing, and while shutting down in
+	// shutdownBlocked.
+	size_t Deflate(mock_layer & out, std::string const& data, size_t * shutdownBlocked = nullptr);
+
+	// Reads until the end of the stream or an error other than EAGAIN
+	int Inflate(mock_layer & in, std::string & data, int & error);
+
+	std::string data_;
+
+	fz::thread_pool pool_;
+	fz::socket socket_{pool_, nullptr};
+};
+
+CPPUNIT_TEST_SUITE_REGISTRATION(CCompressionLayerTest);
+
+void CCompressionLayerTest::setUp()
+{
+	// Compressible, but not trivially
+	data_.clear();
+	for (int i = 0; data_.size() < 1024 * 1024; ++i) {
+		data_ += fz::sprintf("%d %x %d\n", i, i * 7919, (i * 31) % 997);
+	}
+}
+
+size_t CCompressionLayerTest::Deflate(mock_layer & out, std::string const& data, size_t * shutdownBlocked)
+{
+	compression_layer layer(nullptr, out, true, 6);
+	CPPUNIT_ASSERT(layer.initialized());
+
+	size_t blocked{};
+	size_t pos{};
+	while (pos < data.size()) {
+		int error{};
+		size_t const size = std::min(data.size() - pos, size_t(16 * 1024));
+		int const written = layer.write(data.c_str() + pos, static_cast<unsigned int>(size), error);
+		if (written < 0) {
+			CPPUNIT_ASSERT_EQUAL(EAGAIN, error);
+			++blocked;
+			continue;
+		}
+		CPPUNIT_ASSERT(written > 0);
+		pos += static_cast<size_t>(written);
+	}
+
+	// The next layer only gets shut down once everything has been flushed
+	size_t retries{};
+	int res;
+	while ((res = layer.shutdown()) == EAGAIN) {
+		CPPUNIT_ASSERT_EQUAL(0, out.shutdowns_);
+		++retries;
+	}
+	if (shutdownBlocked) {
+		*shutdownBlocked = retries;
+	}
+	CPPUNIT_ASSERT_EQUAL(0, res);
+	CPPUNIT_ASSERT_EQUAL(1, out.shutdowns_);
+
+	// Nothing can be written after the end of the stream
+	int error{};
+	CPPUNIT_ASSERT_EQUAL(-1, layer.write("x", 1, error));
+	CPPUNIT_ASSERT_EQUAL(ENOTCONN, error);
+
+	return blocked;
+}
+
+int CCompressionLayerTest::Inflate(mock_layer & in, std::string & data, int & error)
+{
+	compression_layer layer(nullptr, in, false, 0);
+	CPPUNIT_ASSERT(layer.initialized());
+
+	data.clear();
+	char buffer[1000];
+	for (;;) {
+		error = 0;
+		int const read = layer.read(buffer, sizeof(buffer), error);
+		if (read < 0 && error == EAGAIN) {
+			continue;
+		}
+		if (read <= 0) {
+			return read;
+		}
+		data.append(buffer, static_cast<size_t>(read));
+	}
+}
+
+void CCompressionLayerTest::testRoundTrip()
+{
+	mock_layer out(socket_);
+	size_t shutdownBlocked{};
+	CPPUNIT_ASSERT_EQUAL(size_t(0), Deflate(out, data_, &shutdownBlocked));
+	CPPUNIT_ASSERT_EQUAL(size_t(0), shutdownBlocked);
+	CPPUNIT_ASSERT(out.out_.size() < data_.size());
+
+	mock_layer in(socket_);
+	in.in_ = out.out_;
+
+	std::string data;
+	int error{};
+	CPPUNIT_ASSERT_EQUAL(0, Inflate(in, data, error));
+	CPPUNIT_ASSERT(data == data_);
+
+	// Anything after the end of the stream is ignored
+	mock_layer trailing(socket_);
+	trailing.in_ = out.out_ + "trailing garbage";
+	CPPUNIT_ASSERT_EQUAL(0, Inflate(trailing, data, error));
+	CPPUNIT_ASSERT(data == data_);
+
+	// Empty streams are fine too
+	mock_layer empty_out(socket_);
+	Deflate(empty_out, std::string());
+	mock_layer empty_in(socket_);
+	empty_in.in_ = empty_out.out_;
+	CPPUNIT_ASSERT_EQUAL(0, Inflate(empty_in, data, error));
+	CPPUNIT_ASSERT(data.empty());
+}
+
+void CCompressionLayerTest::testPartial()
+{
+	// Partial writes and EAGAIN in between. The data left over in the
+	// compression layer has to go out with later writes or the shutdown.
+	mock_layer out(socket_);
+	out.alternate_ = true;
+	out.max_ = 100;
+	size_t shutdownBlocked{};
+	CPPUNIT_ASSERT(Deflate(out, data_, &shutdownBlocked) > 0);
+	CPPUNIT_ASSERT(shutdownBlocked > 0);
+
+	// Short reads and EAGAIN in between
+	mock_layer in(socket_);
+	in.in_ = out.out_;
+	in.alternate_ = true;
+	in.max_ = 7;
+
+	std::string data;
+	int error{};
+	CPPUNIT_ASSERT_EQUAL(0, Inflate(in, data, error));
+	CPPUNIT_ASSERT(data == data_);
+}
+
+void CCompressionLayerTest::testTruncated()
+{
+	mock_layer out(socket_);
+	Deflate(out, data_);
+
+	// Connection closed in the middle of the stream
+	for (size_t const size : {size_t(0), size_t(1), out.out_.size() / 2, out.out_.size() - 1}) {
+		mock_layer in(socket_);
+		in.in_ = out.out_.substr(0, size);
+		in.alternate_ = true;
+
+		std::string data;
+		int error{};
+		CPPUNIT_ASSERT_EQUAL(-1, Inflate(in, data, error));
+		CPPUNIT_ASSERT_EQUAL(ECONNABORTED, error);
+		CPPUNIT_ASSERT(data == data_.substr(0, data.size()));
+	}
+}
+
+void CCompressionLayerTest::testInvalid()
+{
+	mock_layer in(socket_);
+	in.in_ = "This is not a zlib stream";
+
+	std::string data;
+	int error{};
+	CPPUNIT_ASSERT_EQUAL(-1, Inflate(in, data, error));
+	CPPUNIT_ASSERT_EQUAL(EPROTO, error);
+
+	// Each layer only works in one direction
+	mock_layer next(socket_);
+	compression_layer deflating(nullptr, next, true, 6);
+	char buffer[10];
+	CPPUNIT_ASSERT_EQUAL(-1, deflating.read(buffer, sizeof(buffer), error));
+	CPPUNIT_ASSERT_EQUAL(ENOTCONN, error);
+
+	compression_layer inflating(nullptr, next, false, 0);
+	CPPUNIT_ASSERT_EQUAL(-1, inflating.write("x", 1, error));
+	CPPUNIT_ASSERT_EQUAL(ENOTCONN, error);
+}
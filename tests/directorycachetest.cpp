@@ -0,0 +1,204 @@
+#include "../src/include/libfilezilla_engine.h"
+#include "../src/engine/directorycache.h"
+
+#include <libfilezilla/file.hpp>
+#include <libfilezilla/format.hpp>
+#include <libfilezilla/local_filesys.hpp>
+
+#include <cppunit/extensions/HelperMacros.h>
+
+#include <atomic>
+#include <thread>
+
+/*
+ * This testsuite asserts the correctness of the CDirectoryCache class
+ * when used from several threads at once. The lookup throughput is
+ * measured by fzbench --cache instead.
+ */
+
+class CDirectoryCacheTest final : public CppUnit::TestFixture
+{
+	CPPUNIT_TEST_SUITE(CDirectoryCacheTest);
+	CPPUNIT_TEST(testLookupFile);
+	CPPUNIT_TEST(testContention);
+	CPPUNIT_TEST(testPersistence);
+	CPPUNIT_TEST_SUITE_END();
+
+public:
+	void setUp();
+	void tearDown() {}
+
+	void testLookupFile();
+	void testContention();
+	void testPersistence();
+
+protected:
+	CServer server_;
+	CDirectoryListing listing_;
+
+	static constexpr size_t fileCount{1000};
+};
+
+CPPUNIT_TEST_SUITE_REGISTRATION(CDirectoryCacheTest);
+
+void CDirectoryCacheTest::setUp()
+{
+	server_ = CServer(ServerProtocol::FTP, DEFAULT, L"example.com", 21);
+
+	std::vector<fz::shared_value<CDirentry>> entries;
+	for (size_t i = 0; i < fileCount; ++i) {
+		CDirentry entry;
+		entry.name = fz::sprintf(L"File%d", i);
+		entry.size = i;
+		entries.emplace_back(std::move(entry));
+	}
+
+	listing_ = CDirectoryListing();
+	listing_.path = CServerPath(L"/foo");
+	listing_.m_firstListTime = fz::monotonic_clock::now();
+	listing_.Assign(std::move(entries));
+}
+
+void CDirectoryCacheTest::testLookupFile()
+{
+	CDirectoryCache cache;
+	cache.Store(listing_, server_);
+
+	// The first lookup completes the search maps, the others only need a shared lock
+	for (int pass = 0; pass < 2; ++pass) {
+		auto [results, entry] = cache.LookupFile(server_, listing_.path, L"File42", LookupFlags{});
+		CPPUNIT_ASSERT(results & LookupResults::found);
+		CPPUNIT_ASSERT(results & LookupResults::matchedcase);
+		CPPUNIT_ASSERT_EQUAL(int64_t(42), entry.size);
+
+		std::tie(results, entry) = cache.LookupFile(server_, listing_.path, L"file42", LookupFlags{});
+		CPPUNIT_ASSERT(results & LookupResults::found);
+		CPPUNIT_ASSERT(!(results & LookupResults::matchedcase));
+
+		std::tie(results, entry) = cache.LookupFile(server_, listing_.path, L"missing", LookupFlags{});
+		CPPUNIT_ASSERT(results & LookupResults::direxists);
+		CPPUNIT_ASSERT(!(results & LookupResults::found));
+
+		std::tie(results, entry) = cache.LookupFile(server_, CServerPath(L"/bar"), L"File42", LookupFlags{});
+		CPPUNIT_ASSERT(!(results & LookupResults::direxists));
+	}
+
+	// Modifications invalidate the search maps
+	CPPUNIT_ASSERT(cache.UpdateFile(server_, listing_.path, L"new", true, CDirectoryCache::file, 5));
+	auto [results, entry] = cache.LookupFile(server_, listing_.path, L"new", LookupFlags{});
+	CPPUNIT_ASSERT(results & LookupResults::found);
+	CPPUNIT_ASSERT_EQUAL(int64_t(5), entry.size);
+}
+
+void CDirectoryCacheTest::testContention()
+{
+	CDirectoryCache cache;
+	cache.Store(listing_, server_);
+
+	// Enough to have readers and the writer overlap, short enough to not
+	// slow down the test run
+	unsigned int const threadCount = 4;
+	size_t const lookupsPerThread = 2000;
+
+	std::atomic<size_t> failures{};
+	std::atomic<bool> done{};
+
+	std::vector<std::thread> readers;
+	for (unsigned int t = 0; t < threadCount; ++t) {
+		readers.emplace_back([&, t]() {
+			for (size_t i = 0; i < lookupsPerThread; ++i) {
+				size_t const n = (i * 7 + t) % fileCount;
+				auto const [results, entry] = cache.LookupFile(server_, listing_.path, fz::sprintf(L"File%d", n), LookupFlags{});
+				if (!(results & LookupResults::found) || entry.size != static_cast<int64_t>(n)) {
+					++failures;
+				}
+			}
+		});
+	}
+
+	// Writes to another directory must not disturb the readers
+	std::thread writer([&]() {
+		CDirectoryListing other = listing_;
+		other.path = CServerPath(L"/bar");
+		while (!done) {
+			cache.Store(other, server_);
+			cache.UpdateFile(server_, other.path, L"File1", false, CDirectoryCache::file, 1);
+		}
+	});
+
+	for (auto & reader : readers) {
+		reader.join();
+	}
+
+	done = true;
+	writer.join();
+
+	CPPUNIT_ASSERT_EQUAL(size_t(0), failures.load());
+}
+
+void CDirectoryCacheTest::testPersistence()
+{
+	std::wstring const file = L"directorycachetest.dat";
+
+	// Extra parameters that affect the content distinguish servers
+	CServer s3(ServerProtocol::S3, DEFAULT, L"s3.example.com", 443);
+	s3.SetUser(L"user");
+	s3.SetExtraParameter("region", L"eu-central-1");
+	CServer otherRegion = s3;
+	otherRegion.SetExtraParameter("region", L"us-east-1");
+
+	CDirectoryListing old = listing_;
+	old.path = CServerPath(L"/old");
+	old.m_firstListTime = fz::monotonic_clock::now() - fz::duration::from_seconds(700);
+
+	{
+		CDirectoryCache cache;
+		cache.Store(listing_, server_);
+		cache.Store(old, server_);
+		cache.Store(listing_, s3);
+		CPPUNIT_ASSERT(cache.Save(file));
+	}
+
+	// Saving goes through a temporary file which is renamed into place
+	CPPUNIT_ASSERT(fz::local_filesys::get_file_type(fz::to_native(file + L".tmp")) == fz::local_filesys::unknown);
+
+	CDirectoryCache cache;
+	CPPUNIT_ASSERT(cache.Load(file));
+	fz::remove_file(fz::to_native(file));
+
+	// Loaded listings are valid for the rest of their TTL
+	auto [results, entry] = cache.LookupFile(server_, listing_.path, L"File42", LookupFlags{});
+	CPPUNIT_ASSERT(!(results & LookupResults::outdated));
+	CPPUNIT_ASSERT(results & LookupResults::found);
+	CPPUNIT_ASSERT_EQUAL(int64_t(42), entry.size);
+
+	CDirectoryListing listing;
+	bool outdated{};
+	CPPUNIT_ASSERT(cache.Lookup(listing, server_, listing_.path, true, outdated));
+	CPPUNIT_ASSERT(!outdated);
+	CPPUNIT_ASSERT_EQUAL(listing_.size(), listing.size());
+
+	// Past it, they are outdated
+	std::tie(results, entry) = cache.LookupFile(server_, old.path, L"File42", LookupFlags{});
+	CPPUNIT_ASSERT(results & LookupResults::outdated);
+	CPPUNIT_ASSERT(!(results & LookupResults::found));
+
+	std::tie(results, entry) = cache.LookupFile(server_, old.path, L"File42", LookupFlags::allow_outdated);
+	CPPUNIT_ASSERT(results & LookupResults::found);
+
+	CPPUNIT_ASSERT(cache.Lookup(listing, s3, listing_.path, true, outdated));
+	CPPUNIT_ASSERT(!outdated);
+	CPPUNIT_ASSERT(!cache.Lookup(listing, otherRegion, listing_.path, true, outdated));
+
+	cache.Clear();
+	CPPUNIT_ASSERT(!cache.Lookup(listing, server_, listing_.path, true, outdated));
+
+	// Corrupt files are rejected
+	{
+		fz::file f(fz::to_native(file), fz::file::writing, fz::file::empty);
+		f.write("FZDC", 4);
+	}
+	CDirectoryCache other;
+	CPPUNIT_ASSERT(!other.Load(file));
+	fz::remove_file(fz::to_native(file));
+}
@@ -0,0 +1,219 @@
+#include "../src/include/libfilezilla_engine.h"
+#include "../src/include/directorylisting.h"
+
+#include <libfilezilla/format.hpp>
+
+#include <cppunit/extensions/HelperMacros.h>
+
+/*
+ * This testsuite asserts the correctness of the compacted form of
+ * directory listings: Entries have to come out of CCompactDirentries
+ * exactly as they went in.
+ */
+
+class CDirectoryListingTest final : public CppUnit::TestFixture
+{
+	CPPUNIT_TEST_SUITE(CDirectoryListingTest);
+	CPPUNIT_TEST(testCompactEntries);
+	CPPUNIT_TEST(testCompactEmpty);
+	CPPUNIT_TEST(testCompactListing);
+	CPPUNIT_TEST(testCompactCopy);
+	CPPUNIT_TEST_SUITE_END();
+
+public:
+	void setUp();
+	void tearDown() {}
+
+	void testCompactEntries();
+	void testCompactEmpty();
+	void testCompactListing();
+	void testCompactCopy();
+
+protected:
+	std::vector<fz::shared_value<CDirentry>> entries_;
+
+	CDirectoryListing MakeListing() const;
+	void CheckEntry(CDirentry const& expected, CDirentry const& got) const;
+};
+
+CPPUNIT_TEST_SUITE_REGISTRATION(CDirectoryListingTest);
+
+void CDirectoryListingTest::setUp()
+{
+	entries_.clear();
+
+	fz::shared_value<std::wstring> const perms(std::wstring(L"-rw-r--r--"));
+	fz::shared_value<std::wstring> const dirPerms(std::wstring(L"drwxr-xr-x"));
+	fz::shared_value<std::wstring> const owner(std::wstring(L"user group"));
+
+	for (int i = 0; i < 50; ++i) {
+		CDirentry entry;
+		entry.name = fz::sprintf(L"File %d", i);
+		entry.size = i * 1000;
+		entry.permissions = (i % 5) ? perms : dirPerms;
+		entry.ownerGroup = owner;
+		entry.time = fz::datetime(fz::datetime::utc, 2020, 1, 1 + i % 28, 12, i, 0);
+		if (!(i % 5)) {
+			entry.flags = CDirentry::flag_dir;
+			entry.size = -1;
+		}
+		if (!(i % 7)) {
+			entry.flags |= CDirentry::flag_link;
+			entry.target = fz::sparse_optional<std::wstring>(fz::sprintf(L"/target/%d", i));
+		}
+		entries_.emplace_back(std::move(entry));
+	}
+
+	// Names may be empty or contain anything
+	CDirentry entry;
+	entry.name = L"";
+	entries_.emplace_back(entry);
+	entry.name = L"äöü \t;/";
+	entry.flags = CDirentry::flag_unsure;
+	entries_.emplace_back(entry);
+}
+
+CDirectoryListing CDirectoryListingTest::MakeListing() const
+{
+	CDirectoryListing listing;
+	listing.path = CServerPath(L"/foo");
+	listing.m_firstListTime = fz::monotonic_clock::now();
+	auto entries = entries_;
+	listing.Assign(std::move(entries));
+	return listing;
+}
+
+void CDirectoryListingTest::CheckEntry(CDirentry const& expected, CDirentry const& got) const
+{
+	std::string const msg = fz::to_utf8(L"Expected:\n" + expected.dump() + L"Got:\n" + got.dump());
+	CPPUNIT_ASSERT_MESSAGE(msg, expected == got);
+
+	// Not covered by CDirentry::operator==
+	CPPUNIT_ASSERT_MESSAGE(msg, expected.time == got.time);
+	CPPUNIT_ASSERT_MESSAGE(msg, static_cast<bool>(expected.target) == static_cast<bool>(got.target));
+	if (expected.target) {
+		CPPUNIT_ASSERT_MESSAGE(msg, *expected.target == *got.target);
+	}
+}
+
+void CDirectoryListingTest::testCompactEntries()
+{
+	CCompactDirentries compact;
+	CPPUNIT_ASSERT(compact.Assign(entries_));
+	CPPUNIT_ASSERT_EQUAL(entries_.size(), compact.size());
+
+	for (size_t i = 0; i < entries_.size(); ++i) {
+		CDirentry const& expected = *entries_[i];
+		CPPUNIT_ASSERT(compact.name(i) == expected.name);
+		CPPUNIT_ASSERT_EQUAL(expected.size, compact.file_size(i));
+		CPPUNIT_ASSERT_EQUAL(expected.flags, compact.flags(i));
+		CPPUNIT_ASSERT(compact.time(i) == expected.time);
+		CheckEntry(expected, compact.entry(i));
+	}
+
+	auto const expanded = compact.Expand();
+	CPPUNIT_ASSERT_EQUAL(entries_.size(), expanded.size());
+	for (size_t i = 0; i < entries_.size(); ++i) {
+		CheckEntry(*entries_[i], *expanded[i]);
+	}
+
+	// Assigning again replaces the previous content
+	std::vector<fz::shared_value<CDirentry>> entries(entries_.begin(), entries_.begin() + 3);
+	CPPUNIT_ASSERT(compact.Assign(entries));
+	CPPUNIT_ASSERT_EQUAL(size_t(3), compact.size());
+	CheckEntry(*entries_[2], compact.entry(2));
+}
+
+void CDirectoryListingTest::testCompactEmpty()
+{
+	CCompactDirentries compact;
+	CPPUNIT_ASSERT_EQUAL(size_t(0), compact.size());
+	CPPUNIT_ASSERT(compact.Expand().empty());
+
+	CPPUNIT_ASSERT(compact.Assign({}));
+	CPPUNIT_ASSERT_EQUAL(size_t(0), compact.size());
+
+	// Empty listings are never compacted
+	CDirectoryListing listing;
+	listing.Compact();
+	CPPUNIT_ASSERT(!listing.compacted());
+	CPPUNIT_ASSERT_EQUAL(size_t(0), listing.size());
+}
+
+void CDirectoryListingTest::testCompactListing()
+{
+	CDirectoryListing listing = MakeListing();
+	size_t const expandedUsage = listing.MemoryUsage();
+
+	CPPUNIT_ASSERT_EQUAL(size_t(5), listing.FindFile_CmpCase(L"File 5"));
+	CPPUNIT_ASSERT(!listing.HasFindMap(true));
+	listing.BuildFindMap(true);
+	CPPUNIT_ASSERT(listing.HasFindMap(true));
+
+	listing.Compact();
+	CPPUNIT_ASSERT(listing.compacted());
+	CPPUNIT_ASSERT(listing.MemoryUsage() < expandedUsage);
+	CPPUNIT_ASSERT_EQUAL(entries_.size(), listing.size());
+
+	// The search maps got dropped, but lookups still work
+	CPPUNIT_ASSERT(!listing.HasFindMap(false));
+	CPPUNIT_ASSERT(!listing.HasFindMap(true));
+	CPPUNIT_ASSERT_EQUAL(size_t(7), listing.FindFile_CmpCase(L"File 7"));
+	CPPUNIT_ASSERT_EQUAL(size_t(7), listing.FindFile_CmpNoCase(L"file 7"));
+	CPPUNIT_ASSERT_EQUAL(std::string::npos, listing.FindFile_CmpCase(L"file 7"));
+
+	// Reading does not expand the listing
+	for (size_t i = 0; i < entries_.size(); ++i) {
+		CheckEntry(*entries_[i], listing.GetEntry(i));
+	}
+	std::vector<std::wstring> names;
+	listing.GetFilenames(names);
+	CPPUNIT_ASSERT_EQUAL(entries_.size(), names.size());
+	CPPUNIT_ASSERT(names[3] == entries_[3]->name);
+	CPPUNIT_ASSERT(listing.compacted());
+
+	// Neither does operator[], the returned references stay valid
+	CDirentry const& first = listing[0];
+	for (size_t i = 0; i < entries_.size(); ++i) {
+		CheckEntry(*entries_[i], listing[i]);
+	}
+	CheckEntry(*entries_[0], first);
+	CPPUNIT_ASSERT(&first == &listing[0]);
+	CPPUNIT_ASSERT(listing.compacted());
+
+	listing.Expand();
+	CPPUNIT_ASSERT(!listing.compacted());
+	for (size_t i = 0; i < entries_.size(); ++i) {
+		CheckEntry(*entries_[i], listing[i]);
+	}
+
+	// Modifications expand the listing by themselves
+	listing.Compact();
+	listing.get(1).size = 42;
+	CPPUNIT_ASSERT(!listing.compacted());
+	CPPUNIT_ASSERT_EQUAL(int64_t(42), listing[1].size);
+
+	listing.Compact();
+	CPPUNIT_ASSERT(listing.RemoveEntry(0));
+	CPPUNIT_ASSERT(!listing.compacted());
+	CPPUNIT_ASSERT_EQUAL(entries_.size() - 1, listing.size());
+	CheckEntry(*entries_[2], listing[1]);
+}
+
+void CDirectoryListingTest::testCompactCopy()
+{
+	CDirectoryListing listing = MakeListing();
+	listing.Compact();
+
+	// Expanding a copy leaves the original alone
+	CDirectoryListing copy = listing;
+	copy.Expand();
+	CPPUNIT_ASSERT(!copy.compacted());
+	CPPUNIT_ASSERT(listing.compacted());
+
+	copy.get(0).name = L"changed";
+	copy.ClearFindMap();
+	CPPUNIT_ASSERT(listing.GetEntry(0).name == entries_[0]->name);
+	CPPUNIT_ASSERT_EQUAL(std::string::npos, listing.FindFile_CmpCase(L"changed"));
+	CPPUNIT_ASSERT_EQUAL(size_t(0), copy.FindFile_CmpCase(L"changed"));
+}
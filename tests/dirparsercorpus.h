@@ -0,0 +1,25 @@
+#ifndef FILEZILLA_TESTS_DIRPARSERCORPUS_HEADER
+#define FILEZILLA_TESTS_DIRPARSERCORPUS_HEADER
+
+#include "../src/include/directorylisting.h"
+#include "../src/include/server.h"
+
+#include <string>
+#include <vector>
+
+/*
+ * Sample lines of all listing formats known to the directory listing
+ * parser, together with the entry each line is expected to be parsed as.
+ * Shared by the parser testsuite and fzbench.
+ */
+struct t_entry
+{
+	std::string data;
+	CDirentry reference;
+	ServerType serverType;
+};
+
+// Each line ends with CRLF
+std::vector<t_entry> dirparser_corpus();
+
+#endif
@@ -0,0 +1,277 @@
+#include "../src/include/libfilezilla_engine.h"
+#include "../src/include/download_segments.h"
+
+#include <libfilezilla/file.hpp>
+#include <libfilezilla/local_filesys.hpp>
+
+#include <cppunit/extensions/HelperMacros.h>
+
+/*
+ * This testsuite asserts the correctness of the download_segments plan:
+ * Claiming, releasing and completing segments, and which segments are
+ * taken as completed when resuming from the record file or without it.
+ */
+
+class CDownloadSegmentsTest final : public CppUnit::TestFixture
+{
+	CPPUNIT_TEST_SUITE(CDownloadSegmentsTest);
+	CPPUNIT_TEST(testClaim);
+	CPPUNIT_TEST(testLoad);
+	CPPUNIT_TEST(testRecord);
+	CPPUNIT_TEST(testDiscard);
+	CPPUNIT_TEST_SUITE_END();
+
+public:
+	void setUp();
+	void tearDown();
+
+	void testClaim();
+	void testLoad();
+	void testRecord();
+	void testDiscard();
+
+protected:
+	void WriteFile(std::wstring const& name, std::string const& data);
+	int64_t FileSize(std::wstring const& name);
+	bool Exists(std::wstring const& name);
+
+	std::wstring const file_{L"downloadsegmentstest.dat"};
+	std::wstring const record_{L"downloadsegmentstest.dat.fzsegments"};
+};
+
+CPPUNIT_TEST_SUITE_REGISTRATION(CDownloadSegmentsTest);
+
+void CDownloadSegmentsTest::setUp()
+{
+	tearDown();
+}
+
+void CDownloadSegmentsTest::tearDown()
+{
+	fz::remove_file(fz::to_native(file_));
+	fz::remove_file(fz::to_native(record_));
+}
+
+void CDownloadSegmentsTest::WriteFile(std::wstring const& name, std::string const& data)
+{
+	fz::file f(fz::to_native(name), fz::file::writing, fz::file::empty);
+	CPPUNIT_ASSERT(f.opened());
+	CPPUNIT_ASSERT_EQUAL(static_cast<int64_t>(data.size()), f.write(data.c_str(), static_cast<int64_t>(data.size())));
+}
+
+int64_t CDownloadSegmentsTest::FileSize(std::wstring const& name)
+{
+	return fz::local_filesys::get_size(fz::to_native(name));
+}
+
+bool CDownloadSegmentsTest::Exists(std::wstring const& name)
+{
+	return fz::local_filesys::get_file_type(fz::to_native(name)) == fz::local_filesys::file;
+}
+
+void CDownloadSegmentsTest::testClaim()
+{
+	download_segments segments(file_, 10, 4);
+	CPPUNIT_ASSERT_EQUAL(size_t(3), segments.segment_count());
+	CPPUNIT_ASSERT(record_ == segments.record_file());
+
+	// Nothing can be claimed before the plan is started
+	download_segments::segment s;
+	CPPUNIT_ASSERT(!segments.claimable());
+	CPPUNIT_ASSERT(!segments.claim(s));
+
+	segments.start();
+	CPPUNIT_ASSERT(segments.started());
+	CPPUNIT_ASSERT(segments.claimable());
+
+	CPPUNIT_ASSERT(segments.claim(s));
+	CPPUNIT_ASSERT_EQUAL(size_t(0), s.index_);
+	CPPUNIT_ASSERT_EQUAL(int64_t(0), s.offset_);
+	CPPUNIT_ASSERT_EQUAL(int64_t(4), s.length_);
+
+	CPPUNIT_ASSERT(segments.claim(s));
+	CPPUNIT_ASSERT_EQUAL(size_t(1), s.index_);
+
+	// The last segment is shorter
+	CPPUNIT_ASSERT(segments.claim(s));
+	CPPUNIT_ASSERT_EQUAL(size_t(2), s.index_);
+	CPPUNIT_ASSERT_EQUAL(int64_t(8), s.offset_);
+	CPPUNIT_ASSERT_EQUAL(int64_t(2), s.length_);
+
+	CPPUNIT_ASSERT(!segments.claimable());
+	CPPUNIT_ASSERT(!segments.claim(s));
+
+	// A released segment can be claimed again, completed ones cannot
+	segments.complete(0);
+	segments.release(0);
+	segments.release(1);
+	CPPUNIT_ASSERT(segments.claimable());
+	CPPUNIT_ASSERT(segments.claim(s));
+	CPPUNIT_ASSERT_EQUAL(size_t(1), s.index_);
+	CPPUNIT_ASSERT(!segments.claim(s));
+
+	CPPUNIT_ASSERT(!segments.done());
+	CPPUNIT_ASSERT_EQUAL(int64_t(4), segments.completed_bytes());
+	segments.complete(1);
+	segments.complete(2);
+	CPPUNIT_ASSERT(segments.done());
+	CPPUNIT_ASSERT_EQUAL(int64_t(10), segments.completed_bytes());
+
+	// Completing saves the record, finishing removes it
+	CPPUNIT_ASSERT(Exists(record_));
+	segments.finish();
+	CPPUNIT_ASSERT(!Exists(record_));
+
+	// Once abandoned, nothing can be claimed anymore
+	download_segments abandoned(file_, 10, 4);
+	abandoned.start();
+	abandoned.abandon();
+	CPPUNIT_ASSERT(!abandoned.claimable());
+	CPPUNIT_ASSERT(!abandoned.claim(s));
+}
+
+void CDownloadSegmentsTest::testLoad()
+{
+	// Without a record, the existing data is taken as left behind by an
+	// ordinary download. Only complete segments count.
+	{
+		download_segments segments(file_, 10, 4);
+		segments.load(9);
+		CPPUNIT_ASSERT_EQUAL(int64_t(8), segments.completed_bytes());
+
+		segments.start();
+		download_segments::segment s;
+		CPPUNIT_ASSERT(segments.claim(s));
+		CPPUNIT_ASSERT_EQUAL(size_t(2), s.index_);
+		CPPUNIT_ASSERT(!segments.claim(s));
+	}
+
+	// A file of the full size may have been prepared by an earlier segmented
+	// download and is not trusted
+	{
+		download_segments segments(file_, 10, 4);
+		segments.load(10);
+		CPPUNIT_ASSERT_EQUAL(int64_t(0), segments.completed_bytes());
+		segments.load(20);
+		CPPUNIT_ASSERT_EQUAL(int64_t(0), segments.completed_bytes());
+	}
+
+	// Without resuming, everything gets downloaded again
+	{
+		download_segments segments(file_, 10, 4);
+		segments.load(4);
+		CPPUNIT_ASSERT_EQUAL(int64_t(4), segments.completed_bytes());
+		segments.clear();
+		CPPUNIT_ASSERT_EQUAL(int64_t(0), segments.completed_bytes());
+	}
+}
+
+void CDownloadSegmentsTest::testRecord()
+{
+	{
+		download_segments segments(file_, 10, 4);
+		CPPUNIT_ASSERT(segments.prepare());
+		CPPUNIT_ASSERT_EQUAL(int64_t(10), FileSize(file_));
+		CPPUNIT_ASSERT(Exists(record_));
+
+		segments.start();
+		download_segments::segment s;
+		CPPUNIT_ASSERT(segments.claim(s));
+		CPPUNIT_ASSERT(segments.claim(s));
+		CPPUNIT_ASSERT(segments.claim(s));
+		segments.complete(0);
+		segments.complete(2);
+		segments.release(1);
+	}
+
+	// The record wins over the size of the file
+	{
+		download_segments segments(file_, 10, 4);
+		segments.load(10);
+		CPPUNIT_ASSERT_EQUAL(int64_t(6), segments.completed_bytes());
+
+		segments.start();
+		download_segments::segment s;
+		CPPUNIT_ASSERT(segments.claim(s));
+		CPPUNIT_ASSERT_EQUAL(size_t(1), s.index_);
+		CPPUNIT_ASSERT(!segments.claim(s));
+	}
+
+	// The segment size is taken from the record
+	{
+		download_segments segments(file_, 10, 3);
+		segments.load(10);
+		CPPUNIT_ASSERT_EQUAL(size_t(3), segments.segment_count());
+		CPPUNIT_ASSERT_EQUAL(int64_t(6), segments.completed_bytes());
+	}
+
+	// A record for a different size means nothing got done
+	{
+		download_segments segments(file_, 11, 4);
+		segments.load(11);
+		CPPUNIT_ASSERT_EQUAL(int64_t(0), segments.completed_bytes());
+	}
+
+	// As does a record that cannot be read
+	for (auto const& data : {"", "FZSEG1 10 4\n10\n", "FZSEG1 10 0\n101\n", "FZSEG0 10 4\n101\n", "garbage"}) {
+		WriteFile(record_, data);
+		download_segments segments(file_, 10, 4);
+		segments.load(4);
+		CPPUNIT_ASSERT_EQUAL(int64_t(0), segments.completed_bytes());
+	}
+
+	WriteFile(record_, "FZSEG1 10 4\n101\n");
+	{
+		download_segments segments(file_, 10, 4);
+		segments.load(0);
+		CPPUNIT_ASSERT_EQUAL(int64_t(6), segments.completed_bytes());
+	}
+}
+
+void CDownloadSegmentsTest::testDiscard()
+{
+	// Without a record, the file is left alone
+	WriteFile(file_, "0123456789");
+	download_segments::discard(file_);
+	CPPUNIT_ASSERT_EQUAL(int64_t(10), FileSize(file_));
+
+	CPPUNIT_ASSERT_EQUAL(int64_t(-1), download_segments::usable_size(file_));
+
+	// Only the completed segments at the start of the file are kept
+	WriteFile(record_, "FZSEG1 10 4\n101\n");
+	CPPUNIT_ASSERT_EQUAL(int64_t(4), download_segments::usable_size(file_));
+	download_segments::discard(file_);
+	CPPUNIT_ASSERT_EQUAL(int64_t(4), FileSize(file_));
+	CPPUNIT_ASSERT(!Exists(record_));
+
+	WriteFile(file_, "0123456789");
+	WriteFile(record_, "FZSEG1 10 4\n111\n");
+	download_segments::discard(file_);
+	CPPUNIT_ASSERT_EQUAL(int64_t(10), FileSize(file_));
+	CPPUNIT_ASSERT(!Exists(record_));
+
+	// Nothing can be trusted if the record is not valid
+	WriteFile(record_, "garbage");
+	CPPUNIT_ASSERT_EQUAL(int64_t(0), download_segments::usable_size(file_));
+	download_segments::discard(file_);
+	CPPUNIT_ASSERT_EQUAL(int64_t(0), FileSize(file_));
+	CPPUNIT_ASSERT(!Exists(record_));
+
+	// Abandoning a plan before starting it discards the record
+	{
+		download_segments segments(file_, 10, 4);
+		CPPUNIT_ASSERT(segments.prepare());
+		segments.abandon();
+		CPPUNIT_ASSERT(!Exists(record_));
+		CPPUNIT_ASSERT_EQUAL(int64_t(0), FileSize(file_));
+	}
+
+	// Once started, the record is kept for resuming
+	{
+		download_segments segments(file_, 10, 4);
+		CPPUNIT_ASSERT(segments.prepare());
+		segments.start();
+		segments.abandon();
+		CPPUNIT_ASSERT(Exists(record_));
+	}
+}
@@ -0,0 +1,168 @@
+#include "../src/include/libfilezilla_engine.h"
+#include "../src/include/engine_metrics.h"
+
+#include <cppunit/extensions/HelperMacros.h>
+
+/*
+ * This testsuite asserts the correctness of the latency_histogram used by
+ * the engine metrics: Which bucket samples end up in, the percentiles
+ * estimated from the buckets and merging of histograms.
+ */
+
+class CEngineMetricsTest final : public CppUnit::TestFixture
+{
+	CPPUNIT_TEST_SUITE(CEngineMetricsTest);
+	CPPUNIT_TEST(testEmpty);
+	CPPUNIT_TEST(testBuckets);
+	CPPUNIT_TEST(testPercentile);
+	CPPUNIT_TEST(testMerge);
+	CPPUNIT_TEST_SUITE_END();
+
+public:
+	void setUp() {}
+	void tearDown() {}
+
+	void testEmpty();
+	void testBuckets();
+	void testPercentile();
+	void testMerge();
+
+protected:
+	static void record(latency_histogram & h, int64_t us, size_t n = 1);
+	static void CheckEqual(latency_histogram const& expected, latency_histogram const& got);
+};
+
+CPPUNIT_TEST_SUITE_REGISTRATION(CEngineMetricsTest);
+
+void CEngineMetricsTest::record(latency_histogram & h, int64_t us, size_t n)
+{
+	for (size_t i = 0; i < n; ++i) {
+		h.record(fz::duration::from_microseconds(us));
+	}
+}
+
+void CEngineMetricsTest::CheckEqual(latency_histogram const& expected, latency_histogram const& got)
+{
+	CPPUNIT_ASSERT_EQUAL(expected.count(), got.count());
+	CPPUNIT_ASSERT_EQUAL(expected.min().get_microseconds(), got.min().get_microseconds());
+	CPPUNIT_ASSERT_EQUAL(expected.max().get_microseconds(), got.max().get_microseconds());
+	CPPUNIT_ASSERT_EQUAL(expected.mean().get_microseconds(), got.mean().get_microseconds());
+	for (size_t i = 0; i < latency_histogram::bucket_count; ++i) {
+		CPPUNIT_ASSERT_EQUAL(expected.buckets_[i], got.buckets_[i]);
+	}
+	for (double p : {0.0, 50.0, 90.0, 99.0, 100.0}) {
+		CPPUNIT_ASSERT_EQUAL(expected.percentile(p).get_microseconds(), got.percentile(p).get_microseconds());
+	}
+}
+
+void CEngineMetricsTest::testEmpty()
+{
+	latency_histogram const h;
+	CPPUNIT_ASSERT_EQUAL(uint64_t(0), h.count());
+	CPPUNIT_ASSERT_EQUAL(int64_t(0), h.mean().get_microseconds());
+	CPPUNIT_ASSERT_EQUAL(int64_t(0), h.percentile(50).get_microseconds());
+	CPPUNIT_ASSERT_EQUAL(int64_t(0), h.percentile(100).get_microseconds());
+}
+
+void CEngineMetricsTest::testBuckets()
+{
+	latency_histogram h;
+
+	// Below 1 microsecond, negative durations count as 0
+	record(h, 0);
+	h.record(fz::duration::from_milliseconds(-5));
+	CPPUNIT_ASSERT_EQUAL(uint64_t(2), h.buckets_[0]);
+	CPPUNIT_ASSERT_EQUAL(int64_t(0), h.min().get_microseconds());
+
+	// Bucket i takes [2^(i-1), 2^i)
+	record(h, 1);
+	CPPUNIT_ASSERT_EQUAL(uint64_t(1), h.buckets_[1]);
+	record(h, 2);
+	record(h, 3);
+	CPPUNIT_ASSERT_EQUAL(uint64_t(2), h.buckets_[2]);
+	record(h, 1023);
+	CPPUNIT_ASSERT_EQUAL(uint64_t(1), h.buckets_[10]);
+	record(h, 1024);
+	CPPUNIT_ASSERT_EQUAL(uint64_t(1), h.buckets_[11]);
+
+	// Everything too large ends up in the last bucket
+	h.record(fz::duration::from_days(365 * 100));
+	CPPUNIT_ASSERT_EQUAL(uint64_t(1), h.buckets_[latency_histogram::bucket_count - 1]);
+	CPPUNIT_ASSERT(h.max() == fz::duration::from_days(365 * 100));
+
+	uint64_t total{};
+	for (auto const count : h.buckets_) {
+		total += count;
+	}
+	CPPUNIT_ASSERT_EQUAL(uint64_t(8), total);
+	CPPUNIT_ASSERT_EQUAL(total, h.count());
+}
+
+void CEngineMetricsTest::testPercentile()
+{
+	// 90 samples in [8, 16), 10 samples in [512, 1024)
+	latency_histogram h;
+	record(h, 10, 90);
+	record(h, 1000, 10);
+
+	CPPUNIT_ASSERT_EQUAL(uint64_t(100), h.count());
+	CPPUNIT_ASSERT_EQUAL(int64_t(10), h.min().get_microseconds());
+	CPPUNIT_ASSERT_EQUAL(int64_t(1000), h.max().get_microseconds());
+	CPPUNIT_ASSERT_EQUAL(int64_t(109), h.mean().get_microseconds());
+
+	// Upper bound of the bucket
+	CPPUNIT_ASSERT_EQUAL(int64_t(16), h.percentile(0).get_microseconds());
+	CPPUNIT_ASSERT_EQUAL(int64_t(16), h.percentile(50).get_microseconds());
+	CPPUNIT_ASSERT_EQUAL(int64_t(16), h.percentile(90).get_microseconds());
+
+	// Unless it is beyond the largest sample
+	CPPUNIT_ASSERT_EQUAL(int64_t(1000), h.percentile(91).get_microseconds());
+	CPPUNIT_ASSERT_EQUAL(int64_t(1000), h.percentile(99).get_microseconds());
+	CPPUNIT_ASSERT_EQUAL(int64_t(1000), h.percentile(100).get_microseconds());
+
+	// Or below the smallest one
+	latency_histogram single;
+	record(single, 5);
+	CPPUNIT_ASSERT_EQUAL(int64_t(5), single.percentile(0).get_microseconds());
+	CPPUNIT_ASSERT_EQUAL(int64_t(5), single.percentile(50).get_microseconds());
+	CPPUNIT_ASSERT_EQUAL(int64_t(5), single.percentile(100).get_microseconds());
+
+	latency_histogram zero;
+	record(zero, 0, 3);
+	CPPUNIT_ASSERT_EQUAL(int64_t(0), zero.percentile(99).get_microseconds());
+}
+
+void CEngineMetricsTest::testMerge()
+{
+	latency_histogram a;
+	record(a, 10, 90);
+	record(a, 3);
+
+	latency_histogram b;
+	record(b, 1000, 10);
+	record(b, 5000);
+
+	latency_histogram all;
+	record(all, 10, 90);
+	record(all, 3);
+	record(all, 1000, 10);
+	record(all, 5000);
+
+	latency_histogram merged = a;
+	merged.merge(b);
+	CheckEqual(all, merged);
+
+	// Order does not matter
+	merged = b;
+	merged.merge(a);
+	CheckEqual(all, merged);
+
+	// Empty histograms on either side change nothing
+	merged.merge(latency_histogram());
+	CheckEqual(all, merged);
+
+	latency_histogram empty;
+	empty.merge(b);
+	CheckEqual(b, empty);
+	CPPUNIT_ASSERT_EQUAL(int64_t(1000), empty.min().get_microseconds());
+}
@@ -0,0 +1,584 @@
+#include "ftpstandin.h"
+
+#include <libfilezilla/format.hpp>
+#include <libfilezilla/string.hpp>
+
+#include <algorithm>
+
+#include <errno.h>
+
+class ftp_standin::session final : public fz::event_handler
+{
+public:
+	session(ftp_standin & server, std::unique_ptr<fz::socket> && control);
+	virtual ~session();
+
+	void start();
+
+private:
+	virtual void operator()(fz::event_base const& ev) override;
+	void on_socket_event(fz::socket_event_source* source, fz::socket_event_flag t, int error);
+
+	void on_control_read();
+	void on_command(std::string const& cmd, std::string const& arg);
+	void reply(std::string const& msg);
+	void flush();
+	void close();
+
+	void on_accept();
+	void start_transfer();
+	void on_data_read();
+	void on_data_write();
+	void finish_transfer(bool success);
+
+	std::string list(std::string const& dir, bool mlsd) const;
+
+	ftp_standin & server_;
+
+	std::unique_ptr<fz::socket> control_;
+	std::string in_;
+	std::string out_;
+	bool closed_{};
+
+	std::string cwd_{"/"};
+	int64_t rest_{};
+
+	std::unique_ptr<fz::listen_socket> pasv_;
+	std::unique_ptr<fz::socket> data_;
+
+	enum class transfer {
+		none,
+		send,
+		receive
+	};
+	transfer transfer_{transfer::none};
+	std::string listing_;
+	int64_t remaining_{};
+	int64_t received_{};
+	std::string target_;
+
+	std::vector<char> buffer_ = std::vector<char>(64 * 1024);
+};
+
+ftp_standin::session::session(ftp_standin & server, std::unique_ptr<fz::socket> && control)
+	: fz::event_handler(server.event_loop_)
+	, server_(server)
+	, control_(std::move(control))
+{
+	control_->set_event_handler(this);
+}
+
+ftp_standin::session::~session()
+{
+	remove_handler();
+}
+
+void ftp_standin::session::start()
+{
+	reply("220 FileZilla benchmark stand-in");
+}
+
+void ftp_standin::session::operator()(fz::event_base const& ev)
+{
+	fz::dispatch<fz::socket_event>(ev, this, &session::on_socket_event);
+}
+
+void ftp_standin::session::on_socket_event(fz::socket_event_source* source, fz::socket_event_flag t, int error)
+{
+	if (closed_) {
+		return;
+	}
+
+	if (source == control_.get()) {
+		if (error) {
+			close();
+		}
+		else if (t == fz::socket_event_flag::read) {
+			on_control_read();
+		}
+		else if (t == fz::socket_event_flag::write) {
+			flush();
+		}
+	}
+	else if (pasv_ && source == pasv_.get()) {
+		if (t == fz::socket_event_flag::connection) {
+			on_accept();
+		}
+	}
+	else if (data_ && source == data_.get()) {
+		if (error) {
+			if (transfer_ != transfer::none) {
+				finish_transfer(false);
+			}
+			else {
+				data_.reset();
+			}
+		}
+		else if (transfer_ == transfer::receive && t == fz::socket_event_flag::read) {
+			on_data_read();
+		}
+		else if (transfer_ == transfer::send && t == fz::socket_event_flag::write) {
+			on_data_write();
+		}
+	}
+}
+
+void ftp_standin::session::on_control_read()
+{
+	while (!closed_) {
+		int error;
+		int read = control_->read(buffer_.data(), static_cast<unsigned int>(buffer_.size()), error);
+		if (read < 0) {
+			if (error != EAGAIN) {
+				close();
+			}
+			return;
+		}
+		if (!read) {
+			close();
+			return;
+		}
+		in_.append(buffer_.data(), static_cast<size_t>(read));
+
+		size_t pos;
+		while (!closed_ && (pos = in_.find('\n')) != std::string::npos) {
+			std::string line = in_.substr(0, pos);
+			in_.erase(0, pos + 1);
+			if (!line.empty() && line.back() == '\r') {
+				line.pop_back();
+			}
+
+			size_t const space = line.find(' ');
+			std::string cmd = fz::str_toupper_ascii(line.substr(0, space));
+			std::string arg = (space == std::string::npos) ? std::string() : line.substr(space + 1);
+			on_command(cmd, arg);
+		}
+	}
+}
+
+void ftp_standin::session::on_command(std::string const& cmd, std::string const& arg)
+{
+	auto & dirs = server_.dirs_;
+
+	if (cmd == "USER") {
+		reply("331 Password required");
+	}
+	else if (cmd == "PASS") {
+		reply("230 Logged on");
+	}
+	else if (cmd == "SYST") {
+		reply("215 UNIX Type: L8");
+	}
+	else if (cmd == "FEAT") {
+		reply("211-Features:\r\n MDTM\r\n SIZE\r\n MLST type*;size*;modify*;\r\n REST STREAM\r\n UTF8\r\n EPSV\r\n211 End");
+	}
+	else if (cmd == "OPTS" || cmd == "TYPE" || cmd == "MODE" || cmd == "STRU" || cmd == "NOOP") {
+		reply("200 OK");
+	}
+	else if (cmd == "PWD") {
+		reply(fz::sprintf("257 \"%s\" is current directory.", cwd_));
+	}
+	else if (cmd == "CWD" || cmd == "CDUP") {
+		std::string const path = resolve(cwd_, cmd == "CDUP" ? std::string("..") : arg);
+		if (path.empty() || dirs.find(path) == dirs.end()) {
+			reply("550 Directory not found");
+		}
+		else {
+			cwd_ = path;
+			reply("250 OK");
+		}
+	}
+	else if (cmd == "MKD") {
+		std::string const path = resolve(cwd_, arg);
+		if (path.empty() || path == "/" || dirs.find(path) != dirs.end() || dirs.find(split(path).first) == dirs.end()) {
+			reply("550 Could not create directory");
+		}
+		else {
+			dirs[path];
+			reply(fz::sprintf("257 \"%s\" created successfully", path));
+		}
+	}
+	else if (cmd == "RMD") {
+		std::string const path = resolve(cwd_, arg);
+		if (path.empty() || path == "/" || !dirs.erase(path)) {
+			reply("550 Directory not found");
+		}
+		else {
+			reply("250 OK");
+		}
+	}
+	else if (cmd == "DELE" || cmd == "SIZE" || cmd == "MDTM") {
+		auto const [dir, name] = split(resolve(cwd_, arg));
+		auto it = dirs.find(dir);
+		if (it == dirs.end() || it->second.find(name) == it->second.end()) {
+			reply("550 File not found");
+			return;
+		}
+
+		auto file = it->second.find(name);
+		if (cmd == "DELE") {
+			it->second.erase(file);
+			reply("250 OK");
+		}
+		else if (cmd == "SIZE") {
+			reply(fz::sprintf("213 %d", file->second));
+		}
+		else {
+			reply("213 20200101000000");
+		}
+	}
+	else if (cmd == "REST") {
+		rest_ = fz::to_integral<int64_t>(arg, -1);
+		if (rest_ < 0) {
+			rest_ = 0;
+			reply("501 Bad offset");
+		}
+		else {
+			reply(fz::sprintf("350 Restarting at %d", rest_));
+		}
+	}
+	else if (cmd == "PASV" || cmd == "EPSV") {
+		data_.reset();
+		pasv_ = std::make_unique<fz::listen_socket>(server_.pool_, this);
+		int error = pasv_->bind("127.0.0.1");
+		if (!error) {
+			error = pasv_->listen(fz::address_type::ipv4, 0);
+		}
+		int const port = error ? -1 : pasv_->local_port(error);
+		if (port <= 0) {
+			pasv_.reset();
+			reply("421 Could not create socket");
+		}
+		else if (cmd == "PASV") {
+			reply(fz::sprintf("227 Entering Passive Mode (127,0,0,1,%d,%d)", port / 256, port % 256));
+		}
+		else {
+			reply(fz::sprintf("229 Entering Extended Passive Mode (|||%d|)", port));
+		}
+	}
+	else if (cmd == "MLSD" || cmd == "LIST" || cmd == "NLST" || cmd == "RETR" || cmd == "STOR") {
+		if (!pasv_ && !data_) {
+			reply("425 Use PASV first");
+			return;
+		}
+
+		if (cmd == "RETR" || cmd == "STOR") {
+			auto const [dir, name] = split(resolve(cwd_, arg));
+			auto it = dirs.find(dir);
+			if (it == dirs.end() || name.empty()) {
+				reply("550 Directory not found");
+				return;
+			}
+			if (cmd == "RETR") {
+				auto file = it->second.find(name);
+				if (file == it->second.end()) {
+					reply("550 File not found");
+					return;
+				}
+				listing_.clear();
+				remaining_ = std::max(int64_t(0), file->second - rest_);
+				transfer_ = transfer::send;
+			}
+			else {
+				target_ = dir + "/" + name;
+				received_ = rest_;
+				transfer_ = transfer::receive;
+			}
+			rest_ = 0;
+		}
+		else {
+			// Ignore options like -a
+			std::string const path = resolve(cwd_, (!arg.empty() && arg[0] == '-') ? std::string() : arg);
+			if (path.empty() || dirs.find(path) == dirs.end()) {
+				reply("550 Directory not found");
+				return;
+			}
+			listing_ = list(path, cmd == "MLSD");
+			remaining_ = static_cast<int64_t>(listing_.size());
+			transfer_ = transfer::send;
+		}
+
+		reply("150 Opening data channel");
+		if (data_) {
+			start_transfer();
+		}
+	}
+	else if (cmd == "QUIT") {
+		reply("221 Goodbye");
+		close();
+	}
+	else {
+		reply("502 Command not implemented");
+	}
+}
+
+std::string ftp_standin::session::list(std::string const& dir, bool mlsd) const
+{
+	std::string ret;
+	for (auto const& [path, files] : server_.dirs_) {
+		auto const [parent, name] = split(path);
+		if (path == "/" || parent != dir) {
+			continue;
+		}
+		if (mlsd) {
+			ret += fz::sprintf("type=dir;modify=20200101000000; %s\r\n", name);
+		}
+		else {
+			ret += fz::sprintf("drwxr-xr-x 1 ftp ftp 0 Jan 01 2020 %s\r\n", name);
+		}
+	}
+	for (auto const& [name, size] : server_.dirs_.at(dir)) {
+		if (mlsd) {
+			ret += fz::sprintf("type=file;size=%d;modify=20200101000000; %s\r\n", size, name);
+		}
+		else {
+			ret += fz::sprintf("-rw-r--r-- 1 ftp ftp %d Jan 01 2020 %s\r\n", size, name);
+		}
+	}
+	return ret;
+}
+
+void ftp_standin::session::reply(std::string const& msg)
+{
+	out_ += msg;
+	out_ += "\r\n";
+	flush();
+}
+
+void ftp_standin::session::flush()
+{
+	while (!out_.empty() && !closed_) {
+		int error;
+		int written = control_->write(out_.data(), static_cast<unsigned int>(out_.size()), error);
+		if (written < 0) {
+			if (error != EAGAIN) {
+				close();
+			}
+			return;
+		}
+		out_.erase(0, static_cast<size_t>(written));
+	}
+}
+
+void ftp_standin::session::close()
+{
+	if (closed_) {
+		return;
+	}
+	closed_ = true;
+
+	data_.reset();
+	pasv_.reset();
+	control_.reset();
+	server_.send_event<session_closed_event>(this);
+}
+
+void ftp_standin::session::on_accept()
+{
+	int error;
+	data_ = pasv_->accept(error);
+	pasv_.reset();
+	if (!data_) {
+		if (transfer_ != transfer::none) {
+			finish_transfer(false);
+		}
+		return;
+	}
+
+	data_->set_event_handler(this);
+	if (transfer_ != transfer::none) {
+		start_transfer();
+	}
+}
+
+void ftp_standin::session::start_transfer()
+{
+	if (transfer_ == transfer::send) {
+		on_data_write();
+	}
+	else {
+		on_data_read();
+	}
+}
+
+void ftp_standin::session::on_data_read()
+{
+	while (true) {
+		int error;
+		int read = data_->read(buffer_.data(), static_cast<unsigned int>(buffer_.size()), error);
+		if (read < 0) {
+			if (error != EAGAIN) {
+				finish_transfer(false);
+			}
+			return;
+		}
+		if (!read) {
+			auto const [dir, name] = split(target_);
+			auto it = server_.dirs_.find(dir);
+			if (it != server_.dirs_.end()) {
+				it->second[name] = received_;
+			}
+			finish_transfer(true);
+			return;
+		}
+		received_ += read;
+	}
+}
+
+void ftp_standin::session::on_data_write()
+{
+	static char const zeros[64 * 1024]{};
+
+	while (remaining_ > 0) {
+		unsigned int const chunk = static_cast<unsigned int>(std::min(remaining_, int64_t(sizeof(zeros))));
+		char const* p = listing_.empty() ? zeros : listing_.data() + (listing_.size() - static_cast<size_t>(remaining_));
+
+		int error;
+		int written = data_->write(p, chunk, error);
+		if (written < 0) {
+			if (error != EAGAIN) {
+				finish_transfer(false);
+			}
+			return;
+		}
+		remaining_ -= written;
+	}
+
+	int res = data_->shutdown();
+	if (res == EAGAIN) {
+		// Retried on the next write event
+		return;
+	}
+	finish_transfer(!res);
+}
+
+void ftp_standin::session::finish_transfer(bool success)
+{
+	data_.reset();
+	transfer_ = transfer::none;
+	listing_.clear();
+
+	if (success) {
+		reply("226 Transfer complete");
+	}
+	else {
+		reply("426 Connection closed; transfer aborted");
+	}
+}
+
+
+ftp_standin::ftp_standin(fz::event_loop & loop, fz::thread_pool & pool)
+	: fz::event_handler(loop)
+	, pool_(pool)
+{
+	dirs_["/"];
+}
+
+ftp_standin::~ftp_standin()
+{
+	// Stop accepting first, closing sessions then cannot reach this handler anymore
+	remove_handler();
+	for (auto & s : sessions_) {
+		s.second->remove_handler();
+	}
+
+	sessions_.clear();
+	listener_.reset();
+}
+
+int ftp_standin::start()
+{
+	listener_ = std::make_unique<fz::listen_socket>(pool_, this);
+	int error = listener_->bind("127.0.0.1");
+	if (!error) {
+		error = listener_->listen(fz::address_type::ipv4, 0);
+	}
+	if (!error) {
+		int const port = listener_->local_port(error);
+		if (port > 0) {
+			port_ = static_cast<unsigned int>(port);
+		}
+	}
+	if (error) {
+		listener_.reset();
+	}
+	return error;
+}
+
+void ftp_standin::add_file(std::string const& path, int64_t size)
+{
+	auto [dir, name] = split(resolve("/", path));
+	for (std::string parent = dir; !parent.empty() && dirs_.find(parent) == dirs_.end(); parent = split(parent).first) {
+		dirs_[parent];
+	}
+	if (!name.empty()) {
+		dirs_[dir][name] = size;
+	}
+}
+
+void ftp_standin::operator()(fz::event_base const& ev)
+{
+	fz::dispatch<fz::socket_event, session_closed_event>(ev, this,
+		&ftp_standin::on_socket_event,
+		&ftp_standin::on_session_closed);
+}
+
+void ftp_standin::on_socket_event(fz::socket_event_source*, fz::socket_event_flag t, int)
+{
+	if (t != fz::socket_event_flag::connection || !listener_) {
+		return;
+	}
+
+	int error;
+	auto socket = listener_->accept(error);
+	if (!socket) {
+		return;
+	}
+
+	auto s = std::make_unique<session>(*this, std::move(socket));
+	auto * p = s.get();
+	sessions_[p] = std::move(s);
+	p->start();
+}
+
+void ftp_standin::on_session_closed(session * s)
+{
+	sessions_.erase(s);
+}
+
+std::string ftp_standin::resolve(std::string const& cwd, std::string const& path)
+{
+	std::vector<std::string> segments;
+	if (path.empty() || path[0] != '/') {
+		segments = fz::strtok(cwd, '/');
+	}
+	for (auto const& segment : fz::strtok(path, '/')) {
+		if (segment == ".") {
+			continue;
+		}
+		if (segment == "..") {
+			if (segments.empty()) {
+				return std::string();
+			}
+			segments.pop_back();
+		}
+		else {
+			segments.push_back(segment);
+		}
+	}
+
+	std::string ret;
+	for (auto const& segment : segments) {
+		ret += "/" + segment;
+	}
+	return ret.empty() ? std::string("/") : ret;
+}
+
+std::pair<std::string, std::string> ftp_standin::split(std::string const& path)
+{
+	size_t const pos = path.rfind('/');
+	if (path.empty() || path == "/" || pos == std::string::npos) {
+		return {std::string(), std::string()};
+	}
+	return {pos ? path.substr(0, pos) : std::string("/"), path.substr(pos + 1)};
+}
@@ -0,0 +1,57 @@
+#ifndef FILEZILLA_TESTS_FTPSTANDIN_HEADER
+#define FILEZILLA_TESTS_FTPSTANDIN_HEADER
+
+#include <libfilezilla/event_handler.hpp>
+#include <libfilezilla/socket.hpp>
+
+#include <map>
+#include <memory>
+#include <string>
+
+/*
+ * A minimal FTP server listening on the loopback interface, good enough
+ * for the engine to log on, list, create directories and transfer files.
+ *
+ * There is no real file system behind it: it only remembers the names and
+ * sizes of the files it has received, downloads send zeros.
+ * All sessions are handled on the event loop passed to the constructor.
+ */
+class ftp_standin final : public fz::event_handler
+{
+public:
+	ftp_standin(fz::event_loop & loop, fz::thread_pool & pool);
+	virtual ~ftp_standin();
+
+	// Listens on an ephemeral port on 127.0.0.1, returns 0 or an error
+	int start();
+	unsigned int port() const { return port_; }
+
+	// Adds a file to the tree, creating the parent directories as needed.
+	void add_file(std::string const& path, int64_t size);
+
+private:
+	class session;
+	friend class session;
+
+	struct session_closed_event_type{};
+	typedef fz::simple_event<session_closed_event_type, session*> session_closed_event;
+
+	virtual void operator()(fz::event_base const& ev) override;
+	void on_socket_event(fz::socket_event_source*, fz::socket_event_flag t, int error);
+	void on_session_closed(session * s);
+
+	// Maps absolute directory paths to the files in them
+	std::map<std::string, std::map<std::string, int64_t>> dirs_;
+
+	// Returns the normalized absolute path, or an empty string if it leaves the root
+	static std::string resolve(std::string const& cwd, std::string const& path);
+	static std::pair<std::string, std::string> split(std::string const& path);
+
+	fz::thread_pool & pool_;
+	std::unique_ptr<fz::listen_socket> listener_;
+	unsigned int port_{};
+
+	std::map<session*, std::unique_ptr<session>> sessions_;
+};
+
+#endif
@@ -0,0 +1,7 @@
+#!/bin/sh
+
+# Smoke test run by `make check`: A short fzbench run against the built-in
+# FTP stand-in and of the listing parser. Fails if any operation fails.
+
+./fzbench --files 5 || exit 1
+./fzbench --parser --files 1 || exit 1
@@ -0,0 +1,229 @@
+#include "../src/include/libfilezilla_engine.h"
+#include "../src/engine/oplock_manager.h"
+
+#include <libfilezilla/event_loop.hpp>
+
+#include <cppunit/extensions/HelperMacros.h>
+
+/*
+ * This testsuite asserts the correctness of the OpLockManager: Which locks
+ * conflict with each other, in which order waiting locks get obtained and
+ * that releasing a lock that is still waiting leaves the others intact.
+ */
+
+namespace {
+class lock_owner final : public fz::event_handler
+{
+public:
+	explicit lock_owner(fz::event_loop & loop)
+		: fz::event_handler(loop)
+	{}
+
+	virtual ~lock_owner()
+	{
+		remove_handler();
+	}
+
+	virtual void operator()(fz::event_base const&) override {}
+};
+}
+
+class COpLockManagerTest final : public CppUnit::TestFixture
+{
+	CPPUNIT_TEST_SUITE(COpLockManagerTest);
+	CPPUNIT_TEST(testConflicts);
+	CPPUNIT_TEST(testInclusive);
+	CPPUNIT_TEST(testWakeOrder);
+	CPPUNIT_TEST(testReleaseWaiting);
+	CPPUNIT_TEST_SUITE_END();
+
+public:
+	void setUp();
+	void tearDown() {}
+
+	void testConflicts();
+	void testInclusive();
+	void testWakeOrder();
+	void testReleaseWaiting();
+
+protected:
+	CServer server_;
+
+	fz::event_loop loop_;
+};
+
+CPPUNIT_TEST_SUITE_REGISTRATION(COpLockManagerTest);
+
+void COpLockManagerTest::setUp()
+{
+	server_ = CServer(ServerProtocol::FTP, DEFAULT, L"example.com", 21);
+}
+
+void COpLockManagerTest::testConflicts()
+{
+	OpLockManager mgr;
+	lock_owner a(loop_);
+	lock_owner b(loop_);
+
+	CServerPath const path(L"/foo");
+
+	OpLock la = mgr.Lock(&a, server_, locking_reason::list, path);
+	CPPUNIT_ASSERT(la && !la.waiting());
+
+	// Own locks never conflict
+	OpLock la2 = mgr.Lock(&a, server_, locking_reason::list, path);
+	CPPUNIT_ASSERT(!la2.waiting());
+	CPPUNIT_ASSERT(!mgr.Waiting(&a));
+
+	OpLock lb = mgr.Lock(&b, server_, locking_reason::list, path);
+	CPPUNIT_ASSERT(lb.waiting());
+	CPPUNIT_ASSERT(mgr.Waiting(&b));
+
+	// Other paths, reasons and servers are independent
+	OpLock other_path = mgr.Lock(&b, server_, locking_reason::list, CServerPath(L"/bar"));
+	CPPUNIT_ASSERT(!other_path.waiting());
+	OpLock other_reason = mgr.Lock(&b, server_, locking_reason::mkdir, path);
+	CPPUNIT_ASSERT(!other_reason.waiting());
+	OpLock other_server = mgr.Lock(&b, CServer(ServerProtocol::FTP, DEFAULT, L"example.org", 21), locking_reason::list, path);
+	CPPUNIT_ASSERT(!other_server.waiting());
+
+	// Without inclusive locks, parent and child paths do not conflict
+	OpLock child = mgr.Lock(&b, server_, locking_reason::list, CServerPath(L"/foo/child"));
+	CPPUNIT_ASSERT(!child.waiting());
+	OpLock parent = mgr.Lock(&b, server_, locking_reason::list, CServerPath(L"/"));
+	CPPUNIT_ASSERT(!parent.waiting());
+
+	// Both of a's locks need to go
+	la = OpLock();
+	CPPUNIT_ASSERT(lb.waiting());
+	la2 = OpLock();
+	CPPUNIT_ASSERT(!lb.waiting());
+	CPPUNIT_ASSERT(!mgr.Waiting(&b));
+}
+
+void COpLockManagerTest::testInclusive()
+{
+	OpLockManager mgr;
+	lock_owner a(loop_);
+	lock_owner b(loop_);
+
+	// Inclusive lock blocks everything below
+	OpLock la = mgr.Lock(&a, server_, locking_reason::list, CServerPath(L"/foo"), true);
+	OpLock lb = mgr.Lock(&b, server_, locking_reason::list, CServerPath(L"/foo/bar/baz"));
+	CPPUNIT_ASSERT(lb.waiting());
+	OpLock lb2 = mgr.Lock(&b, server_, locking_reason::list, CServerPath(L"/foobar"));
+	CPPUNIT_ASSERT(!lb2.waiting());
+	OpLock lb3 = mgr.Lock(&b, server_, locking_reason::list, CServerPath(L"/"));
+	CPPUNIT_ASSERT(!lb3.waiting());
+
+	// The owner of the inclusive lock can still lock paths below it
+	OpLock la2 = mgr.Lock(&a, server_, locking_reason::list, CServerPath(L"/foo/bar"));
+	CPPUNIT_ASSERT(!la2.waiting());
+
+	la = OpLock();
+	la2 = OpLock();
+	CPPUNIT_ASSERT(!lb.waiting());
+
+	// Inclusive lock is blocked by other owners' locks below it
+	OpLock la3 = mgr.Lock(&a, server_, locking_reason::list, CServerPath(L"/foo"), true);
+	CPPUNIT_ASSERT(la3.waiting());
+
+	// Not by the own ones though
+	OpLock lb4 = mgr.Lock(&b, server_, locking_reason::list, CServerPath(L"/foo"), true);
+	CPPUNIT_ASSERT(!lb4.waiting());
+
+	lb = OpLock();
+	CPPUNIT_ASSERT(la3.waiting());
+	lb4 = OpLock();
+	CPPUNIT_ASSERT(!la3.waiting());
+}
+
+void COpLockManagerTest::testWakeOrder()
+{
+	OpLockManager mgr;
+	lock_owner a(loop_);
+	lock_owner b(loop_);
+	lock_owner c(loop_);
+
+	CServerPath const path(L"/foo");
+
+	OpLock la = mgr.Lock(&a, server_, locking_reason::list, path);
+	OpLock lb = mgr.Lock(&b, server_, locking_reason::list, path);
+	OpLock lc = mgr.Lock(&c, server_, locking_reason::list, path);
+	CPPUNIT_ASSERT(lb.waiting());
+	CPPUNIT_ASSERT(lc.waiting());
+	CPPUNIT_ASSERT(!mgr.ObtainWaiting(&b));
+
+	// First come, first served
+	la = OpLock();
+	CPPUNIT_ASSERT(!lb.waiting());
+	CPPUNIT_ASSERT(lc.waiting());
+	CPPUNIT_ASSERT(mgr.ObtainWaiting(&b));
+	CPPUNIT_ASSERT(!mgr.ObtainWaiting(&b));
+	CPPUNIT_ASSERT(!mgr.ObtainWaiting(&c));
+
+	lb = OpLock();
+	CPPUNIT_ASSERT(!lc.waiting());
+	CPPUNIT_ASSERT(mgr.ObtainWaiting(&c));
+
+	// Releasing a child wakes up inclusive locks waiting on a parent
+	OpLock la2 = mgr.Lock(&a, server_, locking_reason::list, CServerPath(L"/foo/bar/baz"));
+	CPPUNIT_ASSERT(!la2.waiting());
+	OpLock lb2 = mgr.Lock(&b, server_, locking_reason::list, CServerPath(L"/foo/bar"), true);
+	CPPUNIT_ASSERT(lb2.waiting());
+	lc = OpLock();
+	CPPUNIT_ASSERT(lb2.waiting());
+	la2 = OpLock();
+	CPPUNIT_ASSERT(!lb2.waiting());
+	CPPUNIT_ASSERT(mgr.ObtainWaiting(&b));
+
+	// Releasing an inclusive lock wakes up the locks waiting below it
+	OpLock lc2 = mgr.Lock(&c, server_, locking_reason::list, CServerPath(L"/foo/bar/baz"));
+	CPPUNIT_ASSERT(lc2.waiting());
+	lb2 = OpLock();
+	CPPUNIT_ASSERT(!lc2.waiting());
+	CPPUNIT_ASSERT(mgr.ObtainWaiting(&c));
+}
+
+void COpLockManagerTest::testReleaseWaiting()
+{
+	OpLockManager mgr;
+	lock_owner a(loop_);
+	lock_owner b(loop_);
+	lock_owner c(loop_);
+
+	CServerPath const path(L"/foo");
+
+	OpLock la = mgr.Lock(&a, server_, locking_reason::list, path);
+	OpLock lb = mgr.Lock(&b, server_, locking_reason::list, path);
+	OpLock lc = mgr.Lock(&c, server_, locking_reason::list, path);
+
+	// Giving up a lock that never got obtained
+	lb = OpLock();
+	CPPUNIT_ASSERT(!mgr.Waiting(&b));
+	CPPUNIT_ASSERT(!mgr.ObtainWaiting(&b));
+	CPPUNIT_ASSERT(lc.waiting());
+
+	la = OpLock();
+	CPPUNIT_ASSERT(!lc.waiting());
+	CPPUNIT_ASSERT(mgr.ObtainWaiting(&c));
+
+	// The last waiting lock on a path goes away, nothing is left behind
+	lb = mgr.Lock(&b, server_, locking_reason::list, path);
+	CPPUNIT_ASSERT(lb.waiting());
+	lb = OpLock();
+	lc = OpLock();
+	CPPUNIT_ASSERT(!mgr.Waiting(&b));
+	CPPUNIT_ASSERT(!mgr.Waiting(&c));
+
+	la = mgr.Lock(&a, server_, locking_reason::list, path);
+	CPPUNIT_ASSERT(!la.waiting());
+
+	// Moving a waiting lock keeps it waiting
+	lb = mgr.Lock(&b, server_, locking_reason::list, path);
+	OpLock moved = std::move(lb);
+	CPPUNIT_ASSERT(!lb);
+	CPPUNIT_ASSERT(moved.waiting());
+	la = OpLock();
+	CPPUNIT_ASSERT(!moved.waiting());
+}
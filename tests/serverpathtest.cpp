@@ -16,6 +16,7 @@ class CServerPathTest final : public CppUnit::TestFixture
 	CPPUNIT_TEST(testGetCommonParent);
 	CPPUNIT_TEST(testFormatFilename);
 	CPPUNIT_TEST(testChangePath);
+	CPPUNIT_TEST(testHash);
 	CPPUNIT_TEST_SUITE_END();
 
 public:
@@ -29,6 +30,7 @@ public:
 	void testGetCommonParent();
 	void testFormatFilename();
 	void testChangePath();
+	void testHash();
 
 protected:
 };
@@ -686,3 +688,24 @@ void CServerPathTest::testChangePath()
 	}
 
 }
+
+void CServerPathTest::testHash()
+{
+	CServerPath const unix1(L"/foo/bar");
+	CServerPath const unix2(L"/FOO/Bar");
+	CServerPath const unix3(L"/foo/baz");
+	CServerPath const unix4(L"/foo/\xe4");
+	CServerPath const unix5(L"/FOO/\xc4");
+
+	CPPUNIT_ASSERT(unix1.Hash() == CServerPath(L"/foo/bar").Hash());
+
+	CPPUNIT_ASSERT(!unix1.CmpNoCase(unix2));
+	CPPUNIT_ASSERT_EQUAL(unix1.HashNoCase(), unix2.HashNoCase());
+
+	// Depending on the locale, these compare equal as well
+	CPPUNIT_ASSERT_EQUAL(unix4.HashNoCase(), unix5.HashNoCase());
+
+	// The contents of the segments are hashed, not just their lengths
+	CPPUNIT_ASSERT(unix1.HashNoCase() != unix3.HashNoCase());
+	CPPUNIT_ASSERT(CServerPath(L"/ab/cd").HashNoCase() != CServerPath(L"/cd/ab").HashNoCase());
+}
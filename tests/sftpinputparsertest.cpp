@@ -0,0 +1,315 @@
+#include "../src/include/libfilezilla_engine.h"
+#include "../src/engine/sftp/input_parser.h"
+
+#include <libfilezilla/event_loop.hpp>
+#include <libfilezilla/logger.hpp>
+#include <libfilezilla/mutex.hpp>
+#include <libfilezilla/process.hpp>
+#include <libfilezilla/thread_pool.hpp>
+
+#include <cppunit/extensions/HelperMacros.h>
+
+/*
+ * This testsuite asserts the correctness of the SftpInputParser in binary
+ * mode: Which messages get sent for the frames from fzsftp, that incomplete
+ * frames are left for later and that malformed frames end the connection.
+ */
+
+namespace {
+struct flush_event_type;
+typedef fz::simple_event<flush_event_type> flush_event;
+
+// Collects the messages sent by the parser
+class receiver final : public fz::event_handler
+{
+public:
+	explicit receiver(fz::event_loop & loop)
+		: fz::event_handler(loop)
+	{}
+
+	virtual ~receiver()
+	{
+		remove_handler();
+	}
+
+	virtual void operator()(fz::event_base const& ev) override
+	{
+		fz::scoped_lock l(mutex_);
+		if (ev.derived_type() == CSftpEvent::type()) {
+			messages_.push_back(std::get<0>(static_cast<CSftpEvent const&>(ev).v_));
+		}
+		else if (ev.derived_type() == CSftpListEvent::type()) {
+			batches_.push_back(std::get<0>(static_cast<CSftpListEvent const&>(ev).v_));
+		}
+		else if (ev.derived_type() == flush_event::type()) {
+			flushed_ = true;
+			cond_.signal(l);
+		}
+	}
+
+	// Waits until everything sent so far has arrived
+	void flush()
+	{
+		send_event<flush_event>();
+		fz::scoped_lock l(mutex_);
+		while (!flushed_) {
+			cond_.wait(l);
+		}
+		flushed_ = false;
+	}
+
+	std::vector<sftp_message> messages_;
+	std::vector<std::vector<sftp_list_message>> batches_;
+
+private:
+	fz::mutex mutex_;
+	fz::condition cond_;
+	bool flushed_{};
+};
+
+class null_logger final : public fz::logger_interface
+{
+public:
+	virtual void do_log(logmsg::type, std::wstring&&) override {}
+};
+
+std::string uint32(uint32_t v)
+{
+	std::string ret;
+	for (int shift = 24; shift >= 0; shift -= 8) {
+		ret += static_cast<char>((v >> shift) & 0xff);
+	}
+	return ret;
+}
+
+std::string str_field(std::string const& s)
+{
+	return "s" + uint32(static_cast<uint32_t>(s.size())) + s;
+}
+
+std::string int_field(int64_t v)
+{
+	return "i" + uint32(static_cast<uint32_t>(static_cast<uint64_t>(v) >> 32)) + uint32(static_cast<uint32_t>(v));
+}
+
+std::string frame(sftpEvent type, std::string const& fields = std::string())
+{
+	std::string const payload = static_cast<char>(type) + fields;
+	return uint32(static_cast<uint32_t>(payload.size())) + payload;
+}
+}
+
+class CSftpInputParserTest final : public CppUnit::TestFixture
+{
+	CPPUNIT_TEST_SUITE(CSftpInputParserTest);
+	CPPUNIT_TEST(testFields);
+	CPPUNIT_TEST(testListentry);
+	CPPUNIT_TEST(testTruncated);
+	CPPUNIT_TEST(testBadTag);
+	CPPUNIT_TEST(testOversize);
+	CPPUNIT_TEST_SUITE_END();
+
+public:
+	void setUp();
+	void tearDown();
+
+	void testFields();
+	void testListentry();
+	void testTruncated();
+	void testBadTag();
+	void testOversize();
+
+protected:
+	// Appends the data to the receive buffer and handles the complete frames
+	int Parse(std::string const& data);
+
+	fz::event_loop loop_;
+	fz::thread_pool pool_;
+	null_logger logger_;
+
+	std::unique_ptr<receiver> receiver_;
+	std::unique_ptr<fz::process> process_;
+	std::unique_ptr<SftpInputParser> parser_;
+};
+
+CPPUNIT_TEST_SUITE_REGISTRATION(CSftpInputParserTest);
+
+void CSftpInputParserTest::setUp()
+{
+	tearDown();
+
+	receiver_ = std::make_unique<receiver>(loop_);
+
+	// Never spawned, only the receive buffer is used
+	process_ = std::make_unique<fz::process>(pool_, *receiver_);
+
+	// Fails on invalid UTF-8 like the real conversion
+	parser_ = std::make_unique<SftpInputParser>(*receiver_, logger_, *process_,
+		[](char const* buffer, size_t len) { return fz::to_wstring_from_utf8(buffer, len); });
+	parser_->SetBinary();
+}
+
+void CSftpInputParserTest::tearDown()
+{
+	parser_.reset();
+	process_.reset();
+	receiver_.reset();
+}
+
+int CSftpInputParserTest::Parse(std::string const& data)
+{
+	parser_->recv_buffer_.append(data);
+	int const res = parser_->ParseFrames();
+	receiver_->flush();
+	return res;
+}
+
+void CSftpInputParserTest::testFields()
+{
+	CPPUNIT_ASSERT_EQUAL(FZ_REPLY_WOULDBLOCK, Parse(frame(sftpEvent::Status, str_field("Connecting"))));
+	CPPUNIT_ASSERT_EQUAL(size_t(1), receiver_->messages_.size());
+	CPPUNIT_ASSERT(receiver_->messages_[0].type == sftpEvent::Status);
+	CPPUNIT_ASSERT(receiver_->messages_[0].text[0] == L"Connecting");
+	CPPUNIT_ASSERT(receiver_->messages_[0].text[1].empty());
+
+	// Strings and integers are assigned in order, independent of each other
+	receiver_->messages_.clear();
+	std::string const fields = int_field(-1) + str_field("first") + int_field(0x123456789ll) + str_field("second") + int_field(3);
+	CPPUNIT_ASSERT_EQUAL(FZ_REPLY_WOULDBLOCK, Parse(frame(sftpEvent::Transfer, fields)));
+	CPPUNIT_ASSERT_EQUAL(size_t(1), receiver_->messages_.size());
+	auto const& transfer = receiver_->messages_[0];
+	CPPUNIT_ASSERT(transfer.type == sftpEvent::Transfer);
+	CPPUNIT_ASSERT(transfer.text[0] == L"first");
+	CPPUNIT_ASSERT(transfer.text[1] == L"second");
+	CPPUNIT_ASSERT_EQUAL(int64_t(-1), transfer.value[0]);
+	CPPUNIT_ASSERT_EQUAL(int64_t(0x123456789ll), transfer.value[1]);
+	CPPUNIT_ASSERT_EQUAL(int64_t(3), transfer.value[2]);
+
+	// Fields beyond what a message can hold are ignored
+	receiver_->messages_.clear();
+	std::string const extra = str_field("a") + str_field("b") + str_field("c") + int_field(1) + int_field(2) + int_field(3) + int_field(4);
+	CPPUNIT_ASSERT_EQUAL(FZ_REPLY_WOULDBLOCK, Parse(frame(sftpEvent::AskHostkey, extra)));
+	CPPUNIT_ASSERT_EQUAL(size_t(1), receiver_->messages_.size());
+	CPPUNIT_ASSERT(receiver_->messages_[0].text[1] == L"b");
+	CPPUNIT_ASSERT_EQUAL(int64_t(3), receiver_->messages_[0].value[2]);
+
+	// Messages without fields, several frames at once
+	receiver_->messages_.clear();
+	CPPUNIT_ASSERT_EQUAL(FZ_REPLY_WOULDBLOCK, Parse(frame(sftpEvent::UsedQuotaRecv) + frame(sftpEvent::Done, str_field("")) + frame(sftpEvent::Reply, str_field("\xc3\xa4"))));
+	CPPUNIT_ASSERT_EQUAL(size_t(3), receiver_->messages_.size());
+	CPPUNIT_ASSERT(receiver_->messages_[0].type == sftpEvent::UsedQuotaRecv);
+	CPPUNIT_ASSERT(receiver_->messages_[1].type == sftpEvent::Done);
+	CPPUNIT_ASSERT(receiver_->messages_[1].text[0].empty());
+	CPPUNIT_ASSERT(receiver_->messages_[2].text[0] == L"\u00e4");
+	CPPUNIT_ASSERT(parser_->recv_buffer_.empty());
+}
+
+void CSftpInputParserTest::testListentry()
+{
+	std::string const entries = str_field("-rw-r--r-- 1 user group 5 Jan 1 2000 foo") + int_field(946684800) + str_field("foo")
+		+ str_field("drwxr-xr-x 2 user group 0 Jan 1 2000 bar") + int_field(0) + str_field("bar");
+	CPPUNIT_ASSERT_EQUAL(FZ_REPLY_WOULDBLOCK, Parse(frame(sftpEvent::Listentry, entries)));
+	CPPUNIT_ASSERT(receiver_->messages_.empty());
+	CPPUNIT_ASSERT_EQUAL(size_t(1), receiver_->batches_.size());
+
+	auto const& batch = receiver_->batches_[0];
+	CPPUNIT_ASSERT_EQUAL(size_t(2), batch.size());
+	CPPUNIT_ASSERT(batch[0].name == L"foo");
+	CPPUNIT_ASSERT(batch[0].text == L"-rw-r--r-- 1 user group 5 Jan 1 2000 foo");
+	CPPUNIT_ASSERT_EQUAL(uint64_t(946684800), batch[0].mtime);
+	CPPUNIT_ASSERT(batch[1].name == L"bar");
+	CPPUNIT_ASSERT_EQUAL(uint64_t(0), batch[1].mtime);
+
+	// An empty batch is not passed on
+	CPPUNIT_ASSERT_EQUAL(FZ_REPLY_WOULDBLOCK, Parse(frame(sftpEvent::Listentry)));
+	CPPUNIT_ASSERT_EQUAL(size_t(1), receiver_->batches_.size());
+
+	// Each entry needs all three fields in order
+	CPPUNIT_ASSERT_EQUAL(FZ_REPLY_DISCONNECTED, Parse(frame(sftpEvent::Listentry, str_field("text") + int_field(0))));
+	setUp();
+	CPPUNIT_ASSERT_EQUAL(FZ_REPLY_DISCONNECTED, Parse(frame(sftpEvent::Listentry, str_field("text") + str_field("name") + int_field(0))));
+	CPPUNIT_ASSERT(receiver_->batches_.empty());
+}
+
+void CSftpInputParserTest::testTruncated()
+{
+	// Incomplete frames are kept until the rest arrives
+	std::string const data = frame(sftpEvent::Verbose, str_field("Hello")) + frame(sftpEvent::Info, str_field("World"));
+	size_t const first = data.size() / 2;
+	for (size_t i = 0; i < data.size(); ++i) {
+		CPPUNIT_ASSERT_EQUAL(FZ_REPLY_WOULDBLOCK, Parse(data.substr(i, 1)));
+		if (i + 1 < first) {
+			CPPUNIT_ASSERT(receiver_->messages_.empty());
+		}
+		else if (i + 1 < data.size()) {
+			CPPUNIT_ASSERT_EQUAL(size_t(1), receiver_->messages_.size());
+		}
+	}
+	CPPUNIT_ASSERT_EQUAL(size_t(2), receiver_->messages_.size());
+	CPPUNIT_ASSERT(receiver_->messages_[0].text[0] == L"Hello");
+	CPPUNIT_ASSERT(receiver_->messages_[1].text[0] == L"World");
+
+	// A field running past the end of its frame is malformed
+	std::string const field = str_field("truncated");
+	for (size_t size : {size_t(1), size_t(4), field.size() - 1}) {
+		setUp();
+		CPPUNIT_ASSERT_EQUAL(FZ_REPLY_DISCONNECTED, Parse(frame(sftpEvent::Status, field.substr(0, size))));
+		CPPUNIT_ASSERT(receiver_->messages_.empty());
+	}
+
+	setUp();
+	CPPUNIT_ASSERT_EQUAL(FZ_REPLY_DISCONNECTED, Parse(frame(sftpEvent::Transfer, int_field(5).substr(0, 8))));
+	CPPUNIT_ASSERT(receiver_->messages_.empty());
+}
+
+void CSftpInputParserTest::testBadTag()
+{
+	// Unknown field tags
+	CPPUNIT_ASSERT_EQUAL(FZ_REPLY_DISCONNECTED, Parse(frame(sftpEvent::Status, "x" + uint32(0))));
+	CPPUNIT_ASSERT(receiver_->messages_.empty());
+
+	setUp();
+	CPPUNIT_ASSERT_EQUAL(FZ_REPLY_DISCONNECTED, Parse(frame(sftpEvent::Status, str_field("ok") + "S" + uint32(0))));
+	CPPUNIT_ASSERT(receiver_->messages_.empty());
+
+	// Unknown message types
+	for (auto type : {sftpEvent::count, sftpEvent::Unknown, static_cast<sftpEvent>(200)}) {
+		setUp();
+		CPPUNIT_ASSERT_EQUAL(FZ_REPLY_DISCONNECTED, Parse(frame(type, str_field("text"))));
+		CPPUNIT_ASSERT(receiver_->messages_.empty());
+	}
+
+	// Strings that cannot be converted
+	setUp();
+	CPPUNIT_ASSERT_EQUAL(FZ_REPLY_DISCONNECTED, Parse(frame(sftpEvent::Status, str_field("\xff\xfe"))));
+	CPPUNIT_ASSERT(receiver_->messages_.empty());
+
+	// Frames before the malformed one are still handled
+	setUp();
+	CPPUNIT_ASSERT_EQUAL(FZ_REPLY_DISCONNECTED, Parse(frame(sftpEvent::Status, str_field("ok")) + frame(sftpEvent::Status, "?")));
+	CPPUNIT_ASSERT_EQUAL(size_t(1), receiver_->messages_.size());
+}
+
+void CSftpInputParserTest::testOversize()
+{
+	// Empty frames lack even the type
+	CPPUNIT_ASSERT_EQUAL(FZ_REPLY_DISCONNECTED, Parse(uint32(0)));
+
+	// Overlong frames are rejected without waiting for their data
+	for (uint32_t len : {uint32_t(1024 * 1024 + 1), uint32_t(0xffffffffu)}) {
+		setUp();
+		CPPUNIT_ASSERT_EQUAL(FZ_REPLY_DISCONNECTED, Parse(uint32(len) + static_cast<char>(sftpEvent::Status)));
+	}
+
+	// The largest frame is still fine
+	setUp();
+	std::string const text(1024 * 1024 - 6, 'x');
+	CPPUNIT_ASSERT_EQUAL(FZ_REPLY_WOULDBLOCK, Parse(frame(sftpEvent::Status, str_field(text))));
+	CPPUNIT_ASSERT_EQUAL(size_t(1), receiver_->messages_.size());
+	CPPUNIT_ASSERT_EQUAL(text.size(), receiver_->messages_[0].text[0].size());
+
+	// String lengths beyond the end of the frame are malformed
+	setUp();
+	CPPUNIT_ASSERT_EQUAL(FZ_REPLY_DISCONNECTED, Parse(frame(sftpEvent::Status, "s" + uint32(0xffffffffu) + "abc")));
+	CPPUNIT_ASSERT(receiver_->messages_.empty());
+}
@@ -0,0 +1,132 @@
+#include "../src/include/libfilezilla_engine.h"
+#include "../src/engine/stringpool.h"
+
+#include <libfilezilla/format.hpp>
+
+#include <cppunit/extensions/HelperMacros.h>
+
+#include <iterator>
+
+/*
+ * This testsuite asserts the correctness of the CStringPool interning table
+ * and its per-thread CStringPoolCache front.
+ * The pool is a process-wide singleton, other tests may have put values
+ * into it already.
+ */
+
+class CStringPoolTest final : public CppUnit::TestFixture
+{
+	CPPUNIT_TEST_SUITE(CStringPoolTest);
+	CPPUNIT_TEST(testInterning);
+	CPPUNIT_TEST(testCache);
+	CPPUNIT_TEST(testStartOver);
+	CPPUNIT_TEST_SUITE_END();
+
+public:
+	void setUp() {}
+	void tearDown() {}
+
+	void testInterning();
+	void testCache();
+	void testStartOver();
+};
+
+CPPUNIT_TEST_SUITE_REGISTRATION(CStringPoolTest);
+
+void CStringPoolTest::testInterning()
+{
+	auto & pool = CStringPool::instance();
+
+	auto const a = pool.get(L"stringpooltest interning");
+	CPPUNIT_ASSERT(*a == L"stringpooltest interning");
+
+	auto const before = pool.get_stats();
+	std::wstring const copy = L"stringpooltest interning";
+	auto const b = pool.get(copy);
+	auto const after = pool.get_stats();
+
+	// Same allocation, nothing added to the pool
+	CPPUNIT_ASSERT(&*a == &*b);
+	CPPUNIT_ASSERT_EQUAL(before.distinct, after.distinct);
+	CPPUNIT_ASSERT_EQUAL(before.bytes, after.bytes);
+	CPPUNIT_ASSERT(after.saved > before.saved);
+
+	auto const c = pool.get(L"stringpooltest other");
+	CPPUNIT_ASSERT(&*a != &*c);
+	CPPUNIT_ASSERT(*c == L"stringpooltest other");
+	auto const added = pool.get_stats();
+	CPPUNIT_ASSERT_EQUAL(after.distinct + 1, added.distinct);
+	CPPUNIT_ASSERT(added.bytes > after.bytes);
+
+	// The empty string is a value like any other
+	auto const e1 = pool.get(std::wstring_view());
+	auto const e2 = pool.get(L"");
+	CPPUNIT_ASSERT(e1->empty());
+	CPPUNIT_ASSERT(&*e1 == &*e2);
+}
+
+void CStringPoolTest::testCache()
+{
+	// Inserted out of order to exercise the sorted insertion
+	wchar_t const* values[] = { L"m", L"stringpooltest cache", L"a", L"z", L"", L"drwxr-xr-x", L"-rw-r--r--", L"b" };
+
+	CStringPoolCache cache;
+	std::vector<std::wstring const*> first;
+	for (auto const v : values) {
+		auto const& value = cache.get(v);
+		CPPUNIT_ASSERT(*value == v);
+		first.push_back(&*value);
+	}
+
+	// Repeated lookups give the same values, no matter the order
+	cache.flush_stats();
+	auto const before = CStringPool::instance().get_stats();
+	for (size_t i = std::size(values); i-- > 0;) {
+		auto const& value = cache.get(values[i]);
+		CPPUNIT_ASSERT(*value == values[i]);
+		CPPUNIT_ASSERT(&*value == first[i]);
+	}
+
+	// These never reached the pool, but count as saved once flushed
+	CPPUNIT_ASSERT_EQUAL(before.saved, CStringPool::instance().get_stats().saved);
+	cache.flush_stats();
+	CPPUNIT_ASSERT(CStringPool::instance().get_stats().saved > before.saved);
+
+	// Separate caches share the values through the pool
+	CStringPoolCache other;
+	for (size_t i = 0; i < std::size(values); ++i) {
+		CPPUNIT_ASSERT(&*other.get(values[i]) == first[i]);
+		CPPUNIT_ASSERT(&*CStringPool::instance().get(values[i]) == first[i]);
+	}
+}
+
+void CStringPoolTest::testStartOver()
+{
+	auto & pool = CStringPool::instance();
+
+	auto const a = pool.get(L"stringpooltest start over");
+
+	// After this many new values the pool must have started over at least once
+	size_t const limit = 100000;
+
+	bool cleared{};
+	size_t last = pool.get_stats().distinct;
+	for (size_t i = 0; i < limit; ++i) {
+		pool.get(fz::sprintf(L"stringpooltest %d", i));
+
+		auto const stats = pool.get_stats();
+		CPPUNIT_ASSERT(stats.distinct <= limit);
+		if (stats.distinct < last) {
+			CPPUNIT_ASSERT_EQUAL(size_t(1), stats.distinct);
+			cleared = true;
+		}
+		last = stats.distinct;
+	}
+	CPPUNIT_ASSERT(cleared);
+
+	// Values handed out before remain valid, they just no longer get shared
+	CPPUNIT_ASSERT(*a == L"stringpooltest start over");
+	auto const b = pool.get(L"stringpooltest start over");
+	CPPUNIT_ASSERT(*b == *a);
+	CPPUNIT_ASSERT(&*a != &*b);
+}